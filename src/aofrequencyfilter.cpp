@@ -1,3 +1,4 @@
+#include <deque>
 #include <iostream>
 
 #include <fftw3.h>
@@ -8,6 +9,7 @@
 
 #include "structures/system.h"
 
+#include "util/fftplancache.h"
 #include "util/lane.h"
 
 #include "imaging/uvimager.h"
@@ -20,11 +22,11 @@ using namespace aoRemote;
 lane<ObservationTimerange*> *readLane;
 lane<ObservationTimerange*> *writeLane;
 
-boost::mutex commanderMutex;
 ProcessCommander *commander;
 
-fftw_plan fftPlanForward, fftPlanBackward;
 const size_t rowCountPerRequest = 128;
+// Number of read requests that are kept in flight by the reader thread
+const size_t readAheadCount = 2;
 
 // fringe size is given in units of wavelength / fringe. Fringes smaller than that will be filtered.
 double filterFringeSize;
@@ -43,6 +45,23 @@ double uvDist(double u, double v, double frequencyWidth)
 	return sqrt(ud * ud + vd * vd) / UVImager::SpeedOfLight();
 }
 
+/**
+ * Transforms are performed in place on the data of a complete ObservationTimerange,
+ * which stores the real and imaginary values separately. Since a backward transform
+ * of split complex data equals a forward transform with real and imaginary parts
+ * swapped, one plan per number of timesteps serves both directions.
+ */
+fftwf_plan getBlockPlan(size_t channelCount, size_t polarizationCount, size_t timestepCount)
+{
+	FFTPlanCache::Dimensions
+		transform(1, FFTPlanCache::Dimension(channelCount, polarizationCount)),
+		batch;
+	batch.push_back(FFTPlanCache::Dimension(timestepCount, polarizationCount * channelCount));
+	batch.push_back(FFTPlanCache::Dimension(polarizationCount, 1));
+	// The data of a timerange is not allocated by fftw, hence the plan should not assume alignment.
+	return FFTPlanCache::Instance().SplitComplexPlan(transform, batch, true, true);
+}
+
 void workThread()
 {
 	ObservationTimerange *timerange;
@@ -54,16 +73,20 @@ void workThread()
 	{
 		const size_t channelCount = timerange->ChannelCount();
 		const unsigned polarizationCount = timerange->PolarizationCount();
-		fftw_complex
-			*fftIn = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * channelCount),
-			*fftOut = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * channelCount);
+		const size_t timestepSize = channelCount * polarizationCount;
+		std::vector<size_t> filterIndexSizes;
+		std::vector<num_t> unfilteredData;
 		do
 		{
-			for(size_t t=0;t<timerange->TimestepCount();++t)
+			const size_t timestepCount = timerange->TimestepCount();
+			
+			// Calculate the frequencies to filter; zero means the timestep is not filtered
+			filterIndexSizes.assign(timestepCount, 0);
+			size_t unfilteredCount = 0;
+			for(size_t t=0;t<timestepCount;++t)
 			{
 				if(timerange->Antenna1(t) != timerange->Antenna2(t))
 				{
-					// Calculate the frequencies to filter
 					double u = timerange->U(t), v = timerange->V(t);
 					double limitFrequency = isFilterSizeInChannels ?
 						(channelCount / filterFringeSize) :
@@ -73,81 +96,135 @@ void workThread()
 					{
 						if(limitFrequency > maxFilterSizeInChannels) maxFilterSizeInChannels = limitFrequency;
 						if(limitFrequency < minFilterSizeInChannels) minFilterSizeInChannels = limitFrequency;
-						for(unsigned p=0;p<polarizationCount;++p)
-						{
-							// Copy data in buffer
-							num_t *realPtr = timerange->RealData(t) + p;
-							num_t *imagPtr = timerange->ImagData(t) + p;
-							
-							for(size_t c=0;c<channelCount;++c)
-							{
-								fftIn[c][0] = *realPtr;
-								fftIn[c][1] = *imagPtr;
-								realPtr += polarizationCount;
-								imagPtr += polarizationCount;
-							}
-							
-							fftw_execute_dft(fftPlanForward, fftIn, fftOut);
-							size_t filterIndexSize = (limitFrequency > 1.0) ? (size_t) ceil(limitFrequency/2.0) : 1;
-							// Remove the high frequencies [filterIndexSize : n-filterIndexSize]
-							for(size_t f=filterIndexSize;f<channelCount - filterIndexSize;++f)
-							{
-								fftOut[f][0] = 0.0;
-								fftOut[f][1] = 0.0;
-							}
-							fftw_execute_dft(fftPlanBackward, fftOut, fftIn);
-
-							// Copy data back; fftw multiplies data with n, so divide by n.
-							double factor = 1.0 / (double) channelCount;
-							realPtr = timerange->RealData(t) + p;
-							imagPtr = timerange->ImagData(t) + p;
-							for(size_t c=0;c<channelCount;++c)
-							{
-								*realPtr = fftIn[c][0] * factor;
-								*imagPtr = fftIn[c][1] * factor;
-								realPtr += polarizationCount;
-								imagPtr += polarizationCount;
-							}
-						}
+						filterIndexSizes[t] = (limitFrequency > 1.0) ? (size_t) ceil(limitFrequency/2.0) : 1;
+					}
+				}
+				if(filterIndexSizes[t] == 0)
+					++unfilteredCount;
+			}
+			
+			if(unfilteredCount != timestepCount)
+			{
+				num_t
+					*realData = timerange->RealData(0),
+					*imagData = timerange->ImagData(0);
+				
+				// All timesteps are transformed at once; the ones that need no filtering are restored afterwards
+				unfilteredData.resize(unfilteredCount * timestepSize * 2);
+				num_t *unfilteredPtr = unfilteredData.empty() ? 0 : &unfilteredData[0];
+				for(size_t t=0;t<timestepCount;++t)
+				{
+					if(filterIndexSizes[t] == 0)
+					{
+						std::copy(timerange->RealData(t), timerange->RealData(t) + timestepSize, unfilteredPtr);
+						std::copy(timerange->ImagData(t), timerange->ImagData(t) + timestepSize, unfilteredPtr + timestepSize);
+						unfilteredPtr += timestepSize * 2;
+					}
+				}
+				
+				fftwf_plan plan = getBlockPlan(channelCount, polarizationCount, timestepCount);
+				fftwf_execute_split_dft(plan, realData, imagData, realData, imagData);
+				
+				// Remove the high frequencies [filterIndexSize : n-filterIndexSize]. Because the
+				// polarizations are interleaved, this is one contiguous range per timestep.
+				for(size_t t=0;t<timestepCount;++t)
+				{
+					const size_t filterIndexSize = filterIndexSizes[t];
+					if(filterIndexSize != 0 && filterIndexSize*2 < channelCount)
+					{
+						const size_t
+							start = filterIndexSize * polarizationCount,
+							end = (channelCount - filterIndexSize) * polarizationCount;
+						std::fill(timerange->RealData(t) + start, timerange->RealData(t) + end, 0.0);
+						std::fill(timerange->ImagData(t) + start, timerange->ImagData(t) + end, 0.0);
+					}
+				}
+				
+				fftwf_execute_split_dft(plan, imagData, realData, imagData, realData);
+				
+				// fftw multiplies data with n, so divide by n.
+				const num_t factor = 1.0 / (num_t) channelCount;
+				const size_t totalSize = timestepCount * timestepSize;
+				for(size_t i=0;i<totalSize;++i)
+				{
+					realData[i] *= factor;
+					imagData[i] *= factor;
+				}
+				
+				unfilteredPtr = unfilteredData.empty() ? 0 : &unfilteredData[0];
+				for(size_t t=0;t<timestepCount;++t)
+				{
+					if(filterIndexSizes[t] == 0)
+					{
+						std::copy(unfilteredPtr, unfilteredPtr + timestepSize, timerange->RealData(t));
+						std::copy(unfilteredPtr + timestepSize, unfilteredPtr + timestepSize * 2, timerange->ImagData(t));
+						unfilteredPtr += timestepSize * 2;
 					}
 				}
 			}
 			writeLane->write(timerange);
 		} while(readLane->read(timerange));
-		fftw_free(fftIn);
-		fftw_free(fftOut);
 	}
 	std::cout << "Worker finished. Filtersize range in channel: " << minFilterSizeInChannels << "-" << maxFilterSizeInChannels << '\n';
 }
 
+struct PendingRead
+{
+	ObservationTimerange *timerange;
+	std::future<void> future;
+	size_t rowCount;
+	size_t slot;
+};
+
 void readThreadFunction(ObservationTimerange &timerange, const size_t &totalRows)
 {
-	std::vector<MSRowDataExt*> rowBuffer(commander->Observation().Size());
-	for(size_t i=0;i<commander->Observation().Size();++i)
-		rowBuffer[i] = new MSRowDataExt[rowCountPerRequest];
+	// Each request that is in flight needs its own set of row buffers
+	const size_t nodeCount = commander->Observation().Size();
+	std::vector<std::vector<MSRowDataExt*> > rowBuffers(readAheadCount, std::vector<MSRowDataExt*>(nodeCount));
+	std::vector<size_t> freeSlots;
+	for(size_t slot=0;slot!=readAheadCount;++slot)
+	{
+		for(size_t i=0;i<nodeCount;++i)
+			rowBuffers[slot][i] = new MSRowDataExt[rowCountPerRequest];
+		freeSlots.push_back(slot);
+	}
 
-	size_t currentRow = 0;
-	while(currentRow < totalRows)
+	std::deque<PendingRead> pendingReads;
+	size_t currentRow = 0, finishedRows = 0;
+	while(finishedRows < totalRows)
 	{
-		size_t currentRowCount = rowCountPerRequest;
-		if(currentRow + currentRowCount > totalRows)
-			currentRowCount = totalRows - currentRow;
-		timerange.SetZero();
-		
-		boost::mutex::scoped_lock lock(commanderMutex);
-		std::cout << "Reading... " << std::flush;
-		commander->PushReadDataRowsTask(timerange, currentRow, currentRowCount, &rowBuffer[0]);
-		commander->Run(false);
-		commander->CheckErrors();
-		std::cout << "Done.\n" << std::flush;
-		lock.unlock();
+		// Keep the pipeline filled before waiting for the oldest request
+		while(currentRow < totalRows && !freeSlots.empty())
+		{
+			size_t currentRowCount = rowCountPerRequest;
+			if(currentRow + currentRowCount > totalRows)
+				currentRowCount = totalRows - currentRow;
+			
+			PendingRead read;
+			read.timerange = new ObservationTimerange(timerange);
+			read.timerange->SetZero();
+			read.rowCount = currentRowCount;
+			read.slot = freeSlots.back();
+			freeSlots.pop_back();
+			read.future = commander->ReadDataRowsAsync(*read.timerange, currentRow, currentRowCount, &rowBuffers[read.slot][0]);
+			pendingReads.push_back(std::move(read));
+			
+			currentRow += currentRowCount;
+		}
 		
-		currentRow += currentRowCount;
-		cout << "Read " << currentRow << '/' << totalRows << '\n';
-		readLane->write(new ObservationTimerange(timerange));
+		PendingRead &read = pendingReads.front();
+		read.future.get();
+		finishedRows += read.rowCount;
+		cout << "Read " << finishedRows << '/' << totalRows << '\n';
+		readLane->write(read.timerange);
+		freeSlots.push_back(read.slot);
+		pendingReads.pop_front();
+	}
+	for(size_t slot=0;slot!=readAheadCount;++slot)
+	{
+		for(size_t i=0;i<nodeCount;++i)
+			delete[] rowBuffers[slot][i];
 	}
-	for(size_t i=0;i<commander->Observation().Size();++i)
-		delete[] rowBuffer[i];
 }
 
 void writeThreadFunction()
@@ -166,39 +243,17 @@ void writeThreadFunction()
 				rowBuffer[i][row] = MSRowDataExt(timerange->PolarizationCount(), timerange->Band(i).channels.size());
 		}
 		do {
-			boost::mutex::scoped_lock lock(commanderMutex);
-			std::cout << "Writing... " << std::flush;
-			commander->PushWriteDataRowsTask(*timerange, &rowBuffer[0]);
-			commander->Run(false);
-			commander->CheckErrors();
-			std::cout << "Done.\n" << std::flush;
-			lock.unlock();
+			// Writes run concurrently with the reads of the reader thread
+			commander->WriteDataRowsAsync(*timerange, &rowBuffer[0]).get();
 			
 			delete timerange;
 		} while(writeLane->read(timerange));
 	}
+	for(size_t i=0;i<obs.Size();++i)
+		delete[] rowBuffer[i];
 	std::cout << "Writer thread finished.\n";
 }
 
-void initializeFFTW(size_t channelCount)
-{
-	fftw_complex *fftIn, *fftOut;
-	
-	fftIn = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * channelCount);
-	fftOut = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * channelCount);
-	fftPlanForward = fftw_plan_dft_1d(channelCount, fftIn, fftOut, FFTW_FORWARD, FFTW_MEASURE);
-	fftPlanBackward = fftw_plan_dft_1d(channelCount, fftIn, fftOut, FFTW_BACKWARD, FFTW_MEASURE);
-
-	fftw_free(fftIn);
-	fftw_free(fftOut);
-}
-
-void deinitializeFFTW()
-{
-	fftw_destroy_plan(fftPlanForward);
-	fftw_destroy_plan(fftPlanBackward);
-}
-
 int main(int argc, char *argv[])
 {
 	if(argc != 4)
@@ -235,7 +290,7 @@ int main(int argc, char *argv[])
 		timerange.Initialize(polarizationCount, rowCountPerRequest);
 		
 		cout << "Initializing FFTW..." << std::flush;
-		initializeFFTW(timerange.ChannelCount());
+		getBlockPlan(timerange.ChannelCount(), polarizationCount, rowCountPerRequest);
 		cout << " Done.\n";
 		
 		// We ask for "0" rows, which means we will ask for the total number of rows
@@ -245,6 +300,9 @@ int main(int argc, char *argv[])
 		const size_t totalRows = commander->RowsTotal();
 		cout << "Total rows to filter: " << totalRows << '\n';
 		
+		// From here on, reads and writes are pipelined over several connections per node
+		commander->StartAsync();
+		
 		readLane = new lane<ObservationTimerange*>(processorCount);
 		writeLane = new lane<ObservationTimerange*>(processorCount);
 		
@@ -270,8 +328,10 @@ int main(int argc, char *argv[])
 		writeLane->write_end();
 		writeThread.join();
 		delete writeLane;
+		commander->StopAsync();
 		
 		// Clean
+		FFTPlanCache::Instance().SaveWisdom();
 		delete commander;
 		delete obs;
 	}
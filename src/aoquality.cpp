@@ -6,16 +6,24 @@
 
 #include "structures/measurementset.h"
 
+#include "quality/combinedinputs.h"
 #include "quality/defaultstatistics.h"
 #include "quality/histogramcollection.h"
+#include "quality/histogramtablesformatter.h"
 #include "quality/qualitytablesformatter.h"
 #include "quality/statisticscollection.h"
 #include "quality/statisticsderivator.h"
 
 #include "remote/clusteredobservation.h"
 #include "remote/processcommander.h"
+
+#include "structures/system.h"
+
 #include "util/plot.h"
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 #ifdef HAS_LOFARSTMAN
 #include <LofarStMan/Register.h>
 #include <AOFlagger/quality/histogramtablesformatter.h>
@@ -579,8 +587,169 @@ void WritePolarizationForLinearPols(casacore::MeasurementSet& ms, bool flagRow =
 	flagRowCol.put(rowIndex, flagRow);
 }
 
-void actionCombine(const std::string outFilename, const std::vector<std::string> inFilenames)
+enum CombineMode
+{
+	CombineAll,
+	CombineTimeOnly,
+	CombineBaselineOnly
+};
+
+/**
+ * Reads the quality tables of a list of measurement sets with a pool of
+ * reader threads. Each thread sums the sets it has read into its own partial
+ * collection. Afterwards, the partial collections are combined pairwise in a
+ * tree, so that the adding is spread over the threads as well.
+ */
+class CombineReaderPool
+{
+	public:
+		CombineReaderPool(const std::vector<std::string> &filenames, enum CombineMode mode) :
+			_filenames(filenames),
+			_mode(mode),
+			_nextIndex(0),
+			_exceptionOccured(false)
+		{
+		}
+		
+		void Run(StatisticsCollection &statisticsCollection, HistogramCollection &histogramCollection)
+		{
+			const size_t threadCount = std::min<size_t>(System::ProcessorCount(), _filenames.size());
+			if(threadCount == 0)
+				return;
+			
+			_partials.clear();
+			for(size_t i=0; i!=threadCount; ++i)
+				_partials.push_back(std::unique_ptr<Partial>(new Partial()));
+			
+			boost::thread_group readers;
+			for(size_t i=0; i!=threadCount; ++i)
+				readers.create_thread(boost::bind(&CombineReaderPool::readerThread, this, i));
+			readers.join_all();
+			if(_exceptionOccured)
+				throw std::runtime_error("Error while reading quality tables: " + _exceptionMessage);
+			
+			std::cout << "Combining statistics of " << threadCount << " reader threads...\n";
+			for(size_t stride=1; stride<threadCount; stride*=2)
+			{
+				boost::thread_group adders;
+				for(size_t i=0; i+stride<threadCount; i+=stride*2)
+					adders.create_thread(boost::bind(&CombineReaderPool::addPartials, this, i, i+stride));
+				adders.join_all();
+			}
+			
+			Partial &total = *_partials.front();
+			if(statisticsCollection.PolarizationCount() == 0)
+				statisticsCollection.SetPolarizationCount(total.statistics.PolarizationCount());
+			statisticsCollection.Add(total.statistics);
+			if(!total.histograms.Empty())
+			{
+				if(histogramCollection.PolarizationCount() == 0)
+					histogramCollection.SetPolarizationCount(total.histograms.PolarizationCount());
+				histogramCollection.Add(total.histograms);
+			}
+			_partials.clear();
+		}
+		
+	private:
+		struct Partial
+		{
+			StatisticsCollection statistics;
+			HistogramCollection histograms;
+		};
+		
+		void readerThread(size_t threadIndex)
+		{
+			Partial &partial = *_partials[threadIndex];
+			try {
+				size_t index;
+				while(nextIndex(index))
+				{
+					const std::string &filename = _filenames[index];
+					QualityTablesFormatter formatter(filename);
+					StatisticsCollection collectionPart;
+					switch(_mode)
+					{
+						case CombineAll:
+							collectionPart.Load(formatter);
+							break;
+						case CombineTimeOnly:
+							collectionPart.SetPolarizationCount(formatter.GetPolarizationCount());
+							collectionPart.LoadTimeStatisticsOnly(formatter);
+							break;
+						case CombineBaselineOnly:
+							collectionPart.SetPolarizationCount(formatter.GetPolarizationCount());
+							collectionPart.LoadBaselineStatisticsOnly(formatter);
+							break;
+					}
+					if(partial.statistics.PolarizationCount() == 0)
+						partial.statistics.SetPolarizationCount(collectionPart.PolarizationCount());
+					partial.statistics.Add(collectionPart);
+					
+					if(_mode == CombineAll)
+					{
+						HistogramTablesFormatter histogramFormatter(filename);
+						if(histogramFormatter.HistogramsExist())
+						{
+							HistogramCollection histogramPart(collectionPart.PolarizationCount());
+							histogramPart.Load(histogramFormatter);
+							if(partial.histograms.PolarizationCount() == 0)
+								partial.histograms.SetPolarizationCount(histogramPart.PolarizationCount());
+							partial.histograms.Add(histogramPart);
+						}
+					}
+				}
+			} catch(std::exception &e) {
+				boost::mutex::scoped_lock lock(_mutex);
+				_exceptionOccured = true;
+				_exceptionMessage = e.what();
+				// Let the other readers stop as soon as possible
+				_nextIndex = _filenames.size();
+			}
+		}
+		
+		bool nextIndex(size_t &index)
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			if(_nextIndex == _filenames.size())
+				return false;
+			index = _nextIndex;
+			++_nextIndex;
+			std::cout << "Reading " << _filenames[index] << " (" << _nextIndex << "/" << _filenames.size() << ")...\n";
+			return true;
+		}
+		
+		void addPartials(size_t destIndex, size_t sourceIndex)
+		{
+			Partial &dest = *_partials[destIndex];
+			Partial &source = *_partials[sourceIndex];
+			if(dest.statistics.PolarizationCount() == 0)
+				dest.statistics.SetPolarizationCount(source.statistics.PolarizationCount());
+			dest.statistics.Add(source.statistics);
+			if(!source.histograms.Empty())
+			{
+				if(dest.histograms.PolarizationCount() == 0)
+					dest.histograms.SetPolarizationCount(source.histograms.PolarizationCount());
+				dest.histograms.Add(source.histograms);
+			}
+			source.statistics.Clear();
+			source.histograms.Clear();
+		}
+		
+		const std::vector<std::string> &_filenames;
+		const enum CombineMode _mode;
+		std::vector<std::unique_ptr<Partial>> _partials;
+		boost::mutex _mutex;
+		size_t _nextIndex;
+		bool _exceptionOccured;
+		std::string _exceptionMessage;
+};
+
+void actionCombine(const std::string outFilename, const std::vector<std::string> inFilenames, enum CombineMode mode, bool incremental)
 {
+	// The target does not store which statistics were combined, so partially combined sets can
+	// not be told apart from the full sets when adding to it later
+	if(incremental && mode != CombineAll)
+		throw std::runtime_error("-incremental can not be used together with -time-only or -baseline-only");
 	if(!inFilenames.empty())
 	{
 		const std::string &firstInFilename = *inFilenames.begin();
@@ -592,6 +761,8 @@ void actionCombine(const std::string outFilename, const std::vector<std::string>
 		std::vector<AntennaInfo> antennae;
 		StatisticsCollection statisticsCollection;
 		HistogramCollection histogramCollection;
+		const bool appendToTarget = incremental && !remote && casacore::Table::isReadable(outFilename);
+		CombinedInputs combinedInputs;
 		if(remote)
 		{
 			std::unique_ptr<aoRemote::ClusteredObservation> observation( aoRemote::ClusteredObservation::Load(firstInFilename));
@@ -601,42 +772,81 @@ void actionCombine(const std::string outFilename, const std::vector<std::string>
 			commander.Run();
 			antennae = commander.Antennas();
 		} else {
-			std::cout << "Reading antenna table...\n";
-			std::unique_ptr<MeasurementSet> ms(new MeasurementSet(firstInFilename));
-			antennae.resize(ms->AntennaCount());
-			for(size_t i=0; i!=ms->AntennaCount(); ++i)
-				antennae[i] = ms->GetAntennaInfo(i);
-			ms.reset();
-			
-			for(std::vector<std::string>::const_iterator i=inFilenames.begin(); i!=inFilenames.end(); ++i)
+			std::vector<std::string> newFilenames;
+			if(appendToTarget)
 			{
-				std::cout << "Reading " << *i << "...\n";
-				// TODO read quality tables from all inFilenames
-				QualityTablesFormatter formatter(*i);
-				StatisticsCollection collectionPart;
-				collectionPart.Load(formatter);
-				if(i == inFilenames.begin())
-					statisticsCollection.SetPolarizationCount(collectionPart.PolarizationCount());
-				statisticsCollection.Add(collectionPart);
-			}
-		}
-		// Create main table
-		casacore::TableDesc tableDesc = casacore::MS::requiredTableDesc();
-		casacore::ArrayColumnDesc<std::complex<float> > dataColumnDesc = casacore::ArrayColumnDesc<std::complex<float> >(casacore::MS::columnName(casacore::MSMainEnums::DATA));
-		tableDesc.addColumn(dataColumnDesc);
-		casacore::SetupNewTable newTab(outFilename, tableDesc, casacore::Table::New);
-		casacore::MeasurementSet ms(newTab);
-		ms.createDefaultSubtables(casacore::Table::New);
-		
-		std::cout << "Writing antenna table...\n";
-		WriteAntennae(ms, antennae);
+				// Without the list, it is unknown which sets the statistics of the target already
+				// contain, and adding the inputs could count them twice
+				if(!CombinedInputs::IsStoredIn(outFilename))
+					throw std::runtime_error("Can not add incrementally to " + outFilename + ", because it does not list the sets that were combined into it. Only a target that was written by 'combine' can be added to.");
+				combinedInputs.Read(outFilename);
+				newFilenames = combinedInputs.SelectNew(inFilenames);
+				if(newFilenames.empty())
+				{
+					std::cout << "All sets have already been combined into " << outFilename << ", nothing to do.\n";
+					return;
+				}
+				std::cout << "Adding " << newFilenames.size() << " new sets to the statistics in " << outFilename << "...\n";
+				QualityTablesFormatter formatter(outFilename);
+				statisticsCollection.Load(formatter);
+				HistogramTablesFormatter histogramFormatter(outFilename);
+				if(histogramFormatter.HistogramsExist())
+				{
+					histogramCollection.SetPolarizationCount(statisticsCollection.PolarizationCount());
+					histogramCollection.Load(histogramFormatter);
+				}
+			} else {
+				newFilenames = combinedInputs.SelectNew(inFilenames);
+				std::cout << "Reading antenna table...\n";
+				std::unique_ptr<MeasurementSet> ms(new MeasurementSet(firstInFilename));
+				antennae.resize(ms->AntennaCount());
+				for(size_t i=0; i!=ms->AntennaCount(); ++i)
+					antennae[i] = ms->GetAntennaInfo(i);
+			}
+			
+			CombineReaderPool readerPool(newFilenames, mode);
+			readerPool.Run(statisticsCollection, histogramCollection);
+			for(std::vector<std::string>::const_iterator i=newFilenames.begin(); i!=newFilenames.end(); ++i)
+				combinedInputs.Add(*i);
+		}
 		
-		std::cout << "Writing polarization table (" << statisticsCollection.PolarizationCount() << " pols)...\n";
-		WritePolarizationForLinearPols(ms);
+		if(!appendToTarget)
+		{
+			// Create main table
+			casacore::TableDesc tableDesc = casacore::MS::requiredTableDesc();
+			casacore::ArrayColumnDesc<std::complex<float> > dataColumnDesc = casacore::ArrayColumnDesc<std::complex<float> >(casacore::MS::columnName(casacore::MSMainEnums::DATA));
+			tableDesc.addColumn(dataColumnDesc);
+			casacore::SetupNewTable newTab(outFilename, tableDesc, casacore::Table::New);
+			casacore::MeasurementSet ms(newTab);
+			ms.createDefaultSubtables(casacore::Table::New);
+			
+			std::cout << "Writing antenna table...\n";
+			WriteAntennae(ms, antennae);
+			
+			std::cout << "Writing polarization table (" << statisticsCollection.PolarizationCount() << " pols)...\n";
+			WritePolarizationForLinearPols(ms);
+		}
 		
 		std::cout << "Writing quality table...\n";
-		QualityTablesFormatter formatter(outFilename);
-		statisticsCollection.Save(formatter);
+		{
+			QualityTablesFormatter formatter(outFilename);
+			if(appendToTarget)
+				formatter.RemoveAllQualityTables();
+			statisticsCollection.Save(formatter);
+		}
+		
+		if(!histogramCollection.Empty())
+		{
+			std::cout << "Writing histogram tables...\n";
+			HistogramTablesFormatter histogramFormatter(outFilename);
+			// The collection already contains the histograms of the target
+			if(appendToTarget)
+				histogramFormatter.RemoveAll();
+			histogramCollection.Save(histogramFormatter);
+		}
+		
+		if(!remote)
+			combinedInputs.Write(outFilename);
 	}
 }
 
@@ -795,10 +1005,16 @@ int main(int argc, char *argv[])
 				}
 				else if(helpAction == "combine")
 				{
-					std::cout << "Syntax: " << argv[0] << " combine <target_ms> [<in_ms> [<in_ms> ..]]\n\n"
+					std::cout << "Syntax: " << argv[0] << " combine [-time-only/-baseline-only] [-incremental] <target_ms> [<in_ms> [<in_ms> ..]]\n\n"
 						"This will read all given input measurement sets, combine the statistics and \n"
 						"write the results to a target measurement set. The target measurement set should\n"
-						"not exist beforehand.\n";
+						"not exist beforehand, unless -incremental is given. The input sets are read in parallel.\n\n"
+						"-time-only and -baseline-only will only combine the time or baseline statistics,\n"
+						"which is considerably faster than combining all statistics.\n"
+						"-incremental will add the statistics to an existing target, and will only read the\n"
+						"input sets that were not combined into the target before. The target should have\n"
+						"been written by combine, because it lists the sets that were combined into it.\n"
+						"It can not be used together with -time-only or -baseline-only.\n";
 				}
 				else if(helpAction == "histogram")
 				{
@@ -879,17 +1095,32 @@ int main(int argc, char *argv[])
 		}
 		else if(action == "combine")
 		{
-			if(argc < 3 )
+			int argi = 2;
+			CombineMode mode = CombineAll;
+			bool incremental = false;
+			while(argi < argc && argv[argi][0] == '-')
+			{
+				std::string p = &argv[argi][1];
+				if(p == "time-only")
+					mode = CombineTimeOnly;
+				else if(p == "baseline-only")
+					mode = CombineBaselineOnly;
+				else if(p == "incremental")
+					incremental = true;
+				else throw std::runtime_error("Bad parameter given to aoquality combine");
+				++argi;
+			}
+			if(argi >= argc)
 			{
 				std::cerr << "combine actions needs at least one parameter.\n";
 				return -1;
 			}
 			else {
-				std::string outFilename = argv[2];
+				std::string outFilename = argv[argi];
 				std::vector<std::string> inFilenames;
-				for(int i=3;i<argc;++i)
+				for(int i=argi+1;i<argc;++i)
 					inFilenames.push_back(argv[i]);
-				actionCombine(outFilename, inFilenames);
+				actionCombine(outFilename, inFilenames, mode, incremental);
 			}
 		}
 		else if(action == "histogram")
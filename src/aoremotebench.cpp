@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "quality/histogramcollection.h"
+#include "quality/statisticscollection.h"
+
+#include "remote/localcluster.h"
+#include "remote/observationtimerange.h"
+#include "remote/processcommander.h"
+
+#include "util/numberlist.h"
+#include "util/stopwatch.h"
+
+using namespace aoRemote;
+
+/**
+ * Keeps the timings of a series of requests.
+ */
+class RequestTimings
+{
+	public:
+		RequestTimings() : _bytes(0) { }
+		
+		void Add(double seconds, size_t bytes)
+		{
+			_latencies.push_back(seconds);
+			_bytes += bytes;
+		}
+		
+		void Report(const std::string &name, size_t nodeCount) const
+		{
+			if(_latencies.empty())
+				return;
+			std::vector<double> sorted(_latencies);
+			std::sort(sorted.begin(), sorted.end());
+			double total = 0.0;
+			for(std::vector<double>::const_iterator i=sorted.begin(); i!=sorted.end(); ++i)
+				total += *i;
+			std::cout
+				<< nodeCount << '\t' << name << '\t' << sorted.size() << '\t'
+				<< std::setprecision(4) << (sorted.front()*1e3) << '\t'
+				<< (sorted[sorted.size()/2]*1e3) << '\t'
+				<< (sorted.back()*1e3) << '\t'
+				<< (_bytes / total / (1024.0*1024.0)) << '\n';
+		}
+	private:
+		std::vector<double> _latencies;
+		size_t _bytes;
+};
+
+void benchmark(const std::string &directory, size_t nodeCount, const LocalCluster::SetDimensions &dimensions, size_t rowsPerRequest, size_t repeatCount)
+{
+	LocalCluster cluster(directory, nodeCount);
+	std::cerr << "Creating " << nodeCount << " synthetic set(s)...\n";
+	cluster.CreateSets(dimensions);
+	
+	ProcessCommander commander(cluster.Observation());
+	commander.SetRunClientsInProcess(true);
+	
+	// The first run includes starting the clients
+	Stopwatch watch(true);
+	commander.PushReadAntennaTablesTask();
+	commander.PushReadBandTablesTask();
+	commander.Run(false);
+	commander.CheckErrors();
+	RequestTimings startupTimings;
+	startupTimings.Add(watch.Seconds(), 0);
+	
+	RequestTimings qualityTimings;
+	for(size_t r=0; r!=repeatCount; ++r)
+	{
+		StatisticsCollection statistics;
+		HistogramCollection histograms;
+		watch.Reset();
+		watch.Start();
+		commander.PushReadQualityTablesTask(&statistics, &histograms);
+		commander.Run(false);
+		commander.CheckErrors();
+		qualityTimings.Add(watch.Seconds(), 0);
+	}
+	
+	ObservationTimerange timerange(cluster.Observation());
+	const std::vector<BandInfo> &bands = commander.Bands();
+	for(size_t i=0; i!=bands.size(); ++i)
+		timerange.SetBandInfo(i, bands[i]);
+	timerange.Initialize(commander.PolarizationCount(), rowsPerRequest);
+	
+	std::vector<MSRowDataExt*> rowBuffer(nodeCount);
+	for(size_t i=0; i!=nodeCount; ++i)
+		rowBuffer[i] = new MSRowDataExt[rowsPerRequest];
+	
+	const size_t totalRows = dimensions.RowCount();
+	const size_t bytesPerRow = nodeCount * dimensions.polarizationCount * dimensions.channelCount * 2 * sizeof(num_t);
+	RequestTimings readTimings, writeTimings;
+	for(size_t r=0; r!=repeatCount; ++r)
+	{
+		for(size_t row=0; row<totalRows; row+=rowsPerRequest)
+		{
+			const size_t rowCount = std::min(rowsPerRequest, totalRows - row);
+			
+			timerange.SetZero();
+			watch.Reset();
+			watch.Start();
+			commander.PushReadDataRowsTask(timerange, row, rowCount, &rowBuffer[0]);
+			commander.Run(false);
+			commander.CheckErrors();
+			readTimings.Add(watch.Seconds(), rowCount * bytesPerRow);
+			
+			watch.Reset();
+			watch.Start();
+			commander.PushWriteDataRowsTask(timerange, &rowBuffer[0]);
+			commander.Run(false);
+			commander.CheckErrors();
+			writeTimings.Add(watch.Seconds(), rowCount * bytesPerRow);
+		}
+	}
+	
+	for(size_t i=0; i!=nodeCount; ++i)
+		delete[] rowBuffer[i];
+	
+	startupTimings.Report("startup", nodeCount);
+	qualityTimings.Report("quality", nodeCount);
+	readTimings.Report("readrows", nodeCount);
+	writeTimings.Report("writerows", nodeCount);
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " [options] <directory>\n"
+			"Benchmarks the remote data path on this machine. For each node count, synthetic\n"
+			"measurement sets are created in the given directory, and every node is served by\n"
+			"an in-process client over a local socket.\n"
+			"Options:\n"
+			"-nodes <list>\n"
+			"  Comma separated list of node counts to benchmark, default: 1,2,4.\n"
+			"-antennas <count>, -channels <count>, -timesteps <count>\n"
+			"  Dimensions of each synthetic set, default: 8 antennas, 64 channels, 100 timesteps.\n"
+			"-rows <count>\n"
+			"  Number of rows per ReadDataRows / WriteDataRows request, default: 128.\n"
+			"-repeat <count>\n"
+			"  Number of passes over the data, default: 1.\n"
+			"\n"
+			"The output has one line per node count and kind of request, with the number of\n"
+			"requests, the minimum, median and maximum latency in ms and the throughput in MB/s.\n";
+		return 1;
+	}
+	
+	std::vector<size_t> nodeCounts;
+	nodeCounts.push_back(1);
+	nodeCounts.push_back(2);
+	nodeCounts.push_back(4);
+	LocalCluster::SetDimensions dimensions;
+	size_t rowsPerRequest = 128, repeatCount = 1;
+	
+	int argi = 1;
+	while(argi < argc && argv[argi][0] == '-')
+	{
+		const std::string p(&argv[argi][1]);
+		if(argi+1 == argc)
+		{
+			std::cerr << "Missing value for parameter -" << p << '\n';
+			return 1;
+		}
+		++argi;
+		if(p == "nodes")
+		{
+			nodeCounts.clear();
+			NumberList::ParseIntList(argv[argi], nodeCounts);
+		}
+		else if(p == "antennas") dimensions.antennaCount = atoi(argv[argi]);
+		else if(p == "channels") dimensions.channelCount = atoi(argv[argi]);
+		else if(p == "timesteps") dimensions.timestepCount = atoi(argv[argi]);
+		else if(p == "rows") rowsPerRequest = atoi(argv[argi]);
+		else if(p == "repeat") repeatCount = atoi(argv[argi]);
+		else {
+			std::cerr << "Unknown parameter: -" << p << '\n';
+			return 1;
+		}
+		++argi;
+	}
+	if(argi == argc)
+	{
+		std::cerr << "No directory given.\n";
+		return 1;
+	}
+	const std::string directory(argv[argi]);
+	
+	std::cout << "nodes\trequest\tcount\tmin_ms\tmedian_ms\tmax_ms\tMB/s\n";
+	for(std::vector<size_t>::const_iterator i=nodeCounts.begin(); i!=nodeCounts.end(); ++i)
+		benchmark(directory, *i, dimensions, rowsPerRequest, repeatCount);
+	
+	return 0;
+}
@@ -1,7 +1,9 @@
 #include <iostream>
 
+#include "test/strategy/actions/actionstestgroup.h"
 #include "test/strategy/algorithms/algorithmstestgroup.h"
 #include "test/experiments/experimentstestgroup.h"
+#include "test/interface/interfacetestgroup.h"
 #include "test/msio/msiotestgroup.h"
 #include "test/quality/qualitytestgroup.h"
 #include "test/util/utiltestgroup.h"
@@ -24,11 +26,21 @@ int main(int argc, char *argv[])
 		successes += mainGroup.Successes();
 		failures += mainGroup.Failures();
 
+		ActionsTestGroup actionsGroup;
+		actionsGroup.Run();
+		successes += actionsGroup.Successes();
+		failures += actionsGroup.Failures();
+
 		MSIOTestGroup msioGroup;
 		msioGroup.Run();
 		successes += msioGroup.Successes();
 		failures += msioGroup.Failures();
 		
+		InterfaceTestGroup interfaceGroup;
+		interfaceGroup.Run();
+		successes += interfaceGroup.Successes();
+		failures += interfaceGroup.Failures();
+		
 		QualityTestGroup qualityGroup;
 		qualityGroup.Run();
 		successes += qualityGroup.Successes();
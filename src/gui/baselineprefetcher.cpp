@@ -0,0 +1,246 @@
+#include "baselineprefetcher.h"
+
+#include <stdexcept>
+#include <vector>
+
+BaselinePrefetcher::BaselinePrefetcher(boost::mutex &ioMutex, size_t cacheSize) :
+	_ioMutex(ioMutex),
+	_cacheSize(cacheSize),
+	_imageSet(0),
+	_thread(0),
+	_stop(false),
+	_request(0),
+	_requestNumber(0),
+	_result(0),
+	_resultIsAvailable(false),
+	_requestIsPending(false)
+{
+}
+
+BaselinePrefetcher::~BaselinePrefetcher()
+{
+	Stop();
+}
+
+void BaselinePrefetcher::Start(rfiStrategy::ImageSet &imageSet)
+{
+	Stop();
+	_imageSet = &imageSet;
+	_stop = false;
+	_thread = new boost::thread(ReaderFunction(*this));
+}
+
+void BaselinePrefetcher::Stop()
+{
+	if(_thread != 0)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_stop = true;
+		_change.notify_all();
+		lock.unlock();
+		_thread->join();
+		delete _thread;
+		_thread = 0;
+	}
+	boost::mutex::scoped_lock lock(_mutex);
+	clearRequest();
+	clearCache();
+	_imageSet = 0;
+}
+
+void BaselinePrefetcher::ClearCache()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	clearCache();
+}
+
+void BaselinePrefetcher::Request(const rfiStrategy::ImageSetIndex &index)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	clearRequest();
+	_request = index.Copy();
+	++_requestNumber;
+	_requestIsPending = true;
+	_change.notify_all();
+}
+
+rfiStrategy::BaselineData *BaselinePrefetcher::TakeRequested()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	if(!_resultIsAvailable)
+		return 0;
+	_resultIsAvailable = false;
+	rfiStrategy::BaselineData *result = _result;
+	_result = 0;
+	if(result == 0)
+		throw std::runtime_error(_error);
+	return result;
+}
+
+void BaselinePrefetcher::WaitForRequested()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	while(_requestIsPending && _thread != 0)
+		_change.wait(lock);
+}
+
+void BaselinePrefetcher::ReaderFunction::operator()()
+{
+	BaselinePrefetcher &p = _prefetcher;
+	boost::mutex::scoped_lock lock(p._mutex);
+	while(!p._stop)
+	{
+		if(p._request != 0)
+		{
+			rfiStrategy::ImageSetIndex *index = p._request;
+			p._request = 0;
+			const size_t requestNumber = p._requestNumber;
+			lock.unlock();
+			
+			rfiStrategy::BaselineData *baseline = 0;
+			std::string key, error;
+			std::vector<rfiStrategy::ImageSetIndex*> neighbours;
+			try {
+				boost::mutex::scoped_lock ioLock(p._ioMutex);
+				key = index->Description();
+				lock.lock();
+				baseline = p.copyFromCache(key);
+				lock.unlock();
+				if(baseline == 0)
+				{
+					baseline = p.read(*index);
+					lock.lock();
+					p.addToCache(key, new rfiStrategy::BaselineData(*baseline));
+					lock.unlock();
+				}
+				
+				// The previous baseline is queued first, so that it is not removed
+				// from the cache by the next one when stepping forward.
+				rfiStrategy::ImageSetIndex *neighbour = index->Copy();
+				neighbour->Previous();
+				if(neighbour->IsValid()) neighbours.push_back(neighbour);
+				else delete neighbour;
+				neighbour = index->Copy();
+				neighbour->Next();
+				if(neighbour->IsValid()) neighbours.push_back(neighbour);
+				else delete neighbour;
+			} catch(std::exception &e)
+			{
+				error = e.what();
+			}
+			delete index;
+			
+			lock.lock();
+			if(requestNumber == p._requestNumber)
+			{
+				p._result = baseline;
+				p._error = error;
+				p._resultIsAvailable = true;
+				p._requestIsPending = false;
+				p._prefetchQueue.insert(p._prefetchQueue.end(), neighbours.begin(), neighbours.end());
+				p._change.notify_all();
+				p._requestAvailable();
+			} else {
+				// A new request came in while reading
+				delete baseline;
+				for(std::vector<rfiStrategy::ImageSetIndex*>::iterator i=neighbours.begin(); i!=neighbours.end(); ++i)
+					delete *i;
+			}
+		}
+		else if(!p._prefetchQueue.empty())
+		{
+			rfiStrategy::ImageSetIndex *index = p._prefetchQueue.front();
+			p._prefetchQueue.pop_front();
+			lock.unlock();
+			
+			try {
+				boost::mutex::scoped_lock ioLock(p._ioMutex);
+				const std::string key = index->Description();
+				lock.lock();
+				rfiStrategy::BaselineData *cached = p.copyFromCache(key);
+				lock.unlock();
+				if(cached == 0)
+				{
+					rfiStrategy::BaselineData *baseline = p.read(*index);
+					lock.lock();
+					p.addToCache(key, baseline);
+					lock.unlock();
+				}
+				delete cached;
+			} catch(std::exception &)
+			{
+				// Errors are reported when the baseline is requested
+			}
+			delete index;
+			lock.lock();
+		}
+		else {
+			p._change.wait(lock);
+		}
+	}
+}
+
+rfiStrategy::BaselineData *BaselinePrefetcher::read(const rfiStrategy::ImageSetIndex &index)
+{
+	_imageSet->AddReadRequest(index);
+	_imageSet->PerformReadRequests();
+	return _imageSet->GetNextRequested();
+}
+
+rfiStrategy::BaselineData *BaselinePrefetcher::copyFromCache(const std::string &key)
+{
+	for(std::deque<CacheItem>::iterator i=_cache.begin(); i!=_cache.end(); ++i)
+	{
+		if(i->key == key)
+		{
+			// Move the item to the back, so that it is removed last
+			CacheItem item = *i;
+			_cache.erase(i);
+			_cache.push_back(item);
+			return new rfiStrategy::BaselineData(*item.baseline);
+		}
+	}
+	return 0;
+}
+
+void BaselinePrefetcher::addToCache(const std::string &key, rfiStrategy::BaselineData *baseline)
+{
+	for(std::deque<CacheItem>::const_iterator i=_cache.begin(); i!=_cache.end(); ++i)
+	{
+		if(i->key == key)
+		{
+			delete baseline;
+			return;
+		}
+	}
+	CacheItem item;
+	item.key = key;
+	item.baseline = baseline;
+	_cache.push_back(item);
+	while(_cache.size() > _cacheSize)
+	{
+		delete _cache.front().baseline;
+		_cache.pop_front();
+	}
+}
+
+void BaselinePrefetcher::clearCache()
+{
+	for(std::deque<CacheItem>::iterator i=_cache.begin(); i!=_cache.end(); ++i)
+		delete i->baseline;
+	_cache.clear();
+}
+
+void BaselinePrefetcher::clearRequest()
+{
+	delete _request;
+	_request = 0;
+	delete _result;
+	_result = 0;
+	_resultIsAvailable = false;
+	_requestIsPending = false;
+	_error.clear();
+	for(std::deque<rfiStrategy::ImageSetIndex*>::iterator i=_prefetchQueue.begin(); i!=_prefetchQueue.end(); ++i)
+		delete *i;
+	_prefetchQueue.clear();
+}
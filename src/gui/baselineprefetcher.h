@@ -0,0 +1,108 @@
+#ifndef GUI_BASELINEPREFETCHER_H
+#define GUI_BASELINEPREFETCHER_H
+
+#include <string>
+#include <deque>
+
+#include <glibmm/dispatcher.h>
+
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "../strategy/imagesets/imageset.h"
+
+/**
+ * Reads the baselines of an image set in a background thread, so that the gui does not
+ * block while a baseline is read. After a requested baseline has been read, the baselines
+ * just before and after it are read as well and kept in a small cache, so that stepping to
+ * the next or previous baseline is immediate.
+ *
+ * The image set is only accessed with the io mutex locked, like the strategy does.
+ * Baselines are identified by the description of their index.
+ */
+class BaselinePrefetcher
+{
+	public:
+		BaselinePrefetcher(boost::mutex &ioMutex, size_t cacheSize = 3);
+		~BaselinePrefetcher();
+
+		/**
+		 * Starts reading from @p imageSet. The set should stay alive until Stop() is called.
+		 */
+		void Start(rfiStrategy::ImageSet &imageSet);
+
+		/**
+		 * Waits for the thread to finish and forgets the set, the cached baselines and any
+		 * outstanding request. Should be called before the image set is destroyed.
+		 */
+		void Stop();
+
+		/**
+		 * Forgets the cached baselines, e.g. because the set has changed on disk.
+		 */
+		void ClearCache();
+
+		/**
+		 * Asks for a baseline, replacing any earlier request that has not been taken yet.
+		 * SignalRequestAvailable() is emitted in the gui thread when it can be taken.
+		 */
+		void Request(const rfiStrategy::ImageSetIndex &index);
+
+		/**
+		 * Returns the requested baseline, which the caller should delete, or 0 if it
+		 * is not available (anymore).
+		 * @throws std::runtime_error if reading the baseline failed.
+		 */
+		rfiStrategy::BaselineData *TakeRequested();
+
+		/**
+		 * Blocks until the baseline of the last request can be taken, for callers that need
+		 * the data before the gui processes SignalRequestAvailable(). Returns immediately
+		 * when there is no outstanding request.
+		 */
+		void WaitForRequested();
+
+		Glib::Dispatcher &SignalRequestAvailable() { return _requestAvailable; }
+	private:
+		struct CacheItem
+		{
+			std::string key;
+			rfiStrategy::BaselineData *baseline;
+		};
+
+		struct ReaderFunction
+		{
+			ReaderFunction(BaselinePrefetcher &prefetcher) : _prefetcher(prefetcher) { }
+			void operator()();
+			BaselinePrefetcher &_prefetcher;
+		};
+
+		rfiStrategy::BaselineData *read(const rfiStrategy::ImageSetIndex &index);
+		rfiStrategy::BaselineData *copyFromCache(const std::string &key);
+		void addToCache(const std::string &key, rfiStrategy::BaselineData *baseline);
+		void clearCache();
+		void clearRequest();
+
+		boost::mutex &_ioMutex;
+		const size_t _cacheSize;
+		rfiStrategy::ImageSet *_imageSet;
+		boost::thread *_thread;
+		Glib::Dispatcher _requestAvailable;
+
+		// The members below are protected by _mutex. The io mutex, if also needed,
+		// is always locked first.
+		boost::mutex _mutex;
+		boost::condition _change;
+		bool _stop;
+		rfiStrategy::ImageSetIndex *_request;
+		size_t _requestNumber;
+		rfiStrategy::BaselineData *_result;
+		std::string _error;
+		bool _resultIsAvailable;
+		bool _requestIsPending;
+		std::deque<rfiStrategy::ImageSetIndex*> _prefetchQueue;
+		std::deque<CacheItem> _cache;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#include "imagepyramid.h"
+
+template<typename T>
+boost::shared_ptr<const T> ImagePyramid::getLevel(const boost::shared_ptr<const T> &source, std::map<Shifts, boost::shared_ptr<const T> > &levels, unsigned shiftX, unsigned shiftY)
+{
+	if(source == 0 || (shiftX == 0 && shiftY == 0))
+		return source;
+	typename std::map<Shifts, boost::shared_ptr<const T> >::const_iterator level = levels.find(Shifts(shiftX, shiftY));
+	if(level != levels.end())
+		return level->second;
+
+	// Start from the smallest available level that is not coarser than the requested one
+	boost::shared_ptr<const T> start = source;
+	Shifts startShifts(0, 0);
+	for(level=levels.begin(); level!=levels.end(); ++level)
+	{
+		const Shifts &shifts = level->first;
+		if(shifts.first <= shiftX && shifts.second <= shiftY &&
+			shifts.first + shifts.second > startShifts.first + startShifts.second)
+		{
+			start = level->second;
+			startShifts = shifts;
+		}
+	}
+
+	boost::shared_ptr<const T> result = start;
+	if(shiftX != startShifts.first)
+		result = result->ShrinkHorizontally(1 << (shiftX - startShifts.first));
+	if(shiftY != startShifts.second)
+		result = result->ShrinkVertically(1 << (shiftY - startShifts.second));
+	levels.insert(std::make_pair(Shifts(shiftX, shiftY), result));
+	return result;
+}
+
+template Image2DCPtr ImagePyramid::getLevel<Image2D>(const Image2DCPtr &source, std::map<Shifts, Image2DCPtr> &levels, unsigned shiftX, unsigned shiftY);
+template Mask2DCPtr ImagePyramid::getLevel<Mask2D>(const Mask2DCPtr &source, std::map<Shifts, Mask2DCPtr> &levels, unsigned shiftX, unsigned shiftY);
@@ -0,0 +1,89 @@
+#ifndef GUI_IMAGEPYRAMID_H
+#define GUI_IMAGEPYRAMID_H
+
+#include <map>
+#include <utility>
+
+#include "../structures/image2d.h"
+#include "../structures/mask2d.h"
+
+/**
+ * Lower resolution versions of an image and its two masks, so that a large image can be
+ * drawn without going through all of its samples. A level is shrunk by a power of two
+ * in time and in frequency separately, given as the shifts of the level. Images are
+ * averaged, while a sample of a mask level is set when any of its samples is set.
+ *
+ * Levels are made when they are first asked for, from the smallest level that is
+ * already available, and are kept until the image or mask they were made from is
+ * replaced. Hence, zooming around only shrinks the full image once or twice.
+ */
+class ImagePyramid
+{
+	public:
+		void SetImage(const Image2DCPtr &image)
+		{
+			setSource(_image, _imageLevels, image);
+		}
+		void SetOriginalMask(const Mask2DCPtr &mask)
+		{
+			setSource(_originalMask, _originalMaskLevels, mask);
+		}
+		void SetAlternativeMask(const Mask2DCPtr &mask)
+		{
+			setSource(_alternativeMask, _alternativeMaskLevels, mask);
+		}
+
+		Image2DCPtr GetImage(unsigned shiftX, unsigned shiftY)
+		{
+			return getLevel(_image, _imageLevels, shiftX, shiftY);
+		}
+		Mask2DCPtr GetOriginalMask(unsigned shiftX, unsigned shiftY)
+		{
+			return getLevel(_originalMask, _originalMaskLevels, shiftX, shiftY);
+		}
+		Mask2DCPtr GetAlternativeMask(unsigned shiftX, unsigned shiftY)
+		{
+			return getLevel(_alternativeMask, _alternativeMaskLevels, shiftX, shiftY);
+		}
+
+		void Clear()
+		{
+			SetImage(Image2DCPtr());
+			SetOriginalMask(Mask2DCPtr());
+			SetAlternativeMask(Mask2DCPtr());
+		}
+
+		/**
+		 * The largest shift with which @p size samples are still shown with at least
+		 * @p targetSize samples, i.e., the coarsest level that does not lose resolution.
+		 */
+		static unsigned ShiftFor(size_t size, size_t targetSize)
+		{
+			unsigned shift = 0;
+			while(targetSize != 0 && (size >> (shift+1)) >= targetSize)
+				++shift;
+			return shift;
+		}
+	private:
+		typedef std::pair<unsigned, unsigned> Shifts;
+
+		template<typename T>
+		static void setSource(boost::shared_ptr<const T> &source, std::map<Shifts, boost::shared_ptr<const T> > &levels, const boost::shared_ptr<const T> &newSource)
+		{
+			if(source != newSource)
+			{
+				source = newSource;
+				levels.clear();
+			}
+		}
+
+		template<typename T>
+		static boost::shared_ptr<const T> getLevel(const boost::shared_ptr<const T> &source, std::map<Shifts, boost::shared_ptr<const T> > &levels, unsigned shiftX, unsigned shiftY);
+
+		Image2DCPtr _image;
+		Mask2DCPtr _originalMask, _alternativeMask;
+		std::map<Shifts, Image2DCPtr> _imageLevels;
+		std::map<Shifts, Mask2DCPtr> _originalMaskLevels, _alternativeMaskLevels;
+};
+
+#endif
@@ -13,9 +13,12 @@
 #include "plot/verticalplotscale.h"
 #include "plot/title.h"
 
+#include <cstring>
 #include <iostream>
 #include <fstream>
 
+#include <emmintrin.h>
+
 #include <boost/algorithm/string.hpp>
 
 ImageWidget::ImageWidget() :
@@ -79,6 +82,8 @@ void ImageWidget::Clear()
 		_highlightConfig = new ThresholdConfig();
 		_highlightConfig->InitializeLengthsSingleSample();
 		_segmentedImage.reset();
+		_pyramid.Clear();
+		_rangeStatistics = RangeStatistics();
 	}
 	if(_horiScale != 0) {
 		delete _horiScale;
@@ -325,36 +330,37 @@ void ImageWidget::SaveText(const std::string &filename)
 
 void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, unsigned height)
 {
-	Image2DCPtr image = _image;
-	Mask2DCPtr mask = GetActiveMask(), originalMask = _originalMask, alternativeMask = _alternativeMask;
-	
-	unsigned int
-		startX = (unsigned int) round(_startHorizontal * image->Width()),
-		startY = (unsigned int) round(_startVertical * image->Height()),
-		endX = (unsigned int) round(_endHorizontal * image->Width()),
-		endY = (unsigned int) round(_endVertical * image->Height()),
+	const unsigned int
+		startX = (unsigned int) round(_startHorizontal * _image->Width()),
+		startY = (unsigned int) round(_startVertical * _image->Height()),
+		endX = (unsigned int) round(_endHorizontal * _image->Width()),
+		endY = (unsigned int) round(_endVertical * _image->Height()),
 		startTimestep = startX,
 		endTimestep = endX;
-	size_t
-		imageWidth = endX - startX,
-		imageHeight = endY - startY;
-		
-	if(imageWidth > 30000)
-	{
-		int shrinkFactor = (imageWidth + 29999) / 30000;
-		image = image->ShrinkHorizontally(shrinkFactor);
-		mask = mask->ShrinkHorizontally(shrinkFactor);
-		if(originalMask != 0)
-			originalMask = originalMask->ShrinkHorizontally(shrinkFactor);
-		if(alternativeMask != 0)
-			alternativeMask = alternativeMask->ShrinkHorizontally(shrinkFactor);
-		startX /= shrinkFactor;
-		endX /= shrinkFactor;
-		imageWidth = endX - startX;
-	}
+	
+	// Only the level of the pyramid that has about the resolution of the screen is drawn,
+	// except when a segmented image is shown, which is drawn at full resolution.
+	unsigned shiftX = 0, shiftY = 0;
+	if(_segmentedImage == 0)
+	{
+		shiftX = ImagePyramid::ShiftFor(endX - startX, width);
+		shiftY = ImagePyramid::ShiftFor(endY - startY, height);
+	}
+	_pyramid.SetImage(_image);
+	_pyramid.SetOriginalMask(_originalMask);
+	_pyramid.SetAlternativeMask(_alternativeMask);
+	Image2DCPtr image = _pyramid.GetImage(shiftX, shiftY);
+	Mask2DCPtr
+		originalMask = _pyramid.GetOriginalMask(shiftX, shiftY),
+		alternativeMask = _pyramid.GetAlternativeMask(shiftX, shiftY);
+	const size_t
+		levelStartX = startX >> shiftX,
+		levelEndX = ((endX - 1) >> shiftX) + 1,
+		levelStartY = startY >> shiftY,
+		levelEndY = ((endY - 1) >> shiftY) + 1;
 
 	num_t min, max;
-	findMinMax(image, mask, min, max);
+	findMinMax(min, max);
 	
 	// If these are not yet created, they are 0, so ok to delete.
 	delete _horiScale;
@@ -455,9 +461,7 @@ void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, un
 
 	class ColorMap *colorMap = createColorMap();
 	
-	const double
-		minLog10 = min>0.0 ? log10(min) : 0.0,
-		maxLog10 = max>0.0 ? log10(max) : 0.0;
+	const double minLog10 = min>0.0 ? log10(min) : 0.0;
 	if(_showColorScale)
 	{
 		for(unsigned x=0;x<256;++x)
@@ -475,70 +479,17 @@ void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, un
 			_colorScale->SetColorValue(imageVal, r/255.0, g/255.0, b/255.0);
 		}
 	}
+	delete colorMap;
 	
 	_imageSurface.clear();
 	_imageSurface =
-		Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, imageWidth, imageHeight);
+		Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, levelEndX - levelStartX, levelEndY - levelStartY);
 
 	_imageSurface->flush();
 	unsigned char *data = _imageSurface->get_data();
 	size_t rowStride = _imageSurface->get_stride();
 
-	Mask2DPtr highlightMask;
-	if(_highlighting)
-	{
-		highlightMask = Mask2D::CreateSetMaskPtr<false>(image->Width(), image->Height());
-		_highlightConfig->Execute(image, highlightMask, true, 10.0);
-	}
-	const bool
-		originalActive = _showOriginalMask && originalMask != 0,
-		altActive = _showAlternativeMask && alternativeMask != 0;
-	int orMaskR=255, orMaskG=0, orMaskB=255;
-	int altMaskR=255, altMaskG=255, altMaskB=0;
-	if(_colorMap == ViridisMap)
-	{
-		orMaskR=0; orMaskG=0; orMaskB=0;
-		altMaskR=255; altMaskG=255; altMaskB=255;
-	}
-	for(unsigned long y=startY;y<endY;++y) {
-		guint8* rowpointer = data + rowStride * (endY - y - 1);
-		for(unsigned long x=startX;x<endX;++x) {
-			int xa = (x-startX) * 4;
-			unsigned char r,g,b,a;
-			if(_highlighting && highlightMask->Value(x, y) != 0) {
-				r = 255; g = 0; b = 0; a = 255;
-			} else if(originalActive && originalMask->Value(x, y)) {
-				r = orMaskR; g = orMaskG; b = orMaskB; a = 255;
-			} else if(altActive && alternativeMask->Value(x, y)) {
-				r = altMaskR; g = altMaskG; b = altMaskB; a = 255;
-			} else {
-				num_t val = image->Value(x, y);
-				if(val > max) val = max;
-				else if(val < min) val = min;
-
-				if(_scaleOption == LogScale)
-				{
-					if(image->Value(x, y) <= 0.0)
-						val = -1.0;
-					else
-						val = (log10(image->Value(x, y)) - minLog10) * 2.0 / (maxLog10 - minLog10) - 1.0;
-				}
-				else
-					val = (image->Value(x, y) - min) * 2.0 / (max - min) - 1.0;
-				if(val < -1.0) val = -1.0;
-				else if(val > 1.0) val = 1.0;
-				r = colorMap->ValueToColorR(val);
-				g = colorMap->ValueToColorG(val);
-				b = colorMap->ValueToColorB(val);
-				a = colorMap->ValueToColorA(val);
-			}
-			rowpointer[xa]=b;
-			rowpointer[xa+1]=g;
-			rowpointer[xa+2]=r;
-			rowpointer[xa+3]=a;
-		}
-	}
-	delete colorMap;
+	drawImage(data, rowStride, image, originalMask, alternativeMask, levelStartX, levelEndX, levelStartY, levelEndY, min, max);
 
 	if(_segmentedImage != 0)
 	{
@@ -600,25 +551,157 @@ ColorMap *ImageWidget::createColorMap()
 	}
 }
 
-void ImageWidget::findMinMax(Image2DCPtr image, Mask2DCPtr mask, num_t &min, num_t &max)
+static inline uint32_t toPixel(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+	const unsigned char bytes[4] = { b, g, r, a };
+	uint32_t pixel;
+	memcpy(&pixel, bytes, sizeof(uint32_t));
+	return pixel;
+}
+
+static inline void drawMask(uint32_t *pixels, const bool *maskRow, size_t width, uint32_t color)
+{
+	if(memchr(maskRow, true, width) != 0)
+	{
+		for(size_t x=0;x!=width;++x)
+		{
+			if(maskRow[x])
+				pixels[x] = color;
+		}
+	}
+}
+
+void ImageWidget::drawImage(unsigned char *data, size_t rowStride, Image2DCPtr image, Mask2DCPtr originalMask, Mask2DCPtr alternativeMask, size_t startX, size_t endX, size_t startY, size_t endY, num_t min, num_t max)
 {
+	Mask2DPtr highlightMask;
+	if(_highlighting)
+	{
+		highlightMask = Mask2D::CreateSetMaskPtr<false>(image->Width(), image->Height());
+		_highlightConfig->Execute(image, highlightMask, true, 10.0);
+	}
+	const bool
+		originalActive = _showOriginalMask && originalMask != 0,
+		altActive = _showAlternativeMask && alternativeMask != 0;
+	uint32_t
+		highlightColor = toPixel(255, 0, 0, 255),
+		originalColor = toPixel(255, 0, 255, 255),
+		altColor = toPixel(255, 255, 0, 255);
+	if(_colorMap == ViridisMap)
+	{
+		originalColor = toPixel(0, 0, 0, 255);
+		altColor = toPixel(255, 255, 255, 255);
+	}
+	
+	// The colour map is evaluated once for a table of values between -1 and 1, which the
+	// scaled image values index.
+	const size_t colorCount = 1024;
+	std::vector<uint32_t> colors(colorCount);
+	class ColorMap *colorMap = createColorMap();
+	for(size_t i=0;i!=colorCount;++i)
+	{
+		const double val = (2.0 * i) / (colorCount - 1) - 1.0;
+		colors[i] = toPixel(colorMap->ValueToColorR(val), colorMap->ValueToColorG(val), colorMap->ValueToColorB(val), colorMap->ValueToColorA(val));
+	}
+	delete colorMap;
+	
+	const bool isLog = _scaleOption == LogScale;
+	// As for the colour scale, a non-positive limit is taken as 1 on a log scale
+	const num_t
+		offset = isLog ? (min>0.0 ? log10(min) : 0.0) : min,
+		range = isLog ? (max>0.0 ? log10(max) : 0.0) - offset : max - min,
+		scale = range > 0.0 ? (colorCount - 1) / range : 0.0,
+		maxIndex = colorCount - 1;
+	const __m128
+		offset4 = _mm_set1_ps(offset),
+		scale4 = _mm_set1_ps(scale),
+		zero4 = _mm_setzero_ps(),
+		maxIndex4 = _mm_set1_ps(maxIndex);
+	const size_t width = endX - startX;
+	for(size_t y=startY;y<endY;++y)
+	{
+		uint32_t *pixels = reinterpret_cast<uint32_t*>(data + rowStride * (endY - y - 1));
+		const num_t *row = image->ValuePtr(startX, y);
+		size_t x = 0;
+		if(isLog)
+		{
+			for(;x!=width;++x)
+			{
+				// Zero and negative values get the first colour
+				num_t index = row[x] > 0.0 ? (log10(row[x]) - offset) * scale : 0.0;
+				if(!(index > 0.0)) index = 0.0;
+				else if(index > maxIndex) index = maxIndex;
+				pixels[x] = colors[(size_t) (index + 0.5)];
+			}
+		} else {
+			for(;x+4<=width;x+=4)
+			{
+				// Clamping with max first also maps NaNs to the first colour
+				__m128 index = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&row[x]), offset4), scale4);
+				index = _mm_min_ps(_mm_max_ps(index, zero4), maxIndex4);
+				int32_t indices[4] __attribute__((aligned(16)));
+				_mm_store_si128(reinterpret_cast<__m128i*>(indices), _mm_cvtps_epi32(index));
+				pixels[x] = colors[indices[0]];
+				pixels[x+1] = colors[indices[1]];
+				pixels[x+2] = colors[indices[2]];
+				pixels[x+3] = colors[indices[3]];
+			}
+			for(;x!=width;++x)
+			{
+				num_t index = (row[x] - offset) * scale;
+				if(!(index > 0.0)) index = 0.0;
+				else if(index > maxIndex) index = maxIndex;
+				pixels[x] = colors[(size_t) (index + 0.5)];
+			}
+		}
+		if(altActive)
+			drawMask(pixels, alternativeMask->ValuePtr(startX, y), width, altColor);
+		if(originalActive)
+			drawMask(pixels, originalMask->ValuePtr(startX, y), width, originalColor);
+		if(_highlighting)
+			drawMask(pixels, highlightMask->ValuePtr(startX, y), width, highlightColor);
+	}
+}
+
+void ImageWidget::findMinMax(num_t &min, num_t &max)
+{
+	const Mask2DCPtr
+		originalMask = _showOriginalMask ? _originalMask : Mask2DCPtr(),
+		alternativeMask = _showAlternativeMask ? _alternativeMask : Mask2DCPtr();
+	RangeStatistics &statistics = _rangeStatistics;
+	if(statistics.image != _image || statistics.originalMask != originalMask || statistics.alternativeMask != alternativeMask)
+	{
+		statistics = RangeStatistics();
+		statistics.image = _image;
+		statistics.originalMask = originalMask;
+		statistics.alternativeMask = alternativeMask;
+	}
+	Mask2DCPtr mask;
+	if(_range != Specified && !statistics.hasMinMax)
+	{
+		mask = GetActiveMask();
+		statistics.max = ThresholdTools::MaxValue(_image, mask);
+		statistics.min = ThresholdTools::MinValue(_image, mask);
+		statistics.hasMinMax = true;
+	}
+	if(_range == Winsorized && !statistics.hasWinsorized)
+	{
+		if(mask == 0)
+			mask = GetActiveMask();
+		ThresholdTools::WinsorizedMeanAndStdDev(_image, mask, statistics.mean, statistics.stddev, false);
+		statistics.hasWinsorized = true;
+	}
+	
 	switch(_range)
 	{
 		case MinMax:
-			max = ThresholdTools::MaxValue(image, mask);
-			min = ThresholdTools::MinValue(image, mask);
+			max = statistics.max;
+			min = statistics.min;
 		break;
 		case Winsorized:
-		{
-			num_t mean, stddev, genMax, genMin;
-			ThresholdTools::WinsorizedMeanAndStdDev(image, mask, mean, stddev);
-			genMax = ThresholdTools::MaxValue(image, mask);
-			genMin = ThresholdTools::MinValue(image, mask);
-			max = mean + stddev*3.0;
-			min = mean - stddev*3.0;
-			if(genMin > min) min = genMin;
-			if(genMax < max) max = genMax;
-		}
+			max = statistics.mean + statistics.stddev*3.0;
+			min = statistics.mean - statistics.stddev*3.0;
+			if(statistics.min > min) min = statistics.min;
+			if(statistics.max < max) max = statistics.max;
 		break;
 		case Specified:
 			min = _min;
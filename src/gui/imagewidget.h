@@ -12,6 +12,8 @@
 #include "../structures/timefrequencymetadata.h"
 #include "../structures/segmentedimage.h"
 
+#include "imagepyramid.h"
+
 class ImageWidget : public Gtk::DrawingArea {
 	public:
 		enum TFMap { BWMap, InvertedMap, HotColdMap, RedBlueMap, RedYellowBlueMap, FireMap, BlackRedMap, ViridisMap };
@@ -204,7 +206,7 @@ class ImageWidget : public Gtk::DrawingArea {
 		}
 
 	private:
-		void findMinMax(Image2DCPtr image, Mask2DCPtr mask, num_t &min, num_t &max);
+		void findMinMax(num_t &min, num_t &max);
 		void update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, unsigned height);
 		void redrawWithoutChanges(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, unsigned height);
 		void downsampleImageBuffer(unsigned newWidth, unsigned newHeight);
@@ -214,6 +216,7 @@ class ImageWidget : public Gtk::DrawingArea {
 		bool onLeave(GdkEventCrossing *event);
 		bool onButtonReleased(GdkEventButton *event);
 		class ColorMap *createColorMap();
+		void drawImage(unsigned char *data, size_t rowStride, Image2DCPtr image, Mask2DCPtr originalMask, Mask2DCPtr alternativeMask, size_t startX, size_t endX, size_t startY, size_t endY, num_t min, num_t max);
 		std::string actualTitleText() const
 		{
 			if(_manualTitle)
@@ -234,6 +237,20 @@ class ImageWidget : public Gtk::DrawingArea {
 		bool _highlighting;
 		class ThresholdConfig *_highlightConfig;
 		double _leftBorderSize, _rightBorderSize, _topBorderSize, _bottomBorderSize;
+		ImagePyramid _pyramid;
+
+		/**
+		 * Statistics of the full resolution image for the colour range, which are kept
+		 * until the image or the visible masks change.
+		 */
+		struct RangeStatistics
+		{
+			RangeStatistics() : hasMinMax(false), hasWinsorized(false) { }
+			Image2DCPtr image;
+			Mask2DCPtr originalMask, alternativeMask;
+			bool hasMinMax, hasWinsorized;
+			num_t min, max, mean, stddev;
+		} _rangeStatistics;
 
 		double _startHorizontal, _endHorizontal;
 		double _startVertical, _endVertical;
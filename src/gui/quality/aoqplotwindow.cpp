@@ -5,15 +5,11 @@
 #include <gtkmm/main.h>
 #include <gtkmm/messagedialog.h>
 
-#include "../../structures/measurementset.h"
+#include "../../structures/system.h"
 
-#include "../../quality/histogramtablesformatter.h"
 #include "../../quality/histogramcollection.h"
 #include "../../quality/statisticscollection.h"
 
-#include "../../remote/clusteredobservation.h"
-#include "../../remote/processcommander.h"
-
 #include "antennaeplotpage.h"
 #include "baselineplotpage.h"
 #include "blengthplotpage.h"
@@ -35,7 +31,8 @@ AOQPlotWindow::AOQPlotWindow() :
 	_summaryMI(_pageGroup, "Summary"),
 	_histogramMI(_pageGroup, "Histograms"),
 	
-	_isOpen(false)
+	_isOpen(false),
+	_loader(System::TotalMemory() / 8)
 {
 	set_default_icon_name("aoqplot");
 	
@@ -67,6 +64,7 @@ AOQPlotWindow::AOQPlotWindow() :
 	add(_vBox);
 	
 	_openOptionsWindow.SignalOpen().connect(sigc::mem_fun(*this, &AOQPlotWindow::onOpenOptionsSelected));
+	_loader.SignalPageAvailable().connect(sigc::mem_fun(*this, &AOQPlotWindow::onPageAvailable));
 	signal_hide().connect(sigc::mem_fun(*this, &AOQPlotWindow::onHide));
 }
 
@@ -89,35 +87,65 @@ void AOQPlotWindow::close()
 	if(_isOpen)
 	{
 		_activeSheet->CloseStatistics();
-		delete _statCollection;
-		delete _histCollection;
-		delete _fullStats;
+		_activeStatistics.reset();
+		_activeHistograms.reset();
+		_loader.Stop();
+		_antennas.clear();
 		_isOpen = false;
 	}
 }
 
-void AOQPlotWindow::readDistributedObservation(const std::string& filename, bool correctHistograms)
+void AOQPlotWindow::readStatistics(const std::vector<std::string>& files, bool downsampleTime, bool downsampleFreq, size_t timeSize, size_t freqSize, bool correctHistograms)
+{
+	close();
+	
+	if(!files.empty())
+	{
+		StatisticsLoader::Options options;
+		options.downsampleTime = downsampleTime;
+		options.downsampleFreq = downsampleFreq;
+		options.timeSize = timeSize;
+		options.freqSize = freqSize;
+		options.correctHistograms = correctHistograms;
+		// Only the summary pages are loaded now, in the background. The other
+		// pages are loaded when a sheet needs them.
+		_loader.Start(files, options);
+		setShowHistograms(false);
+		_isOpen = true;
+	}
+}
+
+StatisticsLoader::Page AOQPlotWindow::pageOfSheet(int sheetIndex)
+{
+	switch(sheetIndex)
+	{
+		case 3: return StatisticsLoader::TimePage;
+		case 4: return StatisticsLoader::FrequencyPage;
+		case 5: return StatisticsLoader::TimeFrequencyPage;
+		case 7: return StatisticsLoader::HistogramsPage;
+		default: return StatisticsLoader::BaselinePage;
+	}
+}
+
+void AOQPlotWindow::onPageAvailable()
 {
-	aoRemote::ClusteredObservation *observation = aoRemote::ClusteredObservation::Load(filename);
-	_statCollection = new StatisticsCollection();
-	_histCollection = new HistogramCollection();
-	aoRemote::ProcessCommander commander(*observation);
-	commander.PushReadAntennaTablesTask();
-	commander.PushReadQualityTablesTask(_statCollection, _histCollection, correctHistograms);
-	commander.Run();
-	if(!commander.Errors().empty())
+	if(!_isOpen)
+		return;
+	
+	const std::vector<std::string> warnings = _loader.TakeWarnings();
+	if(!warnings.empty())
 	{
 		std::stringstream s;
-		s << commander.Errors().size() << " error(s) occured while querying the nodes or measurement sets in the given observation. This might be caused by a failing node, an unreadable measurement set, or maybe the quality tables are not available. The errors reported are:\n\n";
+		s << warnings.size() << " error(s) occured while querying the nodes or measurement sets in the given observation. This might be caused by a failing node, an unreadable measurement set, or maybe the quality tables are not available. The errors reported are:\n\n";
 		size_t count = 0;
-		for(std::vector<std::string>::const_iterator i=commander.Errors().begin();i!=commander.Errors().end() && count < 30;++i)
+		for(std::vector<std::string>::const_iterator i=warnings.begin();i!=warnings.end() && count < 30;++i)
 		{
 			s << "- " << *i << '\n';
 			++count;
 		}
-		if(commander.Errors().size() > 30)
+		if(warnings.size() > 30)
 		{
-			s << "... and " << (commander.Errors().size()-30) << " more.\n";
+			s << "... and " << (warnings.size()-30) << " more.\n";
 		}
 		s << "\nThe program will continue, but this might mean that the statistics are incomplete. If this is the case, fix the issues and reopen the observation.";
 		std::cerr << s.str() << std::endl;
@@ -125,92 +153,60 @@ void AOQPlotWindow::readDistributedObservation(const std::string& filename, bool
 		dialog.run();
 	}
 	
-	_antennas = commander.Antennas();
-	
-	delete observation;
-}
-
-void AOQPlotWindow::readMetaInfoFromMS(const string& filename)
-{
-	MeasurementSet *ms = new MeasurementSet(filename);
-	_polarizationCount = ms->PolarizationCount();
-	unsigned antennaCount = ms->AntennaCount();
-	_antennas.clear();
-	for(unsigned a=0;a<antennaCount;++a)
-		_antennas.push_back(ms->GetAntennaInfo(a));
-	delete ms;
-}
-
-void AOQPlotWindow::readAndCombine(const string& filename)
-{
-	std::cout << "Adding " << filename << " to statistics...\n";
-	QualityTablesFormatter qualityTables(filename);
-	StatisticsCollection statCollection(_polarizationCount);
-	statCollection.Load(qualityTables);
-	_statCollection->Add(statCollection);
+	if(_loader.IsOpened())
+		setShowHistograms(_loader.HasHistograms());
 	
-	HistogramTablesFormatter histogramTables(filename);
-	if(histogramTables.HistogramsExist())
-	{
-		HistogramCollection histCollection(_polarizationCount);
-		histCollection.Load(histogramTables);
-		_histCollection->Add(histCollection);
-	}
+	updateActiveSheetStatistics();
 }
 
-void AOQPlotWindow::readStatistics(const std::vector<std::string>& files, bool downsampleTime, bool downsampleFreq, size_t timeSize, size_t freqSize, bool correctHistograms)
+void AOQPlotWindow::updateActiveSheetStatistics()
 {
-	close();
+	if(!_isOpen || _activeSheetIndex < 0 || _activeStatistics != 0 || _activeHistograms != 0)
+		return;
 	
-	if(!files.empty())
-	{
-		const std::string& firstFile = *files.begin();
-		if(aoRemote::ClusteredObservation::IsClusteredFilename(firstFile))
+	const StatisticsLoader::Page page = pageOfSheet(_activeSheetIndex);
+	try {
+		if(page == StatisticsLoader::HistogramsPage)
 		{
-			if(files.size() != 1)
-				throw std::runtime_error("You are trying to open multiple distributed or clustered sets. Can only open multiple files if they are not distributed.");
-			readDistributedObservation(firstFile, correctHistograms);
+			_activeHistograms = _loader.GetHistograms();
+			if(_activeHistograms != 0)
+				_activeSheet->SetHistograms(_activeHistograms.get());
 		}
 		else {
-			readMetaInfoFromMS(firstFile);
-			
-			_statCollection = new StatisticsCollection(_polarizationCount);
-			_histCollection = new HistogramCollection(_polarizationCount);
-			
-			for(size_t i=0; i!=files.size(); ++i)
+			_activeStatistics = _loader.GetStatistics(page);
+			if(_activeStatistics != 0)
 			{
-				std::cout << " (" << (i+1) << "/" << files.size() << ") ";
-				readAndCombine(files[i]);
+				_antennas = _loader.Antennas();
+				_activeSheet->SetStatistics(_activeStatistics.get(), _antennas);
 			}
 		}
-		setShowHistograms(!_histCollection->Empty());
-		if(downsampleTime)
-		{
-			std::cout << "Lowering time resolution..." << std::endl;
-			_statCollection->LowerTimeResolution(timeSize);
-		}
-
-		if(downsampleFreq)
-		{
-			std::cout << "Lowering frequency resolution..." << std::endl;
-			_statCollection->LowerFrequencyResolution(freqSize);
-		}
+	} catch(std::exception &e)
+	{
+		SetStatus(std::string("Could not load the statistics: ") + e.what());
+		return;
+	}
+	
+	if(_activeStatistics == 0 && _activeHistograms == 0)
+	{
+		_loader.Request(page);
+		SetStatus("Loading statistics...");
+	}
+	else {
+		setSheetStatus();
+	}
+}
 
-		std::cout << "Integrating baseline statistics to one channel..." << std::endl;
-		_statCollection->IntegrateBaselinesToOneChannel();
-		
-		std::cout << "Regridding time statistics..." << std::endl;
-		_statCollection->RegridTime();
-		
-		std::cout << "Copying statistics..." << std::endl;
-		_fullStats = new StatisticsCollection(*_statCollection);
-		
-		std::cout << "Integrating time statistics to one channel..." << std::endl;
-		_statCollection->IntegrateTimeToOneChannel();
-		
-		std::cout << "Opening statistics panel..." << std::endl;
-		_isOpen = true;
+boost::shared_ptr<const StatisticsCollection> AOQPlotWindow::waitForStatistics(StatisticsLoader::Page page)
+{
+	// The page might already have been removed from the cache again
+	// by another page when it is taken, in which case it is reloaded.
+	boost::shared_ptr<const StatisticsCollection> statistics;
+	while(statistics == 0)
+	{
+		_loader.Wait(page);
+		statistics = _loader.GetStatistics(page);
 	}
+	return statistics;
 }
 
 void AOQPlotWindow::onStatusChange(const std::string &newStatus)
@@ -221,37 +217,46 @@ void AOQPlotWindow::onStatusChange(const std::string &newStatus)
 
 void AOQPlotWindow::Save(const AOQPlotWindow::PlotSavingData& data)
 {
+	if(!_isOpen)
+		return;
+	
 	const std::string& prefix = data.filenamePrefix;
 	QualityTablesFormatter::StatisticKind kind = data.statisticKind;
 	
+	boost::shared_ptr<const StatisticsCollection> baselineStatistics = waitForStatistics(StatisticsLoader::BaselinePage);
+	_antennas = _loader.Antennas();
+	
 	std::cout << "Saving " << prefix << "-antennas.pdf...\n";
 	AntennaePlotPage antPage;
-	antPage.SetStatistics(_statCollection, _antennas);
+	antPage.SetStatistics(baselineStatistics.get(), _antennas);
 	antPage.SavePdf(prefix+"-antennas.pdf", kind);
 	
 	std::cout << "Saving " << prefix << "-baselines.pdf...\n";
 	BaselinePlotPage baselPage;
-	baselPage.SetStatistics(_statCollection, _antennas);
+	baselPage.SetStatistics(baselineStatistics.get(), _antennas);
 	baselPage.SavePdf(prefix+"-baselines.pdf", kind);
 	
 	std::cout << "Saving " << prefix << "-baselinelengths.pdf...\n";
 	BLengthPlotPage blenPage;
-	blenPage.SetStatistics(_statCollection, _antennas);
+	blenPage.SetStatistics(baselineStatistics.get(), _antennas);
 	blenPage.SavePdf(prefix+"-baselinelengths.pdf", kind);
 	
 	std::cout << "Saving " << prefix << "-timefrequency.pdf...\n";
 	TimeFrequencyPlotPage tfPage;
-	tfPage.SetStatistics(_fullStats, _antennas);
+	boost::shared_ptr<const StatisticsCollection> timeFrequencyStatistics = waitForStatistics(StatisticsLoader::TimeFrequencyPage);
+	tfPage.SetStatistics(timeFrequencyStatistics.get(), _antennas);
 	tfPage.SavePdf(prefix+"-timefrequency.pdf", kind);
 	
 	std::cout << "Saving " << prefix << "-time.pdf...\n";
 	TimePlotPage timePage;
-	timePage.SetStatistics(_statCollection, _antennas);
+	boost::shared_ptr<const StatisticsCollection> timeStatistics = waitForStatistics(StatisticsLoader::TimePage);
+	timePage.SetStatistics(timeStatistics.get(), _antennas);
 	timePage.SavePdf(prefix+"-time.pdf", kind);
 	
 	std::cout << "Saving " << prefix << "-frequency.pdf...\n";
 	FrequencyPlotPage freqPage;
-	freqPage.SetStatistics(_statCollection, _antennas);
+	boost::shared_ptr<const StatisticsCollection> frequencyStatistics = waitForStatistics(StatisticsLoader::FrequencyPage);
+	freqPage.SetStatistics(frequencyStatistics.get(), _antennas);
 	freqPage.SavePdf(prefix+"-frequency.pdf", kind);
 }
 
@@ -288,28 +293,30 @@ void AOQPlotWindow::onChangeSheet()
 			case 6: _activeSheet.reset(new SummaryPage()); break;
 			case 7: _activeSheet.reset(new HistogramPage()); break;
 		}
-		switch(selectedSheet)
-		{
-			case 0: SetStatus("Baseline statistics"); break;
-			case 1: SetStatus("Antennae statistics"); break;
-			case 2: SetStatus("Baseline length statistics");  break;
-			case 3: SetStatus("Time statistics"); break;
-			case 4: SetStatus("Frequency statistics"); break;
-			case 5: SetStatus("Time-frequency statistics");  break;
-			case 6: SetStatus("Summary"); break;
-			case 7: SetStatus("Histograms"); break;
-		}
-		
 		_activeSheetIndex = selectedSheet;
-		if(selectedSheet == 5)
-			_activeSheet->SetStatistics(_fullStats, _antennas);
-		else
-			_activeSheet->SetStatistics(_statCollection, _antennas);
-		_activeSheet->SetHistograms(_histCollection);
+		_activeStatistics.reset();
+		_activeHistograms.reset();
+		setSheetStatus();
 		_activeSheet->SignalStatusChange().connect(sigc::mem_fun(*this, &AOQPlotWindow::onStatusChange));
 		_activeSheet->InitializeToolbar(_toolbar);
 		_toolbar.show_all();
 		_vBox.pack_start(*_activeSheet);
 		_activeSheet->show_all();
+		updateActiveSheetStatistics();
+	}
+}
+
+void AOQPlotWindow::setSheetStatus()
+{
+	switch(_activeSheetIndex)
+	{
+		case 0: SetStatus("Baseline statistics"); break;
+		case 1: SetStatus("Antennae statistics"); break;
+		case 2: SetStatus("Baseline length statistics");  break;
+		case 3: SetStatus("Time statistics"); break;
+		case 4: SetStatus("Frequency statistics"); break;
+		case 5: SetStatus("Time-frequency statistics");  break;
+		case 6: SetStatus("Summary"); break;
+		case 7: SetStatus("Histograms"); break;
 	}
 }
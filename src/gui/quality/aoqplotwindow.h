@@ -18,6 +18,7 @@
 
 #include "plotsheet.h"
 #include "openoptionswindow.h"
+#include "statisticsloader.h"
 
 #include "../../structures/antennainfo.h"
 
@@ -54,9 +55,10 @@ class AOQPlotWindow : public Gtk::Window {
 		void onOpenOptionsSelected(const std::vector<std::string>& files, bool downsampleTime, bool downsampleFreq, size_t timeSize, size_t freqSize, bool correctHistograms);
 		void close();
 		void readStatistics(const std::vector<std::string>& files, bool downsampleTime, bool downsampleFreq, size_t timeSize, size_t freqSize, bool correctHistograms);
-		void readDistributedObservation(const std::string& filename, bool correctHistograms);
-		void readMetaInfoFromMS(const std::string& filename);
-		void readAndCombine(const std::string& filename);
+		static StatisticsLoader::Page pageOfSheet(int sheetIndex);
+		void onPageAvailable();
+		void updateActiveSheetStatistics();
+		boost::shared_ptr<const class StatisticsCollection> waitForStatistics(StatisticsLoader::Page page);
 		
 		void onHide()
 		{
@@ -65,6 +67,7 @@ class AOQPlotWindow : public Gtk::Window {
 		void onStatusChange(const std::string &newStatus);
 		
 		void onChangeSheet();
+		void setSheetStatus();
 		
 		void setShowHistograms(bool show)
 		{
@@ -86,11 +89,10 @@ class AOQPlotWindow : public Gtk::Window {
 		OpenOptionsWindow _openOptionsWindow;
 
 		bool _isOpen;
-		class StatisticsCollection *_statCollection;
-		class HistogramCollection *_histCollection;
-		class StatisticsCollection *_fullStats;
+		StatisticsLoader _loader;
+		boost::shared_ptr<const class StatisticsCollection> _activeStatistics;
+		boost::shared_ptr<const class HistogramCollection> _activeHistograms;
 		std::vector<class AntennaInfo> _antennas;
-		size_t _polarizationCount;
 };
 
 #endif
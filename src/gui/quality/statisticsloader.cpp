@@ -0,0 +1,484 @@
+#include "statisticsloader.h"
+
+#include <memory>
+#include <stdexcept>
+
+#include "../../structures/measurementset.h"
+
+#include "../../quality/histogramcollection.h"
+#include "../../quality/histogramtablesformatter.h"
+#include "../../quality/statisticscollection.h"
+
+#include "../../remote/clusteredobservation.h"
+#include "../../remote/processcommander.h"
+
+StatisticsLoader::StatisticsLoader(size_t maxCacheSize) :
+	_maxCacheSize(maxCacheSize),
+	_thread(0),
+	_isClustered(false),
+	_polarizationCount(0),
+	_stop(false),
+	_isOpened(false),
+	_hasHistograms(false)
+{
+}
+
+StatisticsLoader::~StatisticsLoader()
+{
+	Stop();
+}
+
+void StatisticsLoader::Start(const std::vector<std::string> &files, const Options &options)
+{
+	Stop();
+	if(files.empty())
+		throw std::runtime_error("No files given to load statistics from");
+	_isClustered = aoRemote::ClusteredObservation::IsClusteredFilename(files.front());
+	if(_isClustered && files.size() != 1)
+		throw std::runtime_error("You are trying to open multiple distributed or clustered sets. Can only open multiple files if they are not distributed.");
+	_files = files;
+	_options = options;
+	_stop = false;
+	// The summary pages are small and needed by most plots, so they are loaded right away.
+	_queue.push_back(BaselinePage);
+	_queue.push_back(TimePage);
+	_queue.push_back(FrequencyPage);
+	_thread = new boost::thread(LoaderFunction(*this));
+}
+
+void StatisticsLoader::Stop()
+{
+	if(_thread != 0)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_stop = true;
+		_change.notify_all();
+		lock.unlock();
+		_thread->join();
+		delete _thread;
+		_thread = 0;
+	}
+	boost::mutex::scoped_lock lock(_mutex);
+	_isOpened = false;
+	_openError.clear();
+	_antennas.clear();
+	_hasHistograms = false;
+	_warnings.clear();
+	_queue.clear();
+	_cache.clear();
+	_errors.clear();
+	_files.clear();
+}
+
+void StatisticsLoader::Request(Page page)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	// Forget an earlier error, so that the page is tried again
+	for(std::vector<std::pair<Page, std::string> >::iterator i=_errors.begin(); i!=_errors.end(); ++i)
+	{
+		if(i->first == page)
+		{
+			_errors.erase(i);
+			break;
+		}
+	}
+	for(std::deque<Page>::iterator i=_queue.begin(); i!=_queue.end(); ++i)
+	{
+		if(*i == page)
+		{
+			_queue.erase(i);
+			break;
+		}
+	}
+	_queue.push_front(page);
+	_change.notify_all();
+}
+
+void StatisticsLoader::Wait(Page page)
+{
+	Request(page);
+	boost::mutex::scoped_lock lock(_mutex);
+	while(!_stop && _thread != 0 && !isLoaded(page))
+		_change.wait(lock);
+}
+
+boost::shared_ptr<const StatisticsCollection> StatisticsLoader::GetStatistics(Page page)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	for(std::vector<std::pair<Page, std::string> >::const_iterator i=_errors.begin(); i!=_errors.end(); ++i)
+	{
+		if(i->first == page)
+			throw std::runtime_error(i->second);
+	}
+	CacheItem *item = findInCache(page);
+	if(item == 0)
+		return boost::shared_ptr<const StatisticsCollection>();
+	else
+		return item->statistics;
+}
+
+boost::shared_ptr<const HistogramCollection> StatisticsLoader::GetHistograms()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	for(std::vector<std::pair<Page, std::string> >::const_iterator i=_errors.begin(); i!=_errors.end(); ++i)
+	{
+		if(i->first == HistogramsPage)
+			throw std::runtime_error(i->second);
+	}
+	CacheItem *item = findInCache(HistogramsPage);
+	if(item == 0)
+		return boost::shared_ptr<const HistogramCollection>();
+	else
+		return item->histograms;
+}
+
+bool StatisticsLoader::IsOpened()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _isOpened;
+}
+
+std::vector<AntennaInfo> StatisticsLoader::Antennas()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _antennas;
+}
+
+bool StatisticsLoader::HasHistograms()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _hasHistograms;
+}
+
+std::vector<std::string> StatisticsLoader::TakeWarnings()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	std::vector<std::string> warnings;
+	warnings.swap(_warnings);
+	return warnings;
+}
+
+void StatisticsLoader::LoaderFunction::operator()()
+{
+	StatisticsLoader &l = _loader;
+	std::string error;
+	try {
+		l.open();
+	} catch(std::exception &e)
+	{
+		error = e.what();
+	}
+	boost::mutex::scoped_lock lock(l._mutex);
+	l._openError = error;
+	l._isOpened = true;
+	l._change.notify_all();
+	l._pageAvailable();
+
+	while(!l._stop)
+	{
+		if(!l._queue.empty())
+		{
+			const Page page = l._queue.front();
+			l._queue.pop_front();
+			if(!l.isLoaded(page))
+			{
+				error = l._openError;
+				if(error.empty())
+				{
+					lock.unlock();
+					try {
+						l.load(page);
+					} catch(std::exception &e)
+					{
+						error = e.what();
+					}
+					lock.lock();
+				}
+				if(!error.empty())
+					l._errors.push_back(std::make_pair(page, error));
+				l._change.notify_all();
+				l._pageAvailable();
+			}
+		}
+		else {
+			l._change.wait(lock);
+		}
+	}
+}
+
+void StatisticsLoader::open()
+{
+	if(_isClustered)
+	{
+		std::vector<Page> pages;
+		pages.push_back(BaselinePage);
+		pages.push_back(TimePage);
+		pages.push_back(FrequencyPage);
+		pages.push_back(TimeFrequencyPage);
+		pages.push_back(HistogramsPage);
+		loadFromClusteredObservation(pages);
+	}
+	else {
+		MeasurementSet ms(_files.front());
+		_polarizationCount = ms.PolarizationCount();
+		const unsigned antennaCount = ms.AntennaCount();
+		std::vector<AntennaInfo> antennas;
+		for(unsigned a=0;a<antennaCount;++a)
+			antennas.push_back(ms.GetAntennaInfo(a));
+
+		bool hasHistograms = false;
+		for(std::vector<std::string>::const_iterator i=_files.begin(); i!=_files.end() && !hasHistograms; ++i)
+		{
+			HistogramTablesFormatter histogramTables(*i);
+			hasHistograms = histogramTables.HistogramsExist();
+		}
+
+		boost::mutex::scoped_lock lock(_mutex);
+		_antennas = antennas;
+		_hasHistograms = hasHistograms;
+	}
+}
+
+void StatisticsLoader::load(Page page)
+{
+	if(_isClustered)
+		loadFromClusteredObservation(std::vector<Page>(1, page));
+	else
+		loadFromMeasurementSets(page);
+}
+
+void StatisticsLoader::loadFromMeasurementSets(Page page)
+{
+	CacheItem item;
+	item.page = page;
+	if(page == HistogramsPage)
+	{
+		HistogramCollection *histograms = new HistogramCollection(_polarizationCount);
+		item.histograms.reset(histograms);
+		for(size_t i=0; i!=_files.size(); ++i)
+		{
+			if(isStopping()) return;
+			HistogramTablesFormatter histogramTables(_files[i]);
+			if(histogramTables.HistogramsExist())
+			{
+				HistogramCollection part(_polarizationCount);
+				part.Load(histogramTables);
+				histograms->Add(part);
+			}
+		}
+		item.size = estimateSize(*histograms);
+	}
+	else {
+		StatisticsCollection *statistics = new StatisticsCollection(_polarizationCount);
+		item.statistics.reset(statistics);
+		for(size_t i=0; i!=_files.size(); ++i)
+		{
+			if(isStopping()) return;
+			// Only the table of the page is read
+			QualityTablesFormatter qualityTables(_files[i]);
+			StatisticsCollection part(_polarizationCount);
+			switch(page)
+			{
+				case BaselinePage:
+					part.LoadBaselineStatisticsOnly(qualityTables);
+					break;
+				case FrequencyPage:
+					part.LoadFrequencyStatisticsOnly(qualityTables);
+					break;
+				default:
+					part.LoadTimeStatisticsOnly(qualityTables);
+					break;
+			}
+			addToPage(page, *statistics, part);
+		}
+		finishPage(page, *statistics);
+		item.size = estimateSize(page, *statistics);
+	}
+	boost::mutex::scoped_lock lock(_mutex);
+	addToCache(item);
+}
+
+void StatisticsLoader::loadFromClusteredObservation(const std::vector<Page> &pages)
+{
+	StatisticsCollection statistics;
+	boost::shared_ptr<HistogramCollection> histograms(new HistogramCollection());
+	readClusteredObservation(statistics, *histograms);
+	_polarizationCount = statistics.PolarizationCount();
+
+	std::vector<CacheItem> items;
+	for(std::vector<Page>::const_iterator page=pages.begin(); page!=pages.end(); ++page)
+	{
+		CacheItem item;
+		item.page = *page;
+		if(*page == HistogramsPage)
+		{
+			item.histograms = histograms;
+			item.size = estimateSize(*histograms);
+		}
+		else {
+			StatisticsCollection *pageStatistics = new StatisticsCollection(_polarizationCount);
+			item.statistics.reset(pageStatistics);
+			addToPage(*page, *pageStatistics, statistics);
+			finishPage(*page, *pageStatistics);
+			item.size = estimateSize(*page, *pageStatistics);
+		}
+		items.push_back(item);
+	}
+
+	boost::mutex::scoped_lock lock(_mutex);
+	_hasHistograms = !histograms->Empty();
+	for(std::vector<CacheItem>::const_iterator item=items.begin(); item!=items.end(); ++item)
+		addToCache(*item);
+}
+
+void StatisticsLoader::readClusteredObservation(StatisticsCollection &statistics, HistogramCollection &histograms)
+{
+	std::unique_ptr<aoRemote::ClusteredObservation> observation(aoRemote::ClusteredObservation::Load(_files.front()));
+	aoRemote::ProcessCommander commander(*observation);
+	commander.PushReadAntennaTablesTask();
+	commander.PushReadQualityTablesTask(&statistics, &histograms, _options.correctHistograms);
+	commander.Run();
+
+	boost::mutex::scoped_lock lock(_mutex);
+	_antennas = commander.Antennas();
+	_warnings.insert(_warnings.end(), commander.Errors().begin(), commander.Errors().end());
+}
+
+void StatisticsLoader::addToPage(Page page, StatisticsCollection &pageStatistics, const StatisticsCollection &part) const
+{
+	switch(page)
+	{
+		case BaselinePage:
+			pageStatistics.AddBaselineStatistics(part);
+			pageStatistics.IntegrateBaselinesToOneChannel();
+			break;
+		case TimePage:
+		case TimeFrequencyPage:
+			pageStatistics.AddTimeStatistics(part);
+			break;
+		case FrequencyPage:
+			pageStatistics.AddFrequencyStatistics(part);
+			break;
+		case HistogramsPage:
+			break;
+	}
+}
+
+/**
+ * The time resolution is lowered once for all sets together, such that the time steps of
+ * the page do not depend on how the observation is divided over sets.
+ */
+void StatisticsLoader::finishPage(Page page, StatisticsCollection &pageStatistics) const
+{
+	if(page == TimePage || page == TimeFrequencyPage)
+	{
+		if(_options.downsampleTime)
+			pageStatistics.LowerTimeResolution(_options.timeSize);
+		pageStatistics.RegridTime();
+		if(page == TimePage)
+			pageStatistics.IntegrateTimeToOneChannel();
+	}
+	else if(page == FrequencyPage && _options.downsampleFreq)
+		pageStatistics.LowerFrequencyResolution(_options.freqSize);
+}
+
+void StatisticsLoader::addToCache(const CacheItem &item)
+{
+	for(std::deque<CacheItem>::iterator i=_cache.begin(); i!=_cache.end(); ++i)
+	{
+		if(i->page == item.page)
+		{
+			_cache.erase(i);
+			break;
+		}
+	}
+	_cache.push_back(item);
+	size_t totalSize = 0;
+	for(std::deque<CacheItem>::const_iterator i=_cache.begin(); i!=_cache.end(); ++i)
+		totalSize += i->size;
+	// The new page is always kept, even when it is larger than the cache
+	while(totalSize > _maxCacheSize && _cache.size() > 1)
+	{
+		totalSize -= _cache.front().size;
+		_cache.pop_front();
+	}
+}
+
+StatisticsLoader::CacheItem *StatisticsLoader::findInCache(Page page)
+{
+	for(std::deque<CacheItem>::iterator i=_cache.begin(); i!=_cache.end(); ++i)
+	{
+		if(i->page == page)
+		{
+			// Move the item to the back, so that it is removed last
+			CacheItem item = *i;
+			_cache.erase(i);
+			_cache.push_back(item);
+			return &_cache.back();
+		}
+	}
+	return 0;
+}
+
+bool StatisticsLoader::isLoaded(Page page)
+{
+	for(std::vector<std::pair<Page, std::string> >::const_iterator i=_errors.begin(); i!=_errors.end(); ++i)
+	{
+		if(i->first == page)
+			return true;
+	}
+	for(std::deque<CacheItem>::const_iterator i=_cache.begin(); i!=_cache.end(); ++i)
+	{
+		if(i->page == page)
+			return true;
+	}
+	return false;
+}
+
+bool StatisticsLoader::isStopping()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _stop;
+}
+
+size_t StatisticsLoader::estimateSize(Page page, const StatisticsCollection &statistics)
+{
+	size_t count = 0;
+	switch(page)
+	{
+		case BaselinePage:
+			count = statistics.BaselineStatistics().BaselineList().size();
+			break;
+		case FrequencyPage:
+			count = statistics.FrequencyStatistics().size();
+			break;
+		default:
+			for(std::map<double, std::map<double, DefaultStatistics> >::const_iterator i=statistics.AllTimeStatistics().begin(); i!=statistics.AllTimeStatistics().end(); ++i)
+				count += i->second.size();
+			break;
+	}
+	// A statistic consists of three counts and four complex sums per polarization, and is
+	// stored in a map node
+	const size_t statisticSize = sizeof(DefaultStatistics) + 4*sizeof(void*) + sizeof(double) +
+		statistics.PolarizationCount() * (3*sizeof(unsigned long) + 4*sizeof(std::complex<long double>));
+	return count * statisticSize;
+}
+
+size_t StatisticsLoader::estimateSize(const HistogramCollection &histograms)
+{
+	size_t binCount = 0;
+	for(unsigned p=0; p!=histograms.PolarizationCount(); ++p)
+	{
+		const std::map<HistogramCollection::AntennaPair, LogHistogram*> *maps[2] = { &histograms.GetTotalHistogram(p), &histograms.GetRFIHistogram(p) };
+		for(size_t m=0; m!=2; ++m)
+		{
+			for(std::map<HistogramCollection::AntennaPair, LogHistogram*>::const_iterator i=maps[m]->begin(); i!=maps[m]->end(); ++i)
+			{
+				for(LogHistogram::const_iterator bin=i->second->begin(); bin!=i->second->end(); ++bin)
+					++binCount;
+			}
+		}
+	}
+	// Each bin is a map node with an amplitude and a count
+	return binCount * (4*sizeof(void*) + sizeof(double) + sizeof(unsigned long));
+}
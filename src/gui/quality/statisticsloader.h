@@ -0,0 +1,168 @@
+#ifndef GUI_QUALITY__STATISTICS_LOADER_H
+#define GUI_QUALITY__STATISTICS_LOADER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <glibmm/dispatcher.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "../../structures/antennainfo.h"
+
+class StatisticsCollection;
+class HistogramCollection;
+
+/**
+ * Loads the quality statistics of an observation in a background thread, one page at a time.
+ * A page holds only what a group of plots needs: the baseline statistics integrated over the
+ * bands, the time statistics integrated over the bands, the frequency statistics, the time
+ * statistics per band for the time-frequency plot, or the histograms. A page is built file
+ * by file from only the table that it needs, so that the statistics of the other pages never
+ * need to be in memory. The resolution of a page is lowered once all files are added, so
+ * that the result does not depend on how the observation is divided over files.
+ *
+ * After opening, the small summary pages (baselines, time and frequency) are loaded. The
+ * time-frequency page and the histograms are only loaded when requested. Loaded pages are
+ * kept in a cache that is limited in size; the least recently used pages are removed first.
+ *
+ * A clustered observation can only be read completely, so all pages are built from one read
+ * of the full statistics.
+ */
+class StatisticsLoader
+{
+	public:
+		enum Page
+		{
+			BaselinePage,
+			TimePage,
+			FrequencyPage,
+			TimeFrequencyPage,
+			HistogramsPage
+		};
+
+		struct Options
+		{
+			bool downsampleTime, downsampleFreq;
+			size_t timeSize, freqSize;
+			bool correctHistograms;
+		};
+
+		/**
+		 * @param maxCacheSize Estimated number of bytes that the cached pages may take.
+		 */
+		explicit StatisticsLoader(size_t maxCacheSize);
+		~StatisticsLoader();
+
+		/**
+		 * Starts loading the statistics of @p files, which is either a list of measurement sets
+		 * or a single clustered observation.
+		 */
+		void Start(const std::vector<std::string> &files, const Options &options);
+
+		/**
+		 * Waits for the thread to finish and forgets the observation and all pages.
+		 */
+		void Stop();
+
+		/**
+		 * Asks to load a page before any other page that is not loaded yet. SignalPageAvailable()
+		 * is emitted in the gui thread when it is loaded.
+		 */
+		void Request(Page page);
+
+		/**
+		 * Blocks until a page is loaded, e.g. to save plots without the gui.
+		 */
+		void Wait(Page page);
+
+		/**
+		 * Returns a loaded page, or an empty pointer if it is not loaded (anymore). The page stays
+		 * valid as long as the pointer is kept, also when it is removed from the cache.
+		 * @throws std::runtime_error if loading the page failed.
+		 */
+		boost::shared_ptr<const StatisticsCollection> GetStatistics(Page page);
+
+		/**
+		 * Like GetStatistics(), for the histograms page.
+		 */
+		boost::shared_ptr<const HistogramCollection> GetHistograms();
+
+		/**
+		 * Whether the antennas and the availability of histograms are known, which is
+		 * the case before the first page becomes available.
+		 */
+		bool IsOpened();
+
+		std::vector<AntennaInfo> Antennas();
+
+		bool HasHistograms();
+
+		/**
+		 * Returns the problems that did not stop the loading, e.g. nodes of a clustered
+		 * observation that could not be read, that were not returned before.
+		 */
+		std::vector<std::string> TakeWarnings();
+
+		Glib::Dispatcher &SignalPageAvailable() { return _pageAvailable; }
+	private:
+		struct CacheItem
+		{
+			Page page;
+			boost::shared_ptr<const StatisticsCollection> statistics;
+			boost::shared_ptr<const HistogramCollection> histograms;
+			size_t size;
+		};
+
+		struct LoaderFunction
+		{
+			LoaderFunction(StatisticsLoader &loader) : _loader(loader) { }
+			void operator()();
+			StatisticsLoader &_loader;
+		};
+
+		void open();
+		void load(Page page);
+		void loadFromMeasurementSets(Page page);
+		void loadFromClusteredObservation(const std::vector<Page> &pages);
+		void readClusteredObservation(StatisticsCollection &statistics, HistogramCollection &histograms);
+		void addToPage(Page page, StatisticsCollection &pageStatistics, const StatisticsCollection &part) const;
+		void finishPage(Page page, StatisticsCollection &pageStatistics) const;
+		void addToCache(const CacheItem &item);
+		CacheItem *findInCache(Page page);
+		bool isLoaded(Page page);
+		bool isStopping();
+		static size_t estimateSize(Page page, const StatisticsCollection &statistics);
+		static size_t estimateSize(const HistogramCollection &histograms);
+
+		const size_t _maxCacheSize;
+		boost::thread *_thread;
+		Glib::Dispatcher _pageAvailable;
+
+		// Only changed while the thread is not running
+		std::vector<std::string> _files;
+		Options _options;
+		bool _isClustered;
+
+		// Only used by the thread
+		unsigned _polarizationCount;
+
+		// The members below are protected by _mutex
+		boost::mutex _mutex;
+		boost::condition _change;
+		bool _stop;
+		bool _isOpened;
+		std::string _openError;
+		std::vector<AntennaInfo> _antennas;
+		bool _hasHistograms;
+		std::vector<std::string> _warnings;
+		std::deque<Page> _queue;
+		std::deque<CacheItem> _cache;
+		std::vector<std::pair<Page, std::string> > _errors;
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include "../structures/timefrequencymetadata.h"
 #include "../structures/segmentedimage.h"
 #include "../structures/spatialmatrixmetadata.h"
+#include "../structures/system.h"
 
 #include "../strategy/actions/strategy.h"
 
@@ -70,6 +71,7 @@ RFIGuiWindow::RFIGuiWindow() :
 	_imageSet(0),
 	_imageSetIndex(0),
 	_gaussianTestSets(true),
+	_prefetcher(_ioMutex),
 	_spatialMetaData(0),
 	_plotWindow(new PlotWindow(_controller->PlotManager()))
 {
@@ -104,10 +106,14 @@ RFIGuiWindow::RFIGuiWindow() :
 	
 	_controller->SignalStateChange().connect(
 		sigc::mem_fun(*this, &RFIGuiWindow::onControllerStateChange));
+	_prefetcher.SignalRequestAvailable().connect(
+		sigc::mem_fun(*this, &RFIGuiWindow::onBaselineLoaded));
 }
 
 RFIGuiWindow::~RFIGuiWindow()
 {
+	// The reader thread uses the io mutex and the image set
+	_prefetcher.Stop();
 	boost::mutex::scoped_lock lock(_ioMutex);
 	while(!_actionGroup->get_actions().empty())
 		_actionGroup->remove(*_actionGroup->get_actions().begin());
@@ -261,49 +267,27 @@ void RFIGuiWindow::onToggleFlags()
 	_controller->SetShowAlternativeFlags(_altFlagsButton->get_active());
 }
 
-void RFIGuiWindow::loadCurrentTFData()
+void RFIGuiWindow::loadCurrentTFData(bool waitForData)
+{
+	if(_imageSet != 0) {
+		// The baseline is read in the background; onBaselineLoaded() shows it
+		_prefetcher.Request(*_imageSetIndex);
+		_statusbar.pop();
+		_statusbar.push("Loading baseline...");
+		if(waitForData)
+		{
+			// onBaselineLoaded() will find nothing to take when it is called later
+			_prefetcher.WaitForRequested();
+			showRequestedBaseline();
+		}
+	}
+}
+
+void RFIGuiWindow::onBaselineLoaded()
 {
 	if(_imageSet != 0) {
 		try {
-			boost::mutex::scoped_lock lock(_ioMutex);
-			_imageSet->AddReadRequest(*_imageSetIndex);
-			_imageSet->PerformReadRequests();
-			rfiStrategy::BaselineData *baseline = _imageSet->GetNextRequested();
-			lock.unlock();
-			
-			_timeFrequencyWidget.SetNewData(baseline->Data(), baseline->MetaData());
-			delete baseline;
-			if(_spatialMetaData != 0)
-			{
-				delete _spatialMetaData;
-				_spatialMetaData = 0;
-			}
-			if(dynamic_cast<rfiStrategy::SpatialMSImageSet*>(_imageSet) != 0)
-			{
-				_spatialMetaData = new SpatialMatrixMetaData(static_cast<rfiStrategy::SpatialMSImageSet*>(_imageSet)->SpatialMetaData(*_imageSetIndex));
-			}
-			// Disable forward/back buttons when only one baseline is available
-			rfiStrategy::ImageSetIndex* firstIndex = _imageSet->StartIndex();
-			firstIndex->Next();
-			bool multipleBaselines = firstIndex->IsValid();
-			delete firstIndex;
-			_previousButton->set_sensitive(multipleBaselines);
-			_reloadButton->set_sensitive(true);
-			_nextButton->set_sensitive(multipleBaselines);
-			
-			// We store these seperate, as they might access the measurement set. This is
-			// not only faster (the names are used in the onMouse.. events) but also less dangerous,
-			// since the set can be simultaneously accessed by another thread. (thus the io mutex should
-			// be locked before calling below statements).
-			lock.lock();
-			_imageSetName = _imageSet->Name();
-			_imageSetIndexDescription = _imageSetIndex->Description();
-			lock.unlock();
-			
-			_timeFrequencyWidget.SetTitleText(_imageSetIndexDescription);
-			_timeFrequencyWidget.Update();
-			
-			setSetNameInStatusBar();
+			showRequestedBaseline();
 		} catch(std::exception &e)
 		{
 			AOLogger::Error << e.what() << '\n';
@@ -312,6 +296,47 @@ void RFIGuiWindow::loadCurrentTFData()
 	}
 }
 
+void RFIGuiWindow::showRequestedBaseline()
+{
+	rfiStrategy::BaselineData *baseline = _prefetcher.TakeRequested();
+	if(baseline == 0)
+		return;
+	
+	_timeFrequencyWidget.SetNewData(baseline->Data(), baseline->MetaData());
+	delete baseline;
+	if(_spatialMetaData != 0)
+	{
+		delete _spatialMetaData;
+		_spatialMetaData = 0;
+	}
+	if(dynamic_cast<rfiStrategy::SpatialMSImageSet*>(_imageSet) != 0)
+	{
+		_spatialMetaData = new SpatialMatrixMetaData(static_cast<rfiStrategy::SpatialMSImageSet*>(_imageSet)->SpatialMetaData(*_imageSetIndex));
+	}
+	// Disable forward/back buttons when only one baseline is available
+	rfiStrategy::ImageSetIndex* firstIndex = _imageSet->StartIndex();
+	firstIndex->Next();
+	bool multipleBaselines = firstIndex->IsValid();
+	delete firstIndex;
+	_previousButton->set_sensitive(multipleBaselines);
+	_reloadButton->set_sensitive(true);
+	_nextButton->set_sensitive(multipleBaselines);
+	
+	// We store these seperate, as they might access the measurement set. This is
+	// not only faster (the names are used in the onMouse.. events) but also less dangerous,
+	// since the set can be simultaneously accessed by another thread. (thus the io mutex should
+	// be locked before calling below statements).
+	boost::mutex::scoped_lock lock(_ioMutex);
+	_imageSetName = _imageSet->Name();
+	_imageSetIndexDescription = _imageSetIndex->Description();
+	lock.unlock();
+	
+	_timeFrequencyWidget.SetTitleText(_imageSetIndexDescription);
+	_timeFrequencyWidget.Update();
+	
+	setSetNameInStatusBar();
+}
+
 void RFIGuiWindow::setSetNameInStatusBar()
 {
   if(HasImageSet()) {
@@ -357,6 +382,8 @@ void RFIGuiWindow::onExecuteStrategyPressed()
 	_progressWindow->show();
 
 	rfiStrategy::ArtifactSet artifacts(&_ioMutex);
+	// Only the shown baseline is flagged, so actions can use all cores for it
+	artifacts.SetThreadCount(System::ProcessorCount());
 
 	artifacts.SetAntennaFlagCountPlot(new AntennaFlagCountPlot());
 	artifacts.SetFrequencyFlagCountPlot(new FrequencyFlagCountPlot());
@@ -396,6 +423,8 @@ void RFIGuiWindow::onExecuteStrategyPressed()
 void RFIGuiWindow::onExecuteStrategyFinished()
 {
 	rfiStrategy::ArtifactSet *artifacts = _strategy->JoinThread();
+	// The strategy might have written flags to the set
+	_prefetcher.ClearCache();
 	if(artifacts != 0)
 	{
 		bool update = false;
@@ -460,12 +489,14 @@ void RFIGuiWindow::onToggleImage()
 
 void RFIGuiWindow::SetImageSet(rfiStrategy::ImageSet *newImageSet, bool loadBaseline)
 {
+	_prefetcher.Stop();
 	if(_imageSet != 0) {
 		delete _imageSet;
 		delete _imageSetIndex;
 	}
 	_imageSet = newImageSet;
 	_imageSetIndex = _imageSet->StartIndex();
+	_prefetcher.Start(*_imageSet);
 	
 	if(loadBaseline)
 	{
@@ -478,14 +509,14 @@ void RFIGuiWindow::SetImageSet(rfiStrategy::ImageSet *newImageSet, bool loadBase
 	}
 }
 
-void RFIGuiWindow::SetImageSetIndex(rfiStrategy::ImageSetIndex *newImageSetIndex)
+void RFIGuiWindow::SetImageSetIndex(rfiStrategy::ImageSetIndex *newImageSetIndex, bool waitForData)
 {
 	if(HasImageSet())
 	{
 		delete _imageSetIndex;
 		_imageSetIndex = newImageSetIndex;
 		_imageSetIndexDescription = _imageSetIndex->Description();
-		loadCurrentTFData();
+		loadCurrentTFData(waitForData);
 	} else {
 		delete newImageSetIndex;
 	}
@@ -1428,6 +1459,7 @@ void RFIGuiWindow::onReloadPressed()
 {
 	if(HasImageSet())
 	{
+		_prefetcher.ClearCache();
 		loadCurrentTFData();
 	}
 }
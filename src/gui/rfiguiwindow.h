@@ -22,6 +22,7 @@
 
 #include "plot/plotwidget.h"
 
+#include "baselineprefetcher.h"
 #include "plotframe.h"
 #include "imagecomparisonwidget.h"
 #include "interfaces.h"
@@ -34,7 +35,11 @@ class RFIGuiWindow : public Gtk::Window, private StrategyController {
 		~RFIGuiWindow();
 
 		void SetImageSet(rfiStrategy::ImageSet *newImageSet, bool loadBaseline);
-		void SetImageSetIndex(rfiStrategy::ImageSetIndex *newImageSetIndex);
+		/**
+		 * Changes the current baseline. It is read in the background, unless @p waitForData is set: then
+		 * the baseline is shown before returning, e.g. so that it can be saved directly afterwards.
+		 */
+		void SetImageSetIndex(rfiStrategy::ImageSetIndex *newImageSetIndex, bool waitForData = false);
 		rfiStrategy::ImageSet &GetImageSet() const { return *_imageSet; }
 		rfiStrategy::ImageSetIndex &GetImageSetIndex() const { return *_imageSetIndex; }
 		void SetRevisedData(const TimeFrequencyData &data)
@@ -91,7 +96,9 @@ class RFIGuiWindow : public Gtk::Window, private StrategyController {
 		void SetStrategy(rfiStrategy::Strategy *newStrategy);
 
 		void createToolbar();
-		void loadCurrentTFData();
+		void loadCurrentTFData(bool waitForData = false);
+		void onBaselineLoaded();
+		void showRequestedBaseline();
 
 		void onLoadPrevious();
 		void onLoadNext();
@@ -272,6 +279,7 @@ class RFIGuiWindow : public Gtk::Window, private StrategyController {
 		rfiStrategy::Strategy *_strategy;
 		int _gaussianTestSets;
 		boost::mutex _ioMutex;
+		BaselinePrefetcher _prefetcher;
 		SegmentedImagePtr _segmentedImage;
 		class SpatialMatrixMetaData *_spatialMetaData;
 		std::vector<double> _horProfile, _vertProfile;
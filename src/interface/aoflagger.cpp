@@ -19,12 +19,15 @@
 #include "../quality/histogramcollection.h"
 #include "../quality/statisticscollection.h"
 
+#include <algorithm>
 #include <vector>
 #include <typeinfo>
 
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace aoflagger {
 	
@@ -43,6 +46,7 @@ namespace aoflagger {
 	const unsigned StrategyFlags::CLEAR_FLAGS          =  0x800;
 	const unsigned StrategyFlags::AUTO_CORRELATION     = 0x1000;
 	const unsigned StrategyFlags::HIGH_TIME_RESOLUTION = 0x2000;
+	const unsigned StrategyFlags::COARSE_SCREENING     = 0x4000;
 
 	
 	class ImageSetData {
@@ -96,6 +100,20 @@ namespace aoflagger {
 			_data->images[i] = Image2D::CreateSetImagePtr(width, height, initialValue, widthCapacity);
 	}
 	
+	ImageSet::ImageSet(float* const* buffers, size_t width, size_t height, size_t count, size_t horizontalStride) :
+		_data(new ImageSetData(count))
+	{
+		assertValidCount(count);
+		if(horizontalStride < width || horizontalStride % 4 != 0)
+			throw std::runtime_error("Invalid horizontal stride specified when wrapping buffers in an image set for aoflagger; should be a multiple of four and at least the width.");
+		for(size_t i=0; i!=count; ++i)
+		{
+			if(reinterpret_cast<size_t>(buffers[i]) % 16 != 0)
+				throw std::runtime_error("Buffer wrapped in an image set for aoflagger is not aligned to 16 bytes.");
+			_data->images[i] = Image2DPtr(Image2D::CreateFromBuffer(buffers[i], width, height, horizontalStride));
+		}
+	}
+	
 	ImageSet::ImageSet(const ImageSet& sourceImageSet) :
 		_data(new ImageSetData(*sourceImageSet._data))
 	{
@@ -201,6 +219,13 @@ namespace aoflagger {
 			_data->mask->SetAll<false>();
 	}
 	
+	FlagMask::FlagMask(bool* buffer, size_t width, size_t height, size_t horizontalStride)
+	{
+		if(horizontalStride < width || horizontalStride % 4 != 0)
+			throw std::runtime_error("Invalid horizontal stride specified when wrapping a buffer in a flag mask for aoflagger; should be a multiple of four and at least the width.");
+		_data = new FlagMaskData(Mask2DPtr(Mask2D::CreateFromBuffer(buffer, width, height, horizontalStride)));
+	}
+	
 	FlagMask::FlagMask(const FlagMask& sourceMask) :
 		_data(new FlagMaskData(*sourceMask._data))
 	{
@@ -379,37 +404,76 @@ namespace aoflagger {
 		StatusListener *_destination;
 	};
 	
-	FlagMask AOFlagger::Run(Strategy& strategy, ImageSet& input)
+	/**
+	 * Flags image sets one after another on a single thread. The listener and the empty
+	 * mask and zero image that initialize the data are created once and reused for all
+	 * image sets of the same size. This is safe, because the artifact set only holds
+	 * constant references to them.
+	 */
+	class FlagRunner
 	{
-		boost::mutex mutex;
-		rfiStrategy::ArtifactSet artifacts(&mutex);
-		ProgressListener* listener;
-		if(_statusListener == 0)
-			listener = new ErrorListener();
-		else
-			listener = new ForwardingListener(_statusListener);
+		public:
+			FlagRunner(StatusListener* statusListener)
+			{
+				if(statusListener == 0)
+					_listener = new ErrorListener();
+				else
+					_listener = new ForwardingListener(statusListener);
+			}
+			
+			~FlagRunner()
+			{
+				delete _listener;
+			}
+			
+			/**
+			 * Returns the flags, which can be a mask of the runner itself, so they should be
+			 * copied before they are returned to the caller.
+			 */
+			Mask2DCPtr Run(rfiStrategy::Strategy& strategy, const std::vector<Image2DPtr>& images);
+			
+		private:
+			void initializeBuffers(size_t width, size_t height)
+			{
+				if(!_zeroImage || _zeroImage->Width() != width || _zeroImage->Height() != height)
+				{
+					_emptyMask = Mask2D::CreateSetMaskPtr<false>(width, height);
+					_zeroImage = Image2D::CreateZeroImagePtr(width, height);
+				}
+			}
+			
+			boost::mutex _ioMutex;
+			ProgressListener* _listener;
+			Mask2DCPtr _emptyMask;
+			Image2DCPtr _zeroImage;
+	};
+	
+	Mask2DCPtr FlagRunner::Run(rfiStrategy::Strategy& strategy, const std::vector<Image2DPtr>& images)
+	{
+		rfiStrategy::ArtifactSet artifacts(&_ioMutex);
 		
-		Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(input.Width(), input.Height());
+		initializeBuffers(images[0]->Width(), images[0]->Height());
+		const Mask2DCPtr& mask = _emptyMask;
+		const Image2DCPtr& zeroImage = _zeroImage;
 		TimeFrequencyData inputData, revisedData;
-		Image2DPtr zeroImage = Image2D::CreateZeroImagePtr(input.Width(), input.Height());
-		switch(input.ImageCount())
+		switch(images.size())
 		{
 			case 1:
-				inputData = TimeFrequencyData(TimeFrequencyData::AmplitudePart, SinglePolarisation, input._data->images[0]);
+				inputData = TimeFrequencyData(TimeFrequencyData::AmplitudePart, SinglePolarisation, images[0]);
 				inputData.SetGlobalMask(mask);
 				revisedData = TimeFrequencyData(TimeFrequencyData::AmplitudePart, SinglePolarisation, zeroImage);
 				revisedData.SetGlobalMask(mask);
 				break;
 			case 2:
-				inputData = TimeFrequencyData(TimeFrequencyData::ComplexRepresentation, SinglePolarisation, input._data->images[0], input._data->images[1]);
+				inputData = TimeFrequencyData(TimeFrequencyData::ComplexRepresentation, SinglePolarisation, images[0], images[1]);
 				inputData.SetGlobalMask(mask);
 				revisedData = TimeFrequencyData(TimeFrequencyData::ComplexRepresentation, SinglePolarisation, zeroImage, zeroImage);
 				revisedData.SetGlobalMask(mask);
 				break;
 			case 4:
 				inputData = TimeFrequencyData(AutoDipolePolarisation,
-					input._data->images[0], input._data->images[1],
-					input._data->images[2], input._data->images[3]
+					images[0], images[1],
+					images[2], images[3]
 				);
 				inputData.SetIndividualPolarisationMasks(mask, mask);
 				revisedData = TimeFrequencyData(AutoDipolePolarisation, zeroImage, zeroImage, zeroImage, zeroImage);
@@ -417,10 +481,10 @@ namespace aoflagger {
 				break;
 			case 8:
 				inputData = TimeFrequencyData(
-					input._data->images[0], input._data->images[1],
-					input._data->images[2], input._data->images[3],
-					input._data->images[4], input._data->images[5],
-					input._data->images[6], input._data->images[7]
+					images[0], images[1],
+					images[2], images[3],
+					images[4], images[5],
+					images[6], images[7]
 				);
 				inputData.SetIndividualPolarisationMasks(mask, mask, mask, mask);
 				revisedData = TimeFrequencyData(
@@ -435,14 +499,285 @@ namespace aoflagger {
 		artifacts.SetPolarizationStatistics(new PolarizationStatistics());
 		artifacts.SetBaselineSelectionInfo(new rfiStrategy::BaselineSelector());
 		
-		strategy._data->strategyPtr->Perform(artifacts, *listener);
+		strategy.Perform(artifacts, *_listener);
 		
 		delete artifacts.BaselineSelectionInfo();
 		delete artifacts.PolarizationStatistics();
-		delete listener;
 		
+		return artifacts.ContaminatedData().GetSingleMask();
+	}
+	
+	FlagMask AOFlagger::Run(Strategy& strategy, ImageSet& input)
+	{
+		FlagRunner runner(_statusListener);
+		FlagMask flagMask;
+		flagMask._data = new FlagMaskData(Mask2D::CreateCopy(runner.Run(*strategy._data->strategyPtr, input._data->images)));
+		return flagMask;
+	}
+	
+	void AOFlagger::Run(Strategy& strategy, ImageSet& input, FlagMask& output)
+	{
+		if(output.Width() != input.Width() || output.Height() != input.Height())
+			throw std::runtime_error("The flag mask passed to the aoflagger does not have the same size as the image set.");
+		FlagRunner runner(_statusListener);
+		*output._data->mask = *runner.Run(*strategy._data->strategyPtr, input._data->images);
+	}
+	
+	class BatchFlagData
+	{
+		public:
+			BatchFlagData(Strategy& _strategy, ImageSet* _inputs, size_t _count, FlagHandler& _handler) :
+				strategy(_strategy), inputs(_inputs), count(_count), handler(_handler),
+				nextIndex(0), failed(false)
+			{
+			}
+			
+			Strategy& strategy;
+			ImageSet* inputs;
+			size_t count;
+			FlagHandler& handler;
+			
+			/** Protects nextIndex, failed and errorMessage. */
+			boost::mutex mutex;
+			size_t nextIndex;
+			bool failed;
+			std::string errorMessage;
+			
+			/** Serializes the calls to the handler. */
+			boost::mutex handlerMutex;
+	};
+	
+	void AOFlagger::Run(Strategy& strategy, ImageSet* inputs, size_t count, FlagHandler& handler, size_t threadCount)
+	{
+		if(threadCount == 0)
+			threadCount = boost::thread::hardware_concurrency();
+		if(threadCount > count)
+			threadCount = count;
+		
+		BatchFlagData batch(strategy, inputs, count, handler);
+		if(threadCount <= 1)
+		{
+			runBatch(batch);
+		} else {
+			boost::thread_group threadGroup;
+			for(size_t i=0; i!=threadCount; ++i)
+				threadGroup.create_thread(boost::bind(&AOFlagger::runBatch, this, boost::ref(batch)));
+			threadGroup.join_all();
+		}
+		
+		if(batch.failed)
+			throw std::runtime_error("An exception occured while flagging a batch of image sets: " + batch.errorMessage);
+	}
+	
+	void AOFlagger::runBatch(BatchFlagData& batch)
+	{
+		try {
+			FlagRunner runner(_statusListener);
+			rfiStrategy::Strategy& strategy = *batch.strategy._data->strategyPtr;
+			while(true)
+			{
+				boost::mutex::scoped_lock lock(batch.mutex);
+				if(batch.nextIndex == batch.count || batch.failed)
+					break;
+				const size_t index = batch.nextIndex;
+				++batch.nextIndex;
+				lock.unlock();
+				
+				FlagMask flagMask;
+				flagMask._data = new FlagMaskData(Mask2D::CreateCopy(runner.Run(strategy, batch.inputs[index]._data->images)));
+				
+				boost::mutex::scoped_lock handlerLock(batch.handlerMutex);
+				batch.handler.OnFlagged(index, flagMask);
+			}
+		} catch(std::exception& e)
+		{
+			boost::mutex::scoped_lock lock(batch.mutex);
+			if(!batch.failed)
+			{
+				batch.failed = true;
+				batch.errorMessage = e.what();
+			}
+		}
+	}
+	
+	/**
+	 * Implementation of the flag stream. The window is stored in images of which the capacity
+	 * is the window size. When time steps are removed from the start of the window, the
+	 * remaining time steps are moved to the start of the images, so that the strategy can be
+	 * run on the images directly.
+	 */
+	class FlagStreamImp
+	{
+		public:
+			FlagStreamImp(const boost::shared_ptr<rfiStrategy::Strategy>& strategy, StatusListener* statusListener, size_t channelCount, size_t imageCount, size_t windowSize, size_t lookAhead) :
+				_strategy(strategy),
+				_runner(statusListener),
+				_window(imageCount),
+				_windowSize(windowSize),
+				_lookAhead(lookAhead),
+				_finalCount(0),
+				_pendingFlags(channelCount)
+			{
+				for(size_t i=0; i!=imageCount; ++i)
+					_window[i] = Image2D::CreateUnsetImagePtr(0, channelCount, windowSize);
+			}
+			
+			void Append(const std::vector<Image2DPtr>& timeSteps);
+			
+			void Finish();
+			
+			size_t FinalFlagCount() const { return _pendingFlags.empty() ? 0 : _pendingFlags[0].size(); }
+			
+			Mask2DPtr ReadFlags();
+			
+		private:
+			void flagWindow(size_t finalEnd);
+			void removeTimeSteps(size_t count);
+			
+			boost::shared_ptr<rfiStrategy::Strategy> _strategy;
+			FlagRunner _runner;
+			std::vector<Image2DPtr> _window;
+			size_t _windowSize, _lookAhead;
+			/** Number of time steps at the start of the window of which the flags are final. */
+			size_t _finalCount;
+			/**
+			 * Final flags that have not been read yet, one row per channel. The rows grow
+			 * with each window, such that appending does not copy the earlier flags.
+			 */
+			std::vector<std::vector<bool> > _pendingFlags;
+	};
+	
+	void FlagStreamImp::Append(const std::vector<Image2DPtr>& timeSteps)
+	{
+		if(timeSteps.size() != _window.size() || timeSteps[0]->Height() != _window[0]->Height())
+			throw std::runtime_error("The image set appended to a flag stream does not have the same number of images and channels as the stream.");
+		
+		const size_t newCount = timeSteps[0]->Width();
+		size_t appended = 0;
+		while(appended != newCount)
+		{
+			const size_t
+				width = _window[0]->Width(),
+				n = std::min(_windowSize - width, newCount - appended);
+			for(size_t i=0; i!=_window.size(); ++i)
+			{
+				Image2D& image = *_window[i];
+				image.ResizeWithoutReallocation(width + n);
+				for(size_t y=0; y!=image.Height(); ++y)
+					memcpy(image.ValuePtr(width, y), timeSteps[i]->ValuePtr(appended, y), n * sizeof(num_t));
+			}
+			appended += n;
+			
+			if(width + n == _windowSize)
+			{
+				flagWindow(_windowSize - _lookAhead);
+				// Keep the time steps that are not final, and as many before them for context
+				removeTimeSteps(_windowSize - 2 * _lookAhead);
+			}
+		}
+	}
+	
+	void FlagStreamImp::Finish()
+	{
+		const size_t width = _window[0]->Width();
+		if(width > _finalCount)
+			flagWindow(width);
+		removeTimeSteps(width);
+	}
+	
+	void FlagStreamImp::flagWindow(size_t finalEnd)
+	{
+		Mask2DCPtr flags = _runner.Run(*_strategy, _window);
+		
+		for(size_t y=0; y!=flags->Height(); ++y)
+		{
+			const bool* row = flags->ValuePtr(0, y);
+			_pendingFlags[y].insert(_pendingFlags[y].end(), row + _finalCount, row + finalEnd);
+		}
+		_finalCount = finalEnd;
+	}
+	
+	Mask2DPtr FlagStreamImp::ReadFlags()
+	{
+		Mask2DPtr flags = Mask2D::CreateUnsetMaskPtr(FinalFlagCount(), _pendingFlags.size());
+		for(size_t y=0; y!=_pendingFlags.size(); ++y)
+		{
+			std::copy(_pendingFlags[y].begin(), _pendingFlags[y].end(), flags->ValuePtr(0, y));
+			_pendingFlags[y].clear();
+		}
+		return flags;
+	}
+	
+	void FlagStreamImp::removeTimeSteps(size_t count)
+	{
+		for(size_t i=0; i!=_window.size(); ++i)
+		{
+			Image2D& image = *_window[i];
+			const size_t remaining = image.Width() - count;
+			for(size_t y=0; y!=image.Height(); ++y)
+			{
+				num_t* row = image.ValuePtr(0, y);
+				memmove(row, row + count, remaining * sizeof(num_t));
+			}
+			image.ResizeWithoutReallocation(remaining);
+		}
+		_finalCount -= count;
+	}
+	
+	class FlagStreamData
+	{
+		public:
+			FlagStreamData(boost::shared_ptr<FlagStreamImp> implementation) :
+				_implementation(implementation)
+			{
+			}
+			boost::shared_ptr<FlagStreamImp> _implementation;
+	};
+	
+	FlagStream::FlagStream(const Strategy& strategy, StatusListener* statusListener, size_t channelCount, size_t imageCount, size_t windowSize, size_t lookAhead)
+	{
+		ImageSet::assertValidCount(imageCount);
+		if(windowSize <= 2 * lookAhead)
+			throw std::runtime_error("The window size of a flag stream should be more than twice the look-ahead.");
+		_data = new FlagStreamData(boost::shared_ptr<FlagStreamImp>(new FlagStreamImp(
+			strategy._data->strategyPtr, statusListener, channelCount, imageCount, windowSize, lookAhead)));
+	}
+	
+	FlagStream::FlagStream(const FlagStream& sourceStream) :
+		_data(new FlagStreamData(sourceStream._data->_implementation))
+	{
+	}
+	
+	FlagStream::~FlagStream()
+	{
+		delete _data;
+	}
+	
+	FlagStream& FlagStream::operator=(const FlagStream& sourceStream)
+	{
+		_data->_implementation = sourceStream._data->_implementation;
+		return *this;
+	}
+	
+	void FlagStream::Append(const ImageSet& timeSteps)
+	{
+		_data->_implementation->Append(timeSteps._data->images);
+	}
+	
+	void FlagStream::Finish()
+	{
+		_data->_implementation->Finish();
+	}
+	
+	size_t FlagStream::FinalFlagCount() const
+	{
+		return _data->_implementation->FinalFlagCount();
+	}
+	
+	FlagMask FlagStream::ReadFlags()
+	{
 		FlagMask flagMask;
-		flagMask._data = new FlagMaskData(Mask2D::CreateCopy(artifacts.ContaminatedData().GetSingleMask()));
+		flagMask._data = new FlagMaskData(_data->_implementation->ReadFlags());
 		return flagMask;
 	}
 	
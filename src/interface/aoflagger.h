@@ -139,6 +139,15 @@ namespace aoflagger {
 			 * observations. Examples are observations for fast pulsars or fast radio burst.
 			 */
 			static const unsigned HIGH_TIME_RESOLUTION;
+			
+			/** @brief Flag a low-resolution copy first, and only flag contaminated parts
+			 * at full resolution.
+			 * 
+			 * This speeds up flagging considerably when most of the data has little RFI.
+			 * Parts in which the low-resolution flagging finds RFI, or that contain
+			 * strong short spikes, are still flagged at full resolution.
+			 */
+			static const unsigned COARSE_SCREENING;
 		private:
 			StrategyFlags();
 	};
@@ -167,6 +176,7 @@ namespace aoflagger {
 	{
 		public:
 			friend class AOFlagger;
+			friend class FlagStream;
 			
 			/** @brief Copy the image set. Only references to images are copied. */
 			ImageSet(const ImageSet& sourceImageSet);
@@ -240,6 +250,8 @@ namespace aoflagger {
 			
 			ImageSet(size_t width, size_t height, size_t count, float initialValue, size_t widthCapacity);
 			
+			ImageSet(float* const* buffers, size_t width, size_t height, size_t count, size_t horizontalStride);
+			
 			static void assertValidCount(size_t count);
 			
 			class ImageSetData *_data;
@@ -270,6 +282,7 @@ namespace aoflagger {
 	{
 		public:
 			friend class AOFlagger;
+			friend class FlagStream;
 			
 			/** @brief Copy a flag mask. Only copies a reference, not the data. */
 			FlagMask(const FlagMask& sourceMask);
@@ -308,6 +321,7 @@ namespace aoflagger {
 			FlagMask();
 			FlagMask(size_t width, size_t height);
 			FlagMask(size_t width, size_t height, bool initialValue);
+			FlagMask(bool* buffer, size_t width, size_t height, size_t horizontalStride);
 			
 			class FlagMaskData *_data;
 	};
@@ -319,11 +333,16 @@ namespace aoflagger {
 	 * can be loaded from disc with @ref AOFlagger::LoadStrategy(). Strategies
 	 * can not be changed with this interface. A user can create stored strategies
 	 * with the @c rfigui tool that is part of the aoflagger package.
+	 * 
+	 * Flagging does not change a strategy, so a copy of a strategy refers to
+	 * the same strategy, and one strategy can be used by several threads at
+	 * the same time; there is no need to make a copy for each thread.
 	 */
 	class Strategy
 	{
 		public:
 			friend class AOFlagger;
+			friend class FlagStream;
 			
 			/** @brief Create a copy of a strategy. */
 			Strategy(const Strategy& sourceStrategy);
@@ -342,6 +361,76 @@ namespace aoflagger {
 			class StrategyData *_data;
 	};
 
+	/** @brief Flags data of one baseline that arrives a few time steps at a time.
+	 * 
+	 * A flag stream is meant for online flagging, e.g. of correlator output, where the
+	 * full time range of a baseline is not available at once. It can be created with
+	 * @ref AOFlagger::MakeFlagStream(). New time steps are added with Append(). The stream
+	 * keeps a window of the most recent time steps, and runs the strategy on this window each
+	 * time it is full. The flags of the time steps in the window are then final, except those
+	 * in the last 'look-ahead' time steps, because the flagger has not seen enough data after
+	 * them yet. Final flags can be read with ReadFlags().
+	 * 
+	 * After flagging the window, the stream keeps the non-final time steps, and as many time
+	 * steps before them as context. Hence, with a window size @c W and a look-ahead of @c L
+	 * time steps:
+	 * - The images of the stream hold at most @c W time steps;
+	 * - The strategy is run once every @c W-2L time steps;
+	 * - The flags of a time step are final at most @c W-2L time steps after it was appended,
+	 *   except in the first window, which has to be filled completely.
+	 * 
+	 * Flagging works best with a large window, but the strategy can take a long time on it.
+	 * A flag stream is not thread safe, but different flag streams can be used from different
+	 * threads, also with the same strategy.
+	 * @since Version 2.9
+	 */
+	class FlagStream
+	{
+		public:
+			friend class AOFlagger;
+			
+			/** @brief Copy the flag stream. Only a reference is copied; both objects refer to the same stream. */
+			FlagStream(const FlagStream& sourceStream);
+			
+			/** @brief Destruct the object. The stream is destroyed when no more references exist. */
+			~FlagStream();
+			
+			/** @brief Assign to this object. Only a reference is copied. */
+			FlagStream &operator=(const FlagStream& sourceStream);
+			
+			/** @brief Add time steps to the stream.
+			 * 
+			 * The image set should have the same height and image count as the stream; its
+			 * width is the number of new time steps, and can be anything.
+			 * When this fills the window, the strategy is run before this call returns.
+			 * @param timeSteps The data of the new time steps.
+			 */
+			void Append(const ImageSet& timeSteps);
+			
+			/** @brief Flag all time steps of which the flags are not yet final.
+			 * 
+			 * This should be called at the end of the data. After this call, the flags of all
+			 * appended time steps can be read. New time steps may still be appended
+			 * afterwards, but they are flagged without the context of the earlier time steps.
+			 */
+			void Finish();
+			
+			/** @brief Number of time steps of which the flags are final but have not been read yet. */
+			size_t FinalFlagCount() const;
+			
+			/** @brief Return and remove the final flags that have not been read yet.
+			 * 
+			 * The returned mask has a width of FinalFlagCount(), and starts at the first time
+			 * step of which the flags were not read before. Its width can be zero.
+			 */
+			FlagMask ReadFlags();
+			
+		private:
+			FlagStream(const Strategy& strategy, class StatusListener* statusListener, size_t channelCount, size_t imageCount, size_t windowSize, size_t lookAhead);
+			
+			class FlagStreamData *_data;
+	};
+
 	/** @brief Statistics that can be collected online and saved to a measurement set.
 	 * 
 	 * It is useful to collect some statistics during flagging, because all data goes through
@@ -443,6 +532,34 @@ namespace aoflagger {
 			virtual void OnException(std::exception &thrownException) = 0;
 	};
 	
+	/**
+	 * @brief A base class which callers can inherit from to receive the flags of
+	 * a batch of image sets as soon as they are available.
+	 * 
+	 * @sa AOFlagger::Run(Strategy&, ImageSet*, size_t, FlagHandler&, size_t)
+	 * @since Version 2.9
+	 */
+	class FlagHandler
+	{
+		public:
+			/**
+			 * @brief Virtual destructor.
+			 */
+			virtual ~FlagHandler() { }
+			/**
+			 * @brief Called when an image set of the batch has been flagged.
+			 * 
+			 * This method is called from the flagging threads, but calls are serialized,
+			 * so it does not need to be thread safe. Image sets finish in arbitrary order,
+			 * hence the @p index identifies the image set. The flagging threads wait for
+			 * this method to return before they report the next result, so it should not
+			 * take long.
+			 * @param index Index of the image set in the batch.
+			 * @param flags The flags identifying bad (RFI contaminated) data.
+			 */
+			virtual void OnFlagged(size_t index, FlagMask& flags) = 0;
+	};
+	
 	/** @brief Main class for access to the flagger functionality.
 	 * 
 	 * Software using the flagger should first create an instance of the @ref AOFlagger
@@ -469,7 +586,10 @@ namespace aoflagger {
 	 * - When a full set is processed, store the statistics with WriteStatistics().
 	 * 
 	 * To flag multiple baselines, the Strategy can be stored and the same instance can be used
-	 * again.
+	 * again. When many baselines are available at once, they can also be passed
+	 * together to the batch version of Run(), which flags them in parallel. When the data of
+	 * a baseline arrives a few time steps at a time, it can be flagged with a
+	 * @ref FlagStream instead, created with MakeFlagStream().
 	 * 
 	 * ### Thread safety
 	 * 
@@ -596,6 +716,46 @@ namespace aoflagger {
 				return FlagMask(width, height, initialValue);
 			}
 			
+			/** @brief Create an @ref ImageSet that uses existing buffers, without copying them.
+			 * 
+			 * This avoids copying data into the flagger when it is already in memory in
+			 * a suitable layout. The buffers remain owned by the caller: they are not freed
+			 * by the flagger, and they should stay valid as long as the returned image set or any
+			 * copy of it exists. The flagger does not change the values in the buffers.
+			 * @param buffers Array of @p count pointers, one for each image (see class description of
+			 * @ref ImageSet for image order). Each buffer should be aligned to 16 bytes and hold
+			 * @p height rows of @p horizontalStride floats.
+			 * @param width Number of time steps in images
+			 * @param height Number of frequency channels in images
+			 * @param count Number of images in set
+			 * @param horizontalStride Number of floats between the start of two rows. Should be
+			 * a multiple of four and at least @p width.
+			 * @return A new ImageSet.
+			 * @since Version 2.9
+			 */
+			ImageSet WrapImageSet(float* const* buffers, size_t width, size_t height, size_t count, size_t horizontalStride)
+			{
+				return ImageSet(buffers, width, height, count, horizontalStride);
+			}
+			
+			/** @brief Create a @ref FlagMask that uses an existing buffer, without copying it.
+			 * 
+			 * Together with Run(Strategy&, ImageSet&, FlagMask&), this lets the flagger write
+			 * its flags directly into memory of the caller. The buffer remains owned by the
+			 * caller and should stay valid as long as the returned mask or any copy of it exists.
+			 * @param buffer Buffer of @p height rows of @p horizontalStride bools.
+			 * @param width Width of mask (number of timesteps)
+			 * @param height Height of mask (number of frequency channels)
+			 * @param horizontalStride Number of bools between the start of two rows. Should be
+			 * a multiple of four and at least @p width.
+			 * @return A new FlagMask.
+			 * @since Version 2.9
+			 */
+			FlagMask WrapFlagMask(bool* buffer, size_t width, size_t height, size_t horizontalStride)
+			{
+				return FlagMask(buffer, width, height, horizontalStride);
+			}
+			
 			/** @brief Initialize a strategy for a specific telescope.
 			 * 
 			 * All parameters are hints to optimize the strategy, but need not actual alter the
@@ -645,6 +805,61 @@ namespace aoflagger {
 			 */
 			FlagMask Run(Strategy& strategy, ImageSet& input);
 			
+			/** @brief Run the flagging strategy on the given data, and store the flags in an
+			 * existing mask.
+			 * 
+			 * This is like Run(Strategy&, ImageSet&), but instead of allocating a new mask, it
+			 * overwrites the flags in @p output, which can e.g. be a mask created with
+			 * WrapFlagMask().
+			 * @param strategy The flagging strategy that will be used.
+			 * @param input The data to run the flagger on.
+			 * @param output Receives the flags identifying bad (RFI contaminated) data. Should
+			 * have the same size as @p input.
+			 * @since Version 2.9
+			 */
+			void Run(Strategy& strategy, ImageSet& input, FlagMask& output);
+			
+			/** @brief Create a stream for flagging the data of one baseline while it arrives.
+			 * 
+			 * See the @ref FlagStream class description for details. The status listener that
+			 * is set at the time of this call, if any, is used by the stream.
+			 * @param strategy The flagging strategy that will be used.
+			 * @param channelCount Number of frequency channels, i.e., the height of the images.
+			 * @param imageCount Number of images of each time step (see class description of
+			 * @ref ImageSet for image order).
+			 * @param windowSize Number of time steps on which the strategy is run at once.
+			 * @param lookAhead Number of time steps that the strategy should have seen after a time
+			 * step before its flags are final. The window size should be more than twice this value.
+			 * @return The new FlagStream.
+			 * @since Version 2.9
+			 */
+			FlagStream MakeFlagStream(const Strategy& strategy, size_t channelCount, size_t imageCount, size_t windowSize, size_t lookAhead)
+			{
+				return FlagStream(strategy, _statusListener, channelCount, imageCount, windowSize, lookAhead);
+			}
+			
+			/** @brief Run the flagging strategy on a batch of image sets in parallel.
+			 * 
+			 * The image sets are distributed over a number of threads. Each thread creates its
+			 * buffers and listener once and reuses them for all the image sets that it flags. This is
+			 * faster than calling Run(Strategy&, ImageSet&) for each image set, in particular
+			 * when the image sets are small. The flags of each image set are passed to the
+			 * @p handler as soon as they are available. This method returns when all image sets
+			 * have been flagged.
+			 * 
+			 * When a status listener is set, it should be thread safe.
+			 * If flagging an image set fails with an exception, the remaining image sets are
+			 * not flagged, and a @c std::runtime_error is thrown after the running threads
+			 * have finished.
+			 * @param strategy The flagging strategy that will be used.
+			 * @param inputs Array of @p count image sets. Each should be a different instance.
+			 * @param count Number of image sets in the batch.
+			 * @param handler Receives the flags of each image set.
+			 * @param threadCount Number of threads to use, or zero to use one thread per processor.
+			 * @since Version 2.9
+			 */
+			void Run(Strategy& strategy, ImageSet* inputs, size_t count, FlagHandler& handler, size_t threadCount = 0);
+			
 			/** @brief Create a new object for collecting statistics.
 			 * 
 			 * See the QualityStatistics class description for info on multithreading and/or combining statistics
@@ -737,6 +952,8 @@ namespace aoflagger {
 			 */
 			void operator=(const AOFlagger&) { }
 			
+			void runBatch(class BatchFlagData& batch);
+			
 			StatusListener* _statusListener;
 	};
 
@@ -1,11 +1,18 @@
+#include <algorithm>
 #include <stdexcept>
 #include <set>
 #include <sstream>
 
+#include <emmintrin.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "rspreader.h"
 #include "../structures/image2d.h"
 #include "../structures/mask2d.h"
 #include "../structures/samplerow.h"
+#include "../structures/system.h"
 
 #include "../util/aologger.h"
 #include "../util/ffttools.h"
@@ -97,40 +104,7 @@ std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> RSPReader::ReadChannelBeam
 
 std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> RSPReader::ReadSingleBeamlet(unsigned long timestepStart, unsigned long timestepEnd, unsigned beamletCount, unsigned beamletIndex)
 {
-	std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> data = ReadAllBeamlets(timestepStart, timestepEnd, beamletCount);
-	
-	const unsigned width = timestepEnd - timestepStart;
-	Image2DPtr realX = Image2D::CreateZeroImagePtr(width, 1);
-	Image2DPtr imaginaryX = Image2D::CreateZeroImagePtr(width, 1);
-	Image2DPtr realY = Image2D::CreateZeroImagePtr(width, 1);
-	Image2DPtr imaginaryY = Image2D::CreateZeroImagePtr(width, 1);
-	Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(width, 1);
-	
-	TimeFrequencyData *allX = data.first.CreateTFData(XXPolarisation);
-	TimeFrequencyData *allY = data.first.CreateTFData(YYPolarisation);
-	Image2DCPtr xr = allX->GetRealPart();
-	Image2DCPtr xi = allX->GetImaginaryPart();
-	Image2DCPtr yr = allY->GetRealPart();
-	Image2DCPtr yi = allY->GetImaginaryPart();
-	delete allX;
-	delete allY;
-	Mask2DCPtr maskWithBeamlets = data.first.GetSingleMask();
-	
-	for(unsigned x=0;x<width;++x)
-	{
-		realX->SetValue(x, 0, xr->Value(x, beamletIndex));
-		imaginaryX->SetValue(x, 0, xi->Value(x, beamletIndex));
-		realY->SetValue(x, 0, yr->Value(x, beamletIndex));
-		imaginaryY->SetValue(x, 0, yi->Value(x, beamletIndex));
-		mask->SetValue(x, 0, maskWithBeamlets->Value(x, beamletIndex));
-	}
-	data.first = TimeFrequencyData(AutoDipolePolarisation, realX, imaginaryX, realY, imaginaryY);
-	data.first.SetGlobalMask(mask);
-	BandInfo band = data.second->Band();
-	band.channels[0] = data.second->Band().channels[beamletIndex];
-	band.channels.resize(1);
-	data.second->SetBand(band);
-	return data;
+	return readBeamlets(timestepStart, timestepEnd, beamletCount, beamletIndex, 1);
 }
 
 unsigned long RSPReader::TimeStepCount(size_t beamletCount) const
@@ -151,22 +125,59 @@ unsigned long RSPReader::TimeStepCount(size_t beamletCount) const
 }
 
 std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> RSPReader::ReadAllBeamlets(unsigned long timestepStart, unsigned long timestepEnd, unsigned beamletCount)
+{
+	return readBeamlets(timestepStart, timestepEnd, beamletCount, 0, beamletCount);
+}
+
+/**
+ * Converts @p count samples of a beamlet to floats. A sample consists of four little endian
+ * 16-bit values, in the order yi, yr, xi, xr. Four samples at a time are separated with
+ * unpack instructions and sign-extended to 32 bits before they are converted.
+ */
+static void unpackSamples(const unsigned char *samples, size_t count, num_t *xr, num_t *xi, num_t *yr, num_t *yi)
+{
+	size_t i = 0;
+	for(; i+4 <= count; i+=4)
+	{
+		const __m128i
+			a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i*8)),
+			b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i*8 + 16)),
+			// t0 = yi0 yi2 yr0 yr2 xi0 xi2 xr0 xr2, t1 = yi1 yi3 yr1 yr3 xi1 xi3 xr1 xr3
+			t0 = _mm_unpacklo_epi16(a, b),
+			t1 = _mm_unpackhi_epi16(a, b),
+			// y = yi0 yi1 yi2 yi3 yr0 yr1 yr2 yr3, x = xi0 xi1 xi2 xi3 xr0 xr1 xr2 xr3
+			y = _mm_unpacklo_epi16(t0, t1),
+			x = _mm_unpackhi_epi16(t0, t1);
+		_mm_storeu_ps(yi+i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(y, y), 16)));
+		_mm_storeu_ps(yr+i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(y, y), 16)));
+		_mm_storeu_ps(xi+i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)));
+		_mm_storeu_ps(xr+i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)));
+	}
+	for(; i!=count; ++i)
+	{
+		const unsigned char *sample = samples + i*8;
+		yi[i] = (signed short) ((sample[1]<<8) | sample[0]);
+		yr[i] = (signed short) ((sample[3]<<8) | sample[2]);
+		xi[i] = (signed short) ((sample[5]<<8) | sample[4]);
+		xr[i] = (signed short) ((sample[7]<<8) | sample[6]);
+	}
+}
+
+std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> RSPReader::readBeamlets(unsigned long timestepStart, unsigned long timestepEnd, unsigned beamletCount, unsigned firstBeamlet, unsigned selectedCount)
 {
 	const unsigned width = timestepEnd - timestepStart;
-	Image2DPtr realX = Image2D::CreateZeroImagePtr(width, beamletCount);
-	Image2DPtr imaginaryX = Image2D::CreateZeroImagePtr(width, beamletCount);
-	Image2DPtr realY = Image2D::CreateZeroImagePtr(width, beamletCount);
-	Image2DPtr imaginaryY = Image2D::CreateZeroImagePtr(width, beamletCount);
-	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<true>(width, beamletCount);
+	Image2DPtr realX = Image2D::CreateZeroImagePtr(width, selectedCount);
+	Image2DPtr imaginaryX = Image2D::CreateZeroImagePtr(width, selectedCount);
+	Image2DPtr realY = Image2D::CreateZeroImagePtr(width, selectedCount);
+	Image2DPtr imaginaryY = Image2D::CreateZeroImagePtr(width, selectedCount);
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<true>(width, selectedCount);
 	
 	std::ifstream file(_rawFile.c_str(), std::ios_base::binary | std::ios_base::in);
-	size_t frame = 0;
 	std::set<short> stations;
-	std::set<unsigned int> timestamps;
 	
 	TimeFrequencyMetaDataPtr metaData = TimeFrequencyMetaDataPtr(new TimeFrequencyMetaData());
 	BandInfo band;
-	for(size_t i=0;i<beamletCount;++i)
+	for(size_t i=firstBeamlet;i<firstBeamlet+selectedCount;++i)
 	{
 		ChannelInfo channel;
 		channel.frequencyHz = i+1;
@@ -181,55 +192,68 @@ std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> RSPReader::ReadAllBeamlets
 	// Because timestepStart might fall within a block, the 
 	RCPApplicationHeader firstHeader;
 	firstHeader.Read(file);
-	const unsigned long bytesPerFrame = beamletCount * firstHeader.nofBlocks * RCPBeamletData::SIZE + RCPApplicationHeader::SIZE;
-	const unsigned long startFrame = timestepStart / (unsigned long) firstHeader.nofBlocks;
+	const unsigned long nofBlocks = firstHeader.nofBlocks;
+	const unsigned long bytesPerFrame = beamletCount * nofBlocks * RCPBeamletData::SIZE + RCPApplicationHeader::SIZE;
+	const unsigned long startFrame = timestepStart / nofBlocks;
 	const unsigned long startByte = startFrame * bytesPerFrame;
-	const unsigned long offsetFromStart = timestepStart - (startFrame * firstHeader.nofBlocks);
-	//AOLogger::Debug << "Seeking to " << startByte << " (timestepStart=" << timestepStart << ", offsetFromStart=" << offsetFromStart << ", startFrame=" << startFrame << ",bytesPerFrame=" << bytesPerFrame << ")\n";
+	const unsigned long offsetFromStart = timestepStart - (startFrame * nofBlocks);
+	const unsigned long frameCount = (width + offsetFromStart + nofBlocks - 1) / nofBlocks;
 	file.seekg(startByte, std::ios_base::beg);
 	
-	// Read the frames
-	unsigned long x=0;
-	while(x < width + offsetFromStart && file.good()) {
-		RCPApplicationHeader header;
-		header.Read(file);
-		if(header.versionId != 2)
-		{
-			std::stringstream s;
-			s << "Corrupted header found in frame " << frame << "!";
-			throw std::runtime_error(s.str());
-		}
-		if(stations.count(header.stationId)==0)
-		{
-			stations.insert(header.stationId);
-			AntennaInfo antenna;
-			std::stringstream s;
-			s << "LOFAR station with index " << header.stationId;
-			antenna.name = s.str();
-			metaData->SetAntenna1(antenna);
-			metaData->SetAntenna2(antenna);
-		}
-		for(size_t j=0;j<beamletCount;++j)
+	// Read the frames in blocks; a frame that is only partly in the file ends the reading,
+	// and leaves the time steps that were not read flagged.
+	const unsigned long framesPerBlock = std::max<unsigned long>(1, blockSize() / bytesPerFrame);
+	std::vector<unsigned char> buffer(std::min(framesPerBlock, frameCount) * bytesPerFrame);
+	unsigned long x=0, frame=0;
+	while(frame < frameCount && file.good())
+	{
+		const unsigned long framesToRead = std::min(framesPerBlock, frameCount - frame);
+		file.read(reinterpret_cast<char*>(&buffer[0]), framesToRead * bytesPerFrame);
+		const unsigned long framesRead = file.gcount() / bytesPerFrame;
+		for(unsigned long f=0; f!=framesRead; ++f)
 		{
-			for(size_t i=0;i<header.nofBlocks;++i)
+			const unsigned char *framePtr = &buffer[f * bytesPerFrame];
+			RCPApplicationHeader header;
+			header.Read(framePtr);
+			if(header.versionId != 2 || header.nofBlocks != nofBlocks)
+			{
+				std::stringstream s;
+				s << "Corrupted header found in frame " << frame << "!";
+				throw std::runtime_error(s.str());
+			}
+			if(stations.count(header.stationId)==0)
 			{
-				RCPBeamletData data;
-				data.Read(file);
-				if(i + x < width + offsetFromStart && i + x >= offsetFromStart)
+				stations.insert(header.stationId);
+				AntennaInfo antenna;
+				std::stringstream s;
+				s << "LOFAR station with index " << header.stationId;
+				antenna.name = s.str();
+				metaData->SetAntenna1(antenna);
+				metaData->SetAntenna2(antenna);
+			}
+			// The samples of a beamlet are stored consecutively in a frame
+			const unsigned long
+				blockStart = (x < offsetFromStart) ? (offsetFromStart - x) : 0,
+				blockEnd = std::min(nofBlocks, width + offsetFromStart - x);
+			if(blockStart < blockEnd)
+			{
+				const unsigned long pos = x + blockStart - offsetFromStart;
+				for(unsigned j=0;j<selectedCount;++j)
 				{
-					const unsigned long pos = i + x - offsetFromStart;
-					realX->SetValue(pos, j, data.xr);
-					imaginaryX->SetValue(pos, j, data.xi);
-					realY->SetValue(pos, j, data.yr);
-					imaginaryY->SetValue(pos, j, data.yi);
-					mask->SetValue(pos, j, false);
+					const unsigned char *samples = framePtr + RCPApplicationHeader::SIZE +
+						((firstBeamlet + j) * nofBlocks + blockStart) * RCPBeamletData::SIZE;
+					unpackSamples(samples, blockEnd - blockStart,
+						realX->ValuePtr(pos, j), imaginaryX->ValuePtr(pos, j),
+						realY->ValuePtr(pos, j), imaginaryY->ValuePtr(pos, j));
+					std::fill(mask->ValuePtr(pos, j), mask->ValuePtr(pos, j) + (blockEnd - blockStart), false);
 				}
 			}
+			x += nofBlocks;
+			++frame;
 		}
-		x += header.nofBlocks;
-		++frame;
+		if(framesRead != framesToRead)
+			break;
 	}
-	//AOLogger::Debug << "Read " << frame << " frames.\n";
 	
 	for(unsigned long i=0;i<width;++i)
 	{
@@ -266,67 +290,69 @@ void RSPReader::ReadForStatistics(unsigned beamletCount)
 
 	double startTime = -1.0, periodStartTime = -1.0;
 	
-	for(unsigned long timestepIndex=0;timestepIndex<timesteps;timestepIndex += stepSize)
+	// The windows are read and counted in batches by all threads, after which the
+	// counts are combined in time order, so that the periods are written as before.
+	const size_t threadCount = System::ProcessorCount();
+	const long unsigned batchSize = threadCount * 4 * stepSize;
+	StatisticsBatch batch;
+	batch.beamletCount = beamletCount;
+	batch.timesteps = timesteps;
+	batch.stepSize = stepSize;
+	for(unsigned long batchStart=0;batchStart<timesteps;batchStart += batchSize)
 	{
-		//Read the data
-		unsigned long end = timestepIndex+stepSize;
-		if(end > timesteps) end = timesteps;
-		std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> dataPair = ReadAllBeamlets(timestepIndex, end, beamletCount);
-		const TimeFrequencyData &data = dataPair.first;
-		if(startTime == -1.0) {
-			startTime = dataPair.second->ObservationTimes()[0];
-			periodStartTime = startTime;
-		}
-
-		//Count the statistics
-		for(unsigned imageIndex=0;imageIndex < data.ImageCount();++imageIndex)
-		{
-			Image2DCPtr image = data.GetImage(imageIndex);
-			for(unsigned y=0;y<image->Height();++y) {
-				for(unsigned x=0;x<image->Width();++x) {
-					int value = (int) image->Value(x, y);
-					if(value < 0) {
-						value = -value;
-						++(statistics[y].bitUseCount[15]);
-					}
-					unsigned highestBit = (value!=0) ? 1 : 0;
-					for(unsigned bit=0;bit<15;++bit) {
-						if((value & (2<<bit)) != 0) {
-							highestBit = bit+1;
-						}
-					}
-					for(unsigned bit=0;bit<highestBit;++bit)
-						++(statistics[y].bitUseCount[bit]);
-					++(statistics[y].totalCount);
-				}
-			}
-		}
-		if((timestepIndex/stepSize)%100000==0 || timestepIndex+stepSize>=timesteps)
+		const unsigned long batchEnd = std::min(batchStart + batchSize, timesteps);
+		batch.firstTimestep = batchStart;
+		batch.windows.assign((batchEnd - batchStart + stepSize - 1) / stepSize, StatisticsWindow());
+		batch.nextWindow = 0;
+		boost::thread_group threads;
+		for(size_t i=0; i!=threadCount; ++i)
+			threads.create_thread(boost::bind(&RSPReader::statisticsThread, this, &batch));
+		threads.join_all();
+		if(!batch.exceptionMessage.empty())
 		{
 			for(unsigned i=0;i<beamletCount;++i)
-			{
-				AOLogger::Info << "Beamlet index " << i << ":\n";
-				statistics[i].Print();
-			}
+				delete statFile[i];
+			throw std::runtime_error(batch.exceptionMessage);
 		}
-		if((dataPair.second->ObservationTimes()[0] - periodStartTime) > 60.0)
+		
+		for(size_t w=0;w!=batch.windows.size();++w)
 		{
-			AOLogger::Debug << "Processed 1 minute of data (" << (dataPair.second->ObservationTimes()[0] - startTime) << "s)\n";
+			const unsigned long timestepIndex = batchStart + w*stepSize;
+			const StatisticsWindow &window = batch.windows[w];
+			if(startTime == -1.0) {
+				startTime = window.startTime;
+				periodStartTime = startTime;
+			}
 			for(unsigned i=0;i<beamletCount;++i)
+				statistics[i] += window.statistics[i];
+			
+			if((timestepIndex/stepSize)%100000==0 || timestepIndex+stepSize>=timesteps)
 			{
-				(*statFile[i])
-					<< (periodStartTime - startTime) << '\t'
-					<< (statistics[i].totalCount - timeStartStatistics[i].totalCount);
-				statistics[i].totalCount = timeStartStatistics[i].totalCount;
-				for(unsigned bit=0;bit<15;++bit)
+				for(unsigned i=0;i<beamletCount;++i)
 				{
-					(*statFile[i]) << '\t' << (statistics[i].bitUseCount[bit] - timeStartStatistics[i].bitUseCount[bit]);
-					timeStartStatistics[i].bitUseCount[bit] = statistics[i].bitUseCount[bit];
+					AOLogger::Info << "Beamlet index " << i << ":\n";
+					statistics[i].Print();
 				}
-				(*statFile[i]) << '\n';
 			}
+			if((window.startTime - periodStartTime) > 60.0)
+			{
+				AOLogger::Debug << "Processed 1 minute of data (" << (window.startTime - startTime) << "s)\n";
+				for(unsigned i=0;i<beamletCount;++i)
+				{
+					(*statFile[i])
+						<< (periodStartTime - startTime) << '\t'
+						<< (statistics[i].totalCount - timeStartStatistics[i].totalCount);
+					statistics[i].totalCount = timeStartStatistics[i].totalCount;
+					for(unsigned bit=0;bit<15;++bit)
+					{
+						(*statFile[i]) << '\t' << (statistics[i].bitUseCount[bit] - timeStartStatistics[i].bitUseCount[bit]);
+						timeStartStatistics[i].bitUseCount[bit] = statistics[i].bitUseCount[bit];
+					}
+					(*statFile[i]) << '\n';
+				}
 
-			periodStartTime = dataPair.second->ObservationTimes()[0];
+				periodStartTime = window.startTime;
+			}
 		}
 	}
 	
@@ -337,3 +363,61 @@ void RSPReader::ReadForStatistics(unsigned beamletCount)
 		delete statFile[i];
 	}
 }
+
+void RSPReader::statisticsThread(StatisticsBatch *batch)
+{
+	boost::mutex::scoped_lock lock(batch->mutex);
+	while(batch->nextWindow != batch->windows.size() && batch->exceptionMessage.empty())
+	{
+		const size_t windowIndex = batch->nextWindow;
+		++batch->nextWindow;
+		lock.unlock();
+		
+		// Every window is only written by the thread that took it
+		StatisticsWindow &window = batch->windows[windowIndex];
+		const unsigned long start = batch->firstTimestep + windowIndex * batch->stepSize;
+		const unsigned long end = std::min(start + batch->stepSize, batch->timesteps);
+		std::string exceptionMessage;
+		try {
+			std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> dataPair = ReadAllBeamlets(start, end, batch->beamletCount);
+			window.startTime = dataPair.second->ObservationTimes()[0];
+			window.statistics.assign(batch->beamletCount, BeamletStatistics());
+			countBits(dataPair.first, window.statistics);
+		} catch(std::exception &e)
+		{
+			exceptionMessage = e.what();
+		}
+		
+		lock.lock();
+		if(!exceptionMessage.empty() && batch->exceptionMessage.empty())
+			batch->exceptionMessage = exceptionMessage;
+	}
+}
+
+void RSPReader::countBits(const TimeFrequencyData &data, std::vector<BeamletStatistics> &statistics)
+{
+	for(unsigned imageIndex=0;imageIndex < data.ImageCount();++imageIndex)
+	{
+		Image2DCPtr image = data.GetImage(imageIndex);
+		for(unsigned y=0;y<image->Height();++y) {
+			BeamletStatistics &beamletStatistics = statistics[y];
+			const num_t *row = image->ValuePtr(0, y);
+			for(unsigned x=0;x<image->Width();++x) {
+				int value = (int) row[x];
+				if(value < 0) {
+					value = -value;
+					++(beamletStatistics.bitUseCount[15]);
+				}
+				unsigned highestBit = (value!=0) ? 1 : 0;
+				for(unsigned bit=0;bit<15;++bit) {
+					if((value & (2<<bit)) != 0) {
+						highestBit = bit+1;
+					}
+				}
+				for(unsigned bit=0;bit<highestBit;++bit)
+					++(beamletStatistics.bitUseCount[bit]);
+				++(beamletStatistics.totalCount);
+			}
+		}
+	}
+}
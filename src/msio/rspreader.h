@@ -2,6 +2,9 @@
 #define RSPREADER_H
 
 #include <fstream>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
 
 #include "../util/aologger.h"
 
@@ -24,6 +27,10 @@ class RSPReader {
 		
 		std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> ReadAllBeamlets(unsigned long timestepStart, unsigned long timestepEnd, unsigned beamletCount);
 		
+		/**
+		 * Counts how often each bit of the samples is used, per beamlet. Windows of time steps
+		 * are read and counted in parallel, and are combined in time order.
+		 */
 		void ReadForStatistics(unsigned beamletCount);
 		
 		const std::string &File() const { return _rawFile; }
@@ -32,13 +39,17 @@ class RSPReader {
 	private:
 		static const unsigned char BitReverseTable256[256];
 
-		static void readNetworkOrder(std::ifstream &stream, char *buffer, unsigned length)
-		{
-			std::vector<char> swappedBuffer(length);
-			stream.read(&swappedBuffer[0], length);
-			for(unsigned i=0,j=length-1;i<length;++i,--j)
-				buffer[j] = swappedBuffer[i];
-		}
+		/**
+		 * Reads beamlets firstBeamlet to firstBeamlet+selectedCount-1. The file is read in
+		 * blocks of frames, and the samples of the selected beamlets are converted into the
+		 * rows of the images directly from the block.
+		 */
+		std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> readBeamlets(unsigned long timestepStart, unsigned long timestepEnd, unsigned beamletCount, unsigned firstBeamlet, unsigned selectedCount);
+		
+		/**
+		 * Number of bytes that are read from the file at once, approximately.
+		 */
+		static size_t blockSize() { return 8*1024*1024; }
 		static unsigned char reverse(unsigned char c)
 		{
 			return BitReverseTable256[c];
@@ -132,6 +143,11 @@ class RSPReader {
 			{
 				unsigned char buffer[16];
 				stream.read(reinterpret_cast<char*>(buffer), 16);
+				Read(buffer);
+			}
+			
+			void Read(const unsigned char *buffer)
+			{
 				versionId = buffer[0];
 				sourceInfo = buffer[1];
 				configurationId = toUShort(buffer[3], buffer[2]);
@@ -186,6 +202,13 @@ class RSPReader {
 				for(unsigned i=0;i<16;++i)
 					bitUseCount[i] = 0;
 			}
+			BeamletStatistics &operator+=(const BeamletStatistics &other)
+			{
+				totalCount += other.totalCount;
+				for(unsigned i=0;i<16;++i)
+					bitUseCount[i] += other.bitUseCount[i];
+				return *this;
+			}
 			void Print()
 			{
 				for(unsigned bit=0;bit<16;++bit)
@@ -200,6 +223,30 @@ class RSPReader {
 			unsigned long totalCount;
 			unsigned long bitUseCount[16];
 		};
+		
+		/**
+		 * Statistics of one window of time steps, as calculated by one of the threads
+		 * of ReadForStatistics().
+		 */
+		struct StatisticsWindow {
+			double startTime;
+			std::vector<BeamletStatistics> statistics;
+		};
+		
+		/**
+		 * The windows that the threads of ReadForStatistics() are working on.
+		 */
+		struct StatisticsBatch {
+			unsigned beamletCount;
+			unsigned long timesteps, stepSize, firstTimestep;
+			std::vector<StatisticsWindow> windows;
+			boost::mutex mutex;
+			size_t nextWindow;
+			std::string exceptionMessage;
+		};
+		
+		void statisticsThread(StatisticsBatch *batch);
+		static void countBits(const TimeFrequencyData &data, std::vector<BeamletStatistics> &statistics);
 };
 
 #endif // RSPREADER_H
@@ -0,0 +1,63 @@
+#include "combinedinputs.h"
+
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include <casacore/tables/Tables/Table.h>
+#include <casacore/tables/Tables/TableRecord.h>
+
+const std::string CombinedInputs::KeywordName = "AOQUALITY_COMBINED_INPUTS";
+
+bool CombinedInputs::IsStoredIn(const std::string &tableName)
+{
+	casacore::Table table(tableName);
+	return table.keywordSet().isDefined(KeywordName);
+}
+
+void CombinedInputs::Read(const std::string &tableName)
+{
+	casacore::Table table(tableName);
+	if(!table.keywordSet().isDefined(KeywordName))
+		throw std::runtime_error("Set " + tableName + " has no list of the sets that were combined into it");
+	casacore::Array<casacore::String> names = table.keywordSet().asArrayString(KeywordName);
+	_names.clear();
+	for(casacore::Array<casacore::String>::const_iterator i=names.begin(); i!=names.end(); ++i)
+		Add(*i);
+}
+
+void CombinedInputs::Write(const std::string &tableName) const
+{
+	casacore::Table table(tableName, casacore::Table::Update);
+	casacore::Vector<casacore::String> names(_names.size());
+	size_t index = 0;
+	for(std::set<std::string>::const_iterator i=_names.begin(); i!=_names.end(); ++i)
+	{
+		names[index] = *i;
+		++index;
+	}
+	table.rwKeywordSet().define(KeywordName, names);
+}
+
+std::vector<std::string> CombinedInputs::SelectNew(const std::vector<std::string> &names) const
+{
+	std::vector<std::string> newNames;
+	std::set<std::string> selected;
+	for(std::vector<std::string>::const_iterator i=names.begin(); i!=names.end(); ++i)
+	{
+		const std::string name = CanonicalName(*i);
+		if(_names.count(name) == 0 && selected.insert(name).second)
+			newNames.push_back(*i);
+	}
+	return newNames;
+}
+
+std::string CombinedInputs::CanonicalName(const std::string &name)
+{
+	boost::system::error_code error;
+	boost::filesystem::path path = boost::filesystem::canonical(name, error);
+	if(error)
+		return name;
+	else
+		return path.string();
+}
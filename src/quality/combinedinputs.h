@@ -0,0 +1,63 @@
+#ifndef COMBINED_INPUTS_H
+#define COMBINED_INPUTS_H
+
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * The names of the sets whose statistics were combined into a set by 'aoquality combine'.
+ * The names are stored in a keyword of the main table of the combined set, and are used
+ * to add only the statistics of new sets when combining incrementally.
+ *
+ * Names are kept as canonical paths, so that e.g. "a.ms", "./a.ms" and "a.ms/" refer
+ * to the same set.
+ */
+class CombinedInputs
+{
+	public:
+		/**
+		 * Whether the set @p tableName has a list of combined inputs. A set without a list
+		 * was not written by 'combine', or by an older version of it; its statistics can
+		 * therefore not be added to incrementally.
+		 */
+		static bool IsStoredIn(const std::string &tableName);
+		
+		/**
+		 * Reads the list of combined inputs of a set.
+		 * @throws std::runtime_error if the set has no list.
+		 */
+		void Read(const std::string &tableName);
+		
+		void Write(const std::string &tableName) const;
+		
+		bool Contains(const std::string &name) const
+		{
+			return _names.count(CanonicalName(name)) != 0;
+		}
+		
+		void Add(const std::string &name)
+		{
+			_names.insert(CanonicalName(name));
+		}
+		
+		/**
+		 * Returns the sets of @p names that are not in the list, with each set only once,
+		 * in the order in which they are given.
+		 */
+		std::vector<std::string> SelectNew(const std::vector<std::string> &names) const;
+		
+		size_t Size() const { return _names.size(); }
+		
+		/**
+		 * Returns the absolute path of @p name without symbolic links, "." and ".." parts and
+		 * trailing slashes, or @p name itself if it does not exist.
+		 */
+		static std::string CanonicalName(const std::string &name);
+		
+		static const std::string KeywordName;
+	private:
+		std::set<std::string> _names;
+};
+
+#endif
@@ -105,6 +105,16 @@ class StatisticsCollection : public Serializable
 			loadTime<false>(qualityData);
 		}
 		
+		void LoadBaselineStatisticsOnly(QualityTablesFormatter &qualityData)
+		{
+			loadBaseline<false>(qualityData);
+		}
+		
+		void LoadFrequencyStatisticsOnly(QualityTablesFormatter &qualityData)
+		{
+			loadFrequency<false>(qualityData);
+		}
+		
 		void Add(QualityTablesFormatter &qualityData)
 		{
 			loadTime<true>(qualityData);
@@ -119,6 +129,25 @@ class StatisticsCollection : public Serializable
 			addBaseline(collection);
 		}
 		
+		/**
+		 * Like Add(const StatisticsCollection&), but only adds the statistics of one dimension,
+		 * so that a collection can be built that holds only what a single plot needs.
+		 */
+		void AddTimeStatistics(const StatisticsCollection &collection)
+		{
+			addTime(collection);
+		}
+		
+		void AddFrequencyStatistics(const StatisticsCollection &collection)
+		{
+			addFrequency(collection);
+		}
+		
+		void AddBaselineStatistics(const StatisticsCollection &collection)
+		{
+			addBaseline(collection);
+		}
+		
 		void GetGlobalTimeStatistics(DefaultStatistics &statistics)
 		{
 			statistics = getGlobalStatistics(_timeStatistics);
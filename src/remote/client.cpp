@@ -2,6 +2,8 @@
 
 #include <typeinfo>
 
+#include <boost/array.hpp>
+
 #include <boost/asio/read.hpp>
 #include <boost/asio/write.hpp>
 
@@ -12,6 +14,7 @@
 #include "../quality/qualitytablesformatter.h"
 #include "../quality/statisticscollection.h"
 
+#include "datarowstransfer.h"
 #include "format.h"
 #include "processcommander.h"
 
@@ -28,8 +31,11 @@ Client::Client()
 
 void Client::Run(const std::string &serverHost)
 {
-	const Hostname hostname = ProcessCommander::GetHostName();
-	
+	Run(serverHost, ProcessCommander::GetHostName());
+}
+
+void Client::Run(const std::string &serverHost, const Hostname &hostname)
+{
 	try {
 		boost::asio::ip::tcp::resolver resolver(_ioService);
 		std::stringstream s;
@@ -137,9 +143,11 @@ void Client::writeDataResponse(std::ostringstream &buffer)
 		const std::string str = buffer.str();
 		header.dataSize = str.size();
 		
-		boost::asio::write(_socket, boost::asio::buffer(&header, sizeof(header)));
-		if(str.size() != 0)
-			boost::asio::write(_socket, boost::asio::buffer(str));
+		// Gather the header and the data in a single write
+		boost::array<boost::asio::const_buffer, 2> buffers = {{
+			boost::asio::buffer(&header, sizeof(header)),
+			boost::asio::buffer(str) }};
+		boost::asio::write(_socket, buffers);
 	} catch(std::exception &e) {
 		writeGenericReadException(e);
 	}
@@ -256,13 +264,12 @@ void Client::handleReadDataRows(unsigned dataSize)
 		boost::asio::read(_socket, boost::asio::buffer(&options.startRow, sizeof(options.startRow)));
 		boost::asio::read(_socket, boost::asio::buffer(&options.rowCount, sizeof(options.rowCount)));
 		
-		std::ostringstream buffer;
-		Serializable::SerializeToUInt64(buffer, options.rowCount);
-		
 		// Read meta data from the MS
 		casacore::Table table(options.msFilename);
+		DataRowsTransfer transfer;
+		std::vector<MSRowDataExt> rows;
 		if(options.rowCount == 0)
-			Serializable::SerializeToUInt64(buffer, table.nrow());
+			transfer.PrepareTotalRowCount(table.nrow());
 		else {
 			casacore::ROArrayColumn<casacore::Complex> dataCol(table, "DATA");
 			casacore::ROArrayColumn<double> uvwColumn(table, "UVW");
@@ -280,19 +287,21 @@ void Client::handleReadDataRows(unsigned dataSize)
 				throw std::runtime_error("Unknown shape of DATA column");
 			const size_t samplesPerRow = polarizationCount * channelCount;
 			
-			// Read and serialize the rows
-			const size_t endRow = options.startRow + options.rowCount;
-			for(size_t rowIndex=options.startRow; rowIndex != endRow; ++rowIndex)
+			// Read the rows
+			rows.assign(options.rowCount, MSRowDataExt(polarizationCount, channelCount));
+			for(size_t i=0; i != options.rowCount; ++i)
 			{
+				const size_t rowIndex = options.startRow + i;
+				
 				// DATA
 				const casacore::Array<casacore::Complex> cellData = dataCol(rowIndex);
 				casacore::Array<casacore::Complex>::const_iterator cellIter = cellData.begin();
 				
-				MSRowDataExt dataExt(polarizationCount, channelCount);
+				MSRowDataExt &dataExt = rows[i];
 				MSRowData &data = dataExt.Data();
 				num_t *realPtr = data.RealPtr();
 				num_t *imagPtr = data.ImagPtr();
-				for(size_t i=0;i<samplesPerRow;++i) {
+				for(size_t s=0;s<samplesPerRow;++s) {
 					*realPtr = cellIter->real();
 					*imagPtr = cellIter->imag();
 					++realPtr;
@@ -314,12 +323,20 @@ void Client::handleReadDataRows(unsigned dataSize)
 				dataExt.SetAntenna2(a2Column(rowIndex));
 				dataExt.SetTime(timeColumn(rowIndex));
 				dataExt.SetTimeOffsetIndex(rowIndex);
-				
-				dataExt.Serialize(buffer);
 			}
+			transfer.PrepareSend(&rows[0], rows.size());
 		}
 		
-		writeDataResponse(buffer);
+		GenericReadResponseHeader header;
+		header.blockIdentifier = GenericReadResponseHeaderId;
+		header.blockSize = sizeof(header);
+		header.errorCode = NoError;
+		header.dataSize = transfer.BlockSize();
+		
+		// The rows are sent directly from their memory
+		std::vector<boost::asio::const_buffer> buffers = transfer.SendBuffers();
+		buffers.insert(buffers.begin(), boost::asio::buffer(&header, sizeof(header)));
+		boost::asio::write(_socket, buffers);
 	} catch(std::exception &e) {
 		writeGenericReadException(e);
 	}
@@ -337,12 +354,17 @@ void Client::handleWriteDataRows(unsigned dataSize)
 		boost::asio::read(_socket, boost::asio::buffer(&options.rowCount, sizeof(options.rowCount)));
 		boost::asio::read(_socket, boost::asio::buffer(&options.dataSize, sizeof(options.dataSize)));
 		
-		// Read the big data chunk
-		std::vector<char> dataBuffer(options.dataSize);
-		boost::asio::read(_socket, boost::asio::buffer(&dataBuffer[0], options.dataSize));
-		std::istringstream stream;
-		if(stream.rdbuf()->pubsetbuf(&dataBuffer[0], options.dataSize) == 0)
-			throw std::runtime_error("Could not set string buffer");
+		// Receive the rows directly into their memory
+		DataRowsTransfer transfer;
+		boost::asio::read(_socket, transfer.HeaderBuffer());
+		if(transfer.BlockSize() != options.dataSize || transfer.Header().rowCount != options.rowCount)
+			throw std::runtime_error("Size of data rows block sent by server does not match its header");
+		std::vector<MSRowDataExt> rows(options.rowCount);
+		if(!rows.empty())
+		{
+			boost::asio::read(_socket, transfer.ReceiveBuffers(&rows[0]));
+			transfer.FinishReceive(&rows[0]);
+		}
 		
 		// Write the received data to the MS
 		casacore::Table table(options.msFilename, casacore::Table::Update);
@@ -359,27 +381,26 @@ void Client::handleWriteDataRows(unsigned dataSize)
 		else
 			throw std::runtime_error("Unknown shape of DATA column");
 		const size_t samplesPerRow = polarizationCount * channelCount;
+		if(!rows.empty() && (transfer.Header().polarizationCount != polarizationCount || transfer.Header().channelCount != channelCount))
+			throw std::runtime_error("Shape of the rows sent by the server does not match the DATA column");
 		
-		// Unserialize and write the rows
+		// Write the rows
 		casacore::Array<casacore::Complex> cellData(shape);
-		const size_t endRow = options.startRow + options.rowCount;
-		for(size_t rowIndex=options.startRow; rowIndex != endRow; ++rowIndex)
+		for(size_t i=0; i != options.rowCount; ++i)
 		{
-			MSRowDataExt dataExt;
-			dataExt.Unserialize(stream);
-			MSRowData &data = dataExt.Data();
+			const MSRowData &data = rows[i].Data();
 			
 			casacore::Array<casacore::Complex>::iterator cellIter = cellData.begin();
 			
-			num_t *realPtr = data.RealPtr();
-			num_t *imagPtr = data.ImagPtr();
-			for(size_t i=0;i<samplesPerRow;++i) {
+			const num_t *realPtr = data.RealPtr();
+			const num_t *imagPtr = data.ImagPtr();
+			for(size_t s=0;s<samplesPerRow;++s) {
 				*cellIter = casacore::Complex(*realPtr, *imagPtr);
 				++realPtr;
 				++imagPtr;
 				++cellIter;
 			}
-			dataCol.put(rowIndex, cellData);
+			dataCol.put(options.startRow + i, cellData);
 		}
 		
 		std::ostringstream buffer;
@@ -5,6 +5,7 @@
 #include <boost/asio/ip/tcp.hpp>
 
 #include "format.h"
+#include "hostname.h"
 
 namespace aoRemote {
 
@@ -15,6 +16,13 @@ class Client
 		
 		void Run(const std::string &serverHost);
 		
+		/**
+		 * Like Run(const std::string&), but identifies itself to the server as
+		 * @p nodeName instead of the name of this host. This allows several
+		 * clients in one process to act as the nodes of a local cluster.
+		 */
+		void Run(const std::string &serverHost, const Hostname &nodeName);
+		
 		static unsigned PORT() { return 1892; }
 		
 	private:
@@ -0,0 +1,173 @@
+#ifndef AOREMOTE__DATA_ROWS_TRANSFER_H
+#define AOREMOTE__DATA_ROWS_TRANSFER_H
+
+#include <stdexcept>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+#include "../structures/msrowdataext.h"
+
+#include "format.h"
+
+namespace aoRemote {
+
+/**
+ * Assembles and disassembles a block of data rows in the format described
+ * by DataRowsHeader. The row samples are not copied: the buffer sequences
+ * that are returned point directly into the memory of the rows, so that
+ * they can be passed to boost::asio's scatter-gather read and write functions.
+ * The header and meta data are stored in this object, which should therefore
+ * remain alive until the transfer has finished.
+ */
+class DataRowsTransfer
+{
+	public:
+		DataRowsTransfer() : _sendRows(0)
+		{
+			_header.rowCount = 0;
+			_header.totalRowCount = 0;
+			_header.polarizationCount = 0;
+			_header.channelCount = 0;
+		}
+		
+		/**
+		 * Prepares an empty block that only reports the total number of rows in a set.
+		 */
+		void PrepareTotalRowCount(size_t totalRowCount)
+		{
+			_header.rowCount = 0;
+			_header.totalRowCount = totalRowCount;
+			_header.polarizationCount = 0;
+			_header.channelCount = 0;
+			_meta.clear();
+		}
+		
+		void PrepareSend(const MSRowDataExt *rows, size_t rowCount)
+		{
+			_header.rowCount = rowCount;
+			_header.totalRowCount = 0;
+			if(rowCount == 0)
+			{
+				_header.polarizationCount = 0;
+				_header.channelCount = 0;
+			} else {
+				_header.polarizationCount = rows[0].Data().PolarizationCount();
+				_header.channelCount = rows[0].Data().ChannelCount();
+			}
+			_meta.resize(rowCount);
+			for(size_t i=0; i!=rowCount; ++i)
+			{
+				const MSRowData &data = rows[i].Data();
+				if(data.PolarizationCount() != _header.polarizationCount || data.ChannelCount() != _header.channelCount)
+					throw std::runtime_error("Data rows to be sent do not all have the same shape");
+				DataRowMeta &meta = _meta[i];
+				meta.antenna1 = rows[i].Antenna1();
+				meta.antenna2 = rows[i].Antenna2();
+				meta.timeOffsetIndex = rows[i].TimeOffsetIndex();
+				meta.u = rows[i].U();
+				meta.v = rows[i].V();
+				meta.w = rows[i].W();
+				meta.time = rows[i].Time();
+			}
+			_sendRows = rows;
+		}
+		
+		/**
+		 * Buffer sequence of a block prepared with PrepareSend() or PrepareTotalRowCount().
+		 * The rows given to PrepareSend() should not change until the sequence
+		 * has been written.
+		 */
+		std::vector<boost::asio::const_buffer> SendBuffers() const
+		{
+			std::vector<boost::asio::const_buffer> buffers;
+			buffers.reserve(_header.rowCount + 2);
+			buffers.push_back(boost::asio::buffer(&_header, sizeof(_header)));
+			if(_header.rowCount != 0)
+			{
+				buffers.push_back(boost::asio::buffer(&_meta[0], _meta.size() * sizeof(DataRowMeta)));
+				const size_t rowSize = rowSampleSize();
+				for(size_t i=0; i!=_header.rowCount; ++i)
+					buffers.push_back(boost::asio::buffer(_sendRows[i].Data().RealPtr(), rowSize));
+			}
+			return buffers;
+		}
+		
+		/**
+		 * Buffer in which the header of a block can be received. After the
+		 * header has been received, ReceiveBuffers() can be used to receive
+		 * the rest of the block.
+		 */
+		boost::asio::mutable_buffers_1 HeaderBuffer()
+		{
+			return boost::asio::buffer(&_header, sizeof(_header));
+		}
+		
+		const DataRowsHeader &Header() const { return _header; }
+		
+		/**
+		 * Number of bytes in the block, including the header.
+		 */
+		size_t BlockSize() const
+		{
+			return sizeof(DataRowsHeader) + _header.rowCount * (sizeof(DataRowMeta) + rowSampleSize());
+		}
+		
+		/**
+		 * Shapes the destination rows according to the received header, and returns
+		 * a buffer sequence that receives the meta data and the samples. The samples
+		 * are directly received into the destination rows. After the sequence has
+		 * been read, FinishReceive() should be called to set the meta data.
+		 * @param destinationRows Array of at least Header().rowCount rows.
+		 */
+		std::vector<boost::asio::mutable_buffer> ReceiveBuffers(MSRowDataExt *destinationRows)
+		{
+			std::vector<boost::asio::mutable_buffer> buffers;
+			_meta.resize(_header.rowCount);
+			if(_header.rowCount != 0)
+			{
+				buffers.reserve(_header.rowCount + 1);
+				buffers.push_back(boost::asio::buffer(&_meta[0], _meta.size() * sizeof(DataRowMeta)));
+				const size_t rowSize = rowSampleSize();
+				for(size_t i=0; i!=_header.rowCount; ++i)
+				{
+					MSRowData &data = destinationRows[i].Data();
+					data.SetShape(_header.polarizationCount, _header.channelCount);
+					buffers.push_back(boost::asio::buffer(data.RealPtr(), rowSize));
+				}
+			}
+			return buffers;
+		}
+		
+		void FinishReceive(MSRowDataExt *destinationRows) const
+		{
+			for(size_t i=0; i!=_header.rowCount; ++i)
+			{
+				const DataRowMeta &meta = _meta[i];
+				MSRowDataExt &row = destinationRows[i];
+				row.SetAntenna1(meta.antenna1);
+				row.SetAntenna2(meta.antenna2);
+				row.SetTimeOffsetIndex(meta.timeOffsetIndex);
+				row.SetU(meta.u);
+				row.SetV(meta.v);
+				row.SetW(meta.w);
+				row.SetTime(meta.time);
+			}
+		}
+	private:
+		DataRowsTransfer(const DataRowsTransfer &) { } // don't allow copies
+		void operator=(const DataRowsTransfer &) { } // don't allow assignment
+		
+		size_t rowSampleSize() const
+		{
+			return size_t(_header.polarizationCount) * _header.channelCount * 2 * sizeof(num_t);
+		}
+		
+		DataRowsHeader _header;
+		std::vector<DataRowMeta> _meta;
+		const MSRowDataExt *_sendRows;
+};
+
+}
+
+#endif
@@ -4,7 +4,7 @@
 #include <stdint.h>
 #include <string>
 
-#define AO_REMOTE_PROTOCOL_VERSION 1
+#define AO_REMOTE_PROTOCOL_VERSION 2
 
 namespace aoRemote {
 
@@ -90,6 +90,31 @@ struct GenericReadResponseHeader
 	int64_t dataSize;
 };
 
+/**
+ * Header of a block of data rows. This block is sent as the data of a read data
+ * rows response and of a write data rows request. The header is followed by
+ * rowCount DataRowMeta structures, which are followed by the samples of each
+ * row. The samples of one row consist of polarizationCount x channelCount real
+ * values followed by the same number of imaginary values, which is the layout of
+ * MSRowData. Hence, rows can be sent from and received into their own memory.
+ */
+struct DataRowsHeader
+{
+	uint64_t rowCount;
+	uint64_t totalRowCount;
+	uint32_t polarizationCount;
+	uint32_t channelCount;
+};
+
+struct DataRowMeta
+{
+	uint32_t antenna1;
+	uint32_t antenna2;
+	uint64_t timeOffsetIndex;
+	double u, v, w;
+	double time;
+};
+
 #define READ_QTABLES_OPTION_COLLECT_IF_REQUIRED  0x0001
 #define READ_QTABLES_OPTION_SAVE_COLLECTED       0x0002
 
@@ -0,0 +1,229 @@
+#include "localcluster.h"
+
+#include <algorithm>
+#include <complex>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <casacore/ms/MeasurementSets/MeasurementSet.h>
+#include <casacore/tables/Tables/ArrColDesc.h>
+#include <casacore/tables/Tables/SetupNewTab.h>
+
+#include "../quality/histogramcollection.h"
+#include "../quality/histogramtablesformatter.h"
+#include "../quality/qualitytablesformatter.h"
+#include "../quality/statisticscollection.h"
+
+#include "../util/rng.h"
+
+namespace aoRemote
+{
+
+LocalCluster::LocalCluster(const std::string &directory, size_t nodeCount)
+: _directory(directory), _nodeCount(nodeCount), _keepSets(false), _setsCreated(false)
+{
+	for(size_t i=0; i!=nodeCount; ++i)
+		_observation.AddItem(ClusteredObservationItem(i, setPath(i), NodeName(i)));
+}
+
+LocalCluster::~LocalCluster()
+{
+	if(_setsCreated && !_keepSets)
+		removeSets();
+}
+
+Hostname LocalCluster::NodeName(size_t nodeIndex)
+{
+	std::ostringstream s;
+	s << "localnode" << nodeIndex;
+	return Hostname(s.str());
+}
+
+std::string LocalCluster::setPath(size_t nodeIndex) const
+{
+	std::ostringstream s;
+	s << "localnode" << nodeIndex << ".ms";
+	return (boost::filesystem::path(_directory) / s.str()).string();
+}
+
+void LocalCluster::CreateSets(const SetDimensions &dimensions, bool addQualityTables)
+{
+	boost::filesystem::create_directories(_directory);
+	_setsCreated = true;
+	for(size_t i=0; i!=_nodeCount; ++i)
+		createSet(i, dimensions, addQualityTables);
+}
+
+void LocalCluster::removeSets()
+{
+	for(size_t i=0; i!=_nodeCount; ++i)
+		boost::filesystem::remove_all(setPath(i));
+}
+
+void LocalCluster::createSet(size_t nodeIndex, const SetDimensions &dimensions, bool addQualityTables) const
+{
+	const std::string path = setPath(nodeIndex);
+	const size_t
+		antennaCount = dimensions.antennaCount,
+		channelCount = dimensions.channelCount,
+		polarizationCount = dimensions.polarizationCount;
+	const double
+		channelWidth = 10000.0,
+		startFrequency = 100.0e6 + nodeIndex * channelCount * channelWidth,
+		startTime = 4.8e9,
+		integrationTime = 1.0;
+	
+	std::vector<double> frequencies(channelCount);
+	for(size_t ch=0; ch!=channelCount; ++ch)
+		frequencies[ch] = startFrequency + ch * channelWidth;
+	StatisticsCollection statistics(polarizationCount);
+	statistics.InitializeBand(0, &frequencies[0], channelCount);
+	HistogramCollection histograms(polarizationCount);
+	
+	// The set is closed at the end of this block, before the quality tables are added
+	{
+		// Main table with a DATA column of fixed shape
+		casacore::TableDesc tableDesc = casacore::MS::requiredTableDesc();
+		casacore::ArrayColumnDesc<casacore::Complex> dataColumnDesc(casacore::MS::columnName(casacore::MSMainEnums::DATA), casacore::IPosition(2, polarizationCount, channelCount), casacore::ColumnDesc::FixedShape);
+		tableDesc.addColumn(dataColumnDesc);
+		casacore::SetupNewTable newTab(path, tableDesc, casacore::Table::New);
+		casacore::MeasurementSet ms(newTab);
+		ms.createDefaultSubtables(casacore::Table::New);
+		
+		// Antennas on a line, 100 m apart
+		casacore::MSAntenna antTable = ms.antenna();
+		casacore::ScalarColumn<casacore::String> nameCol(antTable, antTable.columnName(casacore::MSAntennaEnums::NAME));
+		casacore::ScalarColumn<casacore::String> stationCol(antTable, antTable.columnName(casacore::MSAntennaEnums::STATION));
+		casacore::ScalarColumn<casacore::String> mountCol(antTable, antTable.columnName(casacore::MSAntennaEnums::MOUNT));
+		casacore::ArrayColumn<double> positionCol(antTable, antTable.columnName(casacore::MSAntennaEnums::POSITION));
+		casacore::ScalarColumn<double> dishDiameterCol(antTable, antTable.columnName(casacore::MSAntennaEnums::DISH_DIAMETER));
+		antTable.addRow(antennaCount);
+		for(size_t a=0; a!=antennaCount; ++a)
+		{
+			std::ostringstream name;
+			name << "ANT" << a;
+			nameCol.put(a, name.str());
+			stationCol.put(a, "LOCAL");
+			mountCol.put(a, "ALT-AZ");
+			casacore::Vector<double> position(3);
+			position[0] = 100.0 * a; position[1] = 0.0; position[2] = 0.0;
+			positionCol.put(a, position);
+			dishDiameterCol.put(a, 25.0);
+		}
+		
+		// Spectral window
+		casacore::MSSpectralWindow spwTable = ms.spectralWindow();
+		casacore::ScalarColumn<int> numChanCol(spwTable, spwTable.columnName(casacore::MSSpectralWindowEnums::NUM_CHAN));
+		casacore::ArrayColumn<double> chanFreqCol(spwTable, spwTable.columnName(casacore::MSSpectralWindowEnums::CHAN_FREQ));
+		casacore::ArrayColumn<double> chanWidthCol(spwTable, spwTable.columnName(casacore::MSSpectralWindowEnums::CHAN_WIDTH));
+		casacore::ScalarColumn<double> refFrequencyCol(spwTable, spwTable.columnName(casacore::MSSpectralWindowEnums::REF_FREQUENCY));
+		casacore::Vector<double> chanFreq(channelCount), chanWidth(channelCount);
+		for(size_t ch=0; ch!=channelCount; ++ch)
+		{
+			chanFreq[ch] = frequencies[ch];
+			chanWidth[ch] = channelWidth;
+		}
+		spwTable.addRow(1);
+		numChanCol.put(0, channelCount);
+		chanFreqCol.put(0, chanFreq);
+		chanWidthCol.put(0, chanWidth);
+		refFrequencyCol.put(0, startFrequency);
+		
+		// Polarizations (linear)
+		casacore::MSPolarization polTable = ms.polarization();
+		casacore::ScalarColumn<int> numCorrCol(polTable, polTable.columnName(casacore::MSPolarizationEnums::NUM_CORR));
+		casacore::ArrayColumn<int> corrTypeCol(polTable, polTable.columnName(casacore::MSPolarizationEnums::CORR_TYPE));
+		casacore::ArrayColumn<int> corrProductCol(polTable, polTable.columnName(casacore::MSPolarizationEnums::CORR_PRODUCT));
+		polTable.addRow(1);
+		numCorrCol.put(0, polarizationCount);
+		casacore::Vector<int> corrType(polarizationCount);
+		casacore::Array<int> corrProduct(casacore::IPosition(2, 2, polarizationCount));
+		for(size_t p=0; p!=polarizationCount; ++p)
+		{
+			corrType[p] = 9 + p;
+			corrProduct(casacore::IPosition(2, 0, p)) = p / 2;
+			corrProduct(casacore::IPosition(2, 1, p)) = p % 2;
+		}
+		corrTypeCol.put(0, corrType);
+		corrProductCol.put(0, corrProduct);
+		
+		casacore::MSDataDescription dataDescTable = ms.dataDescription();
+		casacore::ScalarColumn<int> spwIdCol(dataDescTable, dataDescTable.columnName(casacore::MSDataDescriptionEnums::SPECTRAL_WINDOW_ID));
+		casacore::ScalarColumn<int> polIdCol(dataDescTable, dataDescTable.columnName(casacore::MSDataDescriptionEnums::POLARIZATION_ID));
+		dataDescTable.addRow(1);
+		spwIdCol.put(0, 0);
+		polIdCol.put(0, 0);
+		
+		// Rows with Gaussian noise, ordered by time and baseline
+		casacore::ScalarColumn<int> a1Col(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA1));
+		casacore::ScalarColumn<int> a2Col(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA2));
+		casacore::ScalarColumn<double> timeCol(ms, casacore::MS::columnName(casacore::MSMainEnums::TIME));
+		casacore::ScalarColumn<double> intervalCol(ms, casacore::MS::columnName(casacore::MSMainEnums::INTERVAL));
+		casacore::ArrayColumn<double> uvwCol(ms, casacore::MS::columnName(casacore::MSMainEnums::UVW));
+		casacore::ArrayColumn<casacore::Complex> dataCol(ms, casacore::MS::columnName(casacore::MSMainEnums::DATA));
+		casacore::ArrayColumn<bool> flagCol(ms, casacore::MS::columnName(casacore::MSMainEnums::FLAG));
+		
+		const size_t sampleCount = polarizationCount * channelCount;
+		std::vector<float> reals(sampleCount), imags(sampleCount);
+		std::vector<std::complex<float> > polarizationValues(channelCount);
+		std::unique_ptr<bool[]> noFlags(new bool[channelCount]);
+		std::fill(noFlags.get(), noFlags.get() + channelCount, false);
+		casacore::Array<casacore::Complex> data(casacore::IPosition(2, polarizationCount, channelCount));
+		const casacore::Array<bool> flags(casacore::IPosition(2, polarizationCount, channelCount), false);
+		
+		ms.addRow(dimensions.RowCount());
+		size_t row = 0;
+		for(size_t t=0; t!=dimensions.timestepCount; ++t)
+		{
+			const double time = startTime + t * integrationTime;
+			for(size_t a1=0; a1!=antennaCount; ++a1)
+			{
+				for(size_t a2=a1; a2!=antennaCount; ++a2)
+				{
+					casacore::Array<casacore::Complex>::iterator dataIter = data.begin();
+					for(size_t s=0; s!=sampleCount; ++s)
+					{
+						reals[s] = RNG::Gaussian();
+						imags[s] = RNG::Gaussian();
+						*dataIter = casacore::Complex(reals[s], imags[s]);
+						++dataIter;
+					}
+					a1Col.put(row, a1);
+					a2Col.put(row, a2);
+					timeCol.put(row, time);
+					intervalCol.put(row, integrationTime);
+					casacore::Vector<double> uvw(3);
+					uvw[0] = 100.0 * (double(a2) - double(a1)); uvw[1] = 0.0; uvw[2] = 0.0;
+					uvwCol.put(row, uvw);
+					dataCol.put(row, data);
+					flagCol.put(row, flags);
+		
+					if(addQualityTables)
+					{
+						for(size_t p=0; p!=polarizationCount; ++p)
+						{
+							statistics.Add(a1, a2, time, 0, p, &reals[p], &imags[p], noFlags.get(), noFlags.get(), channelCount, polarizationCount, 1, 1);
+							for(size_t ch=0; ch!=channelCount; ++ch)
+								polarizationValues[ch] = std::complex<float>(reals[ch*polarizationCount + p], imags[ch*polarizationCount + p]);
+							histograms.Add(a1, a2, p, &polarizationValues[0], noFlags.get(), channelCount);
+						}
+					}
+					++row;
+				}
+			}
+		}
+	}
+	
+	if(addQualityTables)
+	{
+		QualityTablesFormatter qualityTables(path);
+		statistics.Save(qualityTables);
+		HistogramTablesFormatter histogramTables(path);
+		histograms.Save(histogramTables);
+	}
+}
+
+}
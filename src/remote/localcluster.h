@@ -0,0 +1,75 @@
+#ifndef AOREMOTE__LOCAL_CLUSTER_H
+#define AOREMOTE__LOCAL_CLUSTER_H
+
+#include <string>
+
+#include "clusteredobservation.h"
+
+namespace aoRemote {
+
+/**
+ * A stand-in for a cluster that runs completely on the local machine. It
+ * creates a synthetic measurement set for each of its virtual nodes, and
+ * describes them as a ClusteredObservation in which every node has its
+ * own node name. When a ProcessCommander is run on this observation with
+ * ProcessCommander::SetRunClientsInProcess(true), every node is served by
+ * a client thread over a local socket, so that the complete remote data
+ * path can be exercised and timed without ssh or actual nodes.
+ */
+class LocalCluster
+{
+	public:
+		struct SetDimensions
+		{
+			SetDimensions() : antennaCount(8), channelCount(64), timestepCount(100), polarizationCount(4)
+			{ }
+			
+			size_t antennaCount, channelCount, timestepCount, polarizationCount;
+			
+			/** Nr of rows in each set; all cross-correlations and auto-correlations are stored. */
+			size_t RowCount() const { return timestepCount * antennaCount * (antennaCount+1) / 2; }
+		};
+		
+		/**
+		 * @param directory Directory in which the measurement sets are created. It will
+		 * be created if it does not exist.
+		 * @param nodeCount Number of virtual nodes, each of which holds one set.
+		 */
+		LocalCluster(const std::string &directory, size_t nodeCount);
+		
+		/**
+		 * Removes the sets, unless KeepSets() was called.
+		 */
+		~LocalCluster();
+		
+		/**
+		 * Creates the synthetic sets. Each set holds noise-like visibilities in the
+		 * DATA column and, when @p addQualityTables is set, quality statistics and
+		 * histograms of its data. Every node covers its own frequency range.
+		 */
+		void CreateSets(const SetDimensions &dimensions, bool addQualityTables = true);
+		
+		void KeepSets() { _keepSets = true; }
+		
+		const ClusteredObservation &Observation() const { return _observation; }
+		
+		size_t NodeCount() const { return _nodeCount; }
+		
+		static Hostname NodeName(size_t nodeIndex);
+	private:
+		LocalCluster(const LocalCluster &) { } // don't allow copies
+		void operator=(const LocalCluster &) { } // don't allow assignment
+		
+		std::string setPath(size_t nodeIndex) const;
+		void createSet(size_t nodeIndex, const SetDimensions &dimensions, bool addQualityTables) const;
+		void removeSets();
+		
+		std::string _directory;
+		size_t _nodeCount;
+		bool _keepSets, _setsCreated;
+		ClusteredObservation _observation;
+};
+
+}
+
+#endif
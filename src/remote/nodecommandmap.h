@@ -80,6 +80,18 @@ class NodeCommandMap
 			return _nodeMap.empty();
 		}
 		
+		/**
+		 * Number of items ('commands') that are still to be executed by the given node.
+		 */
+		size_t ItemCount(const Hostname &hostname) const
+		{
+			NodeMap::const_iterator iter = _nodeMap.find(hostname);
+			if(iter == _nodeMap.end())
+				return 0;
+			else
+				return iter->second.size();
+		}
+		
 		void NodeList(std::vector<Hostname> &dest) const
 		{
 			dest.resize(_nodeMap.size());
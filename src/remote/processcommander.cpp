@@ -1,5 +1,6 @@
 #include "processcommander.h"
 
+#include <algorithm>
 #include <climits>
 #include <unistd.h> //gethostname
 #include <boost/mem_fn.hpp>
@@ -14,13 +15,19 @@
 namespace aoRemote {
 
 ProcessCommander::ProcessCommander(const ClusteredObservation &observation)
-: _server(), _observation(observation)
+: _server(), _observation(observation),
+	_runClientsInProcess(false),
+	_isAsync(false), _readChannels(0), _writeChannels(0),
+	_asyncWork(0), _asyncThread(0),
+	_expectedAsyncConnections(0), _asyncConnectionTotal(0)
 {
 	_server.SignalConnectionCreated().connect(boost::bind(&ProcessCommander::onConnectionCreated, this, _1, _2));
 }
 
 ProcessCommander::~ProcessCommander()
 {
+	if(_isAsync)
+		StopAsync();
 	endIdleConnections();
 	for(std::vector<RemoteProcess*>::iterator i=_processes.begin();i!=_processes.end();++i)
 	{
@@ -64,12 +71,7 @@ void ProcessCommander::Run(bool finishConnections)
 			std::vector<Hostname> list;
 			_nodeCommands.NodeList(list);
 			for(std::vector<Hostname>::const_iterator i=list.begin();i!=list.end();++i)
-			{
-				RemoteProcess *process = new RemoteProcess(*i, thisHostName);
-				process->SignalFinished() = boost::bind(&ProcessCommander::onProcessFinished, this, _1, _2, _3);
-				process->Start();
-				_processes.push_back(process);
-			}
+				startProcess(*i, thisHostName);
 		}
 		
 		// We will now start accepting connections. The Run() method will not return until the server
@@ -80,6 +82,238 @@ void ProcessCommander::Run(bool finishConnections)
 	}
 }
 
+void ProcessCommander::startProcess(const Hostname &clientHostName, const Hostname &serverHostName)
+{
+	RemoteProcess *process;
+	if(_runClientsInProcess)
+		process = new RemoteProcess(clientHostName, Hostname("localhost"), true);
+	else
+		process = new RemoteProcess(clientHostName, serverHostName);
+	process->SignalFinished() = boost::bind(&ProcessCommander::onProcessFinished, this, _1, _2, _3);
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		++_runningProcessCounts[clientHostName];
+	}
+	process->Start();
+	_processes.push_back(process);
+}
+
+void ProcessCommander::StartAsync(size_t readChannels, size_t writeChannels)
+{
+	if(_isAsync)
+		throw std::runtime_error("ProcessCommander::StartAsync() called twice");
+	if(readChannels + writeChannels == 0)
+		throw std::runtime_error("ProcessCommander::StartAsync() needs at least one channel");
+	_isAsync = true;
+	_readChannels = readChannels;
+	_writeChannels = writeChannels;
+	_finishConnections = false;
+	_errors.clear();
+	_asyncConnectionCounts.clear();
+	_asyncConnectionTotal = 0;
+	
+	// Start as many processes per node as there are channels. Processes
+	// of earlier synchronous runs are reused.
+	std::map<Hostname, size_t> processCounts;
+	for(std::vector<RemoteProcess*>::const_iterator i=_processes.begin();i!=_processes.end();++i)
+		++processCounts[(*i)->ClientHostname()];
+	NodeCommandMap nodes;
+	nodes.Initialize(_observation);
+	std::vector<Hostname> list;
+	nodes.NodeList(list);
+	_expectedAsyncConnections = list.size() * (readChannels + writeChannels);
+	
+	const Hostname thisHostName = GetHostName();
+	bool newProcesses = false;
+	for(std::vector<Hostname>::const_iterator i=list.begin();i!=list.end();++i)
+	{
+		for(size_t p=processCounts[*i]; p<readChannels + writeChannels; ++p)
+		{
+			startProcess(*i, thisHostName);
+			newProcesses = true;
+		}
+	}
+	
+	_asyncWork = new boost::asio::io_service::work(_server.IOService());
+	if(newProcesses)
+		_server.Reopen();
+	
+	// Idle connections of earlier synchronous runs become the first channels of their node
+	ConnectionVector idleConnections = _idleConnections;
+	_idleConnections.clear();
+	for(ConnectionVector::const_iterator i=idleConnections.begin();i!=idleConnections.end();++i)
+		_server.IOService().post(boost::bind(&ProcessCommander::onConnectionAwaitingCommand, this, *i));
+	
+	_asyncThread = new boost::thread(boost::bind(&Server::Run, &_server));
+}
+
+std::future<void> ProcessCommander::ReadDataRowsAsync(ObservationTimerange &timerange, size_t rowStart, size_t rowCount, MSRowDataExt **rowBuffer)
+{
+	AsyncRequest *request = new AsyncRequest();
+	request->task = ReadDataRowsTask;
+	request->timerange = &timerange;
+	request->rowBuffer = rowBuffer;
+	request->rowStart = rowStart;
+	request->rowCount = rowCount;
+	return queueAsyncRequest(request);
+}
+
+std::future<void> ProcessCommander::WriteDataRowsAsync(ObservationTimerange &timerange, MSRowDataExt **rowBuffer)
+{
+	AsyncRequest *request = new AsyncRequest();
+	request->task = WriteDataRowsTask;
+	request->timerange = &timerange;
+	request->rowBuffer = rowBuffer;
+	request->rowStart = timerange.TimeOffsetIndex();
+	request->rowCount = timerange.TimestepCount();
+	return queueAsyncRequest(request);
+}
+
+std::future<void> ProcessCommander::queueAsyncRequest(AsyncRequest *request)
+{
+	if(!_isAsync)
+		throw std::runtime_error("Asynchronous request made before ProcessCommander::StartAsync() was called");
+	request->nodeCommands.Initialize(_observation);
+	request->itemsLeft = _observation.Size();
+	std::future<void> future = request->promise.get_future();
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		// Nodes whose processes have all finished will not serve this request
+		for(std::map<Hostname, size_t>::const_iterator i=_runningProcessCounts.begin();i!=_runningProcessCounts.end();++i)
+		{
+			if(i->second == 0)
+			{
+				request->itemsLeft -= request->nodeCommands.ItemCount(i->first);
+				request->nodeCommands.RemoveNode(i->first);
+				request->errors.push_back("Node " + i->first.AsString() + " is no longer available");
+			}
+		}
+		_asyncRequests.push_back(request);
+		if(request->itemsLeft == 0)
+			finishAsyncRequest(request);
+	}
+	_server.IOService().post(boost::bind(&ProcessCommander::dispatchAsyncRequests, this));
+	return future;
+}
+
+void ProcessCommander::dispatchAsyncRequests()
+{
+	ConnectionVector idleConnections;
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		idleConnections.swap(_idleAsyncConnections);
+	}
+	for(ConnectionVector::const_iterator i=idleConnections.begin();i!=idleConnections.end();++i)
+		continueAsync(*i);
+}
+
+void ProcessCommander::continueAsync(ServerConnectionPtr serverConnection)
+{
+	const Hostname &hostname = serverConnection->GetHostname();
+	
+	boost::mutex::scoped_lock lock(_mutex);
+	
+	// The first time a connection asks for a command, it is given a channel
+	std::map<ServerConnection*, bool>::iterator channel = _isReadChannel.find(serverConnection.get());
+	if(channel == _isReadChannel.end())
+	{
+		const size_t connectionIndex = _asyncConnectionCounts[hostname]++;
+		channel = _isReadChannel.insert(std::make_pair(serverConnection.get(), connectionIndex < _readChannels)).first;
+		++_asyncConnectionTotal;
+		if(_asyncConnectionTotal == _expectedAsyncConnections)
+			_server.Stop();
+	}
+	
+	// Finish the request item that this connection was working on
+	std::map<ServerConnection*, AsyncAssignment>::iterator assignment = _asyncAssignments.find(serverConnection.get());
+	if(assignment != _asyncAssignments.end())
+	{
+		AsyncRequest *request = assignment->second.request;
+		_asyncAssignments.erase(assignment);
+		--request->itemsLeft;
+		if(request->itemsLeft == 0)
+			finishAsyncRequest(request);
+	}
+	
+	const bool isReadChannel = channel->second;
+	if(!startAsyncAssignment(serverConnection, isReadChannel) && !startAsyncAssignment(serverConnection, !isReadChannel))
+		_idleAsyncConnections.push_back(serverConnection);
+}
+
+bool ProcessCommander::startAsyncAssignment(ServerConnectionPtr serverConnection, bool readRequests)
+{
+	const Hostname &hostname = serverConnection->GetHostname();
+	
+	// Requests are served in the order in which they were queued
+	for(std::deque<AsyncRequest*>::iterator i=_asyncRequests.begin();i!=_asyncRequests.end();++i)
+	{
+		AsyncRequest &request = **i;
+		ClusteredObservationItem item;
+		if((request.task == ReadDataRowsTask) == readRequests && request.nodeCommands.Pop(hostname, item))
+		{
+			AsyncAssignment &assignment = _asyncAssignments[serverConnection.get()];
+			assignment.request = &request;
+			assignment.item = item;
+			
+			const std::string &msFilename = item.LocalPath();
+			MSRowDataExt *rows = request.rowBuffer[item.Index()];
+			if(request.task == ReadDataRowsTask)
+			{
+				serverConnection->ReadDataRows(msFilename, request.rowStart, request.rowCount, rows);
+			} else {
+				request.timerange->GetTimestepData(item.Index(), rows);
+				serverConnection->WriteDataRows(msFilename, request.rowStart, request.rowCount, rows);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void ProcessCommander::finishAsyncRequest(AsyncRequest *request)
+{
+	_asyncRequests.erase(std::find(_asyncRequests.begin(), _asyncRequests.end(), request));
+	if(request->errors.empty())
+		request->promise.set_value();
+	else {
+		std::stringstream s;
+		s << request->errors.size() << " error(s) occured while processing a data row request. The first reported error was: " << request->errors.front();
+		request->promise.set_exception(std::make_exception_ptr(std::runtime_error(s.str())));
+	}
+	delete request;
+	if(_asyncRequests.empty())
+		_asyncRequestsFinishedCondition.notify_all();
+}
+
+void ProcessCommander::StopAsync()
+{
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		while(!_asyncRequests.empty())
+			_asyncRequestsFinishedCondition.wait(lock);
+	}
+	_server.IOService().post(boost::bind(&ProcessCommander::stopAsyncConnections, this));
+	delete _asyncWork;
+	_asyncWork = 0;
+	_asyncThread->join();
+	delete _asyncThread;
+	_asyncThread = 0;
+	_isReadChannel.clear();
+	_isAsync = false;
+}
+
+void ProcessCommander::stopAsyncConnections()
+{
+	ConnectionVector idleConnections;
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		idleConnections.swap(_idleAsyncConnections);
+	}
+	for(ConnectionVector::const_iterator i=idleConnections.begin();i!=idleConnections.end();++i)
+		(*i)->StopClient();
+	_server.Stop();
+}
+
 void ProcessCommander::continueReadQualityTablesTask(ServerConnectionPtr serverConnection)
 {
 	const Hostname &hostname = serverConnection->GetHostname();
@@ -202,6 +436,11 @@ void ProcessCommander::onConnectionCreated(ServerConnectionPtr serverConnection,
 
 void ProcessCommander::onConnectionAwaitingCommand(ServerConnectionPtr serverConnection)
 {
+	if(_isAsync)
+	{
+		continueAsync(serverConnection);
+		return;
+	}
 	switch(currentTask())
 	{
 		case ReadQualityTablesTask:
@@ -276,6 +515,15 @@ void ProcessCommander::onConnectionFinishReadBandTable(ServerConnectionPtr serve
 
 void ProcessCommander::onConnectionFinishReadDataRows(ServerConnectionPtr serverConnection, MSRowDataExt *rowData, size_t totalRows)
 {
+	if(_isAsync)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		const AsyncAssignment &assignment = _asyncAssignments[serverConnection.get()];
+		const AsyncRequest &request = *assignment.request;
+		request.timerange->SetTimestepData(assignment.item.Index(), rowData, request.rowCount);
+		request.timerange->SetTimeOffsetIndex(request.rowStart);
+		return;
+	}
 	const Hostname &hostname = serverConnection->GetHostname();
 	ClusteredObservationItem item;
 	_nodeCommands.Current(hostname, item);
@@ -291,20 +539,58 @@ void ProcessCommander::onError(ServerConnectionPtr connection, const std::string
 	
 	const Hostname &hostname = connection->GetHostname();
 	ClusteredObservationItem item;
-	bool knowFile = _nodeCommands.Current(hostname, item);
+	bool knowFile;
+	if(_isAsync)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		std::map<ServerConnection*, AsyncAssignment>::const_iterator assignment = _asyncAssignments.find(connection.get());
+		knowFile = (assignment != _asyncAssignments.end());
+		if(knowFile)
+			item = assignment->second.item;
+	}
+	else
+		knowFile = _nodeCommands.Current(hostname, item);
 	s << "On connection with " << hostname.AsString();
 	if(knowFile)
 		s << " to process local file '" << item.LocalPath() << "'";
 	s << ", reported error was: " << error;
 	boost::mutex::scoped_lock lock(_mutex);
 	_errors.push_back(s.str());
+	if(_isAsync)
+	{
+		std::map<ServerConnection*, AsyncAssignment>::const_iterator assignment = _asyncAssignments.find(connection.get());
+		if(assignment != _asyncAssignments.end())
+			assignment->second.request->errors.push_back(s.str());
+	}
 }
 
 void ProcessCommander::onProcessFinished(RemoteProcess &process, bool error, int status)
 {
 	boost::mutex::scoped_lock lock(_mutex);
 	
-	if(_nodeCommands.RemoveNode(process.ClientHostname()) && _nodeCommands.Empty())
+	const Hostname &hostname = process.ClientHostname();
+	--_runningProcessCounts[hostname];
+	if(_isAsync)
+	{
+		// When no processes are left on this node, its items of the queued requests will not be served
+		if(_runningProcessCounts[hostname] == 0)
+		{
+			std::vector<AsyncRequest*> requests(_asyncRequests.begin(), _asyncRequests.end());
+			for(std::vector<AsyncRequest*>::iterator i=requests.begin();i!=requests.end();++i)
+			{
+				AsyncRequest *request = *i;
+				const size_t itemCount = request->nodeCommands.ItemCount(hostname);
+				if(request->nodeCommands.RemoveNode(hostname))
+				{
+					request->errors.push_back("Node " + hostname.AsString() + " is no longer available");
+					request->itemsLeft -= itemCount;
+					if(request->itemsLeft == 0)
+						finishAsyncRequest(request);
+				}
+			}
+		}
+	}
+	else if(_nodeCommands.RemoveNode(hostname) && _nodeCommands.Empty())
 		onCurrentTaskFinished();
 	
 	if(error)
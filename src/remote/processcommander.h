@@ -4,8 +4,12 @@
 #include <map>
 #include <string>
 #include <deque>
+#include <future>
 #include <vector>
 
+#include <boost/thread/condition.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "clusteredobservation.h"
 #include "nodecommandmap.h"
 #include "remoteprocess.h"
@@ -82,7 +86,50 @@ class ProcessCommander
 			_rowsTotal = 0;
 		}
 		
+		/**
+		 * Start serving requests asynchronously. After this call, the connections are
+		 * served by a background thread, and data row requests can be queued with
+		 * ReadDataRowsAsync() and WriteDataRowsAsync() from any thread. Run() and the
+		 * Push...Task() methods should not be used until StopAsync() is called.
+		 * 
+		 * Each node is given @p readChannels connections that preferably serve read
+		 * requests and @p writeChannels connections that preferably serve write requests.
+		 * Hence, several read requests can be in flight per node, and reads do not have
+		 * to wait for writes. A connection takes a request of the other kind when there
+		 * is no request of its own kind.
+		 */
+		void StartAsync(size_t readChannels = 2, size_t writeChannels = 1);
+		
+		/**
+		 * Queue a request to read rows from all nodes into the given timerange.
+		 * The timerange and the row buffers should remain available until the
+		 * returned future is ready. The future throws when a node reported an error.
+		 * @param rowBuffer see PushReadDataRowsTask().
+		 */
+		std::future<void> ReadDataRowsAsync(class ObservationTimerange &timerange, size_t rowStart, size_t rowCount, MSRowDataExt **rowBuffer);
+		
+		/**
+		 * Queue a request to write the rows in the given timerange to all nodes.
+		 * @param rowBuffer see PushWriteDataRowsTask().
+		 */
+		std::future<void> WriteDataRowsAsync(class ObservationTimerange &timerange, MSRowDataExt **rowBuffer);
+		
+		/**
+		 * Wait until all queued asynchronous requests are finished, stop the clients
+		 * and the background thread.
+		 */
+		void StopAsync();
+		
 		const ClusteredObservation &Observation() const { return _observation; }
+		
+		/**
+		 * When set, the clients are not started with ssh on the nodes, but run in
+		 * threads of this process. The node names of the observation then only
+		 * serve to group the measurement sets. Should be set before the first
+		 * Run() or StartAsync().
+		 * @see LocalCluster
+		 */
+		void SetRunClientsInProcess(bool runClientsInProcess) { _runClientsInProcess = runClientsInProcess; }
 	private:
 		enum Task {
 			NoTask,
@@ -110,6 +157,32 @@ class ProcessCommander
 		void onError(ServerConnectionPtr connection, const std::string &error);
 		void onProcessFinished(RemoteProcess &process, bool error, int status);
 		
+		struct AsyncRequest
+		{
+			enum Task task;
+			class ObservationTimerange *timerange;
+			MSRowDataExt **rowBuffer;
+			size_t rowStart, rowCount;
+			NodeCommandMap nodeCommands;
+			size_t itemsLeft;
+			std::vector<std::string> errors;
+			std::promise<void> promise;
+		};
+		
+		struct AsyncAssignment
+		{
+			AsyncRequest *request;
+			ClusteredObservationItem item;
+		};
+		
+		void startProcess(const Hostname &clientHostName, const Hostname &serverHostName);
+		std::future<void> queueAsyncRequest(AsyncRequest *request);
+		void dispatchAsyncRequests();
+		void continueAsync(ServerConnectionPtr serverConnection);
+		bool startAsyncAssignment(ServerConnectionPtr serverConnection, bool readRequests);
+		void finishAsyncRequest(AsyncRequest *request);
+		void stopAsyncConnections();
+		
 		Server _server;
 		typedef std::vector<ServerConnectionPtr> ConnectionVector;
 		ConnectionVector _idleConnections;
@@ -129,10 +202,25 @@ class ProcessCommander
 		const ClusteredObservation &_observation;
 		NodeCommandMap _nodeCommands;
 		bool _finishConnections;
+		bool _runClientsInProcess;
 		
 		std::vector<std::string> _errors;
 		std::deque<enum Task> _tasks;
 		
+		bool _isAsync;
+		size_t _readChannels, _writeChannels;
+		boost::asio::io_service::work *_asyncWork;
+		boost::thread *_asyncThread;
+		/** Nr of connections that each node has made in async mode; decides the channel of a new connection */
+		std::map<Hostname, size_t> _asyncConnectionCounts;
+		size_t _expectedAsyncConnections, _asyncConnectionTotal;
+		std::map<Hostname, size_t> _runningProcessCounts;
+		std::map<ServerConnection*, bool> _isReadChannel;
+		std::map<ServerConnection*, AsyncAssignment> _asyncAssignments;
+		std::deque<AsyncRequest*> _asyncRequests;
+		ConnectionVector _idleAsyncConnections;
+		boost::condition _asyncRequestsFinishedCondition;
+		
 		/** 
 		 * Because the processes have separate threads that can send signals from
 		 * their thread, locking is required for accessing data that might be
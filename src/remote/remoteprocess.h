@@ -14,6 +14,7 @@
 
 #include <boost/thread/thread.hpp>
 
+#include "client.h"
 #include "clusteredobservation.h"
 
 namespace aoRemote
@@ -22,8 +23,13 @@ namespace aoRemote
 class RemoteProcess
 {
 	public:
-		RemoteProcess(const Hostname &clientHostName, const Hostname &serverHostName)
-		: _clientHostName(clientHostName), _serverHostName(serverHostName),  _running(false)
+		/**
+		 * @param runInProcess When true, no ssh process is started, but a Client is
+		 * run in a thread of this process that identifies itself as @p clientHostName.
+		 * This is used to simulate a cluster on the local machine.
+		 */
+		RemoteProcess(const Hostname &clientHostName, const Hostname &serverHostName, bool runInProcess = false)
+		: _clientHostName(clientHostName), _serverHostName(serverHostName), _runInProcess(runInProcess), _running(false)
 		{
 		}
 		
@@ -66,6 +72,25 @@ class RemoteProcess
 			ThreadFunctor(RemoteProcess &process) : _remoteProcess(process) { }
 			RemoteProcess &_remoteProcess;
 			void operator()()
+			{
+				if(_remoteProcess._runInProcess)
+					runInProcess();
+				else
+					runRemotely();
+			}
+			void runInProcess()
+			{
+				bool error = false;
+				try {
+					Client client;
+					client.Run(_remoteProcess._serverHostName.AsString(), _remoteProcess._clientHostName);
+				} catch(std::exception &e) {
+					std::cerr << "In-process client " << _remoteProcess._clientHostName.AsString() << " failed: " << e.what() << std::endl;
+					error = true;
+				}
+				_remoteProcess._onFinished(_remoteProcess, error, error ? 1 : 0);
+			}
+			void runRemotely()
 			{
 				std::ostringstream commandLine;
 				commandLine
@@ -101,6 +126,7 @@ class RemoteProcess
 		
 		const ClusteredObservationItem _item;
 		const Hostname _clientHostName, _serverHostName;
+		bool _runInProcess;
 		boost::thread *_thread;
 		bool _running;
 		
@@ -47,6 +47,18 @@ void Server::handleAccept(ServerConnectionPtr connection, const boost::system::e
 	}
 }
 
+void Server::Reopen()
+{
+	if(!_acceptor.is_open())
+	{
+		boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), PORT());
+		_acceptor.open(endpoint.protocol());
+		_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+		_acceptor.bind(endpoint);
+		_acceptor.listen();
+	}
+}
+
 void Server::Stop()
 {
 	if(_acceptor.is_open())
@@ -33,6 +33,12 @@ class Server
 		 */
 		void Run();
 		
+		/**
+		 * Start listening for connections again after the server has been stopped. Run() should be called
+		 * afterwards to accept the connections.
+		 */
+		void Reopen();
+		
 		/**
 		 * Stop listening for connections. This will cause Run() to return. Note that this will not terminate
 		 * any currently running connections; it will merely stop accepting new connections.
@@ -41,6 +47,8 @@ class Server
 		
 		static unsigned PORT() { return 1892; }
 		
+		boost::asio::io_service &IOService() { return _ioService; }
+		
 		boost::signals2::signal<void(ServerConnectionPtr, bool&)> &SignalConnectionCreated()
 		{
 			return _onConnectionCreated;
@@ -6,6 +6,7 @@
 
 #include <boost/bind.hpp>
 
+#include "datarowstransfer.h"
 #include "format.h"
 #include "hostname.h"
 
@@ -205,18 +206,14 @@ void ServerConnection::WriteDataRows(const std::string &msFilename, size_t rowSt
 	requestBlock.request = WriteDataRowsRequest;
 	reqBuffer.write(reinterpret_cast<char *>(&requestBlock), sizeof(requestBlock));
 	
-	std::ostringstream dataBuffer;
-	// Serialize the rows
-	for(size_t rowIndex=0; rowIndex != rowCount; ++rowIndex) {
-		rowArray[rowIndex].Serialize(dataBuffer);
-	}
-	std::string dataBufferStr = dataBuffer.str();
+	DataRowsTransfer transfer;
+	transfer.PrepareSend(rowArray, rowCount);
 
 	options.flags = 0;
 	options.msFilename = msFilename;
 	options.startRow = rowStart;
 	options.rowCount = rowCount;
-	options.dataSize = dataBufferStr.size();
+	options.dataSize = transfer.BlockSize();
 	
 	reqBuffer.write(reinterpret_cast<char *>(&options.flags), sizeof(options.flags));
 	reqBuffer.write(reinterpret_cast<const char *>(options.msFilename.c_str()), options.msFilename.size());
@@ -224,8 +221,11 @@ void ServerConnection::WriteDataRows(const std::string &msFilename, size_t rowSt
 	reqBuffer.write(reinterpret_cast<const char *>(&options.rowCount), sizeof(options.rowCount));
 	reqBuffer.write(reinterpret_cast<const char *>(&options.dataSize), sizeof(options.dataSize));
 	
-	boost::asio::write(_socket, boost::asio::buffer(reqBuffer.str()));
-	boost::asio::write(_socket, boost::asio::buffer(dataBufferStr));
+	// Send the request and the rows in one gathered write, directly from the row memory
+	const std::string reqStr = reqBuffer.str();
+	std::vector<boost::asio::const_buffer> buffers = transfer.SendBuffers();
+	buffers.insert(buffers.begin(), boost::asio::buffer(reqStr));
+	boost::asio::write(_socket, buffers);
 	
 	prepareBuffer(sizeof(GenericReadResponseHeader));
 	boost::asio::async_read(_socket, boost::asio::buffer(_buffer, sizeof(GenericReadResponseHeader)),
@@ -370,26 +370,35 @@ void ServerConnection::onReceiveReadDataRowsResponseHeader()
 		_onAwaitingCommand(shared_from_this());
 	}
 	else {
-		prepareBuffer(responseHeader.dataSize);
-		boost::asio::async_read(_socket, boost::asio::buffer(_buffer, responseHeader.dataSize),
-			boost::bind(&ServerConnection::onReceiveReadDataRowsResponseData, shared_from_this(), responseHeader.dataSize));
+		boost::asio::async_read(_socket, _rowsTransfer.HeaderBuffer(),
+			boost::bind(&ServerConnection::onReceiveReadDataRowsBlockHeader, shared_from_this(), responseHeader.dataSize));
 	}
 }
 
-void ServerConnection::onReceiveReadDataRowsResponseData(size_t dataSize)
+void ServerConnection::onReceiveReadDataRowsBlockHeader(size_t dataSize)
 {
-	std::istringstream stream;
-	if(stream.rdbuf()->pubsetbuf(_buffer, dataSize) == 0)
-		throw std::runtime_error("Could not set string buffer");
-	
-	size_t rowsSent = Serializable::UnserializeUInt64(stream);
-	size_t rowsTotal = 0;
-	if(rowsSent == 0)
-		rowsTotal = Serializable::UnserializeUInt64(stream);
-	for(size_t i=0;i<rowsSent;++i)
-		_readRowData[i].Unserialize(stream);
+	if(_rowsTransfer.BlockSize() != dataSize)
+	{
+		_onError(shared_from_this(), "Size of data rows block sent by client does not match its header");
+		StopClient();
+	}
+	else if(_rowsTransfer.Header().rowCount == 0)
+	{
+		_onFinishReadDataRows(shared_from_this(), _readRowData, _rowsTransfer.Header().totalRowCount);
+		_onAwaitingCommand(shared_from_this());
+	}
+	else {
+		// The samples are read directly into the destination rows
+		boost::asio::async_read(_socket, _rowsTransfer.ReceiveBuffers(_readRowData),
+			boost::bind(&ServerConnection::onReceiveReadDataRowsResponseData, shared_from_this()));
+	}
+}
+
+void ServerConnection::onReceiveReadDataRowsResponseData()
+{
+	_rowsTransfer.FinishReceive(_readRowData);
 
-	_onFinishReadDataRows(shared_from_this(), _readRowData, rowsTotal);
+	_onFinishReadDataRows(shared_from_this(), _readRowData, 0);
 	_onAwaitingCommand(shared_from_this());
 }
 
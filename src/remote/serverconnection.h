@@ -9,6 +9,7 @@
 
 #include <boost/signals2/signal.hpp>
 
+#include "datarowstransfer.h"
 #include "format.h"
 #include "hostname.h"
 
@@ -76,7 +77,8 @@ class ServerConnection : public boost::enable_shared_from_this<ServerConnection>
 		void onReceiveBandTableResponseData(size_t dataSize);
 		
 		void onReceiveReadDataRowsResponseHeader();
-		void onReceiveReadDataRowsResponseData(size_t dataSize);
+		void onReceiveReadDataRowsBlockHeader(size_t dataSize);
+		void onReceiveReadDataRowsResponseData();
 		
 		void onReceiveWriteDataRowsResponseHeader();
 		
@@ -94,6 +96,7 @@ class ServerConnection : public boost::enable_shared_from_this<ServerConnection>
 		BandInfo *_band;
 		MSRowDataExt *_readRowData;
 		const MSRowDataExt *_writeRowData;
+		DataRowsTransfer _rowsTransfer;
 };
 	
 }
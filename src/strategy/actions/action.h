@@ -16,6 +16,7 @@ namespace rfiStrategy {
 		BaselineSelectionActionType,
 		CalibratePassbandActionType,
 		ChangeResolutionActionType,
+		CoarseScreeningActionType,
 		CombineFlagResultsType,
 		CutAreaActionType,
 		DirectionProfileActionType,
@@ -66,6 +67,14 @@ namespace rfiStrategy {
 			 * Write any cached / delayed data to disk
 			 */
 			virtual void Sync() { }
+			/**
+			 * Performs the action on the data in @p artifacts. This should not change the
+			 * action: results that depend on the data belong in the artifact set, e.g.
+			 * in its IterationCache(). Hence, one strategy can be performed by several
+			 * threads at the same time, each with its own artifact set. Actions that pass
+			 * over an image set, like ForEachBaselineAction and WriteFlagsAction, keep
+			 * the state of that pass, and can pass over only one image set at a time.
+			 */
 			virtual void Perform(class ArtifactSet &artifacts, class ProgressListener &progress) = 0;
 			class ActionContainer *Parent() const { return _parent; }
 			virtual ActionType Type() const = 0;
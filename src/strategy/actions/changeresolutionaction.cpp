@@ -3,9 +3,44 @@
 #include "../control/artifactset.h"
 
 #include <stdexcept>
+
+#include <boost/bind.hpp>
+
 #include "../algorithms/thresholdtools.h"
 
 namespace rfiStrategy {
+
+	namespace {
+		/**
+		 * Returns the resampled version of @p source from the cache, or resamples and stores it
+		 * when it is not there yet.
+		 */
+		template<typename Cache, typename Pointer, typename Function>
+		Pointer cachedResample(Cache &cache, const Pointer &source, Function resample)
+		{
+			typename Cache::iterator i = cache.find(source.get());
+			if(i == cache.end())
+			{
+				Pointer result = resample(source);
+				i = cache.insert(typename Cache::value_type(source.get(), std::make_pair(source, result))).first;
+			}
+			return i->second.second;
+		}
+
+		Mask2DPtr enlargeMaskHorizontally(const Mask2DCPtr &smallMask, int factor, size_t width)
+		{
+			Mask2DPtr newMask = Mask2D::CreateUnsetMaskPtr(width, smallMask->Height());
+			newMask->EnlargeHorizontallyAndSet(smallMask, factor);
+			return newMask;
+		}
+
+		Mask2DPtr enlargeMaskVertically(const Mask2DCPtr &smallMask, int factor, size_t height)
+		{
+			Mask2DPtr newMask = Mask2D::CreateUnsetMaskPtr(smallMask->Width(), height);
+			newMask->EnlargeVerticallyAndSet(smallMask, factor);
+			return newMask;
+		}
+	}
 	
 	void ChangeResolutionAction::Perform(class ArtifactSet &artifacts, class ProgressListener &listener)
 	{
@@ -16,15 +51,16 @@ namespace rfiStrategy {
 	
 			TimeFrequencyData oldContaminated = artifacts.ContaminatedData();
 
-			DecreaseTime(artifactsCopy.OriginalData());
-			DecreaseTime(artifactsCopy.ContaminatedData());
-			DecreaseTime(artifactsCopy.RevisedData());
+			ResampleCache decreaseCache;
+			decreaseTime(artifactsCopy.OriginalData(), decreaseCache);
+			decreaseTime(artifactsCopy.ContaminatedData(), decreaseCache);
+			decreaseTime(artifactsCopy.RevisedData(), decreaseCache);
 	
 			PerformFrequencyChange(artifactsCopy, listener);
 	
-			IncreaseTime(artifacts.OriginalData(), artifactsCopy.OriginalData(), false, false);
-			IncreaseTime(artifacts.ContaminatedData(), artifactsCopy.ContaminatedData(), _restoreContaminated, _restoreMasks);
-			IncreaseTime(artifacts.RevisedData(), artifactsCopy.RevisedData(), _restoreRevised, _restoreMasks);
+			ResampleCache increaseCache;
+			increaseTime(artifacts.ContaminatedData(), artifactsCopy.ContaminatedData(), _restoreContaminated, _restoreMasks, increaseCache);
+			increaseTime(artifacts.RevisedData(), artifactsCopy.RevisedData(), _restoreRevised, _restoreMasks, increaseCache);
 
 			if(_restoreRevised && !_restoreContaminated)
 			{
@@ -47,15 +83,16 @@ namespace rfiStrategy {
 	
 			TimeFrequencyData oldContaminated = artifacts.ContaminatedData();
 
-			DecreaseFrequency(artifactsCopy.OriginalData());
-			DecreaseFrequency(artifactsCopy.ContaminatedData());
-			DecreaseFrequency(artifactsCopy.RevisedData());
+			ResampleCache decreaseCache;
+			decreaseFrequency(artifactsCopy.OriginalData(), decreaseCache);
+			decreaseFrequency(artifactsCopy.ContaminatedData(), decreaseCache);
+			decreaseFrequency(artifactsCopy.RevisedData(), decreaseCache);
 	
 			ActionBlock::Perform(artifactsCopy, listener);
 	
-			IncreaseFrequency(artifacts.OriginalData(), artifactsCopy.OriginalData(), false, false);
-			IncreaseFrequency(artifacts.ContaminatedData(), artifactsCopy.ContaminatedData(), _restoreContaminated, _restoreMasks);
-			IncreaseFrequency(artifacts.RevisedData(), artifactsCopy.RevisedData(), _restoreRevised, _restoreMasks);
+			ResampleCache increaseCache;
+			increaseFrequency(artifacts.ContaminatedData(), artifactsCopy.ContaminatedData(), _restoreContaminated, _restoreMasks, increaseCache);
+			increaseFrequency(artifacts.RevisedData(), artifactsCopy.RevisedData(), _restoreRevised, _restoreMasks, increaseCache);
 
 			if(_restoreRevised && !_restoreContaminated)
 			{
@@ -69,72 +106,71 @@ namespace rfiStrategy {
 		}
 	}
 
-	void ChangeResolutionAction::DecreaseTime(TimeFrequencyData &timeFrequencyData)
+	void ChangeResolutionAction::decreaseTime(TimeFrequencyData &timeFrequencyData, ResampleCache &cache)
 	{
 		if(_useMaskInAveraging)
 		{
-			DecreaseTimeWithMask(timeFrequencyData);
+			decreaseTimeWithMask(timeFrequencyData, cache);
 		}
 		else {
 			size_t imageCount = timeFrequencyData.ImageCount();
 			for(size_t i=0;i<imageCount;++i)
 			{
-				Image2DCPtr image = timeFrequencyData.GetImage(i);
-				Image2DPtr newImage = image->ShrinkHorizontally(_timeDecreaseFactor);
-				timeFrequencyData.SetImage(i, newImage);
+				timeFrequencyData.SetImage(i, cachedResample(cache.images, timeFrequencyData.GetImage(i),
+					boost::bind(&Image2D::ShrinkHorizontally, _1, (size_t) _timeDecreaseFactor)));
 			}
 			size_t maskCount = timeFrequencyData.MaskCount();
 			for(size_t i=0;i<maskCount;++i)
 			{
-				Mask2DCPtr mask = timeFrequencyData.GetMask(i);
-				Mask2DPtr newMask = mask->ShrinkHorizontally(_timeDecreaseFactor);
-				timeFrequencyData.SetMask(i, newMask);
+				timeFrequencyData.SetMask(i, cachedResample(cache.masks, timeFrequencyData.GetMask(i),
+					boost::bind(&Mask2D::ShrinkHorizontally, _1, _timeDecreaseFactor)));
 			}
 		}
 	}
 	
-	void ChangeResolutionAction::DecreaseTimeWithMask(TimeFrequencyData &data)
+	void ChangeResolutionAction::decreaseTimeWithMask(TimeFrequencyData &data, ResampleCache &cache)
 	{
-		size_t polCount = data.PolarisationCount();
-		for(size_t i=0;i<polCount;++i)
+		size_t imageCount = data.ImageCount();
+		size_t maskCount = data.MaskCount();
+		if(maskCount == 0)
 		{
-			TimeFrequencyData *polData = data.CreateTFDataFromPolarisationIndex(i);
-			Mask2DCPtr mask = polData->GetSingleMask();
-			for(unsigned j=0;j<polData->ImageCount();++j)
-			{
-				Image2DCPtr image = polData->GetImage(j);
-				polData->SetImage(j, ThresholdTools::ShrinkHorizontally(_timeDecreaseFactor, image, mask));
-			}
-			delete polData;
+			for(size_t i=0;i<imageCount;++i)
+				data.SetImage(i, data.GetImage(i)->ShrinkHorizontally(_timeDecreaseFactor));
+			return;
+		}
+		// Either one mask covers all images, or there is one mask per polarisation, of which
+		// the images are consecutive. The averaged images depend on the mask, hence they are
+		// not cached.
+		size_t imagesPerMask = imageCount / maskCount;
+		for(size_t i=0;i<imageCount;++i)
+		{
+			const Mask2DCPtr &mask = data.GetMask(i / imagesPerMask);
+			data.SetImage(i, ThresholdTools::ShrinkHorizontally(_timeDecreaseFactor, data.GetImage(i), mask));
 		}
-		size_t maskCount = data.MaskCount();
 		for(size_t i=0;i<maskCount;++i)
 		{
-			Mask2DCPtr mask = data.GetMask(i);
-			Mask2DPtr newMask = mask->ShrinkHorizontallyForAveraging(_timeDecreaseFactor);
-			data.SetMask(i, newMask);
+			data.SetMask(i, cachedResample(cache.masks, data.GetMask(i),
+				boost::bind(&Mask2D::ShrinkHorizontallyForAveraging, _1, _timeDecreaseFactor)));
 		}
 	}
 
-	void ChangeResolutionAction::DecreaseFrequency(TimeFrequencyData &timeFrequencyData)
+	void ChangeResolutionAction::decreaseFrequency(TimeFrequencyData &timeFrequencyData, ResampleCache &cache)
 	{
 		size_t imageCount = timeFrequencyData.ImageCount();
 		for(size_t i=0;i<imageCount;++i)
 		{
-			Image2DCPtr image = timeFrequencyData.GetImage(i);
-			Image2DPtr newImage = image->ShrinkVertically(_frequencyDecreaseFactor);
-			timeFrequencyData.SetImage(i, newImage);
+			timeFrequencyData.SetImage(i, cachedResample(cache.images, timeFrequencyData.GetImage(i),
+				boost::bind(&Image2D::ShrinkVertically, _1, (size_t) _frequencyDecreaseFactor)));
 		}
 		size_t maskCount = timeFrequencyData.MaskCount();
 		for(size_t i=0;i<maskCount;++i)
 		{
-			Mask2DCPtr mask = timeFrequencyData.GetMask(i);
-			Mask2DPtr newMask = mask->ShrinkVertically(_frequencyDecreaseFactor);
-			timeFrequencyData.SetMask(i, newMask);
+			timeFrequencyData.SetMask(i, cachedResample(cache.masks, timeFrequencyData.GetMask(i),
+				boost::bind(&Mask2D::ShrinkVertically, _1, _frequencyDecreaseFactor)));
 		}
 	}
 
-	void ChangeResolutionAction::IncreaseTime(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask)
+	void ChangeResolutionAction::increaseTime(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask, ResampleCache &cache)
 	{
 		if(restoreImage)
 		{
@@ -143,26 +179,24 @@ namespace rfiStrategy {
 				throw std::runtime_error("When restoring resolution in change resolution action, original data and changed data do not have the same number of images");
 			for(size_t i=0;i<imageCount;++i)
 			{
-				Image2DCPtr image = changedData.GetImage(i);
-				Image2DPtr newImage = image->EnlargeHorizontally(_timeDecreaseFactor, originalData.ImageWidth());
-				originalData.SetImage(i, newImage);
+				originalData.SetImage(i, cachedResample(cache.images, changedData.GetImage(i),
+					boost::bind(&Image2D::EnlargeHorizontally, _1, (size_t) _timeDecreaseFactor, originalData.ImageWidth())));
 			}
 		}
 		if(restoreMask)
 		{
+			size_t width = originalData.ImageWidth();
 			originalData.SetMask(changedData);
 			size_t maskCount = originalData.MaskCount();
 			for(size_t i=0;i<maskCount;++i)
 			{
-				Mask2DCPtr mask = changedData.GetMask(i);
-				Mask2DPtr newMask = Mask2D::CreateUnsetMaskPtr(originalData.ImageWidth(), originalData.ImageHeight());
-				newMask->EnlargeHorizontallyAndSet(mask, _timeDecreaseFactor);
-				originalData.SetMask(i, newMask);
+				originalData.SetMask(i, cachedResample(cache.masks, changedData.GetMask(i),
+					boost::bind(&enlargeMaskHorizontally, _1, _timeDecreaseFactor, width)));
 			}
 		}
 	}
 
-	void ChangeResolutionAction::IncreaseFrequency(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask)
+	void ChangeResolutionAction::increaseFrequency(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask, ResampleCache &cache)
 	{
 		if(restoreImage)
 		{
@@ -171,21 +205,19 @@ namespace rfiStrategy {
 				throw std::runtime_error("When restoring resolution in change resolution action, original data and changed data do not have the same number of images");
 			for(size_t i=0;i<imageCount;++i)
 			{
-				Image2DCPtr image = changedData.GetImage(i);
-				Image2DPtr newImage = image->EnlargeVertically(_frequencyDecreaseFactor, originalData.ImageHeight());
-				originalData.SetImage(i, newImage);
+				originalData.SetImage(i, cachedResample(cache.images, changedData.GetImage(i),
+					boost::bind(&Image2D::EnlargeVertically, _1, (size_t) _frequencyDecreaseFactor, originalData.ImageHeight())));
 			}
 		}
 		if(restoreMask)
 		{
+			size_t height = originalData.ImageHeight();
 			originalData.SetMask(changedData);
 			size_t maskCount = originalData.MaskCount();
 			for(size_t i=0;i<maskCount;++i)
 			{
-				Mask2DCPtr mask = changedData.GetMask(i);
-				Mask2DPtr newMask = Mask2D::CreateUnsetMaskPtr(originalData.ImageWidth(), originalData.ImageHeight());
-				newMask->EnlargeVerticallyAndSet(mask, _frequencyDecreaseFactor);
-				originalData.SetMask(i, newMask);
+				originalData.SetMask(i, cachedResample(cache.masks, changedData.GetMask(i),
+					boost::bind(&enlargeMaskVertically, _1, _frequencyDecreaseFactor, height)));
 			}
 		}
 	}
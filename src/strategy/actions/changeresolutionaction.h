@@ -1,6 +1,9 @@
 #ifndef CHANGERESOLUTIONACTION_H
 #define CHANGERESOLUTIONACTION_H
 
+#include <map>
+#include <utility>
+
 #include "../../structures/timefrequencydata.h"
 
 #include "../control/actionblock.h"
@@ -40,20 +43,59 @@ namespace rfiStrategy {
 			
 			bool UseMaskInAveraging() const { return _useMaskInAveraging; }
 			void SetUseMaskInAveraging(bool useMask) { _useMaskInAveraging = useMask; }
+			
+			/**
+			 * Averages the images and combines the masks of @p data over the time decrease factor.
+			 * Also used by other blocks that process a lower resolution copy of the data.
+			 */
+			void DecreaseTime(TimeFrequencyData &data)
+			{
+				ResampleCache cache;
+				decreaseTime(data, cache);
+			}
+			void IncreaseTime(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask)
+			{
+				ResampleCache cache;
+				increaseTime(originalData, changedData, restoreImage, restoreMask, cache);
+			}
+
+			/**
+			 * Averages the images and combines the masks of @p data over the frequency decrease factor.
+			 */
+			void DecreaseFrequency(TimeFrequencyData &data)
+			{
+				ResampleCache cache;
+				decreaseFrequency(data, cache);
+			}
+			void IncreaseFrequency(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask)
+			{
+				ResampleCache cache;
+				increaseFrequency(originalData, changedData, restoreImage, restoreMask, cache);
+			}
 		private:
+			/**
+			 * Results of one resampling operation, by their source. The original, contaminated
+			 * and revised data often share images and masks, which then only need to be
+			 * resampled once. The sources are kept, so that their addresses can not be reused
+			 * while the cache exists.
+			 */
+			struct ResampleCache
+			{
+				std::map<const Image2D*, std::pair<Image2DCPtr, Image2DCPtr> > images;
+				std::map<const Mask2D*, std::pair<Mask2DCPtr, Mask2DCPtr> > masks;
+			};
+
 			void PerformFrequencyChange(class ArtifactSet &artifacts, class ProgressListener &listener);
 
+			void decreaseTime(TimeFrequencyData &data, ResampleCache &cache);
+			void decreaseTimeWithMask(TimeFrequencyData &data, ResampleCache &cache);
+			void increaseTime(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask, ResampleCache &cache);
+			void decreaseFrequency(TimeFrequencyData &data, ResampleCache &cache);
+			void increaseFrequency(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask, ResampleCache &cache);
+
 			int _timeDecreaseFactor;
 			int _frequencyDecreaseFactor;
 
-			void DecreaseTime(TimeFrequencyData &data);
-			void IncreaseTime(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask);
-
-			void DecreaseFrequency(TimeFrequencyData &data);
-			void IncreaseFrequency(TimeFrequencyData &originalData, TimeFrequencyData &changedData, bool restoreImage, bool restoreMask);
-			
-			void DecreaseTimeWithMask(TimeFrequencyData &data);
-
 			/**
 			 * If this is true, the subtasks of this task can change the revised image, and
 			 * this task will scale the changed images back to the original format. If it
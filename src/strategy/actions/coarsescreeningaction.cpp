@@ -0,0 +1,328 @@
+#include "coarsescreeningaction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "changeresolutionaction.h"
+
+#include "../control/artifactset.h"
+
+#include "../../util/aologger.h"
+#include "../../util/progresslistener.h"
+
+namespace rfiStrategy {
+
+void CoarseScreeningAction::Perform(ArtifactSet &artifacts, ProgressListener &listener)
+{
+	const TimeFrequencyData data = artifacts.ContaminatedData();
+	const size_t
+		width = data.ImageWidth(),
+		height = data.ImageHeight(),
+		tileCount = tilesX(width) * tilesY(height);
+	if(tileCount <= 1)
+	{
+		ActionBlock::Perform(artifacts, listener);
+		return;
+	}
+
+	ChangeResolutionAction resolution;
+	resolution.SetTimeDecreaseFactor(_timeDecreaseFactor);
+	resolution.SetFrequencyDecreaseFactor(_frequencyDecreaseFactor);
+
+	ArtifactSet coarseArtifacts(artifacts);
+	coarseArtifacts.SetNoImageSet();
+	resolution.DecreaseTime(coarseArtifacts.OriginalData());
+	resolution.DecreaseTime(coarseArtifacts.ContaminatedData());
+	resolution.DecreaseTime(coarseArtifacts.RevisedData());
+	// The flags are increased in resolution again in the same two steps
+	TimeFrequencyData timeDecreased = coarseArtifacts.ContaminatedData();
+	resolution.DecreaseFrequency(coarseArtifacts.OriginalData());
+	resolution.DecreaseFrequency(coarseArtifacts.ContaminatedData());
+	resolution.DecreaseFrequency(coarseArtifacts.RevisedData());
+	const Mask2DCPtr coarseInputMask = coarseArtifacts.ContaminatedData().GetSingleMask();
+
+	listener.OnStartTask(*this, 0, 2, "Coarse flagging");
+	ActionBlock::Perform(coarseArtifacts, listener);
+	listener.OnEndTask(*this);
+
+	const Mask2DCPtr inputMask = data.GetSingleMask();
+	std::vector<num_t> tileDeviations(tileCount, 0.0);
+	findSpikes(data, inputMask, tileDeviations);
+	std::vector<enum TileDecision> decisions;
+	decideTiles(coarseInputMask, coarseArtifacts.ContaminatedData().GetSingleMask(), tileDeviations, tilesX(width), decisions);
+
+	std::stringstream tileLog;
+	size_t contaminatedCount = 0;
+	for(size_t i=0;i!=tileCount;++i)
+	{
+		if(decisions[i] >= NewFlagsTile)
+		{
+			const size_t x = (i % tilesX(width)) * _tileWidth, y = (i / tilesX(width)) * _tileHeight;
+			tileLog << "  Tile at time step " << x << ", channel " << y << ": " << decisionName(decisions[i]);
+			if(decisions[i] == SpikeTile)
+				tileLog << " (" << tileDeviations[i] << " sigma)";
+			tileLog << '\n';
+			++contaminatedCount;
+		}
+	}
+	std::stringstream summary;
+	summary << "Coarse screening: " << contaminatedCount << '/' << tileCount << " tiles contaminated, ";
+
+	if(contaminatedCount > _maxContaminatedFraction * tileCount)
+	{
+		summary << "flagging all data at full resolution.\n";
+		AOLogger::Debug << summary.str() + tileLog.str();
+		listener.OnStartTask(*this, 1, 2, "Full-resolution flagging");
+		ActionBlock::Perform(artifacts, listener);
+		listener.OnEndTask(*this);
+		return;
+	}
+
+	resolution.IncreaseFrequency(timeDecreased, coarseArtifacts.ContaminatedData(), false, true);
+	TimeFrequencyData flagged(data);
+	resolution.IncreaseTime(flagged, timeDecreased, false, true);
+	std::vector<Mask2DPtr> masks(flagged.MaskCount());
+	for(size_t i=0;i!=masks.size();++i)
+		masks[i] = Mask2D::CreateCopy(flagged.GetMask(i));
+
+	// Tiles in which the children left the flags as they were keep their full-resolution flags
+	for(size_t i=0;i!=tileCount;++i)
+	{
+		if(decisions[i] == CleanTileWithFlags)
+		{
+			const size_t
+				xStart = (i % tilesX(width)) * _tileWidth, xEnd = std::min<size_t>(xStart + _tileWidth, width),
+				yStart = (i / tilesX(width)) * _tileHeight, yEnd = std::min<size_t>(yStart + _tileHeight, height);
+			for(size_t m=0;m!=masks.size();++m)
+			{
+				for(size_t y=yStart;y!=yEnd;++y)
+				{
+					for(size_t x=xStart;x!=xEnd;++x)
+						masks[m]->SetValue(x, y, inputMask->Value(x, y));
+				}
+			}
+		}
+	}
+
+	// Contaminated tiles that are adjacent in time are flagged as one region
+	listener.OnStartTask(*this, 1, 2, "Full-resolution flagging");
+	size_t regionCount = 0;
+	for(size_t ty=0;ty!=tilesY(height);++ty)
+	{
+		size_t tx = 0;
+		while(tx != tilesX(width))
+		{
+			if(decisions[ty * tilesX(width) + tx] >= NewFlagsTile)
+			{
+				size_t txEnd = tx + 1;
+				while(txEnd != tilesX(width) && decisions[ty * tilesX(width) + txEnd] >= NewFlagsTile)
+					++txEnd;
+				Region region;
+				region.xStart = tx * _tileWidth;
+				region.xEnd = std::min<size_t>(txEnd * _tileWidth, width);
+				region.yStart = ty * _tileHeight;
+				region.yEnd = std::min<size_t>((ty + 1) * _tileHeight, height);
+				flagRegion(artifacts, listener, region, masks);
+				++regionCount;
+				tx = txEnd;
+			} else {
+				++tx;
+			}
+		}
+	}
+	listener.OnEndTask(*this);
+
+	for(size_t i=0;i!=masks.size();++i)
+		flagged.SetMask(i, masks[i]);
+	artifacts.SetContaminatedData(flagged);
+
+	summary << "flagging " << regionCount << " regions at full resolution.\n";
+	AOLogger::Debug << summary.str() + tileLog.str();
+}
+
+void CoarseScreeningAction::decideTiles(const Mask2DCPtr &coarseInputMask, const Mask2DCPtr &coarseMask, const std::vector<num_t> &tileDeviations, size_t tileCountX, std::vector<enum TileDecision> &decisions) const
+{
+	const size_t tileCount = tileDeviations.size();
+	decisions.resize(tileCount);
+	for(size_t i=0;i!=tileCount;++i)
+	{
+		// Range of the low-resolution cells that overlap with the tile
+		const size_t
+			xStart = (i % tileCountX) * _tileWidth / _timeDecreaseFactor,
+			xEnd = std::min<size_t>(((i % tileCountX) * _tileWidth + _tileWidth + _timeDecreaseFactor - 1) / _timeDecreaseFactor, coarseMask->Width()),
+			yStart = (i / tileCountX) * _tileHeight / _frequencyDecreaseFactor,
+			yEnd = std::min<size_t>(((i / tileCountX) * _tileHeight + _tileHeight + _frequencyDecreaseFactor - 1) / _frequencyDecreaseFactor, coarseMask->Height());
+		bool hasNewFlags = false, hasRemovedFlags = false, hasFlags = false;
+		for(size_t y=yStart;y!=yEnd;++y)
+		{
+			for(size_t x=xStart;x!=xEnd;++x)
+			{
+				const bool
+					isFlagged = coarseMask->Value(x, y),
+					wasFlagged = coarseInputMask->Value(x, y);
+				hasNewFlags = hasNewFlags || (isFlagged && !wasFlagged);
+				hasRemovedFlags = hasRemovedFlags || (!isFlagged && wasFlagged);
+				hasFlags = hasFlags || isFlagged;
+			}
+		}
+		if(hasNewFlags)
+			decisions[i] = NewFlagsTile;
+		else if(tileDeviations[i] > _spikeThreshold)
+			decisions[i] = SpikeTile;
+		else if(!hasFlags)
+			decisions[i] = CleanTile;
+		else if(!hasRemovedFlags)
+			decisions[i] = CleanTileWithFlags;
+		else
+			decisions[i] = ChangedFlagsTile;
+	}
+}
+
+/**
+ * For each tile, finds the largest deviation of an unflagged sample from the average of
+ * the samples of its channel in the same low-resolution cell. The deviations are in units
+ * of the standard deviation of the channel, which is the median of the variances within
+ * these segments of the channel, so that RFI does not raise it. The noise is estimated
+ * per channel because it follows the bandpass.
+ */
+void CoarseScreeningAction::findSpikes(const TimeFrequencyData &data, const Mask2DCPtr &mask, std::vector<num_t> &tileDeviations) const
+{
+	const size_t
+		width = data.ImageWidth(), height = data.ImageHeight(),
+		segmentCount = (width + _timeDecreaseFactor - 1) / _timeDecreaseFactor;
+	std::vector<num_t> means(segmentCount), variances;
+	variances.reserve(segmentCount);
+	for(size_t imageIndex=0;imageIndex!=data.ImageCount();++imageIndex)
+	{
+		const Image2DCPtr image = data.GetImage(imageIndex);
+		for(size_t y=0;y!=height;++y)
+		{
+			const num_t *row = image->ValuePtr(0, y);
+			const bool *maskRow = mask->ValuePtr(0, y);
+			variances.clear();
+			for(size_t segment=0;segment!=segmentCount;++segment)
+			{
+				const size_t
+					xStart = segment * _timeDecreaseFactor,
+					xEnd = std::min<size_t>(xStart + _timeDecreaseFactor, width);
+				double sum = 0.0, sumOfSquares = 0.0;
+				size_t count = 0;
+				for(size_t x=xStart;x!=xEnd;++x)
+				{
+					if(!maskRow[x] && std::isfinite(row[x]))
+					{
+						sum += row[x];
+						sumOfSquares += (double) row[x] * row[x];
+						++count;
+					}
+				}
+				if(count != 0)
+				{
+					const double mean = sum / count;
+					means[segment] = mean;
+					if(count > 1)
+						variances.push_back(sumOfSquares / count - mean * mean);
+				}
+			}
+			if(variances.empty())
+				continue;
+			std::nth_element(variances.begin(), variances.begin() + variances.size()/2, variances.end());
+			const num_t medianVariance = variances[variances.size()/2];
+			if(!(medianVariance > 0.0))
+				continue;
+			const num_t sigma = sqrtn(medianVariance);
+
+			const size_t tileRow = (y / _tileHeight) * tilesX(width);
+			for(size_t x=0;x!=width;++x)
+			{
+				if(!maskRow[x] && std::isfinite(row[x]))
+				{
+					const num_t deviation = std::fabs(row[x] - means[x / _timeDecreaseFactor]) / sigma;
+					num_t &tileDeviation = tileDeviations[tileRow + x / _tileWidth];
+					if(deviation > tileDeviation)
+						tileDeviation = deviation;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Runs the children at full resolution on the region plus a margin, and copies the
+ * resulting flags inside the region into @p masks.
+ */
+void CoarseScreeningAction::flagRegion(ArtifactSet &artifacts, ProgressListener &listener, const Region &region, std::vector<Mask2DPtr> &masks)
+{
+	const size_t
+		width = artifacts.ContaminatedData().ImageWidth(),
+		height = artifacts.ContaminatedData().ImageHeight(),
+		marginX = _tileWidth / 2,
+		marginY = _tileHeight / 2;
+	Region extended;
+	extended.xStart = region.xStart > marginX ? region.xStart - marginX : 0;
+	extended.xEnd = std::min(region.xEnd + marginX, width);
+	extended.yStart = region.yStart > marginY ? region.yStart - marginY : 0;
+	extended.yEnd = std::min(region.yEnd + marginY, height);
+
+	ArtifactSet regionArtifacts(artifacts);
+	regionArtifacts.SetNoImageSet();
+	regionArtifacts.OriginalData().Trim(extended.xStart, extended.yStart, extended.xEnd, extended.yEnd);
+	regionArtifacts.ContaminatedData().Trim(extended.xStart, extended.yStart, extended.xEnd, extended.yEnd);
+	regionArtifacts.RevisedData().Trim(extended.xStart, extended.yStart, extended.xEnd, extended.yEnd);
+	if(artifacts.HasMetaData())
+		regionArtifacts.SetMetaData(trimMetaData(artifacts.MetaData(), extended));
+
+	ActionBlock::Perform(regionArtifacts, listener);
+
+	const TimeFrequencyData &result = regionArtifacts.ContaminatedData();
+	if(result.MaskCount() != masks.size())
+		throw std::runtime_error("Coarse screening: the flags of a full-resolution region do not match the flags of the coarse flagging");
+	for(size_t i=0;i!=masks.size();++i)
+	{
+		const Mask2DCPtr regionMask = result.GetMask(i);
+		for(size_t y=region.yStart;y!=region.yEnd;++y)
+		{
+			for(size_t x=region.xStart;x!=region.xEnd;++x)
+				masks[i]->SetValue(x, y, regionMask->Value(x - extended.xStart, y - extended.yStart));
+		}
+	}
+}
+
+TimeFrequencyMetaDataCPtr CoarseScreeningAction::trimMetaData(const TimeFrequencyMetaDataCPtr &metaData, const Region &region)
+{
+	TimeFrequencyMetaData *newMetaData = new TimeFrequencyMetaData(*metaData);
+	if(newMetaData->HasUVW() && newMetaData->UVW().size() >= region.xEnd)
+	{
+		std::vector<UVW> uvw(newMetaData->UVW().begin() + region.xStart, newMetaData->UVW().begin() + region.xEnd);
+		newMetaData->SetUVW(uvw);
+	}
+	if(newMetaData->HasObservationTimes() && newMetaData->ObservationTimes().size() >= region.xEnd)
+	{
+		std::vector<double> times(newMetaData->ObservationTimes().begin() + region.xStart, newMetaData->ObservationTimes().begin() + region.xEnd);
+		newMetaData->SetObservationTimes(times);
+	}
+	if(newMetaData->HasBand() && newMetaData->Band().channels.size() >= region.yEnd)
+	{
+		BandInfo band(newMetaData->Band());
+		band.channels.assign(newMetaData->Band().channels.begin() + region.yStart, newMetaData->Band().channels.begin() + region.yEnd);
+		newMetaData->SetBand(band);
+	}
+	return TimeFrequencyMetaDataCPtr(newMetaData);
+}
+
+const char *CoarseScreeningAction::decisionName(enum TileDecision decision)
+{
+	switch(decision)
+	{
+		case CleanTile: return "clean";
+		case CleanTileWithFlags: return "clean, keeping existing flags";
+		case NewFlagsTile: return "new flags at low resolution";
+		case ChangedFlagsTile: return "existing flags changed at low resolution";
+		case SpikeTile: return "spike";
+	}
+	return "";
+}
+
+}
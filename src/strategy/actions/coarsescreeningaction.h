@@ -0,0 +1,96 @@
+#ifndef COARSESCREENINGACTION_H
+#define COARSESCREENINGACTION_H
+
+#include <string>
+#include <vector>
+
+#include "../../structures/timefrequencydata.h"
+#include "../../structures/timefrequencymetadata.h"
+
+#include "../control/actionblock.h"
+
+namespace rfiStrategy {
+
+	/**
+	 * Runs its children first on a copy of the data of which the resolution is decreased, like
+	 * the ChangeResolutionAction does, and only runs them again at full resolution on the
+	 * time-frequency tiles that turn out to be contaminated. On baselines with little RFI,
+	 * most tiles are only flagged at the low resolution, which is much faster.
+	 *
+	 * A tile is contaminated when the children flagged samples in it at low resolution that
+	 * were not flagged before, or when a sample in it deviates more than the spike threshold
+	 * from the average of its channel in its low-resolution cell. The latter catches short or
+	 * narrow-band RFI that is averaged out in the low-resolution copy. Contaminated tiles that are
+	 * adjacent in time are flagged together, with a margin of half a tile around them to
+	 * avoid edge effects. When more than the maximum contaminated fraction of the tiles is
+	 * contaminated, the children are simply run on the full data.
+	 *
+	 * Only the flags are changed by this block; the images are restored afterwards. The
+	 * decision for each tile is written to the debug log.
+	 */
+	class CoarseScreeningAction : public ActionBlock {
+		public:
+			CoarseScreeningAction() :
+				_timeDecreaseFactor(10), _frequencyDecreaseFactor(4),
+				_tileWidth(256), _tileHeight(64),
+				_spikeThreshold(6.0), _maxContaminatedFraction(0.5)
+			{
+			}
+			~CoarseScreeningAction()
+			{
+			}
+			virtual std::string Description()
+			{
+				return "Coarse screening";
+			}
+			virtual void Perform(class ArtifactSet &artifacts, class ProgressListener &listener);
+			virtual ActionType Type() const { return CoarseScreeningActionType; }
+
+			int TimeDecreaseFactor() const { return _timeDecreaseFactor; }
+			void SetTimeDecreaseFactor(int factor) { _timeDecreaseFactor = factor; }
+
+			int FrequencyDecreaseFactor() const { return _frequencyDecreaseFactor; }
+			void SetFrequencyDecreaseFactor(int factor) { _frequencyDecreaseFactor = factor; }
+
+			/** Width of a tile in full-resolution time steps. */
+			unsigned TileWidth() const { return _tileWidth; }
+			void SetTileWidth(unsigned tileWidth) { _tileWidth = tileWidth; }
+
+			/** Height of a tile in full-resolution channels. */
+			unsigned TileHeight() const { return _tileHeight; }
+			void SetTileHeight(unsigned tileHeight) { _tileHeight = tileHeight; }
+
+			/**
+			 * Deviation from the average of the channel within the low-resolution cell, in units
+			 * of the standard deviation of the channel, above which a tile is considered contaminated.
+			 */
+			double SpikeThreshold() const { return _spikeThreshold; }
+			void SetSpikeThreshold(double spikeThreshold) { _spikeThreshold = spikeThreshold; }
+
+			double MaxContaminatedFraction() const { return _maxContaminatedFraction; }
+			void SetMaxContaminatedFraction(double fraction) { _maxContaminatedFraction = fraction; }
+		private:
+			enum TileDecision { CleanTile, CleanTileWithFlags, NewFlagsTile, ChangedFlagsTile, SpikeTile };
+
+			struct Region
+			{
+				size_t xStart, xEnd, yStart, yEnd;
+			};
+
+			void decideTiles(const Mask2DCPtr &coarseInputMask, const Mask2DCPtr &coarseMask, const std::vector<num_t> &tileDeviations, size_t tileCountX, std::vector<enum TileDecision> &decisions) const;
+			void findSpikes(const TimeFrequencyData &data, const Mask2DCPtr &mask, std::vector<num_t> &tileDeviations) const;
+			void flagRegion(class ArtifactSet &artifacts, class ProgressListener &listener, const Region &region, std::vector<Mask2DPtr> &masks);
+			static TimeFrequencyMetaDataCPtr trimMetaData(const TimeFrequencyMetaDataCPtr &metaData, const Region &region);
+			static const char *decisionName(enum TileDecision decision);
+
+			size_t tilesX(size_t width) const { return (width + _tileWidth - 1) / _tileWidth; }
+			size_t tilesY(size_t height) const { return (height + _tileHeight - 1) / _tileHeight; }
+
+			int _timeDecreaseFactor, _frequencyDecreaseFactor;
+			unsigned _tileWidth, _tileHeight;
+			double _spikeThreshold, _maxContaminatedFraction;
+	};
+
+}
+
+#endif // COARSESCREENINGACTION_H
@@ -2,6 +2,9 @@
 #define RFI_DIRECTIONALCLEAN_ACTION_H
 
 #include <iostream>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
 
 #include "../../util/ffttools.h"
 #include "../../util/plot.h"
@@ -85,17 +88,14 @@ namespace rfiStrategy {
 				if(_channelConvolutionSize != 1)
 					amplitudes = ThresholdTools::FrequencyRectangularConvolution(amplitudes, _channelConvolutionSize);
 
-				if(_values == 0)
-				{
-					_valueWidth = amplitudes->Width();
-					_values = new num_t[amplitudes->Width()];
-					for(unsigned i=0;i<amplitudes->Width();++i) _values[i] = 0.0;
-				}
-
+				// The removed amplitudes are summed for this data first, and added to the values
+				// for the plot at the end, so that the action can be performed by several threads
+				std::vector<num_t> values(amplitudes->Width(), 0.0);
 				for(unsigned y=0;y<contaminated.ImageHeight();++y)
 				{
-					performFrequency(artifacts, amplitudes, realDest, imagDest, realOriginal, imagOriginal, y, y == contaminated.ImageHeight()/2);
+					performFrequency(artifacts, amplitudes, realDest, imagDest, realOriginal, imagOriginal, &values[0], y, y == contaminated.ImageHeight()/2);
 				}
+				addValues(values);
 				revised.SetImage(0, realDest);
 				revised.SetImage(1, imagDest);
 				original.SetImage(0, realOriginal);
@@ -123,8 +123,22 @@ namespace rfiStrategy {
 			unsigned _valueWidth;
 			bool _makePlot;
 			num_t *_values;
+			boost::mutex _valuesMutex;
+
+			void addValues(const std::vector<num_t> &values)
+			{
+				boost::mutex::scoped_lock lock(_valuesMutex);
+				if(_values == 0)
+				{
+					_valueWidth = values.size();
+					_values = new num_t[values.size()];
+					for(unsigned i=0;i<values.size();++i) _values[i] = 0.0;
+				}
+				for(unsigned i=0;i<values.size() && i<_valueWidth;++i)
+					_values[i] += values[i];
+			}
 
-			void performFrequency(ArtifactSet &artifacts, Image2DCPtr amplitudeValues, Image2DPtr realDest, Image2DPtr imagDest, Image2DPtr realOriginal, Image2DPtr imagOriginal, unsigned y, bool verbose=false)
+			void performFrequency(ArtifactSet &artifacts, Image2DCPtr amplitudeValues, Image2DPtr realDest, Image2DPtr imagDest, Image2DPtr realOriginal, Image2DPtr imagOriginal, num_t *values, unsigned y, bool verbose=false)
 			{
 				Image2DCPtr
 					realInput = artifacts.ContaminatedData().GetRealPart(),
@@ -192,7 +206,7 @@ namespace rfiStrategy {
 					{
 						if(verbose)
 							AOLogger::Debug << "Within limits " << lowestIndex << "-" << upperLimit << '\n';
-						_values[fIndex] += amplitudeRemoved;
+						values[fIndex] += amplitudeRemoved;
 						subtractComponent(realOriginal, imagOriginal, inputWidth, uPositions, fIndex, amplitudeRemoved, phase, y);
 					} else {
 						if(verbose)
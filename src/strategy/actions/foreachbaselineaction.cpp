@@ -70,10 +70,11 @@ namespace rfiStrategy {
 					_threadCount = maxThreads;
 				}
 			}
-			if(dynamic_cast<FilterBankSet*>(imageSet) != 0 && _threadCount != 1)
+			FilterBankSet *filterBankSet = dynamic_cast<FilterBankSet*>(imageSet);
+			if(filterBankSet != 0)
 			{
-				AOLogger::Info << "This is a Filterbank set -- disabling multi-threading\n";
-				_threadCount = 1;
+				// Split the set such that every thread can flag its own interval
+				filterBankSet->SetThreadCount(mathThreadCount());
 			}
 			if(!_antennaeToSkip.empty())
 			{
@@ -143,7 +144,9 @@ namespace rfiStrategy {
 
 			if(_resultSet != 0)
 			{
+				const size_t threadCount = artifacts.ThreadCount();
 				artifacts = *_resultSet;
+				artifacts.SetThreadCount(threadCount);
 				delete _resultSet;
 			}
 
@@ -248,6 +251,8 @@ namespace rfiStrategy {
 			boost::mutex::scoped_lock lock(_action._mutex);
 			ArtifactSet newArtifacts(*_action._artifacts);
 			lock.unlock();
+			// The baselines are already flagged in parallel
+			newArtifacts.SetThreadCount(1);
 			
 			BaselineData *baseline = _action.GetNextBaseline();
 			
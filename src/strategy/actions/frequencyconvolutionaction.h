@@ -2,12 +2,14 @@
 #define RFI_FREQUENCY_CONVOLUTION_ACTION
 
 #include <stdexcept>
+#include <vector>
 
 #include "../../structures/samplerow.h"
 
 #include "../../imaging/uvimager.h"
 
 #include "../../util/aologger.h"
+#include "../../util/ffttools.h"
 #include "../../util/progresslistener.h"
 
 #include "action.h"
@@ -15,6 +17,7 @@
 #include "../control/actionblock.h"
 #include "../control/artifactset.h"
 
+#include "../algorithms/convolutions.h"
 #include "../algorithms/thresholdtools.h"
 
 namespace rfiStrategy {
@@ -81,12 +84,14 @@ namespace rfiStrategy {
 				AOLogger::Debug << "Avg uv dist: " << uvDist << '\n';
 				numl_t convolutionSize = convolutionSizeInSamples(uvDist, source->Height());
 				AOLogger::Debug << "Convolution size: " << convolutionSize << '\n';
-				Image2DPtr destination = Image2D::CreateUnsetImagePtr(source->Width(), source->Height());
-				for(unsigned x=0;x<source->Width();++x)
+				// The kernel covers the full height, hence it is applied in the Fourier domain
+				Image2DPtr destination = Image2D::CreateCopy(source);
+				const size_t height = source->Height();
+				if(height != 0)
 				{
-					SampleRowPtr row = SampleRow::CreateFromColumn(source, x);
-					row->ConvolveWithSinc(1.0 / convolutionSize);
-					row->SetVerticalImageValues(destination, x);
+					std::vector<num_t> kernel(height*2 - 1);
+					Convolutions::SincKernel(&kernel[0], kernel.size(), 1.0 / convolutionSize);
+					FFTTools::FFTConvolveVertically(*destination, &kernel[0], kernel.size());
 				}
 				return destination;
 			}
@@ -131,45 +136,46 @@ namespace rfiStrategy {
 				
 				const num_t factor = M_PIn / _convolutionSize;
 				
+				// The uv positions in wavelengths of all samples, stored row by row as in the
+				// image, so that the inner loop runs along contiguous rows
+				std::vector<num_t> uPositions(width * height), vPositions(width * height);
+				for(size_t y=0;y<height;++y)
+				{
+					const num_t sol = UVImager::SpeedOfLight();
+					const double freq = metaData->Band().channels[y].frequencyHz / sol;
+					for(size_t x=0;x<width;++x)
+					{
+						uPositions[y*width + x] = uvws[x].u * freq;
+						vPositions[y*width + x] = uvws[x].v * freq;
+					}
+				}
+				
 				for(size_t y=0;y<height;++y)
 				{
 					for(size_t x=0;x<width;++x)
 					{
-						const UVW uvw = uvws[x];
-						const num_t sol = UVImager::SpeedOfLight();
-						const double freq1 = metaData->Band().channels[y].frequencyHz / sol;
 						const num_t
-							u1 = uvw.u * freq1,
-							v1 = uvw.v * freq1;
-						//	w1 = uvw.w * freq1;
-						num_t real = 0.0f, imaginary = 0.0f, weight = 1.0f;
+							u1 = uPositions[y*width + x],
+							v1 = vPositions[y*width + x];
+						// The sample itself has weight one
+						num_t
+							real = copyReal->Value(x, y),
+							imaginary = copyImag->Value(x, y),
+							weight = 1.0f;
 						
 						for(size_t yi=0;yi<height;++yi)
 						{
-							const double freq2 = metaData->Band().channels[yi].frequencyHz / sol;
-							for(size_t xi=0;xi<width;++xi)
+							const num_t
+								*uRow = &uPositions[yi*width],
+								*vRow = &vPositions[yi*width],
+								*realRow = copyReal->ValuePtr(0, yi),
+								*imagRow = copyImag->ValuePtr(0, yi);
+							if(yi == y)
 							{
-								if(xi == x && yi == y)
-								{
-									real += copyReal->Value(xi, yi);
-									imaginary += copyImag->Value(xi, yi);
-								} else {
-									const UVW uvwi = uvws[xi];
-									const num_t
-										du = uvwi.u * freq2 - u1,
-										dv = uvwi.v * freq2 - v1;
-										//dw = uvwi.w * freq2 - w1;
-									const num_t dist = sqrtn(du*du + dv*dv) * factor; // + dw*dw
-									const num_t sincVal = sinn(dist) / dist;
-									/*if(xi == 0)
-									{
-										AOLogger::Debug << dist << '*' << factor << " -> " << sincVal << '\n';
-									}*/
-									
-									real += sincVal * copyReal->Value(xi, yi);
-									imaginary += sincVal * copyImag->Value(xi, yi);
-									weight += sincVal;
-								}
+								addSincWeighted(uRow, vRow, realRow, imagRow, 0, x, u1, v1, factor, real, imaginary, weight);
+								addSincWeighted(uRow, vRow, realRow, imagRow, x+1, width, u1, v1, factor, real, imaginary, weight);
+							} else {
+								addSincWeighted(uRow, vRow, realRow, imagRow, 0, width, u1, v1, factor, real, imaginary, weight);
 							}
 						}
 						rImage->SetValue(x, y, real / weight);
@@ -179,6 +185,21 @@ namespace rfiStrategy {
 				}
 			}
 			
+			static void addSincWeighted(const num_t *uRow, const num_t *vRow, const num_t *realRow, const num_t *imagRow, size_t xStart, size_t xEnd, num_t u1, num_t v1, num_t factor, num_t &real, num_t &imaginary, num_t &weight)
+			{
+				for(size_t xi=xStart;xi<xEnd;++xi)
+				{
+					const num_t
+						du = uRow[xi] - u1,
+						dv = vRow[xi] - v1,
+						dist = sqrtn(du*du + dv*dv) * factor,
+						sincVal = sinn(dist) / dist;
+					real += sincVal * realRow[xi];
+					imaginary += sincVal * imagRow[xi];
+					weight += sincVal;
+				}
+			}
+			
 			enum KernelKind _kernelKind;
 			numl_t _convolutionSize;
 			bool _inSamples;
@@ -2,6 +2,8 @@
 
 #include "../algorithms/highpassfilter.h"
 
+#include "../control/iterationcache.h"
+
 namespace rfiStrategy {
 
 void HighPassFilterAction::Perform(ArtifactSet &artifacts, ProgressListener &progress)
@@ -16,13 +18,19 @@ void HighPassFilterAction::Perform(ArtifactSet &artifacts, ProgressListener &pro
 	filter.SetVWindowSize(_windowHeight);
 	Mask2DCPtr mask = data.GetSingleMask();
 	size_t imageCount = data.ImageCount();
+	// Inside an IterationBlock, only the parts of which the flags changed since the
+	// previous iteration are filtered again
+	IterationCache *cache = artifacts.IterationCache();
 	
 	switch(_mode)
 	{
 	case StoreContaminated:
 		for(size_t i=0;i<imageCount;++i)
 		{
-			data.SetImage(i, filter.ApplyHighPass(data.GetImage(i), mask));
+			if(cache != 0)
+				data.SetImage(i, filter.ApplyHighPass(data.GetImage(i), mask, cache->LowPassState(this, i)));
+			else
+				data.SetImage(i, filter.ApplyHighPass(data.GetImage(i), mask));
 		}
 		break;
 		
@@ -33,7 +41,10 @@ void HighPassFilterAction::Perform(ArtifactSet &artifacts, ProgressListener &pro
 		TimeFrequencyData revisedData = data;
 		for(size_t i=0;i<imageCount;++i)
 		{
-			revisedData.SetImage(i, filter.ApplyLowPass(revisedData.GetImage(i), mask));
+			if(cache != 0)
+				revisedData.SetImage(i, filter.ApplyLowPass(revisedData.GetImage(i), mask, cache->LowPassState(this, i)));
+			else
+				revisedData.SetImage(i, filter.ApplyLowPass(revisedData.GetImage(i), mask));
 		}
 		artifacts.SetRevisedData(revisedData);
 		break;
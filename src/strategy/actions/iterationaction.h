@@ -7,6 +7,7 @@
 
 #include "../control/artifactset.h"
 #include "../control/actionblock.h"
+#include "../control/iterationcache.h"
 
 #include "../../util/progresslistener.h"
 
@@ -31,6 +32,10 @@ namespace rfiStrategy {
 				long double sensitivityStep = powl(_sensitivityStart, 1.0L/_iterationCount);
 				long double sensitivity = _sensitivityStart;
 
+				// Actions in the block keep results from one iteration to the next in the cache
+				ArtifactsRestorer restorer(artifacts);
+				class IterationCache cache;
+				artifacts.SetIterationCache(&cache);
 				for(size_t i=0;i<_iterationCount;++i)
 				{
 					artifacts.SetSensitivity(sensitivity * oldSensitivity);
@@ -39,7 +44,6 @@ namespace rfiStrategy {
 					listener.OnEndTask(*this);
 					sensitivity /= sensitivityStep;
 				}
-				artifacts.SetSensitivity(oldSensitivity);
 			}
 			virtual ActionType Type() const { return IterationBlockType; }
 			virtual unsigned int Weight() const { return ActionBlock::Weight() * _iterationCount; }
@@ -49,6 +53,32 @@ namespace rfiStrategy {
 			long double SensitivityStart() const throw() { return _sensitivityStart; }
 			void SetSensitivityStart(long double sensitivityStart) throw() { _sensitivityStart = sensitivityStart; }
 		private:
+			/**
+			 * Restores the iteration cache and sensitivity of the artifact set when the
+			 * block is left, also when one of its actions throws. Otherwise, the set
+			 * would keep pointing to the cache on the stack of Perform().
+			 */
+			class ArtifactsRestorer
+			{
+				public:
+					ArtifactsRestorer(ArtifactSet &artifacts) :
+						_artifacts(artifacts), _iterationCache(artifacts.IterationCache()), _sensitivity(artifacts.Sensitivity())
+					{
+					}
+					~ArtifactsRestorer()
+					{
+						_artifacts.SetIterationCache(_iterationCache);
+						_artifacts.SetSensitivity(_sensitivity);
+					}
+				private:
+					ArtifactsRestorer(const ArtifactsRestorer &source); // don't allow copies
+					void operator=(const ArtifactsRestorer &source); // don't allow assignment
+					
+					ArtifactSet &_artifacts;
+					class IterationCache *_iterationCache;
+					numl_t _sensitivity;
+			};
+			
 			size_t _iterationCount;
 			long double _sensitivityStart;
 	};
@@ -11,6 +11,7 @@ namespace rfiStrategy {
 	void SVDAction::Perform(ArtifactSet &artifacts, class ProgressListener &listener)
 	{
 		SVDMitigater mitigater;
+		mitigater.SetThreadCount(artifacts.ThreadCount());
 		mitigater.Initialize(artifacts.ContaminatedData());
 		mitigater.SetRemoveCount(_singularValueCount);
 		for(size_t i=0;i<mitigater.TaskCount();++i)
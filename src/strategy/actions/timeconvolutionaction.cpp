@@ -1,61 +1,507 @@
 #include "timeconvolutionaction.h"
 
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
 #include <fftw3.h>
 
+#include <boost/bind.hpp>
+
+#include "../../util/fftplancache.h"
+
 namespace rfiStrategy {
 
 void TimeConvolutionAction::PerformFFTSincOperation(ArtifactSet &artifacts, Image2DPtr real, Image2DPtr imag) const
 {
-	fftw_complex
-		*fftIn = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * real->Width()),
-		*fftOut = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * real->Width());
-	
-	// FFTW plan routines are not thread safe, so lock.
-	boost::mutex::scoped_lock lock(artifacts.IOMutex());
-	fftw_plan
-		fftPlanForward = fftw_plan_dft_1d(real->Width(), fftIn, fftOut, FFTW_FORWARD, FFTW_MEASURE),
-		fftPlanBackward = fftw_plan_dft_1d(real->Width(), fftIn, fftOut, FFTW_BACKWARD, FFTW_MEASURE);
-	lock.unlock();
+	const size_t width = real->Width(), height = real->Height();
+	if(width == 0 || height == 0)
+		return;
+	if(real->Stride() != imag->Stride())
+		throw std::runtime_error("PerformFFTSincOperation(): real and imaginary images have different strides");
+	const size_t stride = real->Stride();
 	
-	const size_t width = real->Width();
-
+	// Determine which rows to filter and how many frequencies to keep; zero means the row is not filtered
+	std::vector<size_t> filterIndexSizes(height, 0);
 	const BandInfo band = artifacts.MetaData()->Band();
-	for(unsigned y=0;y<real->Height();++y)
+	for(unsigned y=0;y<height;++y)
 	{
 		const numl_t sincScale = ActualSincScaleInSamples(artifacts, band.channels[y].frequencyHz);
 		const numl_t limitFrequency = (numl_t) width / sincScale;
-		if(y == real->Height()/2)
+		if(y == height/2)
 		{
 			AOLogger::Debug << "Horizontal sinc scale: " << sincScale << " (filter scale: " << Angle::ToString(ActualSincScaleAsRaDecDist(artifacts, band.channels[y].frequencyHz)) << ")\n";
 		}
 		if(sincScale > 1.0)
+			filterIndexSizes[y] = (limitFrequency > 1.0) ? (size_t) ceil(limitFrequency/2.0) : 1;
+	}
+	
+	// Consecutive rows that are filtered are transformed at once, in place in the image
+	// memory. The real and imaginary images are the split parts of the complex data,
+	// hence the backward transform is the forward plan with the parts swapped.
+	// The plans are made once per process and are shared by all threads.
+	FFTPlanCache &planCache = FFTPlanCache::Instance();
+	const num_t factor = 1.0 / (num_t) width;
+	size_t rowStart = 0;
+	while(rowStart < height)
+	{
+		if(filterIndexSizes[rowStart] == 0)
 		{
-			for(unsigned x=0;x<width;++x)
+			++rowStart;
+			continue;
+		}
+		size_t rowEnd = rowStart + 1;
+		while(rowEnd < height && filterIndexSizes[rowEnd] != 0)
+			++rowEnd;
+		
+		fftwf_plan plan = planCache.SplitComplexPlan(FFTPlanCache::Contiguous(width), FFTPlanCache::Batch(rowEnd - rowStart, stride), true, true);
+		num_t
+			*realData = real->ValuePtr(0, rowStart),
+			*imagData = imag->ValuePtr(0, rowStart);
+		fftwf_execute_split_dft(plan, realData, imagData, realData, imagData);
+		
+		// Remove the high frequencies [filterIndexSize : n-filterIndexSize]
+		for(size_t y=rowStart;y<rowEnd;++y)
+		{
+			const size_t filterIndexSize = filterIndexSizes[y];
+			if(filterIndexSize*2 < width)
 			{
-				fftIn[x][0] = real->Value(x, y);
-				fftIn[x][1] = imag->Value(x, y);
+				std::fill(real->ValuePtr(filterIndexSize, y), real->ValuePtr(width - filterIndexSize, y), 0.0);
+				std::fill(imag->ValuePtr(filterIndexSize, y), imag->ValuePtr(width - filterIndexSize, y), 0.0);
 			}
-			
-			fftw_execute_dft(fftPlanForward, fftIn, fftOut);
-			size_t filterIndexSize = (limitFrequency > 1.0) ? (size_t) ceil(limitFrequency/2.0) : 1;
-			// Remove the high frequencies [filterIndexSize : n-filterIndexSize]
-			for(size_t f=filterIndexSize;f<width - filterIndexSize;++f)
+		}
+		
+		fftwf_execute_split_dft(plan, imagData, realData, imagData, realData);
+		
+		// fftw multiplies data with n, so divide by n.
+		for(size_t y=rowStart;y<rowEnd;++y)
+		{
+			num_t
+				*realPtr = real->ValuePtr(0, y),
+				*imagPtr = imag->ValuePtr(0, y);
+			for(size_t x=0;x<width;++x)
+			{
+				realPtr[x] *= factor;
+				imagPtr[x] *= factor;
+			}
+		}
+		
+		rowStart = rowEnd;
+	}
+}
+
+
+Image2DPtr TimeConvolutionAction::PerformProjectedSincOperation(ArtifactSet &artifacts, ProgressListener &listener) const
+{
+	TimeFrequencyData data = artifacts.ContaminatedData();
+	Image2DCPtr image = data.GetSingleImage();
+	Image2DPtr newImage = Image2D::CreateUnsetImagePtr(image->Width(), image->Height());
+	
+	RowProgress progress(*this, listener, image->Height());
+	parallelFor(artifacts, image->Height(), boost::bind(&TimeConvolutionAction::projectedSincRows, this, boost::ref(artifacts), image, newImage, data.IsImaginary(), boost::ref(progress), _1, _2));
+	listener.OnProgress(*this, image->Height(), image->Height());
+	
+	return newImage;
+}
+
+void TimeConvolutionAction::projectedSincRows(ArtifactSet &artifacts, Image2DCPtr image, Image2DPtr newImage, bool isImaginary, RowProgress &progress, size_t yStart, size_t yEnd) const
+{
+	TimeFrequencyMetaDataCPtr metaData = artifacts.MetaData();
+	const size_t width = image->Width();
+	const BandInfo band = metaData->Band();
+	std::vector<numl_t>
+		rowValues(width), rowUPositions(width), rowVPositions(width);
+	std::vector<double>
+		values, positions;
+	values.reserve(width);
+	positions.reserve(width);
+	
+	for(size_t y=yStart;y<yEnd;++y)
+	{
+		progress.StartRows(1);
+		const double sincScale = ActualSincScaleInLambda(artifacts, band.channels[y].frequencyHz);
+		
+		UVProjection::ProjectPositions(metaData, width, y, &rowUPositions[0], &rowVPositions[0], _directionRad);
+		UVProjection::Project(image, y, &rowValues[0], isImaginary);
+		
+		// If a point is exactly on the u axis, it is ignored (it would have infinite weight)
+		values.clear();
+		positions.clear();
+		for(size_t x=0;x<width;++x)
+		{
+			if(metaData->UVW()[x].v != 0.0)
+			{
+				values.push_back(rowValues[x]);
+				positions.push_back(rowUPositions[x] / sincScale);
+			}
+		}
+		
+		// Perform the convolution
+		num_t *newRow = newImage->ValuePtr(0, y);
+		for(size_t t=0;t<width;++t)
+		{
+			const double pos = rowUPositions[t] / sincScale;
+			double valueSum = 0.0, weightSum = 0.0;
+			for(size_t i=0;i!=values.size();++i)
+			{
+				const double dist = positions[i] - pos;
+				if(dist != 0.0)
+				{
+					const double sincValue = sin(dist) / dist;
+					valueSum += sincValue * values[i];
+					weightSum += sincValue;
+				}
+				else
+				{
+					valueSum += values[i];
+					weightSum += 1.0;
+				}
+			}
+			newRow[t] = (num_t) (valueSum / weightSum);
+		}
+	}
+}
+
+void TimeConvolutionAction::Project(IterationData &iterData, Image2DCPtr real, Image2DCPtr imaginary, size_t yStart, size_t yEnd) const
+{
+	const size_t width = iterData.width;
+	std::fill(iterData.rowRValues.begin(), iterData.rowRValues.end(), 0.0);
+	std::fill(iterData.rowIValues.begin(), iterData.rowIValues.end(), 0.0);
+	std::fill(iterData.rowUPositions.begin(), iterData.rowUPositions.end(), 0.0);
+	std::fill(iterData.rowVPositions.begin(), iterData.rowVPositions.end(), 0.0);
+	iterData.maxDist = 0.0;
+	
+	numl_t
+		*values = &iterData.projectedValues[0],
+		*uPositions = &iterData.projectedUPositions[0],
+		*vPositions = &iterData.projectedVPositions[0];
+	const double yL = yEnd - yStart;
+	
+	// We average all values returned by Project() over yStart to yEnd
+	for(size_t y=yStart;y<yEnd;++y)
+	{
+		UVProjection::ProjectPositions(iterData.artifacts->MetaData(), width, y, uPositions, vPositions, iterData.directionRad);
+		
+		UVProjection::Project(real, y, values, false);
+		for(size_t x=0;x<width;++x)
+			iterData.rowRValues[x] += values[x] / yL;
+		UVProjection::Project(imaginary, y, values, true);
+		for(size_t x=0;x<width;++x)
+			iterData.rowIValues[x] += values[x] / yL;
+		
+		for(size_t x=0;x<width;++x)
+		{
+			iterData.rowUPositions[x] += uPositions[x] / yL;
+			iterData.rowVPositions[x] += vPositions[x] / yL;
+		}
+		
+		// Find the point closest to v=0
+		double vDist = fabs(vPositions[0]);
+		size_t vZeroPos = 0;
+		for(size_t i=1;i<width;++i)
+		{
+			if(fabs(vPositions[i]) < vDist)
+			{
+				vDist = fabs(vPositions[i]);
+				vZeroPos = i;
+			}
+		}
+		iterData.vZeroPos = vZeroPos;
+		iterData.channelMaxDist[y] = fabs(uPositions[vZeroPos]);
+		iterData.maxDist += iterData.channelMaxDist[y] / yL;
+	}
+}
+
+void TimeConvolutionAction::PrecalculateFTFactors(IterationData &iterData) const
+{
+	// F(xF) = \\int f(u) * e^(-i 2 \\pi * u_n * xF_n)
+	// xF \\in [0 : fourierWidth] -> xF_n = 2 xF / fourierWidth - 1 \\in [-1 : 1];
+	// u \\in [-maxDist : maxDist] -> u_n = u * width / maxDist \\in [ -width : width ]
+	// final frequenty domain covers [-maxDist : maxDist]
+	// The phase is linear in xF, hence only the phase step per xF is stored for each sample.
+	const size_t width = iterData.width;
+	const double stepFactor = -M_PI * width / (iterData.maxDist * iterData.fourierWidth);
+	size_t count = 0;
+	for(size_t tIndex=iterData.rangeStart;tIndex<iterData.rangeEnd;++tIndex)
+	{
+		const size_t t = (tIndex + width - iterData.vZeroPos) % width;
+		const double posU = iterData.rowUPositions[t];
+		if(posU != 0.0)
+		{
+			iterData.ftIndices[count] = t;
+			iterData.ftPositions[count] = posU;
+			iterData.ftStepReal[count] = cos(stepFactor * posU);
+			iterData.ftStepImag[count] = sin(stepFactor * posU);
+			++count;
+		}
+	}
+	iterData.ftCount = count;
+}
+
+/**
+ * Sets the phasors to exp(i * factor * position).
+ */
+static void setPhasors(const double *positions, size_t count, double factor, double *phasorReal, double *phasorImag)
+{
+	for(size_t i=0;i!=count;++i)
+	{
+		phasorReal[i] = cos(factor * positions[i]);
+		phasorImag[i] = sin(factor * positions[i]);
+	}
+}
+
+void TimeConvolutionAction::PerformFourierTransform(IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t yStart, size_t yEnd) const
+{
+	const size_t
+		count = iterData.ftCount,
+		fourierWidth = iterData.fourierWidth;
+	const double
+		weightSum = count,
+		phaseFactor = M_PI * iterData.width / iterData.maxDist;
+	const double
+		*positions = &iterData.ftPositions[0],
+		*stepReal = &iterData.ftStepReal[0],
+		*stepImag = &iterData.ftStepImag[0];
+	double
+		*valuesReal = &iterData.ftValuesReal[0],
+		*valuesImag = &iterData.ftValuesImag[0],
+		*phasorReal = &iterData.phasorReal[0],
+		*phasorImag = &iterData.phasorImag[0];
+	
+	// Gather the values of the used samples, so that the inner loop is contiguous
+	for(size_t i=0;i!=count;++i)
+	{
+		valuesReal[i] = iterData.rowRValues[iterData.ftIndices[i]];
+		valuesImag[i] = iterData.rowIValues[iterData.ftIndices[i]];
+	}
+	
+	// Perform a 1d Fourier transform, ignoring eta part of the data
+	for(size_t xF=0;xF<fourierWidth;++xF)
+	{
+		if(xF % PhasorReseedInterval == 0)
+			setPhasors(positions, count, -((double) xF / fourierWidth - 0.5) * phaseFactor, phasorReal, phasorImag);
+		
+		// compute F(xF) = \\int f(x) * exp( -2 * \\pi * i * x * xF )
+		double
+			realVal = 0.0,
+			imagVal = 0.0;
+		for(size_t i=0;i!=count;++i)
+		{
+			const double
+				cosVal = phasorReal[i],
+				sinVal = phasorImag[i];
+			realVal += valuesReal[i] * cosVal - valuesImag[i] * sinVal;
+			imagVal += valuesImag[i] * cosVal + valuesReal[i] * sinVal;
+			phasorReal[i] = cosVal * stepReal[i] - sinVal * stepImag[i];
+			phasorImag[i] = cosVal * stepImag[i] + sinVal * stepReal[i];
+		}
+		iterData.fourierValuesReal[xF] = realVal / weightSum;
+		iterData.fourierValuesImag[xF] = imagVal / weightSum;
+		if(_operation == ProjectedFTOperation)
+		{
+			for(size_t y=yStart;y!=yEnd;++y)
 			{
-				fftOut[f][0] = 0.0;
-				fftOut[f][1] = 0.0;
+				real->SetValue(xF/2, y, (num_t) (realVal / weightSum));
+				imaginary->SetValue(xF/2, y, (num_t) (imagVal / weightSum));
 			}
-			fftw_execute_dft(fftPlanBackward, fftOut, fftIn);
+		}
+	}
+}
+
+void TimeConvolutionAction::InvFourierTransform(IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t y) const
+{
+	const size_t
+		startXf = iterData.startXf,
+		endXf = iterData.endXf,
+		width = iterData.width,
+		fourierWidth = iterData.fourierWidth;
+	
+	AOLogger::Debug << "Inv FT, using 0-" << startXf << " and " << endXf << "-" << fourierWidth << '\n';
+	
+	const double *positions = &iterData.rowUPositions[0];
+	double
+		*phasorReal = &iterData.phasorReal[0],
+		*phasorImag = &iterData.phasorImag[0],
+		*stepReal = &iterData.stepReal[0],
+		*stepImag = &iterData.stepImag[0],
+		*sumReal = &iterData.sumReal[0],
+		*sumImag = &iterData.sumImag[0];
+	const double stepFactor = 2.0 * M_PI / fourierWidth;
+	for(size_t t=0;t<width;++t)
+	{
+		stepReal[t] = cos(stepFactor * positions[t]);
+		stepImag[t] = sin(stepFactor * positions[t]);
+		sumReal[t] = 0.0;
+		sumImag[t] = 0.0;
+	}
+	
+	// compute f(x) = \\int F(xF) * exp( 2 * \\pi * i * x * xF ), for all x at once
+	for(size_t xF=startXf;xF<endXf;++xF)
+	{
+		if((xF - startXf) % PhasorReseedInterval == 0)
+			setPhasors(positions, width, ((double) xF / fourierWidth - 0.5) * 2.0 * M_PI, phasorReal, phasorImag);
+		
+		const double
+			fourierReal = iterData.fourierValuesReal[xF],
+			fourierImag = iterData.fourierValuesImag[xF];
+		for(size_t t=0;t<width;++t)
+		{
+			const double
+				cosVal = phasorReal[t],
+				sinVal = phasorImag[t];
+			sumReal[t] += fourierReal * cosVal - fourierImag * sinVal;
+			sumImag[t] += fourierImag * cosVal + fourierReal * sinVal;
+			phasorReal[t] = cosVal * stepReal[t] - sinVal * stepImag[t];
+			phasorImag[t] = cosVal * stepImag[t] + sinVal * stepReal[t];
+		}
+	}
+	
+	num_t
+		*realRow = real->ValuePtr(0, y),
+		*imagRow = imaginary->ValuePtr(0, y);
+	for(size_t t=0;t<width;++t)
+	{
+		if(iterData.rowVPositions[t] != 0.0)
+		{
+			realRow[t] = -sumReal[t];
+			imagRow[t] = -sumImag[t];
+		}
+	}
+}
+
+void TimeConvolutionAction::RemoveFourierComponent(IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t y, double fourierFactor, double fReal, double fImag, bool applyOnImages) const
+{
+	const size_t width = iterData.width;
+	num_t
+		*realRow = applyOnImages ? real->ValuePtr(0, y) : 0,
+		*imagRow = applyOnImages ? imaginary->ValuePtr(0, y) : 0;
+	
+	for(size_t t=0;t<width;++t)
+	{
+		const double
+			posU = iterData.rowUPositions[t],
+			cosValL = cos(-fourierFactor * posU),
+			sinValL = sin(-fourierFactor * posU),
+			realVal = (fReal * cosValL + fImag * sinValL) * 0.75,
+			imagVal = (fReal * sinValL + fImag * cosValL) * 0.75;
+		
+		if(applyOnImages)
+		{
+			realRow[t] -= realVal;
+			imagRow[t] -= imagVal;
+		} else {
+			iterData.rowRValues[t] -= realVal;
+			iterData.rowIValues[t] -= imagVal;
+		}
+	}
+}
+
+void TimeConvolutionAction::PerformExtrapolatedSincOperation(ArtifactSet &artifacts, Image2DPtr real, Image2DPtr imaginary, num_t directionRad, ProgressListener &listener) const
+{
+	// Each block of averaged channels is independent, so blocks are divided over the threads
+	const size_t
+		height = real->Height(),
+		averagingSize = std::max<size_t>(_channelAveragingSize, 1),
+		blockCount = (height + averagingSize - 1) / averagingSize;
+	std::vector<double> channelMaxDist(height);
+	RowProgress progress(*this, listener, height);
+	parallelFor(artifacts, blockCount, boost::bind(&TimeConvolutionAction::extrapolateBlocks, this, boost::ref(artifacts), real, imaginary, directionRad, &channelMaxDist[0], boost::ref(progress), _1, _2));
+	listener.OnProgress(*this, height, height);
+}
+
+void TimeConvolutionAction::extrapolateBlocks(ArtifactSet &artifacts, Image2DPtr real, Image2DPtr imaginary, num_t directionRad, double *channelMaxDist, RowProgress &progress, size_t blockStart, size_t blockEnd) const
+{
+	const size_t
+		width = real->Width(),
+		height = real->Height(),
+		averagingSize = std::max<size_t>(_channelAveragingSize, 1);
+	const BandInfo band = artifacts.MetaData()->Band();
+	
+	IterationData iterData(width);
+	iterData.artifacts = &artifacts;
+	iterData.directionRad = directionRad;
+	iterData.channelMaxDist = channelMaxDist;
+	iterData.rangeStart = (size_t) roundn(_etaParameter * (num_t) width / 2.0),
+	iterData.rangeEnd = width - iterData.rangeStart;
+	
+	for(size_t block=blockStart;block!=blockEnd;++block)
+	{
+		const size_t
+			y = block * averagingSize,
+			yEnd = std::min(y + averagingSize, height);
+		progress.StartRows(yEnd - y);
+		
+		Project(iterData, real, imaginary, y, yEnd);
+		
+		PrecalculateFTFactors(iterData);
+		
+		for(unsigned iteration=0;iteration<_iterations;++iteration)
+		{
+			PerformFourierTransform(iterData, real, imaginary, y, yEnd);
+		
+			numl_t sincScale = ActualSincScaleInLambda(artifacts, band.channels[y].frequencyHz);
+			numl_t clippingFrequency = 1.0/(sincScale * width / iterData.maxDist);
+			long fourierClippingIndex =
+				(long) ceilnl((numl_t) iterData.fourierWidth * 0.5 * clippingFrequency);
+			if(fourierClippingIndex*2 > (long) iterData.fourierWidth)
+				fourierClippingIndex = iterData.fourierWidth/2;
+			if(fourierClippingIndex < 0)
+				fourierClippingIndex = 0;
+			iterData.startXf = iterData.fourierWidth/2 - fourierClippingIndex,
+			iterData.endXf = iterData.fourierWidth/2 + fourierClippingIndex;
 			
-			const double n = width;
-			for(unsigned x=0;x<width;++x)
+			if(_operation == ExtrapolatedSincOperation)
 			{
-				real->SetValue(x, y, fftIn[x][0] / n);
-				imag->SetValue(x, y, fftIn[x][1] / n);
+				InvFourierTransform(iterData, real, imaginary, y);
+			}
+			else if(_operation == IterativeExtrapolatedSincOperation)
+			{
+				const size_t xFRemoval = FindStrongestComponent(iterData, false);
+				const double
+						fReal = iterData.fourierValuesReal[xFRemoval],
+						fImag = iterData.fourierValuesImag[xFRemoval],
+						xFValue = sqrt(fReal*fReal + fImag*fImag);
+				AOLogger::Debug << "Removing frequency at xF=" << xFRemoval << ", amp=" << xFValue << '\n';
+				AOLogger::Debug << "Amplitude = sigma x " << (xFValue / GetAverageAmplitude(iterData)) << '\n';
+				
+				if(xFRemoval < iterData.startXf || xFRemoval > iterData.endXf || _alwaysRemove)
+				{
+					if(!_alwaysRemove)
+						AOLogger::Debug << "Within bounds 0-" << iterData.startXf << '/' << iterData.endXf << "-.. removing from image.\n";
+					// Now, remove the fringe from each channel 
+					for(size_t yI = y; yI != yEnd; ++yI)
+					{
+						const double
+							channelFactor = iterData.channelMaxDist[yI] / iterData.maxDist,
+							fourierPos = (double) xFRemoval / iterData.fourierWidth - 0.5,
+							fourierFactor = fourierPos * 2.0 * M_PI * width * 0.5 / iterData.maxDist * channelFactor;
+						
+						RemoveFourierComponent(iterData, real, imaginary, yI, fourierFactor, fReal, fImag, true);
+					}
+				}
+				
+				// Subtract fringe from average value
+				const double
+					fourierPos = (double) xFRemoval / iterData.fourierWidth - 0.5,
+					fourierFactor = fourierPos * 2.0 * M_PI * width * 0.5 / iterData.maxDist;
+				RemoveFourierComponent(iterData, real, imaginary, y, fourierFactor, fReal, fImag, false);
 			}
 		}
 	}
-	fftw_free(fftIn);
-	fftw_free(fftOut);
+}
+
+void TimeConvolutionAction::parallelFor(const ArtifactSet &artifacts, size_t count, const boost::function<void(size_t, size_t)> &function)
+{
+	const size_t threadCount = std::min(std::max<size_t>(artifacts.ThreadCount(), 1), count);
+	if(threadCount <= 1)
+	{
+		function(0, count);
+	} else {
+		boost::thread_group threads;
+		for(size_t i=0;i!=threadCount;++i)
+			threads.create_thread(boost::bind(function, count*i/threadCount, count*(i+1)/threadCount));
+		threads.join_all();
+	}
 }
 
 }
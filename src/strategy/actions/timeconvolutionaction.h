@@ -16,7 +16,12 @@
 #include "../../util/ffttools.h"
 #include "../../util/progresslistener.h"
 
+#include <vector>
+
 #include <boost/concept_check.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace rfiStrategy {
 
@@ -78,8 +83,10 @@ namespace rfiStrategy {
 					case ExtrapolatedSincOperation:
 					case IterativeExtrapolatedSincOperation:
 					{
-						if(_autoAngle)
-							_directionRad = FindStrongestSourceAngle(artifacts, artifacts.ContaminatedData());
+						// The angle that is found is only used for this data, so that the action
+						// itself is not changed while it is performed
+						const num_t directionRad = _autoAngle ?
+							FindStrongestSourceAngle(artifacts, artifacts.ContaminatedData()) : _directionRad;
 						TimeFrequencyData data = artifacts.ContaminatedData();
 						TimeFrequencyData *realData = data.CreateTFData(TimeFrequencyData::RealPart);
 						TimeFrequencyData *imagData = data.CreateTFData(TimeFrequencyData::ImaginaryPart);
@@ -87,7 +94,7 @@ namespace rfiStrategy {
 						Image2DPtr imaginary = Image2D::CreateCopy(imagData->GetSingleImage());
 						delete realData;
 						delete imagData;
-						PerformExtrapolatedSincOperation(artifacts, real, imaginary, listener);
+						PerformExtrapolatedSincOperation(artifacts, real, imaginary, directionRad, listener);
 						newRevisedData = TimeFrequencyData(data.Polarisation(), real, imaginary);
 					}
 					break;
@@ -149,6 +156,20 @@ namespace rfiStrategy {
 			bool UseHammingWindow() const { return _useHammingWindow; }
 			void SetUseHammingWindow(bool useHammingWindow) { _useHammingWindow = useHammingWindow; }
 private:
+			enum {
+				/**
+				 * The transforms step the complex exponentials from one frequency to the next
+				 * by a rotation. In double precision, this drifts about an epsilon per step,
+				 * which is bounded by recomputing the exponentials once per this many steps.
+				 */
+				PhasorReseedInterval = 1024
+			};
+			
+			/**
+			 * State of the extrapolated operations for one block of averaged channels. Each thread
+			 * has its own instance, of which the buffers are allocated once and are reused for
+			 * all blocks and iterations.
+			 */
 			class IterationData
 			{
 			public:
@@ -162,29 +183,81 @@ private:
 					vZeroPos,
 					startXf,
 					endXf;
-				numl_t
+				double
 					maxDist;
-				numl_t
-					*rowRValues,
-					*rowIValues,
-					*rowUPositions,
-					*rowVPositions,
-					*fourierValuesReal,
-					*fourierValuesImag,
+				/** Direction onto which the uv positions are projected. */
+				num_t
+					directionRad;
+				/** Maximum distance of each channel; shared between the threads, which write different blocks. */
+				double
 					*channelMaxDist;
-				numl_t
-					**fSinTable,
-					**fCosTable;
+				std::vector<double>
+					rowRValues,
+					rowIValues,
+					rowUPositions,
+					rowVPositions,
+					fourierValuesReal,
+					fourierValuesImag;
+				/** The ftCount samples that take part in the forward transform, and their phase step per frequency. */
+				size_t
+					ftCount;
+				std::vector<size_t>
+					ftIndices;
+				std::vector<double>
+					ftPositions,
+					ftValuesReal,
+					ftValuesImag,
+					ftStepReal,
+					ftStepImag;
+				/** Scratch buffers of the transforms. */
+				std::vector<double>
+					phasorReal,
+					phasorImag,
+					stepReal,
+					stepImag,
+					sumReal,
+					sumImag;
+				/** Scratch buffers for UVProjection. */
+				std::vector<numl_t>
+					projectedValues,
+					projectedUPositions,
+					projectedVPositions;
 					
-				IterationData() :
-					artifacts(0), width(0), fourierWidth(0), rangeStart(0), rangeEnd(0),
+				explicit IterationData(size_t _width) :
+					artifacts(0), width(_width), fourierWidth(_width * 2), rangeStart(0), rangeEnd(0),
 					vZeroPos(0), startXf(0), endXf(0),
-					maxDist(0.0),
-					rowRValues(0), rowIValues(0), rowUPositions(0), rowVPositions(0),
-					fourierValuesReal(0), fourierValuesImag(0), channelMaxDist(0),
-					fSinTable(0), fCosTable(0)
+					maxDist(0.0), directionRad(0.0), channelMaxDist(0),
+					rowRValues(_width), rowIValues(_width), rowUPositions(_width), rowVPositions(_width),
+					fourierValuesReal(_width * 2), fourierValuesImag(_width * 2),
+					ftCount(0), ftIndices(_width), ftPositions(_width), ftValuesReal(_width), ftValuesImag(_width), ftStepReal(_width), ftStepImag(_width),
+					phasorReal(_width), phasorImag(_width), stepReal(_width), stepImag(_width),
+					sumReal(_width), sumImag(_width),
+					projectedValues(_width), projectedUPositions(_width), projectedVPositions(_width)
+				{
+				}
+			};
+			
+			/**
+			 * Reports the progress of rows that are processed by several threads.
+			 */
+			class RowProgress
+			{
+			public:
+				RowProgress(const Action &action, class ProgressListener &listener, size_t rowCount) :
+					_action(action), _listener(listener), _rowCount(rowCount), _rowsDone(0)
+				{
+				}
+				void StartRows(size_t rows)
 				{
+					boost::mutex::scoped_lock lock(_mutex);
+					_listener.OnProgress(_action, _rowsDone, _rowCount);
+					_rowsDone += rows;
 				}
+			private:
+				const Action &_action;
+				class ProgressListener &_listener;
+				size_t _rowCount, _rowsDone;
+				boost::mutex _mutex;
 			};
 
 			Image2DPtr PerformSingleSincOperation(ArtifactSet &artifacts) const
@@ -268,299 +341,16 @@ private:
 				return newImage;
 			}
 			
-			Image2DPtr PerformProjectedSincOperation(ArtifactSet &artifacts, class ProgressListener &listener) const
-			{
-				TimeFrequencyData data = artifacts.ContaminatedData();
-				Image2DCPtr image = data.GetSingleImage();
-				Image2DPtr newImage = Image2D::CreateUnsetImagePtr(image->Width(), image->Height());
-				TimeFrequencyMetaDataCPtr metaData = artifacts.MetaData();
+			Image2DPtr PerformProjectedSincOperation(ArtifactSet &artifacts, class ProgressListener &listener) const;
+			void projectedSincRows(ArtifactSet &artifacts, Image2DCPtr image, Image2DPtr newImage, bool isImaginary, RowProgress &progress, size_t yStart, size_t yEnd) const;
 
-				bool isImaginary = data.IsImaginary();
-				const size_t width = image->Width();
-				const BandInfo band = artifacts.MetaData()->Band();
-
-				for(size_t y=0;y<image->Height();++y)
-				{
-					const num_t sincScale = ActualSincScaleInLambda(artifacts, band.channels[y].frequencyHz);
-					listener.OnProgress(*this, y, image->Height());
-					
-					numl_t
-						*rowValues = new numl_t[width],
-						*rowUPositions = new numl_t[width],
-						*rowVPositions = new numl_t[width];
-
-					UVProjection::ProjectPositions(metaData, width, y, rowUPositions, rowVPositions, _directionRad);
-					
-					UVProjection::Project(image, y, rowValues, isImaginary);
-
-					// Perform the convolution
-					for(size_t t=0;t<width;++t)
-					{
-						const numl_t pos = rowUPositions[t];
-
-						numl_t valueSum = 0.0;
-						numl_t weightSum = 0.0;
-						
-						for(size_t x=0;x<width;++x)
-						{
-							// if this is exactly a point on the u axis, this point is ignored
-							// (it would have infinite weight)
-							const UVW &uvw = metaData->UVW()[x];
-							if(uvw.v != 0.0) 
-							{
-								//const numl_t weight = fabsnl(uvw.u / uvw.v);
-								const numl_t dist = (rowUPositions[x] - pos) / sincScale;
-								if(dist!=0.0)
-								{
-									const numl_t sincValue = sinnl(dist) / dist;
-									valueSum += sincValue * rowValues[x];// * weight;
-									weightSum += sincValue;
-								}
-								else
-								{
-									valueSum += rowValues[x];// * weight;
-									weightSum += 1.0;
-								}
-							}
-						}
-						newImage->SetValue(t, y, (num_t) (valueSum / weightSum));
-					}
-					
-					delete[] rowValues;
-					delete[] rowUPositions;
-					delete[] rowVPositions;
-				}
-				listener.OnProgress(*this, image->Height(), image->Height());
-				
-				return newImage;
-			}
-
-			void Project(class IterationData &iterData, Image2DCPtr real, Image2DCPtr imaginary, size_t yStart, size_t yEnd) const
-			{
-				const size_t width = iterData.width;
-				iterData.rowRValues = new numl_t[width];
-				iterData.rowIValues = new numl_t[width];
-				iterData.rowUPositions = new numl_t[width];
-				iterData.rowVPositions = new numl_t[width];
-
-				for(size_t x=0;x<width;++x)
-				{
-					iterData.rowRValues[x] = 0.0;
-					iterData.rowIValues[x] = 0.0;
-					iterData.rowUPositions[x] = 0.0;
-					iterData.rowVPositions[x] = 0.0;
-				}
-
-				iterData.maxDist = 0.0;
-
-				std::vector<numl_t>
-					rowRValues(width), rowIValues(width),
-					rowUPositions(width), rowVPositions(width);
-				numl_t
-					yL = (yEnd - yStart);
-
-				// We average all values returned by Project() over yStart to yEnd
-				for(size_t y=yStart;y<yEnd;++y)
-				{
-					UVProjection::ProjectPositions(iterData.artifacts->MetaData(), width, y, &rowUPositions[0], &rowVPositions[0], _directionRad);
-					
-					UVProjection::Project(real, y, &rowRValues[0], false);
-					UVProjection::Project(imaginary, y, &rowIValues[0], true);
-
-					for(size_t x=0;x<width;++x)
-					{
-						iterData.rowRValues[x] += rowRValues[x] / yL;
-						iterData.rowIValues[x] += rowIValues[x] / yL;
-						iterData.rowUPositions[x] += rowUPositions[x] / yL;
-						iterData.rowVPositions[x] += rowVPositions[x] / yL;
-					}
-
-					// Find the point closest to v=0
-					numl_t vDist = fabsnl(rowVPositions[0]);
-					size_t vZeroPos = 0;
-					for(unsigned i=1;i<width;++i)
-					{
-						if(fabsnl(rowVPositions[i]) < vDist)
-						{
-							vDist = fabsnl(rowVPositions[i]);
-							vZeroPos = i;
-						}
-					}
-					iterData.vZeroPos = vZeroPos;
-					iterData.channelMaxDist[y] = fabsnl(rowUPositions[vZeroPos]);
-					iterData.maxDist += iterData.channelMaxDist[y] / yL;
-
-					//AOLogger::Debug << "v is min at t=" << vZeroPos << " (v=+-" << vDist << ", maxDist=" << iterData.channelMaxDist[y] << ")\n";
-				}
-			}
-
-			void FreeProjectedValues(class IterationData &iterData) const
-			{
-				delete[] iterData.rowRValues;
-				delete[] iterData.rowIValues;
-				delete[] iterData.rowUPositions;
-				delete[] iterData.rowVPositions;
-			}
-
-			void PrecalculateFTFactors(class IterationData &iterData) const
-			{
-				const size_t
-					width = iterData.width,
-					fourierWidth = iterData.fourierWidth,
-					rangeStart = iterData.rangeStart,
-					rangeEnd = iterData.rangeEnd;
-
-				iterData.fSinTable = new numl_t*[fourierWidth],
-				iterData.fCosTable = new numl_t*[fourierWidth];
-				for(size_t xF=0;xF<fourierWidth;++xF)
-				{
-					iterData.fSinTable[xF] = new numl_t[rangeEnd - rangeStart];
-					iterData.fCosTable[xF] = new numl_t[rangeEnd - rangeStart];
-					// F(xF) = \\int f(u) * e^(-i 2 \\pi * u_n * xF_n)
-					// xF \\in [0 : fourierWidth] -> xF_n = 2 xF / fourierWidth - 1 \\in [-1 : 1];
-					// u \\in [-maxDist : maxDist] -> u_n = u * width / maxDist \\in [ -width : width ]
-					// final frequenty domain covers [-maxDist : maxDist]
-					const numl_t
-						fourierPos = (numl_t) xF / fourierWidth - 0.5,
-						fourierFactor = -fourierPos * 2.0 * M_PInl * width * 0.5 / iterData.maxDist;
-					for(size_t tIndex=rangeStart;tIndex<rangeEnd;++tIndex)
-					{
-						size_t t = (tIndex + width - iterData.vZeroPos) % width;
-						const numl_t posU = iterData.rowUPositions[t];
-						iterData.fCosTable[xF][tIndex-rangeStart] = cosnl(fourierFactor * posU);
-						iterData.fSinTable[xF][tIndex-rangeStart] = sinnl(fourierFactor * posU);
-					}
-				}
-			}
-
-			void FreeFTFactors(class IterationData &iterData) const
-			{
-				for(size_t xF=0;xF<iterData.fourierWidth;++xF)
-				{
-					delete[] iterData.fSinTable[xF];
-					delete[] iterData.fCosTable[xF];
-				}
-				delete[] iterData.fSinTable;
-				delete[] iterData.fCosTable;
-			}
-
-			void PerformFourierTransform(class IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t yStart, size_t yEnd) const
-			{
-				const size_t
-					rangeStart = iterData.rangeStart,
-					rangeEnd = iterData.rangeEnd,
-					width = iterData.width,
-					vZeroPos = iterData.vZeroPos;
-
-				// Perform a 1d Fourier transform, ignoring eta part of the data
-				for(size_t xF=0;xF<iterData.fourierWidth;++xF)
-				{
-					numl_t
-						realVal = 0.0,
-						imagVal = 0.0,
-						weightSum = 0.0;
-					const numl_t
-						*fCosTable = iterData.fCosTable[xF],
-						*fSinTable = iterData.fSinTable[xF];
-					// compute F(xF) = \\int f(x) * exp( -2 * \\pi * i * x * xF )
-					for(size_t tIndex=rangeStart;tIndex<rangeEnd;++tIndex)
-					{
-						size_t t = (tIndex + width - vZeroPos) % width;
-						if(iterData.rowUPositions[t] != 0.0)
-						{
-							const numl_t weight = 1.0;//fabsnl(rowVPositions[t]/posU);
-							const numl_t weightSqrt = 1.0;//sqrtnl(weight);
-							realVal += (iterData.rowRValues[t] * fCosTable[tIndex-rangeStart] -
-													iterData.rowIValues[t] * fSinTable[tIndex-rangeStart]) * weightSqrt;
-							imagVal += (iterData.rowIValues[t] * fCosTable[tIndex-rangeStart] +
-													iterData.rowRValues[t] * fSinTable[tIndex-rangeStart]) * weightSqrt;
-							weightSum += weight;
-						}
-					}
-					iterData.fourierValuesReal[xF] = realVal / weightSum;
-					iterData.fourierValuesImag[xF] = imagVal / weightSum;
-					if(_operation == ProjectedFTOperation)
-					{
-						for(size_t y=yStart;y!=yEnd;++y)
-						{
-							real->SetValue(xF/2, y, (num_t) realVal / weightSum);
-							imaginary->SetValue(xF/2, y, (num_t) imagVal / weightSum);
-						}
-					}
-				}
-			}
-
-			void InvFourierTransform(class IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t y) const
-			{
-				const size_t
-					startXf = iterData.startXf,
-					endXf = iterData.endXf,
-					width = iterData.width,
-					fourierWidth = iterData.fourierWidth;
-
-				AOLogger::Debug << "Inv FT, using 0-" << startXf << " and " << endXf << "-" << fourierWidth << '\n';
-				
-				for(size_t t=0;t<width;++t)
-				{
-					const numl_t
-						posU = iterData.rowUPositions[t],
-						posV = iterData.rowVPositions[t],
-						posFactor = posU * 2.0 * M_PInl;
-					numl_t
-						realVal = 0.0,
-						imagVal = 0.0;
-					bool residual = false;
-
-					if(posV != 0.0)
-					{
-						const numl_t weightSum = 1.0; //(endXf - startXf); // * fabsnl(posV / posU);
-						// compute f(x) = \\int F(xF) * exp( 2 * \\pi * i * x * xF )
-						size_t xF, loopEnd;
-						if(residual)
-						{
-							loopEnd = startXf;
-							xF = 0;
-						}
-						else
-						{
-							loopEnd = endXf;
-							xF = startXf;
-						}
-						while(xF < loopEnd)
-						{
-							const numl_t
-								fourierPosL = (numl_t) xF / fourierWidth - 0.5,
-								fourierRealL = iterData.fourierValuesReal[xF],
-								fourierImagL = iterData.fourierValuesImag[xF];
-
-							const numl_t
-								cosValL = cosnl(fourierPosL * posFactor),
-								sinValL = sinnl(fourierPosL * posFactor);
-
-							realVal += fourierRealL * cosValL - fourierImagL * sinValL;
-							imagVal += fourierImagL * cosValL + fourierRealL * sinValL;
-
-							if(residual)
-							{
-								const numl_t
-									fourierPosR = (numl_t) (endXf + xF) / fourierWidth - 0.5,
-									fourierRealR = iterData.fourierValuesReal[endXf + xF],
-									fourierImagR = iterData.fourierValuesImag[endXf + xF];
+			void Project(class IterationData &iterData, Image2DCPtr real, Image2DCPtr imaginary, size_t yStart, size_t yEnd) const;
+			
+			void PrecalculateFTFactors(class IterationData &iterData) const;
 
-								const numl_t
-									cosValR = cosnl(fourierPosR * posFactor),
-									sinValR = sinnl(fourierPosR * posFactor);
+			void PerformFourierTransform(class IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t yStart, size_t yEnd) const;
 
-								realVal += fourierRealR * cosValR - fourierImagR * sinValR;
-								imagVal += fourierImagR * cosValR + fourierRealR * sinValR;
-							}
-							++xF;
-						}
-						real->SetValue(t, y, -realVal/weightSum);
-						imaginary->SetValue(t, y, -imagVal/weightSum);
-					}
-				}
-			}
+			void InvFourierTransform(class IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t y) const;
 
 			size_t FindStrongestComponent(const class IterationData &iterData, bool withinBounds) const
 			{
@@ -617,124 +407,15 @@ private:
 				return xFRemoval;
 			}
 
-			void RemoveFourierComponent(class IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t y, numl_t fourierFactor, numl_t fReal, numl_t fImag, bool applyOnImages) const
-			{
-				const size_t
-					width = iterData.width;
-
-				for(size_t t=0;t<width;++t)
-				{
-					const numl_t
-						posU = iterData.rowUPositions[t],
-						weightSum = 1.0;
-						
-					const numl_t
-						cosValL = cosnl(-fourierFactor * posU),
-						sinValL = sinnl(-fourierFactor * posU);
-
-					numl_t realVal = (fReal * cosValL + fImag * sinValL) * 0.75 / weightSum;
-					numl_t imagVal = (fReal * sinValL + fImag * cosValL) * 0.75 / weightSum;
-					
-					if(applyOnImages)
-					{
-						real->SetValue(t, y, real->Value(t, y) - realVal);
-						imaginary->SetValue(t, y, imaginary->Value(t, y) - imagVal);
-					} else {
-						iterData.rowRValues[t] -= realVal;
-						iterData.rowIValues[t] -= imagVal;
-					}
-				}
-			}
+			void RemoveFourierComponent(class IterationData &iterData, Image2DPtr real, Image2DPtr imaginary, size_t y, double fourierFactor, double fReal, double fImag, bool applyOnImages) const;
 			
-			void PerformExtrapolatedSincOperation(ArtifactSet &artifacts, Image2DPtr real, Image2DPtr imaginary, class ProgressListener &listener) const
-			{
-				TimeFrequencyMetaDataCPtr metaData = artifacts.MetaData();
-
-				const size_t width = real->Width();
-				const BandInfo band = artifacts.MetaData()->Band();
-					
-				class IterationData iterData;
-
-				iterData.artifacts = &artifacts;
-
-				iterData.width = width;
-				iterData.fourierWidth = width * 2;
-				iterData.fourierValuesReal = new numl_t[iterData.fourierWidth];
-				iterData.fourierValuesImag = new numl_t[iterData.fourierWidth];
-				iterData.channelMaxDist = new numl_t[real->Height()];
-
-				iterData.rangeStart = (size_t) roundn(_etaParameter * (num_t) width / 2.0),
-				iterData.rangeEnd = width - iterData.rangeStart;
-
-				for(size_t y=0;y<real->Height();y+=_channelAveragingSize)
-				{
-					listener.OnProgress(*this, y, real->Height());
-
-					Project(iterData, real, imaginary, y, y+_channelAveragingSize);
-					
-					PrecalculateFTFactors(iterData);
-
-					for(unsigned iteration=0;iteration<_iterations;++iteration)
-					{
-						PerformFourierTransform(iterData, real, imaginary, y, y+_channelAveragingSize);
-					
-						numl_t sincScale = ActualSincScaleInLambda(artifacts, band.channels[y].frequencyHz);
-						numl_t clippingFrequency = 1.0/(sincScale * width / iterData.maxDist);
-						long fourierClippingIndex =
-							(long) ceilnl((numl_t) iterData.fourierWidth * 0.5 * clippingFrequency);
-						if(fourierClippingIndex*2 > (long) iterData.fourierWidth)
-							fourierClippingIndex = iterData.fourierWidth/2;
-						if(fourierClippingIndex < 0)
-							fourierClippingIndex = 0;
-						iterData.startXf = iterData.fourierWidth/2 - fourierClippingIndex,
-						iterData.endXf = iterData.fourierWidth/2 + fourierClippingIndex;
-
-						if(_operation == ExtrapolatedSincOperation)
-						{
-							InvFourierTransform(iterData, real, imaginary, y);
-						}
-						else if(_operation == IterativeExtrapolatedSincOperation)
-						{
-							const size_t xFRemoval = FindStrongestComponent(iterData, false);
-							const numl_t
-									fReal = iterData.fourierValuesReal[xFRemoval],
-									fImag = iterData.fourierValuesImag[xFRemoval],
-									xFValue = sqrtnl(fReal*fReal + fImag*fImag);
-							AOLogger::Debug << "Removing frequency at xF=" << xFRemoval << ", amp=" << xFValue << '\n';
-							AOLogger::Debug << "Amplitude = sigma x " << (xFValue / GetAverageAmplitude(iterData)) << '\n';
-
-							if(xFRemoval < iterData.startXf || xFRemoval > iterData.endXf || _alwaysRemove)
-							{
-								if(!_alwaysRemove)
-									AOLogger::Debug << "Within bounds 0-" << iterData.startXf << '/' << iterData.endXf << "-.. removing from image.\n";
-								// Now, remove the fringe from each channel 
-								for(size_t yI = y; yI != y+_channelAveragingSize; ++yI)
-								{
-									const numl_t
-										channelFactor = iterData.channelMaxDist[yI] / iterData.maxDist,
-										fourierPos = (numl_t) xFRemoval / iterData.fourierWidth - 0.5,
-										fourierFactor = fourierPos * 2.0 * M_PInl * width * 0.5 / iterData.maxDist * channelFactor;
-		
-									RemoveFourierComponent(iterData, real, imaginary, yI, fourierFactor, fReal, fImag, true);
-								}
-							}
-
-							// Subtract fringe from average value
-							const numl_t
-								fourierPos = (numl_t) xFRemoval / iterData.fourierWidth - 0.5,
-								fourierFactor = fourierPos * 2.0 * M_PInl * width * 0.5 / iterData.maxDist;
-							RemoveFourierComponent(iterData, real, imaginary, y, fourierFactor, fReal, fImag, false);
-						}
-					}
-					FreeFTFactors(iterData);
-					FreeProjectedValues(iterData);
-				}
-				listener.OnProgress(*this, real->Height(), real->Height());
-
-				delete[] iterData.fourierValuesReal;
-				delete[] iterData.fourierValuesImag;
-				delete[] iterData.channelMaxDist;
-			}
+			void PerformExtrapolatedSincOperation(ArtifactSet &artifacts, Image2DPtr real, Image2DPtr imaginary, num_t directionRad, class ProgressListener &listener) const;
+			void extrapolateBlocks(ArtifactSet &artifacts, Image2DPtr real, Image2DPtr imaginary, num_t directionRad, double *channelMaxDist, RowProgress &progress, size_t blockStart, size_t blockEnd) const;
+			
+			/**
+			 * Divides the range [0, count) over the number of threads given by the artifact set.
+			 */
+			static void parallelFor(const ArtifactSet &artifacts, size_t count, const boost::function<void(size_t, size_t)> &function);
 
 			numl_t avgUVDistance(ArtifactSet &artifacts, const double frequencyHz) const
 			{
@@ -784,7 +465,7 @@ private:
 				return sum / (numl_t) (startXf * 2);
 			}
 
-			numl_t FindStrongestSourceAngle(ArtifactSet &artifacts, const TimeFrequencyData &data)
+			numl_t FindStrongestSourceAngle(ArtifactSet &artifacts, const TimeFrequencyData &data) const
 			{
 				UVImager imager(1024*3, 1024*3);
 				imager.Image(data, artifacts.MetaData());
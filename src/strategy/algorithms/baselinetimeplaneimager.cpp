@@ -7,6 +7,8 @@
 #include <fftw3.h>
 #include <boost/iterator/iterator_concepts.hpp>
 
+#include "../../util/fftplancache.h"
+
 template<typename NumType>
 void BaselineTimePlaneImager<NumType>::Image(NumType uTimesLambda, NumType vTimesLambda, NumType wTimesLambda, NumType lowestFrequency, NumType frequencyStep, size_t channelCount, const std::complex<NumType> *data, Image2D &output)
 {
@@ -35,7 +37,9 @@ void BaselineTimePlaneImager<NumType>::Image(NumType uTimesLambda, NumType vTime
 	size_t fftSize = std::max((size_t) (imgSize*sampleDist/(scale * (2.0*uvDist))), 2*sampleDist);
 	fftw_complex *fftInp = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (fftSize/2+1));
 	double *fftOut = (double*) fftw_malloc(sizeof(double) * fftSize);
+	boost::mutex::scoped_lock planLock(FFTPlanCache::Instance().PlannerMutex());
 	fftw_plan plan = fftw_plan_dft_c2r_1d(fftSize, fftInp, fftOut, FFTW_ESTIMATE);
+	planLock.unlock();
 	size_t startChannel = (lowestFrequency/frequencyStep);
 	for(size_t i=0;i!=(fftSize/2+1);++i) {
 		fftInp[i][0] = 0.0;
@@ -100,7 +104,9 @@ void BaselineTimePlaneImager<NumType>::Image(NumType uTimesLambda, NumType vTime
 		}
 	}
 	
+	planLock.lock();
 	fftw_destroy_plan(plan);
+	planLock.unlock();
 	fftw_free(fftOut);
 }
 
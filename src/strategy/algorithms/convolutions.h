@@ -152,8 +152,19 @@ class Convolutions
 		{
 			if(dataSize == 0) return;
 			const unsigned kernelSize = dataSize*2 - 1;
-			const unsigned centreElement = kernelSize/2;
 			num_t *kernel = new num_t[kernelSize];
+			SincKernel(kernel, kernelSize, frequency);
+			OneDimensionalConvolutionBorderZero(data, dataSize, kernel, kernelSize);
+			delete[] kernel;
+		}
+		
+		/**
+		* Fills @c kernel with the normalized sinc kernel that is used by
+		* OneDimensionalSincConvolution(), with its peak on element (kernelSize/2).
+		*/
+		static void SincKernel(num_t *kernel, unsigned kernelSize, num_t frequency)
+		{
+			const unsigned centreElement = kernelSize/2;
 			const numl_t factor = 2.0 * frequency * M_PInl;
 			numl_t sum = 0.0;
 			for(unsigned i=0;i<kernelSize;++i)
@@ -169,8 +180,6 @@ class Convolutions
 			{
 				kernel[i] /= sum;
 			}
-			OneDimensionalConvolutionBorderZero(data, dataSize, kernel, kernelSize);
-			delete[] kernel;
 		}
 
 		/**
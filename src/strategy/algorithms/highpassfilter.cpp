@@ -1,6 +1,9 @@
 #include <xmmintrin.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <vector>
 
 #include "highpassfilter.h"
 
@@ -45,7 +48,17 @@ void HighPassFilter::applyLowPass(const Image2DPtr &image)
 
 void HighPassFilter::applyLowPassSSE(const Image2DPtr &image)
 {
-	Image2DPtr temp = Image2D::CreateZeroImagePtr(image->Width(), image->Height());
+	Image2DPtr temp = Image2D::CreateUnsetImagePtr(image->Width(), image->Height());
+	for(unsigned y=0;y<image->Height();++y)
+		horizontalLowPassRowSSE(*image, *temp, y);
+	for(unsigned y=0;y<image->Height();++y)
+		verticalLowPassRowSSE(*temp, *image, y, 0, image->Width());
+}
+
+void HighPassFilter::horizontalLowPassRowSSE(const Image2D &input, Image2D &output, unsigned y)
+{
+	float *outputRow = output.ValuePtr(0, y);
+	std::fill(outputRow, outputRow + input.Width(), 0.0);
 	unsigned hKernelMid = _hWindowSize/2;
 	for(unsigned i=0; i<_hWindowSize; ++i) {
 		
@@ -55,64 +68,63 @@ void HighPassFilter::applyLowPassSSE(const Image2DPtr &image)
 			/* xStart is the first column to start writing to. Note that it might be larger
 			 * than the width. */
 			xStart = (i >= hKernelMid) ? 0 : (hKernelMid-i),
-			xEnd = (i <= hKernelMid) ? image->Width() : (image->Width()+hKernelMid > i ? (image->Width()-i+hKernelMid) : 0);
+			xEnd = (i <= hKernelMid) ? input.Width() : (input.Width()+hKernelMid > i ? (input.Width()-i+hKernelMid) : 0);
 		
-		for(unsigned y=0;y<image->Height();++y) {
-			
-			float *tempPtr = temp->ValuePtr(xStart, y);
-			const float *imagePtr = image->ValuePtr(xStart+i-hKernelMid, y);
+		float *tempPtr = outputRow + xStart;
+		const float *imagePtr = input.ValuePtr(xStart+i-hKernelMid, y);
+		
+		unsigned x = xStart;
+		for(;x+4<xEnd;x+=4) {
+			const __m128
+				imageVal = _mm_loadu_ps(imagePtr),
+				tempVal = _mm_loadu_ps(tempPtr);
+
+			// *tempPtr += k * (*imagePtr);
+			_mm_storeu_ps(tempPtr, _mm_add_ps(tempVal, _mm_mul_ps(imageVal, k4)));
 			
-			unsigned x = xStart;
-			for(;x+4<xEnd;x+=4) {
-				const __m128
-					imageVal = _mm_loadu_ps(imagePtr),
-					tempVal = _mm_loadu_ps(tempPtr);
-
-				// *tempPtr += k * (*imagePtr);
-				_mm_storeu_ps(tempPtr, _mm_add_ps(tempVal, _mm_mul_ps(imageVal, k4)));
-				
-				tempPtr += 4;
-				imagePtr += 4;
-			}
-			for(;x<xEnd;++x) {
-				*tempPtr += k * (*imagePtr);
-				++tempPtr;
-				++imagePtr;
-			}
+			tempPtr += 4;
+			imagePtr += 4;
+		}
+		for(;x<xEnd;++x) {
+			*tempPtr += k * (*imagePtr);
+			++tempPtr;
+			++imagePtr;
 		}
 	}
-	
-	image->SetAll(0.0);
+}
+
+void HighPassFilter::verticalLowPassRowSSE(const Image2D &input, Image2D &output, unsigned y, unsigned xBegin, unsigned xEnd)
+{
+	float *outputRow = output.ValuePtr(0, y);
+	std::fill(outputRow + xBegin, outputRow + xEnd, 0.0);
 	unsigned vKernelMid = _vWindowSize/2;
 	for(unsigned i=0; i<_vWindowSize; ++i) {
+		// Skip the kernel values that fall outside the image
+		if(y+i < vKernelMid || y+i-vKernelMid >= input.Height())
+			continue;
 		const num_t k = _vKernel[i];
 		const __m128 k4 = _mm_set_ps(k, k, k, k);
-		const unsigned
-			yStart = (i >= vKernelMid) ? 0 : (vKernelMid-i),
-			yEnd = (i <= vKernelMid) ? image->Height() : ((image->Height()+vKernelMid>i) ? (image->Height()-i+vKernelMid) : 0);
-		for(unsigned y=yStart;y<yEnd;++y) {
+		
+		const float *tempPtr = input.ValuePtr(xBegin, y+i-vKernelMid);
+		float *imagePtr = outputRow + xBegin;
+		
+		unsigned x=xBegin;
+		for(;x+4<input.Width() && x<xEnd;x += 4) {
 			
-			const float *tempPtr = temp->ValuePtr(0, y+i-vKernelMid);
-			float *imagePtr = image->ValuePtr(0, y);
+			const __m128
+				imageVal = _mm_load_ps(imagePtr),
+				tempVal = _mm_load_ps(tempPtr);
 			
-			unsigned x=0;
-			for(;x+4<image->Width();x += 4) {
-				
-				const __m128
-					imageVal = _mm_load_ps(imagePtr),
-					tempVal = _mm_load_ps(tempPtr);
-				
-				// *imagePtr += k * (*tempPtr);
-				_mm_store_ps(imagePtr, _mm_add_ps(imageVal, _mm_mul_ps(tempVal, k4)));
-				
-				tempPtr += 4;
-				imagePtr += 4;
-			}
-			for(;x<image->Width();++x) {
-				*imagePtr += k * (*tempPtr);
-				++tempPtr;
-				++imagePtr;
-			}
+			// *imagePtr += k * (*tempPtr);
+			_mm_store_ps(imagePtr, _mm_add_ps(imageVal, _mm_mul_ps(tempVal, k4)));
+			
+			tempPtr += 4;
+			imagePtr += 4;
+		}
+		for(;x<xEnd;++x) {
+			*imagePtr += k * (*tempPtr);
+			++tempPtr;
+			++imagePtr;
 		}
 	}
 }
@@ -138,6 +150,118 @@ Image2DPtr HighPassFilter::ApplyLowPass(const Image2DCPtr &image, const Mask2DCP
 	return outputImage;
 }
 
+Image2DPtr HighPassFilter::ApplyHighPass(const Image2DCPtr &image, const Mask2DCPtr &mask, State &state)
+{
+	Image2DPtr outputImage = ApplyLowPass(image, mask, state);
+	outputImage->SubtractAsRHS(image);
+	return outputImage;
+}
+
+Image2DPtr HighPassFilter::ApplyLowPass(const Image2DCPtr &image, const Mask2DCPtr &mask, State &state)
+{
+	initializeKernel();
+	const unsigned width = image->Width(), height = image->Height();
+	Image2DPtr
+		values = Image2D::CreateUnsetImagePtr(width, height),
+		weights = Image2D::CreateUnsetImagePtr(width, height);
+	setFlaggedValuesToZeroAndMakeWeightsSSE(image, values, mask, weights);
+	
+	const bool isUpdate = state._values != 0 && state._values->Width() == width && state._values->Height() == height;
+	if(!isUpdate)
+	{
+		state._hValues = Image2D::CreateUnsetImagePtr(width, height);
+		state._hWeights = Image2D::CreateUnsetImagePtr(width, height);
+		state._vValues = Image2D::CreateUnsetImagePtr(width, height);
+		state._vWeights = Image2D::CreateUnsetImagePtr(width, height);
+	}
+	
+	// Convolve the rows with changed input horizontally, and record per row which
+	// columns of the horizontal convolution have changed.
+	const unsigned hKernelMid = _hWindowSize/2;
+	std::vector<unsigned> changeStart(height, 0), changeEnd(height, 0);
+	for(unsigned y=0;y<height;++y)
+	{
+		unsigned xStart = 0, xEnd = width;
+		if(isUpdate)
+		{
+			// An unflagged zero and a flagged sample have the same value, hence the weights are compared too
+			unsigned weightsStart, weightsEnd;
+			findChangedColumns(*state._values, *values, y, xStart, xEnd);
+			findChangedColumns(*state._weights, *weights, y, weightsStart, weightsEnd);
+			if(weightsStart < weightsEnd)
+			{
+				if(xStart < xEnd)
+				{
+					xStart = std::min(xStart, weightsStart);
+					xEnd = std::max(xEnd, weightsEnd);
+				} else {
+					xStart = weightsStart;
+					xEnd = weightsEnd;
+				}
+			}
+		}
+		if(xStart < xEnd)
+		{
+			horizontalLowPassRowSSE(*values, *state._hValues, y);
+			horizontalLowPassRowSSE(*weights, *state._hWeights, y);
+			changeStart[y] = xStart > hKernelMid ? xStart - hKernelMid : 0;
+			changeEnd[y] = std::min(xEnd + hKernelMid, width);
+		}
+	}
+	state._values = values;
+	state._weights = weights;
+	
+	// Convolve the columns vertically that are within reach of a change. The range starts
+	// at a multiple of four and is extended accordingly, so that each sample is
+	// calculated by the same instructions as in a full convolution.
+	const unsigned vKernelMid = _vWindowSize/2;
+	for(unsigned y=0;y<height;++y)
+	{
+		unsigned
+			xStart = width, xEnd = 0,
+			yStart = y > vKernelMid ? y - vKernelMid : 0,
+			yEnd = std::min(y + vKernelMid + 1, height);
+		for(unsigned yi=yStart;yi<yEnd;++yi)
+		{
+			if(changeStart[yi] < changeEnd[yi])
+			{
+				xStart = std::min(xStart, changeStart[yi]);
+				xEnd = std::max(xEnd, changeEnd[yi]);
+			}
+		}
+		if(xStart < xEnd)
+		{
+			xStart -= xStart % 4;
+			xEnd = std::min((xEnd + 3) / 4 * 4, width);
+			verticalLowPassRowSSE(*state._hValues, *state._vValues, y, xStart, xEnd);
+			verticalLowPassRowSSE(*state._hWeights, *state._vWeights, y, xStart, xEnd);
+		}
+	}
+	
+	Image2DPtr outputImage = Image2D::CreateCopy(state._vValues);
+	elementWiseDivideSSE(outputImage, state._vWeights);
+	return outputImage;
+}
+
+/**
+ * Finds the first and last column of row @p y in which @p newValues differs from
+ * @p oldValues. The values are compared bitwise. If the row has not changed,
+ * xStart will equal xEnd.
+ */
+void HighPassFilter::findChangedColumns(const Image2D &oldValues, const Image2D &newValues, unsigned y, unsigned &xStart, unsigned &xEnd)
+{
+	const unsigned width = oldValues.Width();
+	const float
+		*oldRow = oldValues.ValuePtr(0, y),
+		*newRow = newValues.ValuePtr(0, y);
+	xStart = 0;
+	while(xStart < width && memcmp(&oldRow[xStart], &newRow[xStart], sizeof(float)) == 0)
+		++xStart;
+	xEnd = width;
+	while(xEnd > xStart && memcmp(&oldRow[xEnd-1], &newRow[xEnd-1], sizeof(float)) == 0)
+		--xEnd;
+}
+
 void HighPassFilter::initializeKernel()
 {
 	if(_hKernel == 0)
@@ -26,6 +26,23 @@ class HighPassFilter
 		
 		~HighPassFilter();
 		
+		/**
+		 * The inputs and intermediate results of a low-pass filter, kept between calls of
+		 * ApplyLowPass(image, mask, state). When the filter is applied again with the same
+		 * parameters to an image of which only some samples or flags have changed, only
+		 * the rows with changes are convolved horizontally, and only the columns within
+		 * reach of a change are convolved vertically. The result is bit-identical to a
+		 * full recomputation.
+		 */
+		class State
+		{
+			public:
+				State() { }
+			private:
+				friend class HighPassFilter;
+				Image2DPtr _values, _weights, _hValues, _hWeights, _vValues, _vWeights;
+		};
+		
 		/**
 		 * Apply a Gaussian high pass filter on the given image.
 		 */
@@ -48,6 +65,20 @@ class HighPassFilter
 		 */
 		Image2DPtr ApplyLowPass(const Image2DCPtr &image, const Mask2DCPtr &mask);
 		
+		/**
+		 * Apply a Gaussian high-pass filter incrementally.
+		 * @see ApplyLowPass(const Image2DCPtr &, const Mask2DCPtr &, State &)
+		 */
+		Image2DPtr ApplyHighPass(const Image2DCPtr &image, const Mask2DCPtr &mask, State &state);
+		
+		/**
+		 * Apply a Gaussian low-pass filter, ignoring flagged samples, and only recompute
+		 * the parts that changed since the previous call with the same @p state.
+		 * The first call with a state, or a call with an image of different size, performs
+		 * the full filter.
+		 */
+		Image2DPtr ApplyLowPass(const Image2DCPtr &image, const Mask2DCPtr &mask, State &state);
+		
 		/**
 		 * Set the horizontal size of the sliding window in samples. Must be odd: if the given
 		 * parameter is not odd, it will be incremented by one.
@@ -144,6 +175,12 @@ class HighPassFilter
 		 */
 		void applyLowPass(const Image2DPtr &image);
 		void applyLowPassSSE(const Image2DPtr &image);
+		void horizontalLowPassRowSSE(const Image2D &input, Image2D &output, unsigned y);
+		/**
+		 * Convolves columns [xBegin, xEnd) of row @p y vertically. @p xBegin should be a multiple of four.
+		 */
+		void verticalLowPassRowSSE(const Image2D &input, Image2D &output, unsigned y, unsigned xBegin, unsigned xEnd);
+		static void findChangedColumns(const Image2D &oldValues, const Image2D &newValues, unsigned y, unsigned &xStart, unsigned &xEnd);
 		
 		void initializeKernel();
 		
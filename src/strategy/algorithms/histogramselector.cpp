@@ -0,0 +1,123 @@
+#include "histogramselector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+HistogramSelector::HistogramSelector(const Image2DCPtr &image, const Mask2DCPtr &mask) :
+	_image(image), _mask(mask), _histogram(BinCount, 0), _count(0), _minKey(~0u), _maxKey(0)
+{
+	const size_t width = image->Width();
+	for(size_t y=0;y<image->Height();++y)
+	{
+		const num_t *values = image->ValuePtr(0, y);
+		const bool *flags = mask ? mask->ValuePtr(0, y) : 0;
+		for(size_t x=0;x<width;++x)
+		{
+			if((flags == 0 || !flags[x]) && std::isfinite(values[x]))
+			{
+				const unsigned key = ToKey(values[x]);
+				++_histogram[key >> BinShift];
+				if(key < _minKey) _minKey = key;
+				if(key > _maxKey) _maxKey = key;
+				++_count;
+			}
+		}
+	}
+}
+
+unsigned HistogramSelector::ToKey(float value)
+{
+	unsigned bits;
+	memcpy(&bits, &value, sizeof(bits));
+	// Negative values are ordered reversely, and below the positive values
+	if(bits & 0x80000000u)
+		return ~bits;
+	else
+		return bits | 0x80000000u;
+}
+
+float HistogramSelector::FromKey(unsigned key)
+{
+	unsigned bits;
+	if(key & 0x80000000u)
+		bits = key & 0x7FFFFFFFu;
+	else
+		bits = ~key;
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+void HistogramSelector::findBin(size_t rank, unsigned &bin, size_t &rankInBin) const
+{
+	size_t cumulative = 0;
+	for(bin=0;bin!=BinCount-1;++bin)
+	{
+		if(cumulative + _histogram[bin] > rank)
+			break;
+		cumulative += _histogram[bin];
+	}
+	rankInBin = rank - cumulative;
+}
+
+num_t HistogramSelector::interpolate(unsigned bin, size_t rankInBin) const
+{
+	unsigned
+		firstKey = bin << BinShift,
+		lastKey = firstKey | ((1u << BinShift) - 1);
+	if(firstKey < _minKey) firstKey = _minKey;
+	if(lastKey > _maxKey) lastKey = _maxKey;
+	const double position = (rankInBin + 0.5) / (double) _histogram[bin];
+	return FromKey(firstKey + (unsigned) ((lastKey - firstKey) * position));
+}
+
+void HistogramSelector::refine(unsigned lowBin, size_t lowRankInBin, unsigned highBin, size_t highRankInBin, num_t &lowValue, num_t &highValue) const
+{
+	std::vector<num_t> lowSamples, highSamples;
+	lowSamples.reserve(_histogram[lowBin]);
+	if(highBin != lowBin)
+		highSamples.reserve(_histogram[highBin]);
+	const size_t width = _image->Width();
+	for(size_t y=0;y<_image->Height();++y)
+	{
+		const num_t *values = _image->ValuePtr(0, y);
+		const bool *flags = _mask ? _mask->ValuePtr(0, y) : 0;
+		for(size_t x=0;x<width;++x)
+		{
+			if((flags == 0 || !flags[x]) && std::isfinite(values[x]))
+			{
+				const unsigned bin = ToKey(values[x]) >> BinShift;
+				if(bin == lowBin)
+					lowSamples.push_back(values[x]);
+				else if(bin == highBin)
+					highSamples.push_back(values[x]);
+			}
+		}
+	}
+	std::nth_element(lowSamples.begin(), lowSamples.begin() + lowRankInBin, lowSamples.end());
+	lowValue = lowSamples[lowRankInBin];
+	if(highBin == lowBin)
+	{
+		std::nth_element(lowSamples.begin(), lowSamples.begin() + highRankInBin, lowSamples.end());
+		highValue = lowSamples[highRankInBin];
+	} else {
+		std::nth_element(highSamples.begin(), highSamples.begin() + highRankInBin, highSamples.end());
+		highValue = highSamples[highRankInBin];
+	}
+}
+
+void HistogramSelector::Select(size_t lowRank, size_t highRank, num_t &lowValue, num_t &highValue, bool exact) const
+{
+	unsigned lowBin, highBin;
+	size_t lowRankInBin, highRankInBin;
+	findBin(lowRank, lowBin, lowRankInBin);
+	findBin(highRank, highBin, highRankInBin);
+	if(exact)
+	{
+		refine(lowBin, lowRankInBin, highBin, highRankInBin, lowValue, highValue);
+	} else {
+		lowValue = interpolate(lowBin, lowRankInBin);
+		highValue = interpolate(highBin, highRankInBin);
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef HISTOGRAM_SELECTOR_H
+#define HISTOGRAM_SELECTOR_H
+
+#include <vector>
+
+#include "../../structures/image2d.h"
+#include "../../structures/mask2d.h"
+
+/**
+ * Selects the samples of given ranks from the unflagged, finite samples of an image,
+ * without copying or sorting the image. The constructor counts the samples in a
+ * histogram over the 16 most significant bits of their single precision bit pattern,
+ * after mapping the pattern such that its unsigned order is the order of the values.
+ * This takes one pass over the image.
+ *
+ * A bin covers a relative range of about 1/128 of its values. An approximate
+ * selection interpolates within the bin that holds the requested rank, and needs no
+ * further pass. An exact selection collects only the samples in that bin during a second
+ * pass and selects the rank from those; its result is equal to what
+ * std::nth_element on all samples would return.
+ */
+class HistogramSelector
+{
+	public:
+		/**
+		 * @param mask Flagged samples are skipped. Can be empty, in which case all finite samples are used.
+		 */
+		HistogramSelector(const Image2DCPtr &image, const Mask2DCPtr &mask);
+		
+		/**
+		 * Number of unflagged, finite samples.
+		 */
+		size_t Count() const { return _count; }
+		
+		/**
+		 * Value of the sample with the given (zero-based) rank in ascending order.
+		 * @p rank should be smaller than Count().
+		 */
+		num_t Select(size_t rank, bool exact) const
+		{
+			num_t value;
+			Select(rank, rank, value, value, exact);
+			return value;
+		}
+		
+		/**
+		 * Selects two ranks at once. In exact mode, both are refined in the same pass.
+		 */
+		void Select(size_t lowRank, size_t highRank, num_t &lowValue, num_t &highValue, bool exact) const;
+		
+		/**
+		 * Ordered key of a value: larger values have larger keys.
+		 */
+		static unsigned ToKey(float value);
+		static float FromKey(unsigned key);
+	private:
+		enum { BinShift = 16, BinCount = 1 << 16 };
+		
+		void findBin(size_t rank, unsigned &bin, size_t &rankInBin) const;
+		num_t interpolate(unsigned bin, size_t rankInBin) const;
+		void refine(unsigned lowBin, size_t lowRankInBin, unsigned highBin, size_t highRankInBin, num_t &lowValue, num_t &highValue) const;
+		
+		Image2DCPtr _image;
+		Mask2DCPtr _mask;
+		std::vector<size_t> _histogram;
+		size_t _count;
+		unsigned _minKey, _maxKey;
+};
+
+#endif
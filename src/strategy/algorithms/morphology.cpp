@@ -1,9 +1,10 @@
 #include "morphology.h"
+#include "segmentlabeler.h"
 #include "statisticalflagger.h"
 
 #include "../../util/aologger.h"
 
-#include <stack>
+#include <algorithm>
 #include <iostream>
 
 size_t
@@ -11,6 +12,17 @@ size_t
 	Morphology::LINE_SEGMENT = 2,
 	Morphology::BLOB_SEGMENT = 3;
 
+/**
+ * Sign of the opening values: positive samples are part of a horizontal
+ * structure, negative samples of a vertical structure.
+ */
+struct MorphologyOpeningSign
+{
+	MorphologyOpeningSign(const int *const *_values) : values(_values) { }
+	int operator()(size_t x, size_t y) const { return values[y][x] > 0 ? 1 : -1; }
+	const int *const *values;
+};
+
 void Morphology::SegmentByMaxLength(Mask2DCPtr mask, SegmentedImagePtr output)
 {
 	int **lengthWidthValues = new int*[mask->Height()];
@@ -19,21 +31,10 @@ void Morphology::SegmentByMaxLength(Mask2DCPtr mask, SegmentedImagePtr output)
 	
 	calculateOpenings(mask, lengthWidthValues);
 
-	for(size_t y=0;y<mask->Height();++y)
-	{
-		for(size_t x=0;x<mask->Width();++x)
-			output->SetValue(x,y,0);
-	}
-	for(size_t y=0;y<mask->Height();++y)
-	{
-		for(size_t x=0;x<mask->Width();++x)
-		{
-			if(mask->Value(x, y) && output->Value(x,y) == 0)
-			{
-				floodFill(mask, output, lengthWidthValues, x, y, output->NewSegmentValue());
-			}
-		}
-	}
+	// Neighbouring samples are in the same segment when their openings have the same sign
+	SegmentLabeler labeler;
+	labeler.Label(*mask, MorphologyOpeningSign(lengthWidthValues));
+	labeler.WriteSegments(*output);
 		
 	for(size_t y=0;y<mask->Height();++y)
 		delete[] lengthWidthValues[y];
@@ -45,8 +46,8 @@ void Morphology::SegmentByLengthRatio(Mask2DCPtr mask, SegmentedImagePtr output)
 	Mask2DPtr maskCopy = Mask2D::CreateCopy(mask);
 	//StatisticalFlagger::EnlargeFlags(maskCopy, 2, 2);
 	
-	Mask2DPtr matrices[3];
-	for(size_t i=0;i<3;++i)
+	Mask2DPtr matrices[2];
+	for(size_t i=0;i<2;++i)
 		matrices[i] = Mask2D::CreateUnsetMaskPtr(mask->Width(), mask->Height());
 	
 	int
@@ -71,23 +72,48 @@ void Morphology::SegmentByLengthRatio(Mask2DCPtr mask, SegmentedImagePtr output)
 			output->SetValue(x, y, 0);
 	}
 	StatisticalFlagger::EnlargeFlags(matrices[0], _hLineEnlarging, 0);
-	StatisticalFlagger::EnlargeFlags(matrices[2], 0, _vLineEnlarging);
+	StatisticalFlagger::EnlargeFlags(matrices[1], 0, _vLineEnlarging);
 	StatisticalFlagger::DensityTimeFlagger(matrices[0], _hDensityEnlargeRatio);
-	StatisticalFlagger::DensityFrequencyFlagger(matrices[2], _vDensityEnlargeRatio);
+	StatisticalFlagger::DensityFrequencyFlagger(matrices[1], _vDensityEnlargeRatio);
 
 	// Calculate counts again with new matrices
 	calculateHorizontalCounts(matrices[0], hCounts);
-	calculateVerticalCounts(matrices[2], vCounts);
-
-	for(size_t z=0;z<3;z+=2)
+	calculateVerticalCounts(matrices[1], vCounts);
+
+	// First the horizontal segments are labelled, then the vertical segments. A segment
+	// of the enlarged matrix gets a new value only when it has a sample that is not yet
+	// labelled, and the value is only assigned to flagged samples. Vertical segments
+	// take over flagged samples of horizontal segments where the vertical count is larger.
+	SegmentLabeler labeler;
+	for(size_t z=0;z<2;++z)
 	{
-		for(size_t y=0;y<mask->Height();++y)
+		labeler.Label(*matrices[z]);
+		const std::vector<SegmentLabeler::Run> &runs = labeler.Runs();
+		std::vector<size_t> values(labeler.SegmentCount() + 1, 0);
+		for(std::vector<SegmentLabeler::Run>::const_iterator r=runs.begin();r!=runs.end();++r)
 		{
-			for(size_t x=0;x<mask->Width();++x)
+			if(values[r->segment] == 0)
 			{
-				if(matrices[z]->Value(x, y) && output->Value(x, y)==0)
+				for(size_t x=r->xStart;x!=r->xEnd;++x)
 				{
-					floodFill(mask, output, matrices, x, y, z, output->NewSegmentValue(), hCounts, vCounts);
+					if(output->Value(x, r->y) == 0)
+					{
+						values[r->segment] = output->NewSegmentValue();
+						break;
+					}
+				}
+			}
+		}
+		for(std::vector<SegmentLabeler::Run>::const_iterator r=runs.begin();r!=runs.end();++r)
+		{
+			const size_t value = values[r->segment];
+			if(value != 0)
+			{
+				const size_t y = r->y;
+				for(size_t x=r->xStart;x!=r->xEnd;++x)
+				{
+					if(mask->Value(x, y) && (output->Value(x, y) == 0 || (z == 1 && hCounts[y][x] < vCounts[y][x])))
+						output->SetValue(x, y, value);
 				}
 			}
 		}
@@ -113,49 +139,38 @@ void Morphology::calculateHorizontalCounts(Mask2DCPtr mask, int **values)
 			if(mask->Value(x, y))
 			{
 				++length;
-			} else if(length > 0) {
-				for(size_t i=x-length;i<x;++i)
-				{
-					values[y][i] = length;
-				}
-				length = 0;
-				values[y][x] = 0;
 			} else {
+				std::fill(values[y] + x - length, values[y] + x, length);
+				length = 0;
 				values[y][x] = 0;
 			}
 		}
-		for(size_t i=mask->Width()-length;i<mask->Width();++i)
-		{
-			values[y][i] = length;
-		}
+		std::fill(values[y] + mask->Width() - length, values[y] + mask->Width(), length);
 	}
 }
 
 void Morphology::calculateVerticalCounts(Mask2DCPtr mask, int **values)
 {
-	for(size_t x=0;x<mask->Width();++x)
+	// Row by row, first count the length of the runs so far downwards, and
+	// then copy the full length at the end of each run upwards.
+	for(size_t y=0;y<mask->Height();++y)
 	{
-		size_t length = 0;
-
-		for(size_t y=0;y<mask->Height();++y)
+		for(size_t x=0;x<mask->Width();++x)
 		{
 			if(mask->Value(x, y))
-			{
-				++length;
-			} else if(length > 0) {
-				for(size_t i=y-length;i<y;++i)
-				{
-					values[i][x] = length;
-				}
-				length = 0;
-				values[y][x] = 0;
-			} else {
+				values[y][x] = (y > 0) ? values[y-1][x] + 1 : 1;
+			else
 				values[y][x] = 0;
-			}
 		}
-		for(size_t i=mask->Height()-length;i<mask->Height();++i)
+	}
+	for(size_t y=mask->Height();y>1;--y)
+	{
+		const int *below = values[y-1];
+		int *above = values[y-2];
+		for(size_t x=0;x<mask->Width();++x)
 		{
-			values[i][x] = length;
+			if(above[x] != 0 && below[x] != 0)
+				above[x] = below[x];
 		}
 	}
 }
@@ -228,128 +243,11 @@ void Morphology::calculateOpenings(Mask2DCPtr mask, Mask2DPtr *values, int **hCo
 		{
 			bool v = mask->Value(x, y);
 			values[0]->SetValue(x, y, v && (hCounts[y][x] > vCounts[y][x]));
-			values[1]->SetValue(x, y, v && false);
-			//values[1]->SetValue(x, y, v && (abs(hCounts[y][x] - vCounts[y][x]) < zThreshold));
-			values[2]->SetValue(x, y, v && (hCounts[y][x] <= vCounts[y][x]));
+			values[1]->SetValue(x, y, v && (hCounts[y][x] <= vCounts[y][x]));
 		}
 	}
 }
 
-struct MorphologyPoint2D { size_t x, y; };
-struct MorphologyPoint3D { size_t x, y, z; };
-
-void Morphology::floodFill(Mask2DCPtr mask, SegmentedImagePtr output, const int *const *lengthWidthValues, size_t x, size_t y, size_t value)
-{
-	std::stack<MorphologyPoint2D> points;
-	MorphologyPoint2D startPoint;
-	startPoint.x = x;
-	startPoint.y = y;
-	points.push(startPoint);
-	do {
-		MorphologyPoint2D p = points.top();
-		points.pop();
-		output->SetValue(p.x, p.y, value);
-		int z = lengthWidthValues[p.y][p.x];
-		if(p.x > 0 && output->Value(p.x-1, p.y) == 0 && mask->Value(p.x-1,p.y))
-		{
-			int zl = lengthWidthValues[p.y][p.x-1];
-			if((zl > 0 && z > 0) || (zl < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x-1; newP.y = p.y;
-				points.push(newP);
-			}
-		}
-		if(p.x < mask->Width()-1 && output->Value(p.x+1, p.y)==0 && mask->Value(p.x+1,p.y))
-		{
-			int zr = lengthWidthValues[p.y][p.x+1];
-			if((zr > 0 && z > 0) || (zr < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x+1; newP.y = p.y;
-				points.push(newP);
-			}
-		}
-		if(p.y > 0 && output->Value(p.x, p.y-1)==0 && mask->Value(p.x,p.y-1))
-		{
-			int zt = lengthWidthValues[p.y-1][p.x];
-			if((zt > 0 && z > 0) || (zt < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x; newP.y = p.y-1;
-				points.push(newP);
-			}
-		}
-		if(p.y < mask->Height()-1 && output->Value(p.x, p.y+1)==0 && mask->Value(p.x,p.y+1))
-		{
-			int zb = lengthWidthValues[p.y+1][p.x];
-			if((zb > 0 && z > 0) || (zb < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x; newP.y = p.y+1;
-				points.push(newP);
-			}
-		}
-	} while(points.size() != 0);
-}
-
-void Morphology::floodFill(Mask2DCPtr mask, SegmentedImagePtr output, Mask2DPtr *matrices, size_t x, size_t y, size_t z, size_t value, int **hCounts, int **vCounts)
-{
-	std::stack<MorphologyPoint3D> points;
-	MorphologyPoint3D startPoint;
-	startPoint.x = x;
-	startPoint.y = y;
-	startPoint.z = z;
-	points.push(startPoint);
-	do {
-		MorphologyPoint3D p = points.top();
-		points.pop();
-		if(mask->Value(p.x, p.y))
-		{
-			if(output->Value(p.x, p.y) == 0)
-			{
-				output->SetValue(p.x, p.y, value);
-			} else {
-				// now we need to decide whether to change this sample to the new segment or not
-				if(hCounts[p.y][p.x] < vCounts[p.y][p.x] && p.z == 2)
-					output->SetValue(p.x, p.y, value);
-			}
-		}
-		Mask2DPtr matrix = matrices[p.z];
-		matrix->SetValue(p.x, p.y, false);
-		if((p.z == 0 || p.z == 2) && matrices[1]->Value(p.x,p.y))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x; newP.y = p.y; newP.z = 1;
-			points.push(newP);
-		}
-		if(p.x > 0 && matrix->Value(p.x-1,p.y))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x-1; newP.y = p.y; newP.z = p.z;
-			points.push(newP);
-		}
-		if(p.x < mask->Width()-1 && matrix->Value(p.x+1,p.y))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x+1; newP.y = p.y; newP.z = p.z; newP.z = p.z;
-			points.push(newP);
-		}
-		if(p.y > 0 && matrix->Value(p.x,p.y-1))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x; newP.y = p.y-1; newP.z = p.z;
-			points.push(newP);
-		}
-		if(p.y < mask->Height()-1 && matrix->Value(p.x,p.y+1))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x; newP.y = p.y+1; newP.z = p.z;
-			points.push(newP);
-		}
-	} while(points.size() != 0);
-}
-
 void Morphology::Cluster(SegmentedImagePtr segmentedImage)
 {
 	std::map<size_t,SegmentInfo> segments = createSegmentMap(segmentedImage);
@@ -430,7 +328,8 @@ void Morphology::Cluster(SegmentedImagePtr segmentedImage)
 
 std::map<size_t,Morphology::SegmentInfo> Morphology::createSegmentMap(SegmentedImageCPtr segmentedImage) const
 {
-	std::map<size_t,SegmentInfo> segments;
+	// Collect the info in a vector indexed by segment value, to avoid a map lookup per sample
+	std::vector<SegmentInfo> infos(segmentedImage->SegmentCount() + 1);
 	for(size_t y=0;y<segmentedImage->Height();++y)
 	{
 		for(size_t x=0;x<segmentedImage->Width();++x)
@@ -438,29 +337,31 @@ std::map<size_t,Morphology::SegmentInfo> Morphology::createSegmentMap(SegmentedI
 			size_t segmentValue = segmentedImage->Value(x,y);
 			if(segmentValue != 0)
 			{
-				if(segments.count(segmentValue) == 0)
+				if(segmentValue >= infos.size())
+					infos.resize(segmentValue + 1);
+				SegmentInfo &segment = infos[segmentValue];
+				if(segment.count == 0)
 				{
-					SegmentInfo segment;
 					segment.segment = segmentValue;
 					segment.left = x;
 					segment.right = x+1;
 					segment.top = y;
 					segment.bottom = y+1;
-					segment.AddPoint(x,y);
-					segments.insert(std::map<size_t,SegmentInfo>::value_type(segmentValue, segment));
-				} else {
-					SegmentInfo &segment = segments.find(segmentValue)->second;
-					segment.AddPoint(x,y);
 				}
+				segment.AddPoint(x,y);
 			}
 		}
 	}
 
-	for(std::map<size_t,SegmentInfo>::iterator i=segments.begin();i!=segments.end();++i)
+	std::map<size_t,SegmentInfo> segments;
+	for(std::vector<SegmentInfo>::iterator i=infos.begin();i!=infos.end();++i)
 	{
-		SegmentInfo &info = i->second;
-		info.width = info.right - info.left;
-		info.height = info.bottom - info.top;
+		if(i->count != 0)
+		{
+			i->width = i->right - i->left;
+			i->height = i->bottom - i->top;
+			segments.insert(segments.end(), std::map<size_t,SegmentInfo>::value_type(i->segment, *i));
+		}
 	}
 	return segments;
 }
@@ -485,15 +386,28 @@ void Morphology::RemoveSmallSegments(SegmentedImagePtr segmentedImage, size_t th
 void Morphology::Classify(SegmentedImagePtr segmentedImage)
 {
 	std::map<size_t,SegmentInfo> segments = createSegmentMap(segmentedImage);
+	if(segments.empty())
+		return;
 
+	// Determine the class of all segments first, and relabel the image in a single pass
+	std::vector<size_t> classes(segments.rbegin()->first + 1, 0);
 	for(std::map<size_t,SegmentInfo>::iterator i=segments.begin();i!=segments.end();++i)
 	{
 		SegmentInfo &info = i->second;
 		if(info.width > info.height * 10)
-			segmentedImage->MergeSegments(LINE_SEGMENT, info.segment);
+			classes[info.segment] = LINE_SEGMENT;
 		else if(info.height > info.width * 10)
-			segmentedImage->MergeSegments(BROADBAND_SEGMENT, info.segment);
+			classes[info.segment] = BROADBAND_SEGMENT;
 		else
-			segmentedImage->MergeSegments(BLOB_SEGMENT, info.segment);
+			classes[info.segment] = BLOB_SEGMENT;
+	}
+	for(size_t y=0;y<segmentedImage->Height();++y)
+	{
+		for(size_t x=0;x<segmentedImage->Width();++x)
+		{
+			size_t segmentValue = segmentedImage->Value(x, y);
+			if(segmentValue != 0)
+				segmentedImage->SetValue(x, y, classes[segmentValue]);
+		}
 	}
 }
@@ -69,8 +69,6 @@ class Morphology {
 		void calculateOpenings(Mask2DCPtr mask, Mask2DPtr *values, int **hCounts, int **vCounts);
 		void calculateVerticalCounts(Mask2DCPtr mask, int **values);
 		void calculateHorizontalCounts(Mask2DCPtr mask, int **values);
-		void floodFill(Mask2DCPtr mask, SegmentedImagePtr output, const int *const *lengthWidthValues, size_t x, size_t y, size_t value);
-		void floodFill(Mask2DCPtr mask, SegmentedImagePtr output, Mask2DPtr *matrices, size_t x, size_t y, size_t z, size_t value, int **hCounts, int **vCounts);
 		std::map<size_t,SegmentInfo> createSegmentMap(SegmentedImageCPtr segmentedImage) const;
 		
 		size_t _hLineEnlarging;
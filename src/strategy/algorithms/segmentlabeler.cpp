@@ -0,0 +1,105 @@
+#include "segmentlabeler.h"
+
+void SegmentLabeler::initialize(size_t height)
+{
+	_runs.clear();
+	_parents.clear();
+	_segments.clear();
+	_rowStarts.clear();
+	_rowStarts.reserve(height + 1);
+	_rowStarts.push_back(0);
+}
+
+size_t SegmentLabeler::findRoot(size_t run)
+{
+	// Path halving
+	while(_parents[run] != run)
+	{
+		_parents[run] = _parents[_parents[run]];
+		run = _parents[run];
+	}
+	return run;
+}
+
+void SegmentLabeler::join(size_t runA, size_t runB)
+{
+	runA = findRoot(runA);
+	runB = findRoot(runB);
+	// The earliest run stays the root, so that roots are in row-major order
+	if(runA < runB)
+		_parents[runB] = runA;
+	else if(runB < runA)
+		_parents[runA] = runB;
+}
+
+void SegmentLabeler::joinRow(size_t y)
+{
+	const size_t
+		rowStart = _rowStarts.back(),
+		rowEnd = _runs.size();
+	for(size_t i=rowStart;i!=rowEnd;++i)
+		_parents.push_back(i);
+	if(y > 0)
+	{
+		// Walk through the runs of the previous and current row simultaneously
+		const size_t extent = _eightConnected ? 1 : 0;
+		size_t above = _rowStarts[_rowStarts.size()-2], current = rowStart;
+		while(above != rowStart && current != rowEnd)
+		{
+			const Run &a = _runs[above], &c = _runs[current];
+			if(a.xStart < c.xEnd + extent && c.xStart < a.xEnd + extent && a.sampleClass == c.sampleClass)
+				join(above, current);
+			if(a.xEnd < c.xEnd)
+				++above;
+			else
+				++current;
+		}
+	}
+	_rowStarts.push_back(rowEnd);
+}
+
+void SegmentLabeler::finish()
+{
+	for(size_t i=0;i!=_runs.size();++i)
+	{
+		Run &run = _runs[i];
+		const size_t root = findRoot(i);
+		if(root == i)
+		{
+			_segments.push_back(Segment());
+			Segment &segment = _segments.back();
+			segment.left = run.xStart;
+			segment.right = run.xEnd;
+			segment.top = run.y;
+			run.segment = _segments.size();
+		} else {
+			run.segment = _runs[root].segment;
+		}
+		
+		Segment &segment = _segments[run.segment-1];
+		const size_t length = run.xEnd - run.xStart;
+		if(run.xStart < segment.left) segment.left = run.xStart;
+		if(run.xEnd > segment.right) segment.right = run.xEnd;
+		segment.bottom = run.y + 1;
+		segment.area += length;
+		segment.xTotal += (run.xStart + run.xEnd - 1) * length / 2;
+		segment.yTotal += run.y * length;
+	}
+}
+
+void SegmentLabeler::WriteSegments(SegmentedImage &output) const
+{
+	std::vector<size_t> values(_segments.size() + 1, 0);
+	for(size_t segment=1;segment<=_segments.size();++segment)
+		values[segment] = output.NewSegmentValue();
+	for(size_t y=0;y<output.Height();++y)
+	{
+		for(size_t x=0;x<output.Width();++x)
+			output.SetValue(x, y, 0);
+	}
+	for(std::vector<Run>::const_iterator i=_runs.begin();i!=_runs.end();++i)
+	{
+		for(size_t x=i->xStart;x!=i->xEnd;++x)
+			output.SetValue(x, i->y, values[i->segment]);
+	}
+}
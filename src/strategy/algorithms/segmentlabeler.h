@@ -0,0 +1,128 @@
+#ifndef SEGMENT_LABELER_H
+#define SEGMENT_LABELER_H
+
+#include <vector>
+
+#include "../../structures/mask2d.h"
+#include "../../structures/segmentedimage.h"
+
+/**
+ * Labels the connected segments of the set samples in a mask. The mask is
+ * scanned once to collect its horizontal runs of set samples; overlapping runs in
+ * consecutive rows are joined with a union-find structure. Hence, the time is linear
+ * in the number of samples, and unlike a flood fill, no stack or queue grows with
+ * the size of a segment.
+ *
+ * Segments are numbered from 1, in the order of their first sample in row-major
+ * order, which is the same order in which a row-by-row flood fill would find them.
+ * The area and bounding box of each segment are collected while labelling.
+ */
+class SegmentLabeler
+{
+	public:
+		struct Run
+		{
+			Run(size_t _y, size_t _xStart, size_t _xEnd, int _sampleClass) :
+				y(_y), xStart(_xStart), xEnd(_xEnd), sampleClass(_sampleClass), segment(0)
+			{ }
+			size_t y, xStart, xEnd;
+			int sampleClass;
+			size_t segment;
+		};
+		
+		struct Segment
+		{
+			Segment() : left(0), right(0), top(0), bottom(0), area(0), xTotal(0), yTotal(0)
+			{ }
+			/** Bounding box; right and bottom are exclusive. */
+			size_t left, right, top, bottom;
+			size_t area;
+			size_t xTotal, yTotal;
+			
+			size_t Width() const { return right - left; }
+			size_t Height() const { return bottom - top; }
+		};
+		
+		/**
+		 * @param eightConnected Whether diagonally neighbouring samples are connected. Otherwise,
+		 * only horizontally and vertically neighbouring samples are.
+		 */
+		explicit SegmentLabeler(bool eightConnected = false) : _eightConnected(eightConnected)
+		{ }
+		
+		void Label(const Mask2D &mask)
+		{
+			Label(mask, NoClasses());
+		}
+		
+		/**
+		 * Labels the set samples, but only connects neighbouring samples of which
+		 * the class is equal.
+		 * @param sampleClass Functor that returns the class of a sample as an int, given its x and y.
+		 */
+		template<typename ClassFunction>
+		void Label(const Mask2D &mask, ClassFunction sampleClass)
+		{
+			initialize(mask.Height());
+			for(size_t y=0;y<mask.Height();++y)
+			{
+				const bool *row = mask.ValuePtr(0, y);
+				size_t x = 0;
+				while(x < mask.Width())
+				{
+					if(row[x])
+					{
+						const size_t xStart = x;
+						const int runClass = sampleClass(x, y);
+						do {
+							++x;
+						} while(x < mask.Width() && row[x] && sampleClass(x, y) == runClass);
+						_runs.push_back(Run(y, xStart, x, runClass));
+					} else {
+						++x;
+					}
+				}
+				joinRow(y);
+			}
+			finish();
+		}
+		
+		size_t SegmentCount() const { return _segments.size(); }
+		
+		/**
+		 * @param segment Segment number, 1 <= segment <= SegmentCount().
+		 */
+		const Segment &GetSegment(size_t segment) const { return _segments[segment-1]; }
+		
+		/**
+		 * The runs in row-major order, each with the number of its segment.
+		 */
+		const std::vector<Run> &Runs() const { return _runs; }
+		
+		/**
+		 * Stores the labelled segments in @p output as new segments, numbered with
+		 * SegmentedImage::NewSegmentValue() in the order of the segments. Samples that are not
+		 * set in the mask are set to zero.
+		 */
+		void WriteSegments(SegmentedImage &output) const;
+	private:
+		struct NoClasses
+		{
+			int operator()(size_t, size_t) const { return 0; }
+		};
+		
+		void initialize(size_t height);
+		void joinRow(size_t y);
+		void finish();
+		size_t findRoot(size_t run);
+		void join(size_t runA, size_t runB);
+		
+		bool _eightConnected;
+		std::vector<Run> _runs;
+		std::vector<size_t> _parents;
+		/** Index of the first run of each row; has one extra element for the end. */
+		std::vector<size_t> _rowStarts;
+		std::vector<Segment> _segments;
+};
+
+#endif
@@ -1,3 +1,11 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "../../util/stopwatch.h"
 
 #include "svdmitigater.h"
@@ -11,9 +19,52 @@ extern "C" {
 	      doublecomplex *a, integer *lda, doublereal *s, doublecomplex *u, 
 	      integer *ldu, doublecomplex *vt, integer *ldvt, doublecomplex *work, 
 	      integer *lwork, doublereal *rwork, integer *info);
+  int cgesvd_(char *jobu, char *jobvt, integer *m, integer *n, 
+	      complex *a, integer *lda, real *s, complex *u, 
+	      integer *ldu, complex *vt, integer *ldvt, complex *work, 
+	      integer *lwork, real *rwork, integer *info);
+}
+
+/**
+ * Economy size svd of a column-major matrix, in the precision of num_t.
+ */
+static void economySVD(integer m, integer n, std::complex<float> *a, float *s, std::complex<float> *u, std::complex<float> *vt)
+{
+	char job = 'S';
+	integer minmn = std::min(m, n), info = 0, workAreaSize = -1;
+	std::complex<float> workAreaSizeValue;
+	std::vector<float> realWorkArea(5 * minmn);
+	complex *ca = reinterpret_cast<complex*>(a), *cu = reinterpret_cast<complex*>(u), *cvt = reinterpret_cast<complex*>(vt);
+	cgesvd_(&job, &job, &m, &n, ca, &m, s, cu, &m, cvt, &minmn, reinterpret_cast<complex*>(&workAreaSizeValue), &workAreaSize, &realWorkArea[0], &info);
+	if(info == 0)
+	{
+		workAreaSize = (integer) workAreaSizeValue.real();
+		std::vector<std::complex<float> > workArea(workAreaSize);
+		cgesvd_(&job, &job, &m, &n, ca, &m, s, cu, &m, cvt, &minmn, reinterpret_cast<complex*>(&workArea[0]), &workAreaSize, &realWorkArea[0], &info);
+	}
+	if(info != 0)
+		throw std::runtime_error("cgesvd_ failed to decompose the reduced matrix");
+}
+
+static void economySVD(integer m, integer n, std::complex<double> *a, double *s, std::complex<double> *u, std::complex<double> *vt)
+{
+	char job = 'S';
+	integer minmn = std::min(m, n), info = 0, workAreaSize = -1;
+	std::complex<double> workAreaSizeValue;
+	std::vector<double> realWorkArea(5 * minmn);
+	doublecomplex *ca = reinterpret_cast<doublecomplex*>(a), *cu = reinterpret_cast<doublecomplex*>(u), *cvt = reinterpret_cast<doublecomplex*>(vt);
+	zgesvd_(&job, &job, &m, &n, ca, &m, s, cu, &m, cvt, &minmn, reinterpret_cast<doublecomplex*>(&workAreaSizeValue), &workAreaSize, &realWorkArea[0], &info);
+	if(info == 0)
+	{
+		workAreaSize = (integer) workAreaSizeValue.real();
+		std::vector<std::complex<double> > workArea(workAreaSize);
+		zgesvd_(&job, &job, &m, &n, ca, &m, s, cu, &m, cvt, &minmn, reinterpret_cast<doublecomplex*>(&workArea[0]), &workAreaSize, &realWorkArea[0], &info);
+	}
+	if(info != 0)
+		throw std::runtime_error("zgesvd_ failed to decompose the reduced matrix");
 }
 
-SVDMitigater::SVDMitigater() : _background(0), _singularValues(0), _leftSingularVectors(0), _rightSingularVectors(0), _iteration(0), _removeCount(10),  _verbose(false)
+SVDMitigater::SVDMitigater() : _background(0), _singularValues(0), _leftSingularVectors(0), _rightSingularVectors(0), _iteration(0), _removeCount(10),  _verbose(false), _threadCount(1), _useRangeFinder(true)
 {
 }
 
@@ -34,7 +85,25 @@ void SVDMitigater::Clear()
 		_rightSingularVectors = 0;
 	}
 	if(_background != 0)
+	{
 		delete _background;
+		_background = 0;
+	}
+}
+
+void SVDMitigater::RemoveSingularValues(unsigned singularValueCount)
+{
+	const size_t minmn = std::min(_data.ImageWidth(), _data.ImageHeight());
+	if(_useRangeFinder && (singularValueCount + OversampleCount) * 2 <= minmn)
+	{
+		removeLeadingComponents(singularValueCount);
+	} else {
+		if(!IsDecomposed())
+			Decompose();
+		for(unsigned i=0;i<singularValueCount && i<minmn;++i)
+			SetSingularValue(i, 0.0);
+		Compose();
+	}
 }
 
 // lda = leading dimension
@@ -146,6 +215,203 @@ void SVDMitigater::Compose()
 		std::cout << watch.ToString() << std::endl;
 }
 
+/**
+ * Randomised range finder (Halko, Martinsson & Tropp, 2011). With A the data with frequency
+ * along the rows, the columns of Q form an orthonormal basis for the range of A Omega, with
+ * Omega a random Gaussian matrix with k+p columns. Power iterations with A A^H make the basis
+ * converge to the leading left singular vectors. The svd of the small matrix
+ * B = Q^H A = Ub S Vb^H then gives the leading components A_k = (Q Ub_k) S_k Vb_k^H,
+ * which are subtracted from A. The data matrix is used directly from the images, and is
+ * never copied.
+ */
+void SVDMitigater::removeLeadingComponents(size_t componentCount)
+{
+	Stopwatch watch(true);
+	Clear();
+	Image2DCPtr
+		real = _data.GetRealPart(),
+		imaginary = _data.GetImaginaryPart();
+	const size_t
+		m = _data.ImageHeight(),
+		n = _data.ImageWidth(),
+		l = componentCount + OversampleCount;
+	
+	// All matrices are stored row-major
+	// Omega is drawn from a generator with a fixed seed, so that the result does not
+	// depend on other users of a random generator, e.g. other baselines being flagged
+	std::vector<ComplexValue> omega(n * l), q(m * l), z(n * l);
+	boost::random::mt19937 generator(RandomSeed);
+	boost::random::normal_distribution<num_t> gaussian;
+	for(std::vector<ComplexValue>::iterator i=omega.begin();i!=omega.end();++i)
+	{
+		const num_t r = gaussian(generator);
+		*i = ComplexValue(r, gaussian(generator));
+	}
+	
+	parallelFor(m, boost::bind(&SVDMitigater::multiplyRows, real.get(), imaginary.get(), &omega, &q, l, _1, _2));
+	orthonormalize(q, m, l);
+	for(size_t i=0;i!=PowerIterationCount;++i)
+	{
+		parallelFor(n, boost::bind(&SVDMitigater::multiplyAdjointColumns, real.get(), imaginary.get(), &q, &z, l, _1, _2));
+		orthonormalize(z, n, l);
+		parallelFor(m, boost::bind(&SVDMitigater::multiplyRows, real.get(), imaginary.get(), &z, &q, l, _1, _2));
+		orthonormalize(q, m, l);
+	}
+	
+	// z = A^H Q = B^H. Stored row-major, it is conj(B) stored column-major, with
+	// conj(B) = U' S V'^H, so that Ub = conj(U') and Vb^H = conj(V'^H).
+	parallelFor(n, boost::bind(&SVDMitigater::multiplyAdjointColumns, real.get(), imaginary.get(), &q, &z, l, _1, _2));
+	std::vector<num_t> singularValues(l);
+	std::vector<ComplexValue> u(l * l), vt(l * n);
+	economySVD(l, n, &z[0], &singularValues[0], &u[0], &vt[0]);
+	
+	// left = Q Ub_k S_k (m x k), right = Vb_k^H (k x n)
+	std::vector<ComplexValue> left(m * componentCount), right(componentCount * n);
+	for(size_t f=0;f!=m;++f)
+	{
+		for(size_t g=0;g!=componentCount;++g)
+		{
+			ComplexValue sum = 0.0;
+			for(size_t j=0;j!=l;++j)
+				sum += q[f*l + j] * std::conj(u[g*l + j]);
+			left[f*componentCount + g] = sum * singularValues[g];
+		}
+	}
+	for(size_t g=0;g!=componentCount;++g)
+	{
+		for(size_t t=0;t!=n;++t)
+			right[g*n + t] = std::conj(vt[t*l + g]);
+	}
+	
+	Image2DPtr
+		backgroundReal = Image2D::CreateUnsetImagePtr(n, m),
+		backgroundImaginary = Image2D::CreateUnsetImagePtr(n, m);
+	parallelFor(m, boost::bind(&SVDMitigater::subtractRows, real.get(), imaginary.get(), &left, &right, componentCount, backgroundReal.get(), backgroundImaginary.get(), _1, _2));
+	_background = new TimeFrequencyData(SinglePolarisation, backgroundReal, backgroundImaginary);
+	
+	if(_verbose) {
+		for(size_t i=0;i!=componentCount;++i)
+			std::cout << singularValues[i] << ",";
+		std::cout << std::endl;
+		std::cout << watch.ToString() << std::endl;
+	}
+}
+
+void SVDMitigater::parallelFor(size_t count, const boost::function<void(size_t, size_t)> &function) const
+{
+	const size_t threadCount = std::min(std::max<size_t>(_threadCount, 1), count);
+	if(threadCount <= 1)
+	{
+		function(0, count);
+	} else {
+		boost::thread_group threads;
+		for(size_t i=0;i!=threadCount;++i)
+			threads.create_thread(boost::bind(function, count*i/threadCount, count*(i+1)/threadCount));
+		threads.join_all();
+	}
+}
+
+/**
+ * y = A x for the rows [rowStart, rowEnd) of y.
+ */
+void SVDMitigater::multiplyRows(const Image2D *real, const Image2D *imaginary, const std::vector<ComplexValue> *x, std::vector<ComplexValue> *y, size_t columnCount, size_t rowStart, size_t rowEnd)
+{
+	const size_t n = real->Width();
+	for(size_t f=rowStart;f!=rowEnd;++f)
+	{
+		const num_t
+			*aReal = real->ValuePtr(0, f),
+			*aImaginary = imaginary->ValuePtr(0, f);
+		ComplexValue *yRow = &(*y)[f * columnCount];
+		std::fill(yRow, yRow + columnCount, ComplexValue(0.0, 0.0));
+		for(size_t t=0;t!=n;++t)
+		{
+			const ComplexValue a(aReal[t], aImaginary[t]);
+			const ComplexValue *xRow = &(*x)[t * columnCount];
+			for(size_t j=0;j!=columnCount;++j)
+				yRow[j] += a * xRow[j];
+		}
+	}
+}
+
+/**
+ * z = A^H x for the rows [tStart, tEnd) of z.
+ */
+void SVDMitigater::multiplyAdjointColumns(const Image2D *real, const Image2D *imaginary, const std::vector<ComplexValue> *x, std::vector<ComplexValue> *z, size_t columnCount, size_t tStart, size_t tEnd)
+{
+	std::fill(z->begin() + tStart * columnCount, z->begin() + tEnd * columnCount, ComplexValue(0.0, 0.0));
+	for(size_t f=0;f!=real->Height();++f)
+	{
+		const num_t
+			*aReal = real->ValuePtr(0, f),
+			*aImaginary = imaginary->ValuePtr(0, f);
+		const ComplexValue *xRow = &(*x)[f * columnCount];
+		for(size_t t=tStart;t!=tEnd;++t)
+		{
+			const ComplexValue a(aReal[t], -aImaginary[t]);
+			ComplexValue *zRow = &(*z)[t * columnCount];
+			for(size_t j=0;j!=columnCount;++j)
+				zRow[j] += a * xRow[j];
+		}
+	}
+}
+
+/**
+ * dest = A - left right for the rows [rowStart, rowEnd).
+ */
+void SVDMitigater::subtractRows(const Image2D *real, const Image2D *imaginary, const std::vector<ComplexValue> *left, const std::vector<ComplexValue> *right, size_t componentCount, Image2D *destReal, Image2D *destImaginary, size_t rowStart, size_t rowEnd)
+{
+	const size_t n = real->Width();
+	for(size_t f=rowStart;f!=rowEnd;++f)
+	{
+		num_t
+			*dReal = destReal->ValuePtr(0, f),
+			*dImaginary = destImaginary->ValuePtr(0, f);
+		std::copy(real->ValuePtr(0, f), real->ValuePtr(0, f) + n, dReal);
+		std::copy(imaginary->ValuePtr(0, f), imaginary->ValuePtr(0, f) + n, dImaginary);
+		for(size_t g=0;g!=componentCount;++g)
+		{
+			const ComplexValue l = (*left)[f * componentCount + g];
+			const ComplexValue *rRow = &(*right)[g * n];
+			for(size_t t=0;t!=n;++t)
+			{
+				dReal[t] -= l.real() * rRow[t].real() - l.imag() * rRow[t].imag();
+				dImaginary[t] -= l.real() * rRow[t].imag() + l.imag() * rRow[t].real();
+			}
+		}
+	}
+}
+
+/**
+ * Modified Gram-Schmidt on the columns of a row-major matrix, with one
+ * reorthogonalization to keep the columns orthogonal in single precision.
+ * Columns that are linearly dependent on earlier columns become zero.
+ */
+void SVDMitigater::orthonormalize(std::vector<ComplexValue> &matrix, size_t rowCount, size_t columnCount)
+{
+	for(size_t j=0;j!=columnCount;++j)
+	{
+		for(size_t pass=0;pass!=2;++pass)
+		{
+			for(size_t i=0;i!=j;++i)
+			{
+				std::complex<double> projection = 0.0;
+				for(size_t r=0;r!=rowCount;++r)
+					projection += std::complex<double>(std::conj(matrix[r*columnCount + i]) * matrix[r*columnCount + j]);
+				const ComplexValue p(projection.real(), projection.imag());
+				for(size_t r=0;r!=rowCount;++r)
+					matrix[r*columnCount + j] -= p * matrix[r*columnCount + i];
+			}
+		}
+		double norm = 0.0;
+		for(size_t r=0;r!=rowCount;++r)
+			norm += std::norm(matrix[r*columnCount + j]);
+		norm = sqrt(norm);
+		const num_t factor = (norm > 1e-30) ? 1.0 / norm : 0.0;
+		for(size_t r=0;r!=rowCount;++r)
+			matrix[r*columnCount + j] *= factor;
+	}
+}
 
 #ifdef HAVE_GTKMM
 
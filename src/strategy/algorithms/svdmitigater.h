@@ -1,7 +1,11 @@
 #ifndef SVDMITIGATER_H
 #define SVDMITIGATER_H
 
+#include <complex>
 #include <iostream>
+#include <vector>
+
+#include <boost/function.hpp>
 
 #include "../../structures/image2d.h"
 
@@ -27,14 +31,13 @@ class SVDMitigater : public SurfaceFitMethod {
 			RemoveSingularValues(_removeCount);
 		}
 
-		virtual void RemoveSingularValues(unsigned singularValueCount)
-		{
-			if(!IsDecomposed())
-				Decompose();
-			for(unsigned i=0;i<singularValueCount;++i)
-				SetSingularValue(i, 0.0);
-			Compose();
-		}
+		/**
+		 * Sets the background to the data without its @p singularValueCount leading
+		 * components. When only a few components are removed compared to the size of the data,
+		 * only the leading components are determined with a randomised range finder, and
+		 * subtracted from the data. Otherwise, the full decomposition is computed.
+		 */
+		virtual void RemoveSingularValues(unsigned singularValueCount);
 
 		virtual TimeFrequencyData Background()
 		{
@@ -50,11 +53,36 @@ class SVDMitigater : public SurfaceFitMethod {
 		double SingularValue(unsigned index) const throw() { return _singularValues[index]; }
 		void SetRemoveCount(unsigned removeCount) throw() { _removeCount = removeCount; }
 		void SetVerbose(bool verbose) throw() { _verbose = verbose; }
+		/**
+		 * Number of threads used for the matrix products of the truncated decomposition.
+		 * The default is one, because the mitigater is often run for several baselines at once.
+		 */
+		void SetThreadCount(size_t threadCount) throw() { _threadCount = threadCount; }
+		/**
+		 * Whether the leading components may be determined with the randomised range finder.
+		 * When false, the full decomposition is always computed. Default: true.
+		 */
+		void SetUseRangeFinder(bool useRangeFinder) throw() { _useRangeFinder = useRangeFinder; }
 		static void CreateSingularValueGraph(const TimeFrequencyData &data, class Plot2D &plot);
 	private:
+		typedef std::complex<num_t> ComplexValue;
+		
+		/** Extra dimensions of the random range, which makes the leading components more accurate. */
+		static const size_t OversampleCount = 10;
+		/** Nr of power iterations of the range finder, which suppresses the noise floor. */
+		static const size_t PowerIterationCount = 2;
+		/** Seed of the random range; the same for every decomposition. */
+		static const unsigned RandomSeed = 5489;
+		
 		void Clear();
 		void Decompose();
 		void Compose();
+		void removeLeadingComponents(size_t componentCount);
+		void parallelFor(size_t count, const boost::function<void(size_t, size_t)> &function) const;
+		static void multiplyRows(const Image2D *real, const Image2D *imaginary, const std::vector<ComplexValue> *x, std::vector<ComplexValue> *y, size_t columnCount, size_t rowStart, size_t rowEnd);
+		static void multiplyAdjointColumns(const Image2D *real, const Image2D *imaginary, const std::vector<ComplexValue> *x, std::vector<ComplexValue> *z, size_t columnCount, size_t tStart, size_t tEnd);
+		static void subtractRows(const Image2D *real, const Image2D *imaginary, const std::vector<ComplexValue> *left, const std::vector<ComplexValue> *right, size_t componentCount, Image2D *destReal, Image2D *destImaginary, size_t rowStart, size_t rowEnd);
+		static void orthonormalize(std::vector<ComplexValue> &matrix, size_t rowCount, size_t columnCount);
 		void SetSingularValue(unsigned index, double newValue) throw() { _singularValues[index] = newValue; }
 
 		TimeFrequencyData _data;
@@ -66,6 +94,8 @@ class SVDMitigater : public SurfaceFitMethod {
 		unsigned _iteration;
 		unsigned _removeCount;
 		bool _verbose;
+		size_t _threadCount;
+		bool _useRangeFinder;
 };
 
 #endif
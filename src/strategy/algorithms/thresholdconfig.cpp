@@ -207,7 +207,7 @@ void ThresholdConfig::Execute(Image2DCPtr image, Mask2DPtr mask, bool additive,
 			factor = sensitivity * mode;
 		if(_verbose) {
 			num_t mean, stddev;
-			ThresholdTools::WinsorizedMeanAndStdDev(image, mask, mean, stddev);
+			ThresholdTools::WinsorizedMeanAndStdDev(image, mask, mean, stddev, false);
 			std::cout << "Mode=" << mode << " first threshold=" << _horizontalOperations[0].threshold*factor << std::endl;
 			std::cout << "Stddev=" << stddev << std::endl; 
 		} 
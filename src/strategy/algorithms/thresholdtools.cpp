@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <deque>
 #include <limits>
 
@@ -5,6 +6,8 @@
 
 #include "../../util/rng.h"
 
+#include "histogramselector.h"
+#include "segmentlabeler.h"
 #include "thresholdtools.h"
 
 void ThresholdTools::MeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &mask, num_t &mean, num_t &stddev)
@@ -37,58 +40,9 @@ void ThresholdTools::MeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &m
 	stddev = sqrtn(stddev / (num_t) count);
 }
 
-void ThresholdTools::WinsorizedMeanAndStdDev(const Image2DCPtr &image, num_t &mean, num_t &stddev)
+void ThresholdTools::WinsorizedMeanAndStdDev(const Image2DCPtr &image, num_t &mean, num_t &stddev, bool exact)
 {
-	size_t size = image->Width() * image->Height();
-	num_t *data = new num_t[size];
-	image->CopyData(data);
-	std::sort(data, data + size, numLessThanOperator);
-	size_t lowIndex = (size_t) floor(0.1 * size);
-	size_t highIndex = (size_t) ceil(0.9 * size)-1;
-	num_t lowValue = data[lowIndex];
-	num_t highValue = data[highIndex];
-	delete[] data;
-
-	// Calculate mean
-	mean = 0.0;
-	size_t count = 0;
-	for(size_t y = 0;y<image->Height();++y) {
-		for(size_t x = 0;x<image->Width(); ++x) {
-			if(std::isfinite(image->Value(x, y))) {
-				num_t value = image->Value(x, y);
-				if(value < lowValue)
-					mean += lowValue;
-				else if(value > highValue)
-					mean += highValue;
-				else
-					mean += value;
-				count++; 
-			}
-		}
-	}
-	if(count > 0)
-		mean /= (num_t) count;
-	// Calculate variance
-	stddev = 0.0;
-	count = 0;
-	for(size_t y = 0;y<image->Height();++y) {
-		for(size_t x=0;x<image->Width(); ++x) {
-			if(std::isfinite(image->Value(x, y))) {
-				num_t value = image->Value(x, y);
-				if(value < lowValue)
-					stddev += (lowValue-mean)*(lowValue-mean);
-				else if(value > highValue)
-					stddev += (highValue-mean)*(highValue-mean);
-				else
-					stddev += (value-mean)*(value-mean);
-				count++; 
-			}
-		}
-	}
-	if(count > 0)
-		stddev = sqrtn(1.54 * stddev / (num_t) count);
-	else
-		stddev = 0.0;
+	WinsorizedMeanAndStdDev(image, Mask2DCPtr(), mean, stddev, exact);
 }
 
 template<typename T>
@@ -107,10 +61,11 @@ void ThresholdTools::TrimmedMeanAndStdDev(const std::vector<T> &input, T &mean,
 			return;
 		}
 	std::vector<T> data(input);
-	std::sort(data.begin(), data.end(), numLessThanOperator);
 	size_t lowIndex = (size_t) floor(0.25 * data.size());
 	size_t highIndex = (size_t) ceil(0.75 * data.size())-1;
+	std::nth_element(data.begin(), data.begin() + lowIndex, data.end(), numLessThanOperator);
 	T lowValue = data[lowIndex];
+	std::nth_element(data.begin() + lowIndex, data.begin() + highIndex, data.end(), numLessThanOperator);
 	T highValue = data[highIndex];
 
 	// Calculate mean
@@ -154,10 +109,11 @@ void ThresholdTools::WinsorizedMeanAndStdDev(const std::vector<T> &input, T &mea
 		stddev = 0.0;
 	} else {
 		std::vector<T> data(input);
-		std::sort(data.begin(), data.end(), numLessThanOperator);
 		size_t lowIndex = (size_t) floor(0.1 * data.size());
 		size_t highIndex = (size_t) ceil(0.9 * data.size())-1;
+		std::nth_element(data.begin(), data.begin() + lowIndex, data.end(), numLessThanOperator);
 		T lowValue = data[lowIndex];
+		std::nth_element(data.begin() + lowIndex, data.begin() + highIndex, data.end(), numLessThanOperator);
 		T highValue = data[highIndex];
 
 		// Calculate mean
@@ -201,59 +157,64 @@ void ThresholdTools::WinsorizedMeanAndStdDev(const std::vector<T> &input, T &mea
 template void ThresholdTools::WinsorizedMeanAndStdDev(const std::vector<num_t> &input, num_t &mean, num_t &stddev);
 template void ThresholdTools::WinsorizedMeanAndStdDev(const std::vector<double> &input, double &mean, double &stddev);
 
-void ThresholdTools::WinsorizedMeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &mask, num_t &mean, num_t &stddev)
+void ThresholdTools::WinsorizedMeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &mask, num_t &mean, num_t &stddev, bool exact)
 {
-	num_t *data = new num_t[image->Width() * image->Height()];
-	size_t unflaggedCount = 0;
-	for(size_t y=0;y<image->Height();++y)
+	HistogramSelector selector(image, mask);
+	const size_t unflaggedCount = selector.Count();
+	if(unflaggedCount == 0)
 	{
-		for(size_t x=0;x<image->Width();++x)
-		{
-			num_t val = image->Value(x, y);
-			if(!mask->Value(x, y) && std::isfinite(val))
-			{
-				data[unflaggedCount] = image->Value(x, y);
-				++unflaggedCount;
-			}
-		}
+		mean = 0.0;
+		stddev = 0.0;
+		return;
 	}
 	size_t lowIndex = (size_t) floor(0.1 * unflaggedCount);
 	size_t highIndex = (size_t) ceil(0.9 * unflaggedCount);
 	if(highIndex > 0) --highIndex;
-	std::nth_element(data, data + lowIndex, data + unflaggedCount, numLessThanOperator);
-	num_t lowValue = data[lowIndex];
-	std::nth_element(data, data + highIndex, data + unflaggedCount, numLessThanOperator);
-	num_t highValue = data[highIndex];
+	num_t lowValue, highValue;
+	selector.Select(lowIndex, highIndex, lowValue, highValue, exact);
 
 	// Calculate mean
 	mean = 0.0;
-	for(size_t i = 0;i<unflaggedCount;++i) {
-		num_t value = data[i];
-		if(value < lowValue)
-			mean += lowValue;
-		else if(value > highValue)
-			mean += highValue;
-		else
-			mean += value;
+	for(size_t y=0;y<image->Height();++y)
+	{
+		const num_t *values = image->ValuePtr(0, y);
+		const bool *flags = mask ? mask->ValuePtr(0, y) : 0;
+		for(size_t x=0;x<image->Width();++x)
+		{
+			if((flags == 0 || !flags[x]) && std::isfinite(values[x]))
+			{
+				num_t value = values[x];
+				if(value < lowValue)
+					mean += lowValue;
+				else if(value > highValue)
+					mean += highValue;
+				else
+					mean += value;
+			}
+		}
 	}
-	if(unflaggedCount > 0)
-		mean /= (num_t) unflaggedCount;
+	mean /= (num_t) unflaggedCount;
 	// Calculate variance
 	stddev = 0.0;
-	for(size_t i = 0;i<unflaggedCount;++i) {
-		num_t value = data[i];
-		if(value < lowValue)
-			stddev += (lowValue-mean)*(lowValue-mean);
-		else if(value > highValue)
-			stddev += (highValue-mean)*(highValue-mean);
-		else
-			stddev += (value-mean)*(value-mean);
+	for(size_t y=0;y<image->Height();++y)
+	{
+		const num_t *values = image->ValuePtr(0, y);
+		const bool *flags = mask ? mask->ValuePtr(0, y) : 0;
+		for(size_t x=0;x<image->Width();++x)
+		{
+			if((flags == 0 || !flags[x]) && std::isfinite(values[x]))
+			{
+				num_t value = values[x];
+				if(value < lowValue)
+					stddev += (lowValue-mean)*(lowValue-mean);
+				else if(value > highValue)
+					stddev += (highValue-mean)*(highValue-mean);
+				else
+					stddev += (value-mean)*(value-mean);
+			}
+		}
 	}
-	delete[] data;
-	if(unflaggedCount > 0)
-		stddev = sqrtn(1.54 * stddev / (num_t) unflaggedCount);
-	else
-		stddev = 0.0;
+	stddev = sqrtn(1.54 * stddev / (num_t) unflaggedCount);
 }
 
 num_t ThresholdTools::MinValue(const Image2DCPtr &image, const Mask2DCPtr &mask)
@@ -431,81 +392,81 @@ numl_t ThresholdTools::RMS(const Image2DCPtr &image, const Mask2DCPtr &mask)
 	return sqrtnl(mode / (numl_t) count);
 }
 
-num_t ThresholdTools::WinsorizedMode(const Image2DCPtr &image, const Mask2DCPtr &mask)
+num_t ThresholdTools::WinsorizedMode(const Image2DCPtr &image, const Mask2DCPtr &mask, bool exact)
 {
-	num_t *data = new num_t[image->Width() * image->Height()];
-	size_t unflaggedCount = 0;
+	HistogramSelector selector(image, mask);
+	const size_t unflaggedCount = selector.Count();
+	if(unflaggedCount == 0)
+		return 0.0;
+	size_t highIndex = (size_t) floor(0.9 * unflaggedCount);
+	num_t highValue = selector.Select(highIndex, exact);
+	
+	num_t mode = 0.0;
 	for(size_t y=0;y<image->Height();++y)
 	{
+		const num_t *values = image->ValuePtr(0, y);
+		const bool *flags = mask->ValuePtr(0, y);
 		for(size_t x=0;x<image->Width();++x)
 		{
-			num_t val = image->Value(x, y);
-			if(!mask->Value(x, y) && std::isfinite(val))
+			num_t value = values[x];
+			if(!flags[x] && std::isfinite(value))
 			{
-				data[unflaggedCount] = val;
-				++unflaggedCount;
+				if(value > highValue)
+					mode += highValue * highValue;
+				else
+					mode += value * value;
 			}
 		}
 	}
-	size_t highIndex = (size_t) floor(0.9 * unflaggedCount);
-	std::nth_element(data, data + highIndex, data + unflaggedCount);
-	num_t highValue = data[highIndex];
-	
-	num_t mode = 0.0;
-	for(size_t i = 0; i < unflaggedCount; ++i) {
-		num_t value = data[i];
-		if(value > highValue)
-			mode += highValue * highValue;
-		else
-			mode += value * value;
-	}
-	delete[] data;
 	// The correction factor 1.0541 was found by running simulations
 	// It corresponds with the correction factor needed when winsorizing 10% of the 
 	// data, meaning that the highest 10% is set to the value exactly at the
 	// 90%/10% limit.
-	if(unflaggedCount > 0)
-		return sqrtn(mode / (2.0 * (num_t) unflaggedCount)) * 1.0541;
-	else
-		return 0.0;
+	return sqrtn(mode / (2.0 * (num_t) unflaggedCount)) * 1.0541;
 }
 
-num_t ThresholdTools::WinsorizedMode(const Image2DCPtr &image)
+num_t ThresholdTools::WinsorizedMode(const Image2DCPtr &image, bool exact)
 {
-	size_t size = image->Width() * image->Height();
-	num_t *data = new num_t[size];
-	image->CopyData(data);
-	std::sort(data, data + size, numLessThanOperator);
+	HistogramSelector selector(image, Mask2DCPtr());
+	const size_t size = selector.Count();
+	if(size == 0)
+		return 0.0;
 	size_t highIndex = (size_t) ceil(0.9 * size)-1;
-	num_t highValue = data[highIndex];
-	delete[] data;
+	num_t highValue = selector.Select(highIndex, exact);
 
 	num_t mode = 0.0;
 	for(size_t y = 0;y<image->Height();++y) {
+		const num_t *values = image->ValuePtr(0, y);
 		for(size_t x = 0;x<image->Width(); ++x) {
-			num_t value = image->Value(x, y);
-			if(value > highValue || -value > highValue)
-				mode += highValue * highValue;
-			else
-				mode += value * value;
+			num_t value = values[x];
+			if(std::isfinite(value))
+			{
+				if(value > highValue || -value > highValue)
+					mode += highValue * highValue;
+				else
+					mode += value * value;
+			}
 		}
 	}
 	// The correction factor 1.0541 was found by running simulations
 	// It corresponds with the correction factor needed when winsorizing 10% of the 
 	// data, meaning that the highest 10% is set to the value exactly at the
 	// 90%/10% limit.
-	if(size > 0)
-		return sqrtn(mode / (2.0L * (num_t) size)) * 1.0541L;
-	else
-		return 0.0;
+	return sqrtn(mode / (2.0L * (num_t) size)) * 1.0541L;
 }
 
 void ThresholdTools::FilterConnectedSamples(Mask2DPtr mask, size_t minConnectedSampleArea, bool eightConnected)
 {
-	for(size_t y=0;y<mask->Height();++y) {
-		for(size_t x=0;x<mask->Width();++x)
-			if(mask->Value(x, y))
-				FilterConnectedSample(mask, x, y, minConnectedSampleArea, eightConnected);
+	SegmentLabeler labeler(eightConnected);
+	labeler.Label(*mask);
+	const std::vector<SegmentLabeler::Run> &runs = labeler.Runs();
+	for(std::vector<SegmentLabeler::Run>::const_iterator i=runs.begin();i!=runs.end();++i)
+	{
+		if(labeler.GetSegment(i->segment).area < minConnectedSampleArea)
+		{
+			for(size_t x=i->xStart;x!=i->xEnd;++x)
+				mask->SetValue(x, i->y, false);
+		}
 	}
 }
 
@@ -585,37 +546,75 @@ Image2DPtr ThresholdTools::ShrinkHorizontally(size_t factor, const Image2DCPtr &
 
 	Image2D *newImage = Image2D::CreateUnsetImage(newWidth, input->Height());
 
-	for(size_t x=0;x<newWidth;++x)
+	for(size_t y=0;y<input->Height();++y)
 	{
-		size_t avgSize = factor;
-		if(avgSize + x*factor > oldWidth)
-			avgSize = oldWidth - x*factor;
-		size_t count = 0;
-
-		for(size_t y=0;y<input->Height();++y)
+		const num_t *inputRow = input->ValuePtr(0, y);
+		const bool *maskRow = mask->ValuePtr(0, y);
+		num_t *outputRow = newImage->ValuePtr(0, y);
+		for(size_t x=0;x<newWidth;++x)
 		{
-			num_t sum = 0.0;
+			size_t avgSize = factor;
+			if(avgSize + x*factor > oldWidth)
+				avgSize = oldWidth - x*factor;
+			const num_t *binValues = &inputRow[x*factor];
+			const bool *binFlags = &maskRow[x*factor];
+
+			// Sum the unflagged and all samples in the same pass; the latter is used when
+			// the entire bin is flagged.
+			num_t sum = 0.0, unflaggedSum = 0.0;
+			size_t count = 0;
 			for(size_t binX=0;binX<avgSize;++binX)
 			{
-				size_t curX = x*factor + binX;
-				if(!mask->Value(curX, y))
+				sum += binValues[binX];
+				if(!binFlags[binX])
 				{
-					sum += input->Value(curX, y);
+					unflaggedSum += binValues[binX];
 					++count;
 				}
 			}
 			if(count == 0)
-			{
-				sum = 0.0;
-				for(size_t binX=0;binX<avgSize;++binX)
-				{
-					size_t curX = x*factor + binX;
-					sum += input->Value(curX, y);
-					++count;
-				}
-			}
-			newImage->SetValue(x, y, sum / (num_t) count);
+				outputRow[x] = sum / (num_t) avgSize;
+			else
+				outputRow[x] = unflaggedSum / (num_t) count;
 		}
 	}
 	return Image2DPtr(newImage);
 }
+
+Image2DPtr ThresholdTools::FrequencyRectangularConvolution(const Image2DCPtr &source, size_t convolutionSize)
+{
+	const size_t
+		width = source->Width(),
+		height = source->Height();
+	if(convolutionSize == 0)
+		convolutionSize = 1;
+	const size_t upperWindowHalf = (convolutionSize+1) / 2;
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	
+	// Output row y is the average of input rows [windowStart, windowEnd)
+	std::vector<double> sums(width, 0.0);
+	size_t windowStart = 0, windowEnd = 0;
+	for(size_t y=0;y<height;++y)
+	{
+		const size_t
+			newWindowEnd = std::min(y + upperWindowHalf, height),
+			newWindowStart = (y + upperWindowHalf > convolutionSize) ? (y + upperWindowHalf - convolutionSize) : 0;
+		for(;windowEnd<newWindowEnd;++windowEnd)
+		{
+			const num_t *row = source->ValuePtr(0, windowEnd);
+			for(size_t x=0;x<width;++x)
+				sums[x] += row[x];
+		}
+		for(;windowStart<newWindowStart;++windowStart)
+		{
+			const num_t *row = source->ValuePtr(0, windowStart);
+			for(size_t x=0;x<width;++x)
+				sums[x] -= row[x];
+		}
+		const double count = windowEnd - windowStart;
+		num_t *destination = image->ValuePtr(0, y);
+		for(size_t x=0;x<width;++x)
+			destination[x] = sums[x] / count;
+	}
+	return image;
+}
@@ -7,6 +7,7 @@
 #include "../actions/baselineselectionaction.h"
 #include "../actions/calibratepassbandaction.h"
 #include "../actions/changeresolutionaction.h"
+#include "../actions/coarsescreeningaction.h"
 #include "../actions/combineflagresultsaction.h"
 #include "../actions/cutareaaction.h"
 #include "../actions/directionalcleanaction.h"
@@ -51,6 +52,7 @@ const std::vector<std::string> ActionFactory::GetActionList()
 	list.push_back("Baseline selection");
 	list.push_back("Calibrate passband");
 	list.push_back("Change resolution");
+	list.push_back("Coarse screening");
 	list.push_back("Combine flag results");
 	list.push_back("Cut area");
 	list.push_back("Directional CLEAN");
@@ -100,6 +102,8 @@ Action *ActionFactory::CreateAction(const std::string &action)
 		return new CalibratePassbandAction();
 	else if(action == "Change resolution")
 		return new ChangeResolutionAction();
+	else if(action == "Coarse screening")
+		return new CoarseScreeningAction();
 	else if(action == "Combine flag results")
 		return new CombineFlagResults();
 	else if(action == "Cut area")
@@ -187,6 +191,12 @@ const char *ActionFactory::GetDescription(ActionType action)
 				"Changes the resolution of the time frequency data currently in memory. This is "
 				"part of the algorithm and should normally not be changed. Currently changes only "
 				"the time direction.";
+		case CoarseScreeningActionType:
+			return
+				"Runs its children on a copy of the data with decreased resolution, and runs them "
+				"again at full resolution only on the tiles in which the low-resolution flagging "
+				"found new flags, or in which a sample deviates strongly from its low-resolution "
+				"average. This speeds up flagging of data with little RFI.";
 		case CombineFlagResultsType:
 			return
 				"Runs each of its children and combines the flags (by OR-ing) afterwards.";
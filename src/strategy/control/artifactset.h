@@ -25,7 +25,7 @@ namespace rfiStrategy {
 			_antennaFlagCountPlot(0), _frequencyFlagCountPlot(0),
 			_frequencyPowerPlot(0), _timeFlagCountPlot(0), _iterationsPlot(0),
 			_polarizationStatistics(0), _baselineSelectionInfo(0), _observatorium(0),
-			_model(0),
+			_model(0), _iterationCache(0), _threadCount(1),
 			_horizontalProfile(), _verticalProfile()
 			{
 			}
@@ -43,6 +43,8 @@ namespace rfiStrategy {
 				_baselineSelectionInfo(source._baselineSelectionInfo),
 				_observatorium(source._observatorium),
 				_model(source._model),
+				_iterationCache(source._iterationCache),
+				_threadCount(source._threadCount),
 				_horizontalProfile(source._horizontalProfile),
 				_verticalProfile(source._verticalProfile)
 			{
@@ -73,6 +75,8 @@ namespace rfiStrategy {
 				_baselineSelectionInfo = source._baselineSelectionInfo;
 				_observatorium = source._observatorium;
 				_model = source._model;
+				_iterationCache = source._iterationCache;
+				_threadCount = source._threadCount;
 				_horizontalProfile = source._horizontalProfile;
 				_verticalProfile = source._verticalProfile;
 				return *this;
@@ -209,6 +213,31 @@ namespace rfiStrategy {
 			{
 				return _model;
 			}
+			/**
+			 * Results kept between the iterations of the enclosing IterationBlock, or
+			 * null when not inside an IterationBlock.
+			 */
+			class IterationCache *IterationCache() const
+			{
+				return _iterationCache;
+			}
+			void SetIterationCache(class IterationCache *iterationCache)
+			{
+				_iterationCache = iterationCache;
+			}
+			/**
+			 * Number of threads that an action may use for the data of this set. This is one
+			 * when sets are already flagged in parallel, e.g. for each baseline, to avoid
+			 * running more threads than there are cores.
+			 */
+			size_t ThreadCount() const
+			{
+				return _threadCount;
+			}
+			void SetThreadCount(size_t threadCount)
+			{
+				_threadCount = threadCount;
+			}
 			void SetProjectedDirectionRad(numl_t projectedDirectionRad)
 			{
 				_projectedDirectionRad = projectedDirectionRad;
@@ -245,6 +274,8 @@ namespace rfiStrategy {
 			class BaselineSelector *_baselineSelectionInfo;
 			class Observatorium *_observatorium;
 			class Model *_model;
+			class IterationCache *_iterationCache;
+			size_t _threadCount;
 			std::vector<num_t> _horizontalProfile, _verticalProfile;
 	};
 }
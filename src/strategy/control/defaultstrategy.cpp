@@ -5,6 +5,7 @@
 #include "../actions/baselineselectionaction.h"
 #include "../actions/calibratepassbandaction.h"
 #include "../actions/changeresolutionaction.h"
+#include "../actions/coarsescreeningaction.h"
 #include "../actions/combineflagresultsaction.h"
 #include "../actions/foreachbaselineaction.h"
 #include "../actions/foreachcomplexcomponentaction.h"
@@ -50,7 +51,8 @@ namespace rfiStrategy {
 		DefaultStrategy::FLAG_GUI_FRIENDLY        = aoflagger::StrategyFlags::GUI_FRIENDLY,
 		DefaultStrategy::FLAG_CLEAR_FLAGS         = aoflagger::StrategyFlags::CLEAR_FLAGS,
 		DefaultStrategy::FLAG_AUTO_CORRELATION    = aoflagger::StrategyFlags::AUTO_CORRELATION,
-		DefaultStrategy::FLAG_HIGH_TIME_RESOLUTION= aoflagger::StrategyFlags::HIGH_TIME_RESOLUTION;
+		DefaultStrategy::FLAG_HIGH_TIME_RESOLUTION= aoflagger::StrategyFlags::HIGH_TIME_RESOLUTION,
+		DefaultStrategy::FLAG_COARSE_SCREENING    = aoflagger::StrategyFlags::COARSE_SCREENING;
 	
 	std::string DefaultStrategy::TelescopeName(DefaultStrategy::TelescopeId telescopeId)
 	{
@@ -151,7 +153,28 @@ namespace rfiStrategy {
 		
 		bool hasBaselines = telescopeId!=PARKES_TELESCOPE && telescopeId!=ARECIBO_TELESCOPE && telescopeId!=BIGHORNS_TELESCOPE && telescopeId!=GENERIC_TELESCOPE;
 		
-		LoadSingleStrategy(strategy, iterationCount, keepTransients, changeResVertically, calPassband, channelSelection, clearFlags, resetContaminated, sumThresholdSensitivity, onStokesIQ, assembleStatistics, verticalSmoothing, hasBaselines, hiTimeResolution);
+		if((flags&FLAG_COARSE_SCREENING) != 0)
+		{
+			// The children of the screening block run more than once per baseline, so
+			// statistics are collected after it.
+			CoarseScreeningAction *screening = new CoarseScreeningAction();
+			strategy.Add(screening);
+			LoadSingleStrategy(*screening, iterationCount, keepTransients, changeResVertically, calPassband, channelSelection, clearFlags, resetContaminated, sumThresholdSensitivity, onStokesIQ, false, verticalSmoothing, hasBaselines, hiTimeResolution);
+			if(assembleStatistics)
+			{
+				PlotAction *plotPolarizationStatistics = new PlotAction();
+				plotPolarizationStatistics->SetPlotKind(PlotAction::PolarizationStatisticsPlot);
+				strategy.Add(plotPolarizationStatistics);
+				if(hasBaselines)
+				{
+					BaselineSelectionAction *baselineSelection = new BaselineSelectionAction();
+					baselineSelection->SetPreparationStep(true);
+					strategy.Add(baselineSelection);
+				}
+			}
+		} else {
+			LoadSingleStrategy(strategy, iterationCount, keepTransients, changeResVertically, calPassband, channelSelection, clearFlags, resetContaminated, sumThresholdSensitivity, onStokesIQ, assembleStatistics, verticalSmoothing, hasBaselines, hiTimeResolution);
+		}
 	}
 	
 	void DefaultStrategy::LoadSingleStrategy(ActionBlock &block, int iterationCount, bool keepTransients, bool changeResVertically, bool calPassband, bool channelSelection, bool clearFlags, bool resetContaminated, double sumThresholdSensitivity, bool onStokesIQ, bool assembleStatistics, double verticalSmoothing, bool hasBaselines, bool highTimeResolution)
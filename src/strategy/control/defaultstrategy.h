@@ -52,7 +52,8 @@ namespace rfiStrategy {
 			FLAG_GUI_FRIENDLY,
 			FLAG_CLEAR_FLAGS,
 			FLAG_AUTO_CORRELATION,
-			FLAG_HIGH_TIME_RESOLUTION;
+			FLAG_HIGH_TIME_RESOLUTION,
+			FLAG_COARSE_SCREENING;
 				
 		/** @TODO Not all flags are implemented yet. */
 		static Strategy *CreateStrategy(enum TelescopeId telescopeId, unsigned flags, double frequency=0.0, double timeRes=0.0, double frequencyRes=0.0);
@@ -0,0 +1,40 @@
+#ifndef RFI_ITERATION_CACHE_H
+#define RFI_ITERATION_CACHE_H
+
+#include <map>
+#include <utility>
+
+#include "../algorithms/highpassfilter.h"
+
+namespace rfiStrategy {
+
+	/**
+	 * Results that actions keep from one iteration of an IterationBlock to the next,
+	 * so that the next iteration only recomputes what has changed. The IterationBlock
+	 * owns the cache while it iterates and makes it available through
+	 * ArtifactSet::IterationCache(). Because each thread has its own ArtifactSet,
+	 * the cache is not shared between threads.
+	 */
+	class IterationCache
+	{
+		public:
+			IterationCache() { }
+			
+			/**
+			 * The state of the low-pass filter with index @p index that is performed by
+			 * action @p owner, e.g. one per image of the data.
+			 */
+			HighPassFilter::State &LowPassState(const void *owner, size_t index)
+			{
+				return _lowPassStates[std::make_pair(owner, index)];
+			}
+		private:
+			IterationCache(const IterationCache &) { } // don't allow copies
+			void operator=(const IterationCache &) { } // don't allow assignment
+			
+			std::map<std::pair<const void *, size_t>, HighPassFilter::State> _lowPassStates;
+	};
+
+}
+
+#endif // RFI_ITERATION_CACHE_H
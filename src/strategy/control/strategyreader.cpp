@@ -9,6 +9,7 @@
 #include "../actions/baselineselectionaction.h"
 #include "../actions/calibratepassbandaction.h"
 #include "../actions/changeresolutionaction.h"
+#include "../actions/coarsescreeningaction.h"
 #include "../actions/combineflagresultsaction.h"
 #include "../actions/cutareaaction.h"
 #include "../actions/directionalcleanaction.h"
@@ -232,6 +233,8 @@ Action *StrategyReader::parseAction(xmlNode *node)
 		newAction = parseCalibratePassbandAction(node);
 	else if(typeStr == "ChangeResolutionAction")
 		newAction = parseChangeResolutionAction(node);
+	else if(typeStr == "CoarseScreeningAction")
+		newAction = parseCoarseScreeningAction(node);
 	else if(typeStr == "CombineFlagResults")
 		newAction = parseCombineFlagResults(node);
 	else if(typeStr == "CutAreaAction")
@@ -360,6 +363,19 @@ Action *StrategyReader::parseChangeResolutionAction(xmlNode *node)
 	return newAction;
 }
 
+Action *StrategyReader::parseCoarseScreeningAction(xmlNode *node)
+{
+	CoarseScreeningAction *newAction = new CoarseScreeningAction();
+	newAction->SetTimeDecreaseFactor(getInt(node, "time-decrease-factor"));
+	newAction->SetFrequencyDecreaseFactor(getInt(node, "frequency-decrease-factor"));
+	newAction->SetTileWidth(getInt(node, "tile-width"));
+	newAction->SetTileHeight(getInt(node, "tile-height"));
+	newAction->SetSpikeThreshold(getDouble(node, "spike-threshold"));
+	newAction->SetMaxContaminatedFraction(getDouble(node, "max-contaminated-fraction"));
+	parseChildren(node, newAction);
+	return newAction;
+}
+
 Action *StrategyReader::parseCombineFlagResults(xmlNode *node)
 {
 	CombineFlagResults *newAction = new CombineFlagResults();
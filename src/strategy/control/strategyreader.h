@@ -40,6 +40,7 @@ class StrategyReader {
 		class Action *parseBaselineSelectionAction(xmlNode *node);
 		class Action *parseCalibratePassbandAction(xmlNode *node);
 		class Action *parseChangeResolutionAction(xmlNode *node);
+		class Action *parseCoarseScreeningAction(xmlNode *node);
 		class Action *parseCombineFlagResults(xmlNode *node);
 		class Action *parseCutAreaAction(xmlNode *node);
 		class Action *parseDirectionalCleanAction(xmlNode *node);
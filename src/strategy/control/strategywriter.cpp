@@ -6,6 +6,7 @@
 #include "../actions/baselineselectionaction.h"
 #include "../actions/calibratepassbandaction.h"
 #include "../actions/changeresolutionaction.h"
+#include "../actions/coarsescreeningaction.h"
 #include "../actions/combineflagresultsaction.h"
 #include "../actions/cutareaaction.h"
 #include "../actions/directionalcleanaction.h"
@@ -101,6 +102,9 @@ namespace rfiStrategy {
 			case ChangeResolutionActionType:
 				writeChangeResolutionAction(static_cast<const ChangeResolutionAction&>(action));
 				break;
+			case CoarseScreeningActionType:
+				writeCoarseScreeningAction(static_cast<const CoarseScreeningAction&>(action));
+				break;
 			case CombineFlagResultsType:
 				writeCombineFlagResults(static_cast<const CombineFlagResults&>(action));
 				break;
@@ -263,6 +267,18 @@ namespace rfiStrategy {
 		writeContainerItems(action);
 	}
 
+	void StrategyWriter::writeCoarseScreeningAction(const CoarseScreeningAction &action)
+	{
+		Attribute("type", "CoarseScreeningAction");
+		Write<int>("time-decrease-factor", action.TimeDecreaseFactor());
+		Write<int>("frequency-decrease-factor", action.FrequencyDecreaseFactor());
+		Write<unsigned>("tile-width", action.TileWidth());
+		Write<unsigned>("tile-height", action.TileHeight());
+		Write<double>("spike-threshold", action.SpikeThreshold());
+		Write<double>("max-contaminated-fraction", action.MaxContaminatedFraction());
+		writeContainerItems(action);
+	}
+
 	void StrategyWriter::writeCombineFlagResults(const CombineFlagResults &action)
 	{
 		Attribute("type", "CombineFlagResults");
@@ -55,6 +55,7 @@ namespace rfiStrategy {
 			void writeBaselineSelectionAction(const class BaselineSelectionAction &action);
 			void writeCalibratePassbandAction(const class CalibratePassbandAction &action);
 			void writeChangeResolutionAction(const class ChangeResolutionAction &action);
+			void writeCoarseScreeningAction(const class CoarseScreeningAction &action);
 			void writeCombineFlagResults(const class CombineFlagResults &action);
 			void writeCutAreaAction(const class CutAreaAction &action);
 			void writeDirectionalCleanAction(const class DirectionalCleanAction &action);
@@ -13,6 +13,7 @@ namespace rfiStrategy
 	class ImageSet;
 	class ImageSetIndex;
 	class IterationBlock;
+	class IterationCache;
 	class MSImageSet;
 	class Strategy;
 
@@ -64,7 +65,8 @@ class Observatorium;
 // 3.5 : Added the AbsThresholdAction
 // 3.6 : Added the DirectionProfileAction and the EigenValueVerticalAction.
 // 3.7 : Added the NormalizeVarianceAction
-#define STRATEGY_FILE_FORMAT_VERSION 3.7
+// 3.8 : Added the CoarseScreeningAction
+#define STRATEGY_FILE_FORMAT_VERSION 3.8
 
 // The earliest format version which can be read by this version of the software
 #define STRATEGY_FILE_FORMAT_VERSION_REQUIRED 3.4
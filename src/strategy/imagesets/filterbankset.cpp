@@ -3,7 +3,13 @@
 #include "../../structures/date.h"
 #include "../../structures/system.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <limits>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
 
 namespace rfiStrategy {
 
@@ -59,6 +65,14 @@ FilterBankSet::FilterBankSet(const std::string &location) :
 			readInt(file);
 	}
 	_headerEnd = file.tellg();
+	if(_bitCount != 1 && _bitCount != 2 && _bitCount != 4 && _bitCount != 8 && _bitCount != 16 && _bitCount != 32)
+	{
+		std::ostringstream str;
+		str << "Filterbank file has " << _bitCount << " bits per sample: only 1, 2, 4, 8, 16 and 32 bits are supported";
+		throw std::runtime_error(str.str());
+	}
+	if(_channelCount == 0 || (_channelCount * _bitCount) % 8 != 0)
+		throw std::runtime_error("Filterbank file has a number of channels that does not fill a whole number of bytes per spectrum");
 	if(_sampleCount == 0)
 	{
 		file.seekg(0, std::ios::end);
@@ -73,12 +87,34 @@ FilterBankSet::FilterBankSet(const std::string &location) :
 	
 	_timeStart = Date::MJDToAipsMJD(_timeStart);
 	
-	double sizeOfImage = double(_channelCount) * _sampleCount * _bitCount / 8.0;
+	calculateIntervalCount(1);
+}
+
+void FilterBankSet::SetThreadCount(size_t threadCount)
+{
+	calculateIntervalCount(threadCount);
+}
+
+void FilterBankSet::calculateIntervalCount(size_t threadCount)
+{
+	if(threadCount < 1) threadCount = 1;
+	// Every thread holds an interval, so all of them together should fit. Samples are
+	// converted to floats, so the image can be larger than the file.
+	double sizeOfImage = double(_channelCount) * _sampleCount * sizeof(float);
 	double memSize = System::TotalMemory();
-	_intervalCount = ceil(sizeOfImage / (memSize / 16.0));
-	if(_intervalCount < 1) _intervalCount = 1;
+	_intervalCount = ceil(sizeOfImage * threadCount / (memSize / 16.0));
+	if(_intervalCount < threadCount) _intervalCount = threadCount;
 	if(_intervalCount*8 > _sampleCount) _intervalCount = _sampleCount/8;
-	AOLogger::Debug << round(sizeOfImage*1e-8)*0.1 << " GB/image required of total of " << round(memSize*1e-8)*0.1 << " GB of mem, splitting in " << _intervalCount << " intervals\n";
+	if(_intervalCount < 1) _intervalCount = 1;
+	AOLogger::Debug << round(sizeOfImage*1e-8)*0.1 << " GB/image required of total of " << round(memSize*1e-8)*0.1 << " GB of mem, splitting in " << _intervalCount << " intervals for " << threadCount << " thread(s)\n";
+}
+
+size_t FilterBankSet::blockSize() const
+{
+	// About 8 MB per file operation, and a multiple of four time steps, so
+	// that the transpose can store aligned
+	size_t timeSteps = ((8*1024*1024) / (_channelCount * sizeof(float))) & ~size_t(3);
+	return timeSteps < 4 ? 4 : timeSteps;
 }
 
 void FilterBankSet::AddReadRequest(const ImageSetIndex& index)
@@ -88,9 +124,6 @@ void FilterBankSet::AddReadRequest(const ImageSetIndex& index)
 
 BaselineData* FilterBankSet::GetNextRequested()
 {
-	if(_bitCount != 32)
-		throw std::runtime_error("Only support for 32-bit filterbank sets has been added as of yet");
-	
 	BaselineData* baseline = _requests.front();
 	_requests.pop_front();
 	const size_t intervalIndex = reinterpret_cast<const FilterBankSetIndex&>(baseline->Index())._intervalIndex;
@@ -99,20 +132,20 @@ BaselineData* FilterBankSet::GetNextRequested()
 		startIndex = (_sampleCount * intervalIndex) / _intervalCount,
 		endIndex = (_sampleCount * (intervalIndex+1)) / _intervalCount;
 	
-	std::ifstream file(_location.c_str());
-	file.seekg(_headerEnd + std::streampos(startIndex * sizeof(float) * _channelCount));
+	std::ifstream file(_location.c_str(), std::ios::in | std::ios::binary);
+	file.seekg(_headerEnd + std::streampos(startIndex * spectrumSize()));
 	
 	Image2DPtr image = Image2D::CreateUnsetImagePtr(endIndex - startIndex, _channelCount);
 	Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(endIndex - startIndex, _channelCount);
-	std::vector<float> buffer(_channelCount);
-	for(size_t x=0; x!=endIndex - startIndex; ++x)
+	const size_t blockTimeSteps = blockSize();
+	std::vector<char> buffer(std::min(blockTimeSteps, endIndex - startIndex) * spectrumSize());
+	for(size_t x=0; x < endIndex - startIndex; x += blockTimeSteps)
 	{
-		file.read(reinterpret_cast<char*>(&buffer[0]), _channelCount*sizeof(float));
-		for(size_t y=0; y!=_channelCount; ++y)
-		{
-			image->SetValue(x, y, buffer[y]);
-			mask->SetValue(x, y, !std::isfinite(buffer[y]));
-		}
+		const size_t timeCount = std::min(blockTimeSteps, endIndex - startIndex - x);
+		file.read(&buffer[0], timeCount*spectrumSize());
+		if(file.fail())
+			throw std::runtime_error(std::string("Error reading filterbank file ") + _location);
+		unpackBlock(&buffer[0], timeCount, x, *image, *mask);
 	}
 	TimeFrequencyData tfData(TimeFrequencyData::AmplitudePart, StokesIPolarisation, image);
 	tfData.SetGlobalMask(mask);
@@ -153,31 +186,253 @@ BaselineData* FilterBankSet::GetNextRequested()
 
 void FilterBankSet::AddWriteFlagsTask(const ImageSetIndex& index, std::vector<Mask2DCPtr>& flags)
 {
-	if(_bitCount != 32)
-		throw std::runtime_error("Only support for 32-bit filterbank sets has been added as of yet");
-	
 	const size_t intervalIndex = reinterpret_cast<const FilterBankSetIndex&>(index)._intervalIndex;
 	
 	const size_t
 		startIndex = (_sampleCount * intervalIndex) / _intervalCount,
 		endIndex = (_sampleCount * (intervalIndex+1)) / _intervalCount;
 	
-	std::fstream file(_location.c_str());
-	file.seekg(_headerEnd + std::streampos(startIndex * sizeof(float) * _channelCount));
+	std::fstream file(_location.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	file.seekg(_headerEnd + std::streampos(startIndex * spectrumSize()));
 	
-	std::vector<float> buffer(_channelCount);
-	for(size_t x=0; x!=endIndex - startIndex; ++x)
+	const size_t blockTimeSteps = blockSize();
+	std::vector<char> buffer(std::min(blockTimeSteps, endIndex - startIndex) * spectrumSize());
+	for(size_t x=0; x < endIndex - startIndex; x += blockTimeSteps)
 	{
+		const size_t timeCount = std::min(blockTimeSteps, endIndex - startIndex - x);
+		const size_t byteCount = timeCount*spectrumSize();
 		std::streampos pos = file.tellg();
-		file.read(reinterpret_cast<char*>(&buffer[0]), _channelCount*sizeof(float));
-		for(size_t y=0; y!=_channelCount; ++y)
+		file.read(&buffer[0], byteCount);
+		if(file.fail())
+			throw std::runtime_error(std::string("Error reading filterbank file ") + _location);
+		if(flagBlock(&buffer[0], timeCount, x, *flags[0]))
+		{
+			file.seekp(pos);
+			file.write(&buffer[0], byteCount);
+			if(file.fail())
+				throw std::runtime_error(std::string("Error writing flags to filterbank file ") + _location);
+			file.seekg(pos + std::streampos(byteCount));
+		}
+	}
+}
+
+/**
+ * Readers for the sample formats. Load4() converts four consecutive channels of a spectrum,
+ * starting at a multiple of four, and Load() converts a single channel.
+ */
+struct FloatSamples
+{
+	static __m128 Load4(const char *spectrum, size_t channel)
+	{
+		return _mm_loadu_ps(reinterpret_cast<const float*>(spectrum) + channel);
+	}
+	static float Load(const char *spectrum, size_t channel)
+	{
+		return reinterpret_cast<const float*>(spectrum)[channel];
+	}
+};
+
+struct ByteSamples
+{
+	static __m128 Load4(const char *spectrum, size_t channel)
+	{
+		int32_t bytes;
+		memcpy(&bytes, spectrum + channel, sizeof(int32_t));
+		const __m128i zero = _mm_setzero_si128();
+		__m128i values = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+	}
+	static float Load(const char *spectrum, size_t channel)
+	{
+		return reinterpret_cast<const unsigned char*>(spectrum)[channel];
+	}
+};
+
+struct ShortSamples
+{
+	static __m128 Load4(const char *spectrum, size_t channel)
+	{
+		__m128i values = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(spectrum + channel*2));
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, _mm_setzero_si128()));
+	}
+	static float Load(const char *spectrum, size_t channel)
+	{
+		uint16_t value;
+		memcpy(&value, spectrum + channel*2, sizeof(uint16_t));
+		return value;
+	}
+};
+
+/**
+ * Samples of 1, 2 or 4 bits, packed with the first channel in the lowest bits, like sigproc does.
+ */
+template<unsigned Bits>
+struct PackedSamples
+{
+	static __m128 Load4(const char *spectrum, size_t channel)
+	{
+		// Four samples take at most two bytes, and never cross the end of the spectrum
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>(spectrum) + channel*Bits/8;
+		unsigned word = bytes[0];
+		if(Bits == 4)
+			word |= unsigned(bytes[1]) << 8;
+		word >>= (channel*Bits) % 8;
+		const unsigned mask = (1u << Bits) - 1;
+		__m128i values = _mm_set_epi32((word >> (3*Bits)) & mask, (word >> (2*Bits)) & mask, (word >> Bits) & mask, word & mask);
+		return _mm_cvtepi32_ps(values);
+	}
+	static float Load(const char *spectrum, size_t channel)
+	{
+		const unsigned char byte = reinterpret_cast<const unsigned char*>(spectrum)[channel*Bits/8];
+		return (byte >> ((channel*Bits) % 8)) & ((1u << Bits) - 1);
+	}
+};
+
+/**
+ * Stores four time steps of a channel, and sets the mask for the values that are not finite.
+ * Subtracting a finite value from itself gives zero, while it gives NaN for NaN and infinity.
+ */
+static inline void storeTransposed(__m128 values, __m128 zero4, float *imagePtr, bool *maskPtr)
+{
+	_mm_store_ps(imagePtr, values);
+	const int isFinite = _mm_movemask_ps(_mm_cmpeq_ps(_mm_sub_ps(values, values), zero4));
+	maskPtr[0] = (isFinite & 1) == 0;
+	maskPtr[1] = (isFinite & 2) == 0;
+	maskPtr[2] = (isFinite & 4) == 0;
+	maskPtr[3] = (isFinite & 8) == 0;
+}
+
+template<typename Samples>
+void FilterBankSet::transposeBlock(const char *block, size_t spectrumSize, size_t timeCount, size_t channelCount, size_t xStart, Image2D &image, Mask2D &mask)
+{
+	const size_t
+		timeCount4 = timeCount & ~size_t(3),
+		channelCount4 = channelCount & ~size_t(3);
+	const __m128 zero4 = _mm_setzero_ps();
+	// Transposes tiles of 4x4 samples, going through the channels in bands, such that
+	// the rows that are written to stay in cache while going through the time steps.
+	const size_t bandHeight = 64;
+	for(size_t bandStart=0; bandStart<channelCount4; bandStart+=bandHeight)
+	{
+		const size_t bandEnd = std::min(bandStart + bandHeight, channelCount4);
+		for(size_t t=0; t!=timeCount4; t+=4)
 		{
-			if(flags[0]->Value(x, y))
-				buffer[y] = std::numeric_limits<float>::quiet_NaN();
+			const char *spectrum = &block[t*spectrumSize];
+			for(size_t y=bandStart; y!=bandEnd; y+=4)
+			{
+				__m128
+					row0 = Samples::Load4(spectrum, y),
+					row1 = Samples::Load4(spectrum + spectrumSize, y),
+					row2 = Samples::Load4(spectrum + 2*spectrumSize, y),
+					row3 = Samples::Load4(spectrum + 3*spectrumSize, y);
+				_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+				storeTransposed(row0, zero4, image.ValuePtr(xStart+t, y), mask.ValuePtr(xStart+t, y));
+				storeTransposed(row1, zero4, image.ValuePtr(xStart+t, y+1), mask.ValuePtr(xStart+t, y+1));
+				storeTransposed(row2, zero4, image.ValuePtr(xStart+t, y+2), mask.ValuePtr(xStart+t, y+2));
+				storeTransposed(row3, zero4, image.ValuePtr(xStart+t, y+3), mask.ValuePtr(xStart+t, y+3));
+			}
+		}
+	}
+	// Remaining channels and time steps
+	for(size_t y=channelCount4; y!=channelCount; ++y)
+	{
+		for(size_t t=0; t!=timeCount; ++t)
+		{
+			const float value = Samples::Load(&block[t*spectrumSize], y);
+			image.SetValue(xStart+t, y, value);
+			mask.SetValue(xStart+t, y, !std::isfinite(value));
+		}
+	}
+	for(size_t y=0; y!=channelCount4; ++y)
+	{
+		for(size_t t=timeCount4; t!=timeCount; ++t)
+		{
+			const float value = Samples::Load(&block[t*spectrumSize], y);
+			image.SetValue(xStart+t, y, value);
+			mask.SetValue(xStart+t, y, !std::isfinite(value));
+		}
+	}
+}
+
+void FilterBankSet::unpackBlock(const char *block, size_t timeCount, size_t xStart, Image2D &image, Mask2D &mask) const
+{
+	switch(_bitCount)
+	{
+		case 1: transposeBlock<PackedSamples<1> >(block, spectrumSize(), timeCount, _channelCount, xStart, image, mask); break;
+		case 2: transposeBlock<PackedSamples<2> >(block, spectrumSize(), timeCount, _channelCount, xStart, image, mask); break;
+		case 4: transposeBlock<PackedSamples<4> >(block, spectrumSize(), timeCount, _channelCount, xStart, image, mask); break;
+		case 8: transposeBlock<ByteSamples>(block, spectrumSize(), timeCount, _channelCount, xStart, image, mask); break;
+		case 16: transposeBlock<ShortSamples>(block, spectrumSize(), timeCount, _channelCount, xStart, image, mask); break;
+		default: transposeBlock<FloatSamples>(block, spectrumSize(), timeCount, _channelCount, xStart, image, mask); break;
+	}
+}
+
+unsigned FilterBankSet::readSample(const char *spectrum, size_t channel) const
+{
+	switch(_bitCount)
+	{
+		case 1: return PackedSamples<1>::Load(spectrum, channel);
+		case 2: return PackedSamples<2>::Load(spectrum, channel);
+		case 4: return PackedSamples<4>::Load(spectrum, channel);
+		case 8: return ByteSamples::Load(spectrum, channel);
+		default: return ShortSamples::Load(spectrum, channel);
+	}
+}
+
+void FilterBankSet::writeSample(char *spectrum, size_t channel, unsigned value) const
+{
+	if(_bitCount == 16)
+	{
+		const uint16_t shortValue = value;
+		memcpy(spectrum + channel*2, &shortValue, sizeof(uint16_t));
+	}
+	else {
+		unsigned char &byte = reinterpret_cast<unsigned char*>(spectrum)[channel*_bitCount/8];
+		const unsigned
+			shift = (channel*_bitCount) % 8,
+			mask = ((1u << _bitCount) - 1) << shift;
+		byte = (byte & ~mask) | ((value << shift) & mask);
+	}
+}
+
+bool FilterBankSet::flagBlock(char *block, size_t timeCount, size_t xStart, const Mask2D &mask) const
+{
+	bool isChanged = false;
+	for(size_t y=0; y!=_channelCount; ++y)
+	{
+		const bool *maskRow = mask.ValuePtr(xStart, y);
+		if(memchr(maskRow, true, timeCount) == 0)
+			continue;
+		isChanged = true;
+		if(_bitCount == 32)
+		{
+			for(size_t t=0; t!=timeCount; ++t)
+			{
+				if(maskRow[t])
+					reinterpret_cast<float*>(&block[t*spectrumSize()])[y] = std::numeric_limits<float>::quiet_NaN();
+			}
+		}
+		else {
+			// Integer samples can not be NaN: replace them by the average of the unflagged
+			// samples of the channel in this block.
+			size_t sum = 0, count = 0;
+			for(size_t t=0; t!=timeCount; ++t)
+			{
+				if(!maskRow[t])
+				{
+					sum += readSample(&block[t*spectrumSize()], y);
+					++count;
+				}
+			}
+			const unsigned replacement = count == 0 ? 0 : (sum + count/2) / count;
+			for(size_t t=0; t!=timeCount; ++t)
+			{
+				if(maskRow[t])
+					writeSample(&block[t*spectrumSize()], y, replacement);
+			}
 		}
-		file.seekp(pos);
-		file.write(reinterpret_cast<char*>(&buffer[0]), _channelCount*sizeof(float));
 	}
+	return isChanged;
 }
 
 void FilterBankSet::Initialize()
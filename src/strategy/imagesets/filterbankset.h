@@ -82,8 +82,47 @@ namespace rfiStrategy {
 			{
 				return _timeOfSample;
 			}
+			
+			/**
+			 * Recalculates the intervals in which the set is split, such that @p threadCount
+			 * intervals fit in memory together and every thread has at least one interval
+			 * to flag. This should be called before iterating over the set.
+			 */
+			void SetThreadCount(size_t threadCount);
 		private:
 			friend class FilterBankSetIndex;
+			
+			void calculateIntervalCount(size_t threadCount);
+			
+			/**
+			 * Number of time steps that are read or written at once.
+			 */
+			size_t blockSize() const;
+			
+			/**
+			 * Number of bytes of one time step in the file.
+			 */
+			size_t spectrumSize() const { return _channelCount * _bitCount / 8; }
+			
+			/**
+			 * Converts a block of spectra as stored in the file into the columns of
+			 * an image that start at @p xStart, and flags the values that are not finite.
+			 */
+			void unpackBlock(const char *block, size_t timeCount, size_t xStart, Image2D &image, Mask2D &mask) const;
+			
+			template<typename Samples>
+			static void transposeBlock(const char *block, size_t spectrumSize, size_t timeCount, size_t channelCount, size_t xStart, Image2D &image, Mask2D &mask);
+			
+			/**
+			 * Replaces the samples of a block of spectra that are flagged in @p mask. Float
+			 * samples are set to NaN; integer samples are set to the average of the unflagged
+			 * samples of their channel in the block, in the bit depth of the file.
+			 * @returns Whether any sample was flagged.
+			 */
+			bool flagBlock(char *block, size_t timeCount, size_t xStart, const Mask2D &mask) const;
+			
+			unsigned readSample(const char *spectrum, size_t channel) const;
+			void writeSample(char *spectrum, size_t channel, unsigned value) const;
 			std::string _location;
 			
 			double _timeOfSample, _timeStart, _fch1, _foff;
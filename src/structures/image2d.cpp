@@ -16,7 +16,9 @@
 Image2D::Image2D(size_t width, size_t height) :
 	_width(width),
 	_height(height),
-	_stride((((width-1)/4)+1)*4)
+	_stride((((width-1)/4)+1)*4),
+	_ownsData(true),
+	_paddingRows(0)
 {
 	if(_width == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
@@ -54,7 +56,9 @@ Image2D::Image2D(size_t width, size_t height) :
 Image2D::Image2D(size_t width, size_t height, size_t widthCapacity) :
 	_width(width),
 	_height(height),
-	_stride((((widthCapacity-1)/4)+1)*4)
+	_stride((((widthCapacity-1)/4)+1)*4),
+	_ownsData(true),
+	_paddingRows(0)
 {
 	if(widthCapacity == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
@@ -89,10 +93,48 @@ Image2D::Image2D(size_t width, size_t height, size_t widthCapacity) :
 	}
 }
 
+Image2D::Image2D(num_t *buffer, size_t width, size_t height, size_t stride) :
+	_width(width),
+	_height(height),
+	_stride(stride),
+	_dataConsecutive(buffer),
+	_ownsData(false),
+	_paddingRows(0)
+{
+	if(stride < width || stride % 4 != 0)
+		throw BadUsageException("The stride of an image buffer should be a multiple of four and at least the width");
+	if(reinterpret_cast<size_t>(buffer) % 16 != 0)
+		throw BadUsageException("An image buffer should be aligned to 16 bytes");
+	unsigned allocHeight = ((((height-1)/4)+1)*4);
+	if(height == 0) allocHeight = 0;
+	_dataPtr = new num_t*[allocHeight];
+	for(size_t y=0;y<height;++y)
+		_dataPtr[y] = &_dataConsecutive[_stride * y];
+	// The rows after the requested height are read by some SSE algorithms. They are not part
+	// of the buffer, so they are allocated here (and initialized to zero, as above).
+	if(allocHeight != height)
+	{
+#ifdef __APPLE__
+		_paddingRows = (num_t*)malloc(_stride * (allocHeight - height) * sizeof(num_t));
+#else
+		if(posix_memalign((void **) &_paddingRows, 16, _stride * (allocHeight - height) * sizeof(num_t)) != 0)
+			throw std::bad_alloc();
+#endif
+		for(size_t y=height;y<allocHeight;++y)
+		{
+			_dataPtr[y] = &_paddingRows[_stride * (y - height)];
+			for(size_t x=0;x<_stride;++x)
+				_dataPtr[y][x] = 0.0;
+		}
+	}
+}
+
 Image2D::~Image2D()
 {
 	delete[] _dataPtr;
-	free(_dataConsecutive);
+	if(_ownsData)
+		free(_dataConsecutive);
+	free(_paddingRows);
 }
 
 Image2D *Image2D::CreateSetImage(size_t width, size_t height, num_t initialValue) 
@@ -121,9 +163,14 @@ Image2D *Image2D::CreateFromSum(const Image2D &imageA, const Image2D &imageB)
 	if(imageA.Width() != imageB.Width() || imageA.Height() != imageB.Height())
 		throw IOException("Images do not match in size");
 	Image2D *image = new Image2D(imageA.Width(), imageA.Height());
-	const size_t total = imageA._stride * imageA.Height();
-	for(size_t i=0;i<total;++i) {
-		image->_dataConsecutive[i] = imageA._dataConsecutive[i] + imageB._dataConsecutive[i];
+	// The strides of the images can differ, but each is at least the stride of the new image
+	for(size_t y=0;y<image->_height;++y)
+	{
+		const float *lhsPtr = imageA._dataPtr[y];
+		const float *rhsPtr = imageB._dataPtr[y];
+		float *destPtr = image->_dataPtr[y];
+		for(size_t x=0;x<image->_stride;++x)
+			destPtr[x] = lhsPtr[x] + rhsPtr[x];
 	}
 	return image;
 }
@@ -133,17 +180,20 @@ Image2D *Image2D::CreateFromDiff(const Image2D &imageA, const Image2D &imageB)
 	if(imageA.Width() != imageB.Width() || imageA.Height() != imageB.Height())
 		throw IOException("Images do not match in size");
 	Image2D *image = new Image2D(imageA.Width(), imageA.Height());
-	const float *lhsPtr = &(imageA._dataConsecutive[0]);
-	const float *rhsPtr = &(imageB._dataConsecutive[0]);
-	float *destPtr = &(image->_dataConsecutive[0]);
-	const float *end = lhsPtr + imageA._stride * imageA._height;
-	while(lhsPtr < end)
+	for(size_t y=0;y<image->_height;++y)
 	{
-		// (*destPtr) = (*lhsPtr) - (*rhsPtr);
-		_mm_store_ps(destPtr, _mm_sub_ps(_mm_load_ps(lhsPtr), _mm_load_ps(rhsPtr)));
-		lhsPtr += 4;
-		rhsPtr += 4;
-		destPtr += 4;
+		const float *lhsPtr = imageA._dataPtr[y];
+		const float *rhsPtr = imageB._dataPtr[y];
+		float *destPtr = image->_dataPtr[y];
+		const float *end = destPtr + image->_stride;
+		while(destPtr < end)
+		{
+			// (*destPtr) = (*lhsPtr) - (*rhsPtr);
+			_mm_store_ps(destPtr, _mm_sub_ps(_mm_load_ps(lhsPtr), _mm_load_ps(rhsPtr)));
+			lhsPtr += 4;
+			rhsPtr += 4;
+			destPtr += 4;
+		}
 	}
 	return image;
 }
@@ -151,17 +201,17 @@ Image2D *Image2D::CreateFromDiff(const Image2D &imageA, const Image2D &imageB)
 Image2D *Image2D::CreateCopy(const Image2D &image)
 {
 	const size_t width = image.Width(), height = image.Height();
-	Image2D *newImage = new Image2D(width, height);
+	// Use the same stride, so that the data can be copied at once
+	Image2D *newImage = new Image2D(width, height, image._stride);
 	memcpy(newImage->_dataConsecutive, image._dataConsecutive, image._stride * height * sizeof(num_t));
 	return newImage;
 }
 
 void Image2D::SetValues(const Image2D &source)
 {
-	const size_t size = _stride*_height;
-	for(size_t i=0;i<size;++i) {
-		_dataConsecutive[i] = source._dataConsecutive[i];
-	}
+	const size_t rowSize = std::min(_stride, source._stride);
+	for(size_t y=0;y<_height;++y)
+		memcpy(_dataPtr[y], source._dataPtr[y], rowSize * sizeof(num_t));
 }
 
 void Image2D::SetAll(num_t value)
@@ -437,49 +487,64 @@ void Image2D::MultiplyValues(num_t factor)
 
 void Image2D::SubtractAsRHS(const Image2DCPtr &lhs)
 {
-	float *thisPtr = &_dataConsecutive[0];
-	const float *otherPtr = &(lhs->_dataConsecutive[0]);
-	float *end = thisPtr + _stride * _height;
-/* #ifdef __AVX__
-	while(thisPtr < end)
-	{
-		// (*thisPtr) = (*otherPtr) - (*thisPtr);
-		_mm_store256_ps(thisPtr, _mm_sub256_ps(_mm_load256_ps(otherPtr), _mm_load256_ps(thisPtr)));
-		thisPtr += 8;
-		otherPtr += 8;
-	}
-#else // Use slower SSE instructions
-*/
-	while(thisPtr < end)
+	const size_t rowSize = std::min(_stride, lhs->_stride);
+	for(size_t y=0;y<_height;++y)
 	{
-		// (*thisPtr) = (*otherPtr) - (*thisPtr);
-		_mm_store_ps(thisPtr, _mm_sub_ps(_mm_load_ps(otherPtr), _mm_load_ps(thisPtr)));
-		thisPtr += 4;
-		otherPtr += 4;
+		float *thisPtr = _dataPtr[y];
+		const float *otherPtr = lhs->_dataPtr[y];
+		float *end = thisPtr + rowSize;
+		while(thisPtr < end)
+		{
+			// (*thisPtr) = (*otherPtr) - (*thisPtr);
+			_mm_store_ps(thisPtr, _mm_sub_ps(_mm_load_ps(otherPtr), _mm_load_ps(thisPtr)));
+			thisPtr += 4;
+			otherPtr += 4;
+		}
 	}
 }
 
 Image2DPtr Image2D::ShrinkHorizontally(size_t factor) const
 {
-	size_t newWidth = (_width + factor - 1) / factor;
+	const size_t
+		newWidth = (_width + factor - 1) / factor,
+		fullBins = _width / factor,
+		lastBinSize = _width - fullBins * factor;
 
 	Image2D *newImage = new Image2D(newWidth, _height);
 
-	for(size_t x=0;x<newWidth;++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
-
-		for(size_t y=0;y<_height;++y)
+		const num_t *inputRow = _dataPtr[y];
+		num_t *outputRow = newImage->_dataPtr[y];
+		// Each SSE lane sums one bin, in the same order as the scalar loop below, so that
+		// both give the same results.
+		const __m128 factor4 = _mm_set1_ps((num_t) factor);
+		size_t x = 0;
+		for(;x+4<=fullBins;x+=4)
 		{
-			num_t sum = 0.0;
-			for(size_t binX=0;binX<binSize;++binX)
+			const num_t *input = &inputRow[x * factor];
+			__m128 sum = _mm_setzero_ps();
+			for(size_t binX=0;binX<factor;++binX)
 			{
-				size_t curX = x*factor + binX;
-				sum += Value(curX, y);
+				sum = _mm_add_ps(sum, _mm_set_ps(input[binX + 3*factor], input[binX + 2*factor], input[binX + factor], input[binX]));
 			}
-			newImage->SetValue(x, y, sum / (num_t) binSize);
+			_mm_store_ps(&outputRow[x], _mm_div_ps(sum, factor4));
+		}
+		for(;x<fullBins;++x)
+		{
+			const num_t *input = &inputRow[x * factor];
+			num_t sum = 0.0;
+			for(size_t binX=0;binX<factor;++binX)
+				sum += input[binX];
+			outputRow[x] = sum / (num_t) factor;
+		}
+		if(lastBinSize != 0)
+		{
+			const num_t *input = &inputRow[fullBins * factor];
+			num_t sum = 0.0;
+			for(size_t binX=0;binX<lastBinSize;++binX)
+				sum += input[binX];
+			outputRow[fullBins] = sum / (num_t) lastBinSize;
 		}
 	}
 	return Image2DPtr(newImage);
@@ -496,16 +561,17 @@ Image2DPtr Image2D::ShrinkVertically(size_t factor) const
 		size_t binSize = factor;
 		if(binSize + y*factor > _height)
 			binSize = _height - y*factor;
+		const __m128 binSize4 = _mm_set1_ps((num_t) binSize);
 
-		for(size_t x=0;x<_width;++x)
+		// Rows are aligned and padded to a multiple of four, so the full stride of the new image
+		// can be processed. The stride of this image can be larger, but not smaller.
+		num_t *outputRow = newImage->_dataPtr[y];
+		for(size_t x=0;x<newImage->_stride;x+=4)
 		{
-			num_t sum = 0.0;
+			__m128 sum = _mm_setzero_ps();
 			for(size_t binY=0;binY<binSize;++binY)
-			{
-				size_t curY = y*factor + binY;
-				sum += Value(x, curY);
-			}
-			newImage->SetValue(x, y, sum / (num_t) binSize);
+				sum = _mm_add_ps(sum, _mm_load_ps(&_dataPtr[y*factor + binY][x]));
+			_mm_store_ps(&outputRow[x], _mm_div_ps(sum, binSize4));
 		}
 	}
 	return Image2DPtr(newImage);
@@ -515,13 +581,17 @@ Image2DPtr Image2D::EnlargeHorizontally(size_t factor, size_t newWidth) const
 {
 	Image2D *newImage = new Image2D(newWidth, _height);
 
-	for(size_t x=0;x<newWidth;++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t xOld = x / factor;
-
-		for(size_t y=0;y<_height;++y)
+		const num_t *inputRow = _dataPtr[y];
+		num_t *outputRow = newImage->_dataPtr[y];
+		size_t x = 0;
+		for(size_t xOld=0;x<newWidth;++xOld)
 		{
-			newImage->SetValue(x, y, Value(xOld, y));
+			const size_t binEnd = std::min(x + factor, newWidth);
+			const num_t value = inputRow[xOld];
+			for(;x<binEnd;++x)
+				outputRow[x] = value;
 		}
 	}
 	return Image2DPtr(newImage);
@@ -531,14 +601,8 @@ Image2DPtr Image2D::EnlargeVertically(size_t factor, size_t newHeight) const
 {
 	Image2D *newImage = new Image2D(_width, newHeight);
 
-	for(size_t x=0;x<_width;++x)
-	{
-		for(size_t y=0;y<newHeight;++y)
-		{
-			size_t yOld = y / factor;
-			newImage->SetValue(x, y, Value(x, yOld));
-		}
-	}
+	for(size_t y=0;y<newHeight;++y)
+		memcpy(newImage->_dataPtr[y], _dataPtr[y / factor], newImage->_stride * sizeof(num_t));
 	return Image2DPtr(newImage);
 }
 
@@ -565,11 +629,7 @@ Image2DPtr Image2D::Trim(size_t startX, size_t startY, size_t endX, size_t endY)
 void Image2D::SetTrim(size_t startX, size_t startY, size_t endX, size_t endY)
 {
 	Image2DPtr trimmed = Trim(startX, startY, endX, endY);
-	std::swap(trimmed->_dataConsecutive, _dataConsecutive);
-	std::swap(trimmed->_dataPtr, _dataPtr);
-	std::swap(trimmed->_height, _height);
-	std::swap(trimmed->_width, _width);
-	std::swap(trimmed->_stride, _stride);
+	Swap(*trimmed);
 }
 
 /**
@@ -48,6 +48,23 @@ class Image2D {
 			return new Image2D(width, height, widthCapacity);
 		}
 		
+		/**
+		 * Creates an image that uses the given buffer for its values, without copying it. The
+		 * buffer is not freed when the image is destructed; it should stay valid as long as the
+		 * image exists.
+		 * @param buffer Buffer of @p height rows of @p stride values. It should be aligned
+		 * to 16 bytes, because the rows are processed with SSE instructions.
+		 * @param width Width of the new image.
+		 * @param height Height of the new image.
+		 * @param stride Distance in values between the starts of two rows; should be a
+		 * multiple of four and at least @p width.
+		 * @return The new image. Should be deleted by the caller.
+		 */
+		static Image2D *CreateFromBuffer(num_t *buffer, size_t width, size_t height, size_t stride)
+		{
+			return new Image2D(buffer, width, height, stride);
+		}
+		
 		/**
 		 * As CreateUnsetImage(size_t,size_t), but returns a smart pointer instead.
 		 * @param width Width of the new image.
@@ -69,7 +86,7 @@ class Image2D {
 		 */
 		static Image2DPtr CreateUnsetImagePtr(size_t width, size_t height, size_t widthCapacity)
 		{
-			return Image2DPtr(CreateUnsetImage(width, height));
+			return Image2DPtr(CreateUnsetImage(width, height, widthCapacity));
 		}
 		
 		static Image2D *CreateSetImage(size_t width, size_t height, num_t initialValue);
@@ -367,6 +384,8 @@ class Image2D {
 			std::swap(source._height, _height);
 			std::swap(source._dataPtr, _dataPtr);
 			std::swap(source._dataConsecutive, _dataConsecutive);
+			std::swap(source._ownsData, _ownsData);
+			std::swap(source._paddingRows, _paddingRows);
 		}
 		
 		/**
@@ -494,10 +513,17 @@ class Image2D {
 	private:
 		Image2D(size_t width, size_t height);
 		Image2D(size_t width, size_t height, size_t widthCapacity);
+		Image2D(num_t *buffer, size_t width, size_t height, size_t stride);
 		
 		size_t _width, _height;
 		size_t _stride;
 		num_t **_dataPtr, *_dataConsecutive;
+		/**
+		 * False when _dataConsecutive is an external buffer. The rows up to the allocated height,
+		 * which is a multiple of four, are then stored in _paddingRows.
+		 */
+		bool _ownsData;
+		num_t *_paddingRows;
 };
 
 #endif
@@ -6,7 +6,9 @@
 Mask2D::Mask2D(size_t width, size_t height) :
 	_width(width),
 	_height(height),
-	_stride((((width-1)/4)+1)*4)
+	_stride((((width-1)/4)+1)*4),
+	_ownsValues(true),
+	_paddingRows(0)
 {
 	if(_width == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
@@ -36,10 +38,41 @@ Mask2D::Mask2D(size_t width, size_t height) :
 	}
 }
 
+Mask2D::Mask2D(bool *buffer, size_t width, size_t height, size_t stride) :
+	_width(width),
+	_height(height),
+	_stride(stride),
+	_valuesConsecutive(buffer),
+	_ownsValues(false),
+	_paddingRows(0)
+{
+	if(stride < width || stride % 4 != 0)
+		throw BadUsageException("The stride of a mask buffer should be a multiple of four and at least the width");
+	unsigned allocHeight = ((((height-1)/4)+1)*4);
+	if(height == 0) allocHeight = 0;
+	_values = new bool*[allocHeight];
+	for(size_t y=0;y<height;++y)
+		_values[y] = &_valuesConsecutive[_stride * y];
+	// The rows after the requested height are not part of the buffer
+	// (see remark above about initializing to true)
+	if(allocHeight != height)
+	{
+		_paddingRows = new bool[_stride * (allocHeight - height)];
+		for(size_t y=height;y<allocHeight;++y)
+		{
+			_values[y] = &_paddingRows[_stride * (y - height)];
+			for(size_t x=0;x<_stride;++x)
+				_values[y][x] = true;
+		}
+	}
+}
+
 Mask2D::~Mask2D()
 {
 	delete[] _values;
-	delete[] _valuesConsecutive;
+	if(_ownsValues)
+		delete[] _valuesConsecutive;
+	delete[] _paddingRows;
 }
 
 Mask2D *Mask2D::CreateUnsetMask(const Image2D &templateImage)
@@ -69,7 +102,7 @@ Mask2D *Mask2D::CreateCopy(const Mask2D &source)
 		height = source.Height();
 
 	Mask2D *newMask = new Mask2D(width, height);
-	memcpy(newMask->_valuesConsecutive, source._valuesConsecutive, source._stride * height * sizeof(bool));
+	*newMask = source;
 	return newMask;
 }
 
@@ -79,21 +112,17 @@ Mask2DPtr Mask2D::ShrinkHorizontally(int factor) const
 
 	Mask2D *newMask= new Mask2D(newWidth, _height);
 
-	for(size_t x=0;x<newWidth;++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
-
-		for(size_t y=0;y<_height;++y)
+		const bool *inputRow = _values[y];
+		bool *outputRow = newMask->_values[y];
+		for(size_t x=0;x<newWidth;++x)
 		{
-			bool value = false;
-			for(size_t binX=0;binX<binSize;++binX)
-			{
-				size_t curX = x*factor + binX;
-				value = value | Value(curX, y);
-			}
-			newMask->SetValue(x, y, value);
+			size_t binSize = factor;
+			if(binSize + x*factor > _width)
+				binSize = _width - x*factor;
+			// A bin is flagged if any of its samples is
+			outputRow[x] = memchr(&inputRow[x*factor], true, binSize) != 0;
 		}
 	}
 	return Mask2DPtr(newMask);
@@ -105,21 +134,17 @@ Mask2DPtr Mask2D::ShrinkHorizontallyForAveraging(int factor) const
 
 	Mask2D *newMask= new Mask2D(newWidth, _height);
 
-	for(size_t x=0;x<newWidth;++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
-
-		for(size_t y=0;y<_height;++y)
+		const bool *inputRow = _values[y];
+		bool *outputRow = newMask->_values[y];
+		for(size_t x=0;x<newWidth;++x)
 		{
-			bool value = true;
-			for(size_t binX=0;binX<binSize;++binX)
-			{
-				size_t curX = x*factor + binX;
-				value = value & Value(curX, y);
-			}
-			newMask->SetValue(x, y, value);
+			size_t binSize = factor;
+			if(binSize + x*factor > _width)
+				binSize = _width - x*factor;
+			// A bin is flagged only if all of its samples are
+			outputRow[x] = memchr(&inputRow[x*factor], false, binSize) == 0;
 		}
 	}
 	return Mask2DPtr(newMask);
@@ -137,15 +162,13 @@ Mask2DPtr Mask2D::ShrinkVertically(int factor) const
 		if(binSize + y*factor > _height)
 			binSize = _height - y*factor;
 
-		for(size_t x=0;x<_width;++x)
+		bool *outputRow = newMask->_values[y];
+		memcpy(outputRow, _values[y*factor], _width * sizeof(bool));
+		for(size_t binY=1;binY<binSize;++binY)
 		{
-			bool value = false;
-			for(size_t binY=0;binY<binSize;++binY)
-			{
-				size_t curY = y*factor + binY;
-				value = value | Value(x, curY);
-			}
-			newMask->SetValue(x, y, value);
+			const bool *inputRow = _values[y*factor + binY];
+			for(size_t x=0;x<_width;++x)
+				outputRow[x] |= inputRow[x];
 		}
 	}
 	return Mask2DPtr(newMask);
@@ -153,19 +176,16 @@ Mask2DPtr Mask2D::ShrinkVertically(int factor) const
 
 void Mask2D::EnlargeHorizontallyAndSet(Mask2DCPtr smallMask, int factor)
 {
-	for(size_t x=0;x<smallMask->Width();++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
-
-		for(size_t y=0;y<_height;++y)
+		const bool *inputRow = smallMask->_values[y];
+		bool *outputRow = _values[y];
+		for(size_t x=0;x<smallMask->Width();++x)
 		{
-			for(size_t binX=0;binX<binSize;++binX)
-			{
-				size_t curX = x*factor + binX;
-				SetValue(curX, y, smallMask->Value(x, y));
-			}
+			size_t binSize = factor;
+			if(binSize + x*factor > _width)
+				binSize = _width - x*factor;
+			memset(&outputRow[x*factor], inputRow[x], binSize * sizeof(bool));
 		}
 	}
 }
@@ -178,13 +198,7 @@ void Mask2D::EnlargeVerticallyAndSet(Mask2DCPtr smallMask, int factor)
 		if(binSize + y*factor > _height)
 			binSize = _height - y*factor;
 
-		for(size_t x=0;x<_width;++x)
-		{
-			for(size_t binY=0;binY<binSize;++binY)
-			{
-				size_t curY = y*factor + binY;
-				SetValue(x, curY, smallMask->Value(x, y));
-			}
-		}
+		for(size_t binY=0;binY<binSize;++binY)
+			memcpy(_values[y*factor + binY], smallMask->_values[y], _width * sizeof(bool));
 	}
 }
@@ -17,13 +17,18 @@ class Mask2D {
 		// This method assumes equal height and width.
 		void operator=(Mask2DCPtr source)
 		{
-			memcpy(_valuesConsecutive, source->_valuesConsecutive, _stride * _height * sizeof(bool));
+			*this = *source;
 		}
 
 		// This method assumes equal height and width.
 		void operator=(const Mask2D &source)
 		{
-			memcpy(_valuesConsecutive, source._valuesConsecutive, _stride * _height * sizeof(bool));
+			if(_stride == source._stride)
+				memcpy(_valuesConsecutive, source._valuesConsecutive, _stride * _height * sizeof(bool));
+			else {
+				for(size_t y=0;y<_height;++y)
+					memcpy(_values[y], source._values[y], _width * sizeof(bool));
+			}
 		}
 		
 		/**
@@ -37,6 +42,8 @@ class Mask2D {
 			std::swap(source._height, _height);
 			std::swap(source._values, _values);
 			std::swap(source._valuesConsecutive, _valuesConsecutive);
+			std::swap(source._ownsValues, _ownsValues);
+			std::swap(source._paddingRows, _paddingRows);
 		}
 
 		/**
@@ -57,6 +64,21 @@ class Mask2D {
 			return Mask2DPtr(new Mask2D(width, height));
 		}
 
+		/**
+		 * Creates a mask that uses the given buffer for its values, without copying it. The
+		 * buffer is not freed when the mask is destructed; it should stay valid as long as the
+		 * mask exists.
+		 * @param buffer Buffer of @p height rows of @p stride values.
+		 * @param width Width of the new mask.
+		 * @param height Height of the new mask.
+		 * @param stride Distance in values between the starts of two rows; should be a
+		 * multiple of four and at least @p width.
+		 */
+		static Mask2D *CreateFromBuffer(bool *buffer, size_t width, size_t height, size_t stride)
+		{
+			return new Mask2D(buffer, width, height, stride);
+		}
+		
 		static Mask2D *CreateUnsetMask(const class Image2D &templateImage);
 		static Mask2DPtr CreateUnsetMask(Image2DCPtr templateImage)
 		{
@@ -330,12 +352,19 @@ class Mask2D {
 		}
 	private:
 		Mask2D(size_t width, size_t height);
+		Mask2D(bool *buffer, size_t width, size_t height, size_t stride);
 
 		size_t _width, _height;
 		size_t _stride;
 		
 		bool **_values;
 		bool *_valuesConsecutive;
+		/**
+		 * False when _valuesConsecutive is an external buffer. The rows up to the allocated
+		 * height, which is a multiple of four, are then stored in _paddingRows.
+		 */
+		bool _ownsValues;
+		bool *_paddingRows;
 };
 
 #endif
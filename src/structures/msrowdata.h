@@ -91,6 +91,24 @@ class MSRowData : public Serializable
 			for(size_t i=0 ; i<size * 2; ++i)
 				_realData[i] = UnserializeFloat(stream);
 		}
+		/**
+		 * Change the number of polarizations and channels of this row. When the
+		 * total size changes, the data is reallocated and left uninitialized.
+		 */
+		void SetShape(unsigned polarizationCount, unsigned channelCount)
+		{
+			const size_t oldSize = _polarizationCount * _channelCount;
+			const size_t size = polarizationCount * channelCount;
+			_polarizationCount = polarizationCount;
+			_channelCount = channelCount;
+			if(oldSize != size)
+			{
+				delete[] _realData;
+				_realData = new num_t[size*2];
+				_imagData = &_realData[size];
+			}
+		}
+		
 		unsigned PolarizationCount() const { return _polarizationCount; }
 		unsigned ChannelCount() const { return _channelCount; }
 		const num_t *RealPtr() const { return _realData; }
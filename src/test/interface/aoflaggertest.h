@@ -0,0 +1,289 @@
+#ifndef AOFLAGGER_AOFLAGGERTEST_H
+#define AOFLAGGER_AOFLAGGERTEST_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../interface/aoflagger.h"
+
+#include "../../util/rng.h"
+
+class AOFlaggerTest : public UnitTest {
+	public:
+		AOFlaggerTest() : UnitTest("AOFlagger interface")
+		{
+			AddTest(TestWrappedBuffers(), "Flagging wrapped buffers with a wide stride");
+			AddTest(TestFlagStream(), "Flag stream with different chunk sizes");
+			AddTest(TestBatch(), "Flagging a batch of image sets");
+		}
+		
+	private:
+		struct TestWrappedBuffers : public Asserter
+		{
+			void operator()();
+		};
+		struct TestFlagStream : public Asserter
+		{
+			void operator()();
+		};
+		struct TestBatch : public Asserter
+		{
+			void operator()();
+		};
+		
+		/**
+		 * Keeps the flags of each image set of a batch.
+		 */
+		class FlagCollector : public aoflagger::FlagHandler
+		{
+			public:
+				FlagCollector(size_t count) : flags(count, 0), callCount(0) { }
+				~FlagCollector()
+				{
+					for(std::vector<aoflagger::FlagMask*>::iterator i=flags.begin(); i!=flags.end(); ++i)
+						delete *i;
+				}
+				virtual void OnFlagged(size_t index, aoflagger::FlagMask& mask)
+				{
+					delete flags[index];
+					flags[index] = new aoflagger::FlagMask(mask);
+					++callCount;
+				}
+				std::vector<aoflagger::FlagMask*> flags;
+				size_t callCount;
+		};
+		
+		static void fillData(aoflagger::ImageSet &imageSet);
+		static aoflagger::ImageSet copyTimeSteps(aoflagger::AOFlagger &flagger, const aoflagger::ImageSet &source, size_t start, size_t count);
+		static void copyFlags(const aoflagger::FlagMask &source, size_t sourceStart, aoflagger::FlagMask &destination, size_t destinationStart, size_t count);
+		static size_t countFlags(const aoflagger::FlagMask &mask);
+		static size_t countDifferences(const aoflagger::FlagMask &a, const aoflagger::FlagMask &b);
+};
+
+/**
+ * Gaussian noise with a broadband burst, a narrowband line and a few spikes.
+ */
+inline void AOFlaggerTest::fillData(aoflagger::ImageSet &imageSet)
+{
+	const size_t width = imageSet.Width(), height = imageSet.Height(), stride = imageSet.HorizontalStride();
+	for(size_t i=0;i!=imageSet.ImageCount();++i)
+	{
+		float *buffer = imageSet.ImageBuffer(i);
+		for(size_t y=0;y!=height;++y)
+		{
+			for(size_t x=0;x!=width;++x)
+			{
+				float value = RNG::Gaussian();
+				if(x == width/3 || y == height/2 || (x*7 + y*3) % 97 == 0)
+					value += 20.0;
+				buffer[y*stride + x] = value;
+			}
+		}
+	}
+}
+
+inline aoflagger::ImageSet AOFlaggerTest::copyTimeSteps(aoflagger::AOFlagger &flagger, const aoflagger::ImageSet &source, size_t start, size_t count)
+{
+	aoflagger::ImageSet imageSet = flagger.MakeImageSet(count, source.Height(), source.ImageCount());
+	for(size_t i=0;i!=source.ImageCount();++i)
+	{
+		for(size_t y=0;y!=source.Height();++y)
+			memcpy(imageSet.ImageBuffer(i) + y*imageSet.HorizontalStride(), source.ImageBuffer(i) + y*source.HorizontalStride() + start, count * sizeof(float));
+	}
+	return imageSet;
+}
+
+inline void AOFlaggerTest::copyFlags(const aoflagger::FlagMask &source, size_t sourceStart, aoflagger::FlagMask &destination, size_t destinationStart, size_t count)
+{
+	for(size_t y=0;y!=source.Height();++y)
+		memcpy(destination.Buffer() + y*destination.HorizontalStride() + destinationStart, source.Buffer() + y*source.HorizontalStride() + sourceStart, count * sizeof(bool));
+}
+
+inline size_t AOFlaggerTest::countFlags(const aoflagger::FlagMask &mask)
+{
+	size_t count = 0;
+	for(size_t y=0;y!=mask.Height();++y)
+	{
+		const bool *row = mask.Buffer() + y * mask.HorizontalStride();
+		for(size_t x=0;x!=mask.Width();++x)
+		{
+			if(row[x]) ++count;
+		}
+	}
+	return count;
+}
+
+inline size_t AOFlaggerTest::countDifferences(const aoflagger::FlagMask &a, const aoflagger::FlagMask &b)
+{
+	if(a.Width() != b.Width() || a.Height() != b.Height())
+		return a.Width() * a.Height();
+	size_t count = 0;
+	for(size_t y=0;y!=a.Height();++y)
+	{
+		const bool
+			*rowA = a.Buffer() + y * a.HorizontalStride(),
+			*rowB = b.Buffer() + y * b.HorizontalStride();
+		for(size_t x=0;x!=a.Width();++x)
+		{
+			if(rowA[x] != rowB[x]) ++count;
+		}
+	}
+	return count;
+}
+
+inline void AOFlaggerTest::TestWrappedBuffers::operator()()
+{
+	// The strategy for transients only decreases the frequency resolution, which it does
+	// directly on a single amplitude image. The stride is larger than the width rounded up
+	// to four, and the decreased height has no padding rows, so that writing beyond the
+	// rows of the decreased image is noticed.
+	const size_t width = 50, height = 48, count = 1, stride = 64;
+	aoflagger::AOFlagger flagger;
+	aoflagger::Strategy strategy = flagger.MakeStrategy(aoflagger::GENERIC_TELESCOPE, aoflagger::StrategyFlags::TRANSIENTS);
+	aoflagger::ImageSet imageSet = flagger.MakeImageSet(width, height, count);
+	fillData(imageSet);
+	
+	// The padding of the rows gets a value that would show up in the flags if it was used
+	float *buffers[count];
+	for(size_t i=0;i!=count;++i)
+	{
+		if(posix_memalign((void **) &buffers[i], 16, stride * height * sizeof(float)) != 0)
+			throw std::bad_alloc();
+		for(size_t y=0;y!=height;++y)
+		{
+			for(size_t x=0;x!=stride;++x)
+				buffers[i][y*stride + x] = (x < width) ? imageSet.ImageBuffer(i)[y*imageSet.HorizontalStride() + x] : 1e6;
+		}
+	}
+	aoflagger::ImageSet wrapped = flagger.WrapImageSet(buffers, width, height, count, stride);
+	AssertEquals(wrapped.HorizontalStride(), stride, "Stride of wrapped image set");
+	
+	aoflagger::FlagMask expected = flagger.Run(strategy, imageSet);
+	AssertTrue(countFlags(expected) != 0, "Data contain flagged samples");
+	aoflagger::FlagMask flags = flagger.Run(strategy, wrapped);
+	AssertEquals(countDifferences(flags, expected), (size_t) 0, "Flags of wrapped image set");
+	
+	bool *maskBuffer = new bool[stride * height];
+	aoflagger::FlagMask wrappedMask = flagger.WrapFlagMask(maskBuffer, width, height, stride);
+	flagger.Run(strategy, wrapped, wrappedMask);
+	AssertEquals(countDifferences(wrappedMask, expected), (size_t) 0, "Flags written into a wrapped mask");
+	
+	size_t changedValues = 0;
+	for(size_t i=0;i!=count;++i)
+	{
+		for(size_t y=0;y!=height;++y)
+		{
+			for(size_t x=0;x!=stride;++x)
+			{
+				const float value = (x < width) ? imageSet.ImageBuffer(i)[y*imageSet.HorizontalStride() + x] : 1e6;
+				if(buffers[i][y*stride + x] != value) ++changedValues;
+			}
+		}
+	}
+	AssertEquals(changedValues, (size_t) 0, "Values in the wrapped buffers are not changed");
+	
+	delete[] maskBuffer;
+	for(size_t i=0;i!=count;++i)
+		free(buffers[i]);
+}
+
+inline void AOFlaggerTest::TestFlagStream::operator()()
+{
+	const size_t width = 330, height = 16, count = 2, windowSize = 100, lookAhead = 20;
+	aoflagger::AOFlagger flagger;
+	aoflagger::Strategy strategy = flagger.MakeStrategy();
+	aoflagger::ImageSet imageSet = flagger.MakeImageSet(width, height, count);
+	fillData(imageSet);
+	
+	// Flag the windows of the stream directly: each window starts windowSize - 2 lookAhead
+	// time steps after the previous one, and its flags are final up to the look-ahead. The
+	// last window is flagged by Finish(), up to the end.
+	aoflagger::FlagMask expected = flagger.MakeFlagMask(width, height, false);
+	size_t windowStart = 0, finalEnd = 0;
+	while(windowStart + windowSize <= width)
+	{
+		aoflagger::ImageSet window = copyTimeSteps(flagger, imageSet, windowStart, windowSize);
+		aoflagger::FlagMask windowFlags = flagger.Run(strategy, window);
+		copyFlags(windowFlags, finalEnd - windowStart, expected, finalEnd, windowStart + windowSize - lookAhead - finalEnd);
+		finalEnd = windowStart + windowSize - lookAhead;
+		windowStart += windowSize - 2 * lookAhead;
+	}
+	const size_t finalBeforeFinish = finalEnd;
+	aoflagger::ImageSet lastWindow = copyTimeSteps(flagger, imageSet, windowStart, width - windowStart);
+	aoflagger::FlagMask lastFlags = flagger.Run(strategy, lastWindow);
+	copyFlags(lastFlags, finalEnd - windowStart, expected, finalEnd, width - finalEnd);
+	AssertTrue(countFlags(expected) != 0, "Data contain flagged samples");
+	
+	const size_t chunkSizes[4] = { 1, 7, 64, width };
+	for(size_t i=0;i!=4;++i)
+	{
+		std::stringstream s;
+		s << " with chunks of " << chunkSizes[i] << " time steps";
+		aoflagger::FlagStream stream = flagger.MakeFlagStream(strategy, height, count, windowSize, lookAhead);
+		aoflagger::FlagMask flags = flagger.MakeFlagMask(width, height, false);
+		size_t appended = 0, read = 0;
+		while(appended != width)
+		{
+			const size_t chunkSize = std::min(chunkSizes[i], width - appended);
+			stream.Append(copyTimeSteps(flagger, imageSet, appended, chunkSize));
+			appended += chunkSize;
+			aoflagger::FlagMask chunkFlags = stream.ReadFlags();
+			AssertEquals(stream.FinalFlagCount(), (size_t) 0, "Reading removes the final flags" + s.str());
+			copyFlags(chunkFlags, 0, flags, read, chunkFlags.Width());
+			read += chunkFlags.Width();
+		}
+		AssertEquals(read, finalBeforeFinish, "Final time steps before finishing" + s.str());
+		
+		stream.Finish();
+		AssertEquals(stream.FinalFlagCount(), width - read, "Final time steps after finishing" + s.str());
+		aoflagger::FlagMask chunkFlags = stream.ReadFlags();
+		copyFlags(chunkFlags, 0, flags, read, chunkFlags.Width());
+		read += chunkFlags.Width();
+		AssertEquals(read, width, "All time steps are final after finishing" + s.str());
+		AssertEquals(countDifferences(flags, expected), (size_t) 0, "Flags of the stream" + s.str());
+	}
+}
+
+inline void AOFlaggerTest::TestBatch::operator()()
+{
+	// Image sets of alternating sizes, so that the buffers of a thread are both reused
+	// and reallocated
+	const size_t count = 9, height = 24, imageCount = 2;
+	aoflagger::AOFlagger flagger;
+	aoflagger::Strategy strategy = flagger.MakeStrategy();
+	std::vector<aoflagger::ImageSet> inputs;
+	for(size_t i=0;i!=count;++i)
+	{
+		inputs.push_back(flagger.MakeImageSet((i%3 == 2) ? 37 : 80, height, imageCount));
+		fillData(inputs.back());
+	}
+	std::vector<aoflagger::FlagMask> expected;
+	for(size_t i=0;i!=count;++i)
+		expected.push_back(flagger.Run(strategy, inputs[i]));
+	
+	const size_t threadCounts[3] = { 1, 3, 0 };
+	for(size_t t=0;t!=3;++t)
+	{
+		std::stringstream s;
+		s << " with " << threadCounts[t] << " threads";
+		FlagCollector collector(count);
+		flagger.Run(strategy, &inputs[0], count, collector, threadCounts[t]);
+		AssertEquals(collector.callCount, count, "Number of flagged image sets" + s.str());
+		for(size_t i=0;i!=count;++i)
+		{
+			std::stringstream is;
+			is << "Flags of image set " << i << s.str();
+			AssertTrue(collector.flags[i] != 0, is.str() + " are reported");
+			AssertEquals(countDifferences(*collector.flags[i], expected[i]), (size_t) 0, is.str());
+		}
+	}
+}
+
+#endif
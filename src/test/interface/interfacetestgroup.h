@@ -0,0 +1,18 @@
+#ifndef AOFLAGGER_INTERFACETESTGROUP_H
+#define AOFLAGGER_INTERFACETESTGROUP_H
+
+#include "../testingtools/testgroup.h"
+
+#include "aoflaggertest.h"
+
+class InterfaceTestGroup : public TestGroup {
+	public:
+		InterfaceTestGroup() : TestGroup("Library interface") { }
+		
+		virtual void Initialize()
+		{
+			Add(new AOFlaggerTest());
+		}
+};
+
+#endif
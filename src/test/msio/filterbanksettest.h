@@ -0,0 +1,355 @@
+#ifndef AOFLAGGER_FILTERBANKSETTEST_H
+#define AOFLAGGER_FILTERBANKSETTEST_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../structures/image2d.h"
+#include "../../structures/mask2d.h"
+
+#include "../../strategy/imagesets/filterbankset.h"
+
+class FilterBankSetTest : public UnitTest {
+	public:
+		FilterBankSetTest() : UnitTest("Filterbank set")
+		{
+			AddTest(TestRead(), "Reading samples of each bit depth");
+			AddTest(TestWriteFlags(), "Writing flags for each bit depth");
+		}
+
+	private:
+		struct TestRead : public Asserter
+		{
+			void operator()();
+		};
+		struct TestWriteFlags : public Asserter
+		{
+			void operator()();
+		};
+
+		/**
+		 * Bit depths that are tested, with a number of channels for each that is not a
+		 * multiple of the transposed tiles where the depth allows it, and that is larger
+		 * than one band of the transpose.
+		 */
+		static size_t bitCount(size_t i)
+		{
+			const size_t bitCounts[6] = { 1, 2, 4, 8, 16, 32 };
+			return bitCounts[i];
+		}
+		static size_t channelCount(size_t i)
+		{
+			const size_t channelCounts[6] = { 72, 68, 70, 69, 67, 66 };
+			return channelCounts[i];
+		}
+		static size_t depthCount() { return 6; }
+
+		/**
+		 * Number of time steps in the file. The set is split in two intervals, of which
+		 * neither is a multiple of four time steps long.
+		 */
+		static size_t timeCount() { return 45; }
+		static size_t intervalStart(size_t interval) { return interval == 0 ? 0 : 22; }
+		static size_t intervalEnd(size_t interval) { return interval == 0 ? 22 : 45; }
+
+		static const char *filename() { return "filterbanksettest.fil"; }
+
+		static float sampleValue(size_t t, size_t channel, size_t bits);
+		static bool isFlagged(size_t t, size_t channel)
+		{
+			return channel == 2 || (t + 3*channel) % 7 == 0;
+		}
+		static float readReference(const char *spectrum, size_t channel, size_t bits);
+		static void writeReference(char *spectrum, size_t channel, size_t bits, float value);
+		static void writeFile(const std::vector<float> &samples, size_t channels, size_t bits);
+		static std::vector<float> readFile(size_t channels, size_t bits);
+		static void writeString(std::ostream &stream, const std::string &str);
+		static void writeInt(std::ostream &stream, int32_t value);
+		static void writeDouble(std::ostream &stream, double value);
+};
+
+/**
+ * A pattern that uses all bits of the samples. Float samples contain NaNs and
+ * infinities at every position of the transposed tiles.
+ */
+inline float FilterBankSetTest::sampleValue(size_t t, size_t channel, size_t bits)
+{
+	const unsigned pattern = t*131 + channel*71 + t*channel*17;
+	if(bits == 32)
+	{
+		if((t*5 + channel) % 13 == 0)
+			return std::numeric_limits<float>::quiet_NaN();
+		if((t*5 + channel) % 13 == 6)
+			return std::numeric_limits<float>::infinity();
+		return (float) (pattern & 0xFFFF) * 0.5f;
+	}
+	else
+		return pattern & ((1u << bits) - 1);
+}
+
+/**
+ * Scalar decoding of a sample, with the first channel in the lowest bits of a byte.
+ */
+inline float FilterBankSetTest::readReference(const char *spectrum, size_t channel, size_t bits)
+{
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(spectrum);
+	switch(bits)
+	{
+		case 32: {
+			float value;
+			memcpy(&value, spectrum + channel*4, sizeof(float));
+			return value;
+		}
+		case 16:
+			return bytes[channel*2] | (bytes[channel*2+1] << 8);
+		case 8:
+			return bytes[channel];
+		default: {
+			const size_t bitIndex = channel * bits;
+			return (bytes[bitIndex / 8] >> (bitIndex % 8)) & ((1u << bits) - 1);
+		}
+	}
+}
+
+inline void FilterBankSetTest::writeReference(char *spectrum, size_t channel, size_t bits, float value)
+{
+	unsigned char *bytes = reinterpret_cast<unsigned char*>(spectrum);
+	switch(bits)
+	{
+		case 32:
+			memcpy(spectrum + channel*4, &value, sizeof(float));
+			break;
+		case 16:
+			bytes[channel*2] = (unsigned) value & 0xFF;
+			bytes[channel*2+1] = (unsigned) value >> 8;
+			break;
+		case 8:
+			bytes[channel] = (unsigned) value;
+			break;
+		default: {
+			const size_t bitIndex = channel * bits;
+			bytes[bitIndex / 8] |= (unsigned) value << (bitIndex % 8);
+		} break;
+	}
+}
+
+inline void FilterBankSetTest::writeString(std::ostream &stream, const std::string &str)
+{
+	writeInt(stream, str.size());
+	stream.write(str.data(), str.size());
+}
+
+inline void FilterBankSetTest::writeInt(std::ostream &stream, int32_t value)
+{
+	stream.write(reinterpret_cast<const char*>(&value), sizeof(int32_t));
+}
+
+inline void FilterBankSetTest::writeDouble(std::ostream &stream, double value)
+{
+	stream.write(reinterpret_cast<const char*>(&value), sizeof(double));
+}
+
+/**
+ * Writes a filterbank file with a header and the given samples, indexed as
+ * samples[t*channels + channel].
+ */
+inline void FilterBankSetTest::writeFile(const std::vector<float> &samples, size_t channels, size_t bits)
+{
+	std::ofstream file(filename(), std::ios::out | std::ios::binary | std::ios::trunc);
+	writeString(file, "HEADER_START");
+	writeString(file, "telescope_id");
+	writeInt(file, 0);
+	writeString(file, "nchans");
+	writeInt(file, channels);
+	writeString(file, "nbits");
+	writeInt(file, bits);
+	writeString(file, "nifs");
+	writeInt(file, 1);
+	writeString(file, "tsamp");
+	writeDouble(file, 0.001);
+	writeString(file, "tstart");
+	writeDouble(file, 56000.0);
+	writeString(file, "fch1");
+	writeDouble(file, 150.0);
+	writeString(file, "foff");
+	writeDouble(file, -0.1);
+	writeString(file, "HEADER_END");
+	const size_t spectrumSize = channels * bits / 8;
+	std::vector<char> spectrum(spectrumSize);
+	for(size_t t=0;t!=timeCount();++t)
+	{
+		std::fill(spectrum.begin(), spectrum.end(), 0);
+		for(size_t channel=0;channel!=channels;++channel)
+			writeReference(&spectrum[0], channel, bits, samples[t*channels + channel]);
+		file.write(&spectrum[0], spectrumSize);
+	}
+}
+
+/**
+ * Reads back the samples of a file written by writeFile().
+ */
+inline std::vector<float> FilterBankSetTest::readFile(size_t channels, size_t bits)
+{
+	std::ifstream file(filename(), std::ios::in | std::ios::binary);
+	const size_t spectrumSize = channels * bits / 8;
+	file.seekg(0, std::ios::end);
+	file.seekg(std::streamoff(file.tellg()) - std::streamoff(spectrumSize * timeCount()));
+	std::vector<float> samples(channels * timeCount());
+	std::vector<char> spectrum(spectrumSize);
+	for(size_t t=0;t!=timeCount();++t)
+	{
+		file.read(&spectrum[0], spectrumSize);
+		for(size_t channel=0;channel!=channels;++channel)
+			samples[t*channels + channel] = readReference(&spectrum[0], channel, bits);
+	}
+	return samples;
+}
+
+inline void FilterBankSetTest::TestRead::operator()()
+{
+	for(size_t i=0;i!=depthCount();++i)
+	{
+		const size_t bits = bitCount(i), channels = channelCount(i);
+		std::ostringstream depth;
+		depth << " of " << bits << "-bit file";
+		std::vector<float> samples(channels * timeCount());
+		for(size_t t=0;t!=timeCount();++t)
+		{
+			for(size_t channel=0;channel!=channels;++channel)
+				samples[t*channels + channel] = sampleValue(t, channel, bits);
+		}
+		writeFile(samples, channels, bits);
+
+		rfiStrategy::FilterBankSet set(filename());
+		set.SetThreadCount(2);
+		rfiStrategy::ImageSetIndex *index = set.StartIndex();
+		size_t interval = 0, valueErrors = 0, maskErrors = 0;
+		while(index->IsValid())
+		{
+			set.AddReadRequest(*index);
+			set.PerformReadRequests();
+			rfiStrategy::BaselineData *baseline = set.GetNextRequested();
+			Image2DCPtr image = baseline->Data().GetImage(0);
+			Mask2DCPtr mask = baseline->Data().GetSingleMask();
+			AssertEquals(image->Width(), intervalEnd(interval) - intervalStart(interval), "Width of interval" + depth.str());
+			AssertEquals(image->Height(), channels, "Height of interval" + depth.str());
+			for(size_t x=0;x!=image->Width();++x)
+			{
+				for(size_t channel=0;channel!=channels;++channel)
+				{
+					const float expected = samples[(intervalStart(interval) + x)*channels + channel];
+					const float value = image->Value(x, channel);
+					if(std::isfinite(expected) ? value != expected : std::isfinite(value))
+						++valueErrors;
+					if(mask->Value(x, channel) != !std::isfinite(expected))
+						++maskErrors;
+				}
+			}
+			delete baseline;
+			index->Next();
+			++interval;
+		}
+		delete index;
+		std::remove(filename());
+		AssertEquals(interval, (size_t) 2, "Number of intervals" + depth.str());
+		AssertEquals(valueErrors, (size_t) 0, "Wrongly unpacked samples" + depth.str());
+		AssertEquals(maskErrors, (size_t) 0, "Wrongly flagged samples" + depth.str());
+	}
+}
+
+inline void FilterBankSetTest::TestWriteFlags::operator()()
+{
+	for(size_t i=0;i!=depthCount();++i)
+	{
+		const size_t bits = bitCount(i), channels = channelCount(i);
+		std::ostringstream depth;
+		depth << " of " << bits << "-bit file";
+		std::vector<float> samples(channels * timeCount());
+		for(size_t t=0;t!=timeCount();++t)
+		{
+			for(size_t channel=0;channel!=channels;++channel)
+				samples[t*channels + channel] = sampleValue(t, channel, bits);
+		}
+		writeFile(samples, channels, bits);
+
+		// Flagged float samples become NaN. Flagged integer samples become the rounded
+		// average of the unflagged samples of their channel in the interval, or zero when
+		// the whole channel is flagged.
+		std::vector<float> expected(samples);
+		for(size_t interval=0;interval!=2;++interval)
+		{
+			for(size_t channel=0;channel!=channels;++channel)
+			{
+				size_t sum = 0, count = 0;
+				for(size_t t=intervalStart(interval);t!=intervalEnd(interval);++t)
+				{
+					if(!isFlagged(t, channel))
+					{
+						sum += (size_t) samples[t*channels + channel];
+						++count;
+					}
+				}
+				const float replacement = bits == 32 ?
+					std::numeric_limits<float>::quiet_NaN() :
+					(float) (count == 0 ? 0 : (sum + count/2) / count);
+				for(size_t t=intervalStart(interval);t!=intervalEnd(interval);++t)
+				{
+					if(isFlagged(t, channel))
+						expected[t*channels + channel] = replacement;
+				}
+			}
+		}
+
+		rfiStrategy::FilterBankSet set(filename());
+		set.SetThreadCount(2);
+		rfiStrategy::ImageSetIndex *index = set.StartIndex();
+		size_t interval = 0;
+		while(index->IsValid())
+		{
+			const size_t width = intervalEnd(interval) - intervalStart(interval);
+			Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(width, channels);
+			for(size_t x=0;x!=width;++x)
+			{
+				for(size_t channel=0;channel!=channels;++channel)
+					mask->SetValue(x, channel, isFlagged(intervalStart(interval) + x, channel));
+			}
+			std::vector<Mask2DCPtr> flags(1, mask);
+			set.AddWriteFlagsTask(*index, flags);
+			set.PerformWriteFlagsTask();
+			index->Next();
+			++interval;
+		}
+		delete index;
+
+		std::vector<float> written = readFile(channels, bits);
+		std::remove(filename());
+		size_t flaggedErrors = 0, unflaggedErrors = 0;
+		for(size_t t=0;t!=timeCount();++t)
+		{
+			for(size_t channel=0;channel!=channels;++channel)
+			{
+				const float e = expected[t*channels + channel], w = written[t*channels + channel];
+				if(std::isfinite(e) ? w != e : std::isfinite(w))
+				{
+					if(isFlagged(t, channel))
+						++flaggedErrors;
+					else
+						++unflaggedErrors;
+				}
+			}
+		}
+		AssertEquals(flaggedErrors, (size_t) 0, "Wrongly written flagged samples" + depth.str());
+		AssertEquals(unflaggedErrors, (size_t) 0, "Changed unflagged samples" + depth.str());
+	}
+}
+
+#endif
@@ -3,12 +3,17 @@
 
 #include "../testingtools/testgroup.h"
 
+#include "filterbanksettest.h"
+#include "rspreadertest.h"
+
 class MSIOTestGroup : public TestGroup {
 	public:
 		MSIOTestGroup() : TestGroup("Measurement set input/output") { }
 		
 		virtual void Initialize()
 		{
+			Add(new FilterBankSetTest());
+			Add(new RSPReaderTest());
 		}
 };
 
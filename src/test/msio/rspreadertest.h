@@ -0,0 +1,265 @@
+#ifndef AOFLAGGER_RSPREADERTEST_H
+#define AOFLAGGER_RSPREADERTEST_H
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../structures/image2d.h"
+#include "../../structures/mask2d.h"
+#include "../../structures/timefrequencydata.h"
+
+#include "../../msio/rspreader.h"
+
+class RSPReaderTest : public UnitTest {
+	public:
+		RSPReaderTest() : UnitTest("RSP reader")
+		{
+			AddTest(TestReadAllBeamlets(), "Reading all beamlets");
+			AddTest(TestReadSingleBeamlet(), "Reading a single beamlet");
+			AddTest(TestReadPastEnd(), "Reading past the end of the file");
+			AddTest(TestStatistics(), "Counting bit statistics");
+		}
+
+	private:
+		struct TestReadAllBeamlets : public Asserter
+		{
+			void operator()();
+		};
+		struct TestReadSingleBeamlet : public Asserter
+		{
+			void operator()();
+		};
+		struct TestReadPastEnd : public Asserter
+		{
+			void operator()();
+		};
+		struct TestStatistics : public Asserter
+		{
+			void operator()();
+		};
+
+		/**
+		 * The file is a bit larger than one block of the reader, so that reading all of it
+		 * crosses a block boundary.
+		 */
+		static unsigned beamletCount() { return 3; }
+		static unsigned blocksPerFrame() { return 16; }
+		static unsigned long frameCount() { return 21000; }
+		static unsigned long timestepCount() { return frameCount() * blocksPerFrame(); }
+
+		static const char *filename() { return "rspreadertest.raw"; }
+
+		/**
+		 * Value of a component of a sample: 0 = xr, 1 = xi, 2 = yr, 3 = yi. Values use all bits,
+		 * including the sign, and are shifted down by a varying amount such that the
+		 * statistics cover all bit counts.
+		 */
+		static signed short sampleValue(unsigned long timestep, unsigned beamlet, unsigned component)
+		{
+			const unsigned hash = (unsigned) timestep * 2654435761u + beamlet * 40503u + component * 9973u;
+			return (signed short) (hash >> 16) >> (timestep % 16);
+		}
+		static void writeFile();
+		static size_t countDifferences(const TimeFrequencyData &data, unsigned long timestepStart, unsigned long timestepEnd, unsigned firstBeamlet);
+		static void countBits(signed short value, std::vector<unsigned long> &bitUseCount);
+		static void writeShort(unsigned char *buffer, unsigned value)
+		{
+			buffer[0] = value & 0xFF;
+			buffer[1] = (value >> 8) & 0xFF;
+		}
+		static void writeInt(unsigned char *buffer, unsigned value)
+		{
+			writeShort(buffer, value & 0xFFFF);
+			writeShort(buffer + 2, value >> 16);
+		}
+};
+
+/**
+ * Writes frames of a 16-byte header followed by the samples of each beamlet. Every sample
+ * is stored as the little endian 16-bit values yi, yr, xi and xr.
+ */
+inline void RSPReaderTest::writeFile()
+{
+	std::ofstream file(filename(), std::ios::out | std::ios::binary | std::ios::trunc);
+	std::vector<unsigned char> frame(16 + beamletCount() * blocksPerFrame() * 8);
+	for(unsigned long f=0;f!=frameCount();++f)
+	{
+		frame[0] = 2;
+		frame[1] = 0;
+		writeShort(&frame[2], 0);
+		writeShort(&frame[4], 7);
+		frame[6] = beamletCount();
+		frame[7] = blocksPerFrame();
+		writeInt(&frame[8], 1000 + f);
+		writeInt(&frame[12], f * blocksPerFrame());
+		for(unsigned b=0;b!=beamletCount();++b)
+		{
+			for(unsigned block=0;block!=blocksPerFrame();++block)
+			{
+				const unsigned long timestep = f * blocksPerFrame() + block;
+				unsigned char *sample = &frame[16 + (b * blocksPerFrame() + block) * 8];
+				writeShort(sample, (unsigned short) sampleValue(timestep, b, 3));
+				writeShort(sample + 2, (unsigned short) sampleValue(timestep, b, 2));
+				writeShort(sample + 4, (unsigned short) sampleValue(timestep, b, 1));
+				writeShort(sample + 6, (unsigned short) sampleValue(timestep, b, 0));
+			}
+		}
+		file.write(reinterpret_cast<char*>(&frame[0]), frame.size());
+	}
+}
+
+/**
+ * Number of values that differ from the pattern, plus the number of time steps inside the
+ * file that are flagged and outside the file that are not.
+ */
+inline size_t RSPReaderTest::countDifferences(const TimeFrequencyData &data, unsigned long timestepStart, unsigned long timestepEnd, unsigned firstBeamlet)
+{
+	size_t differences = 0;
+	Mask2DCPtr mask = data.GetSingleMask();
+	for(unsigned component=0;component!=4;++component)
+	{
+		Image2DCPtr image = data.GetImage(component);
+		for(unsigned y=0;y!=image->Height();++y)
+		{
+			for(unsigned long x=0;x!=timestepEnd-timestepStart;++x)
+			{
+				const unsigned long timestep = timestepStart + x;
+				const num_t expected = timestep < timestepCount() ? sampleValue(timestep, firstBeamlet + y, component) : 0.0;
+				if(image->Value(x, y) != expected)
+					++differences;
+				if(component == 0 && mask->Value(x, y) != (timestep >= timestepCount()))
+					++differences;
+			}
+		}
+	}
+	return differences;
+}
+
+/**
+ * Counts the bits of a value the same way as the reader: the sign in bit 15, and each bit
+ * up to the highest bit that is set.
+ */
+inline void RSPReaderTest::countBits(signed short value, std::vector<unsigned long> &bitUseCount)
+{
+	int absValue = value;
+	if(absValue < 0)
+	{
+		absValue = -absValue;
+		++bitUseCount[15];
+	}
+	unsigned highestBit = (absValue != 0) ? 1 : 0;
+	for(unsigned bit=0;bit<15;++bit)
+	{
+		if((absValue & (2<<bit)) != 0)
+			highestBit = bit+1;
+	}
+	for(unsigned bit=0;bit<highestBit;++bit)
+		++bitUseCount[bit];
+}
+
+inline void RSPReaderTest::TestReadAllBeamlets::operator()()
+{
+	writeFile();
+	RSPReader reader(filename());
+	AssertEquals(reader.TimeStepCount(beamletCount()), timestepCount(), "Number of time steps");
+	// Start and end halfway a frame; the whole file crosses a block boundary
+	const unsigned long ranges[3][2] = { { 37, 613 }, { 5, timestepCount() - 3 }, { 48, 49 } };
+	for(size_t i=0;i!=3;++i)
+	{
+		std::ostringstream s;
+		s << "Differences for time steps " << ranges[i][0] << " to " << ranges[i][1];
+		std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> data = reader.ReadAllBeamlets(ranges[i][0], ranges[i][1], beamletCount());
+		AssertEquals(data.first.ImageWidth(), (size_t) (ranges[i][1] - ranges[i][0]), "Width");
+		AssertEquals(data.first.ImageHeight(), (size_t) beamletCount(), "Height");
+		AssertEquals(countDifferences(data.first, ranges[i][0], ranges[i][1], 0), (size_t) 0, s.str());
+	}
+	std::remove(filename());
+}
+
+inline void RSPReaderTest::TestReadSingleBeamlet::operator()()
+{
+	writeFile();
+	RSPReader reader(filename());
+	for(unsigned beamlet=0;beamlet!=beamletCount();++beamlet)
+	{
+		std::ostringstream s;
+		s << "Differences for beamlet " << beamlet;
+		std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> data = reader.ReadSingleBeamlet(13, 203, beamletCount(), beamlet);
+		AssertEquals(data.first.ImageHeight(), (size_t) 1, "Height");
+		AssertEquals(countDifferences(data.first, 13, 203, beamlet), (size_t) 0, s.str());
+	}
+	std::remove(filename());
+}
+
+inline void RSPReaderTest::TestReadPastEnd::operator()()
+{
+	writeFile();
+	RSPReader reader(filename());
+	const unsigned long start = timestepCount() - 21, end = timestepCount() + 30;
+	std::pair<TimeFrequencyData,TimeFrequencyMetaDataPtr> data = reader.ReadAllBeamlets(start, end, beamletCount());
+	AssertEquals(countDifferences(data.first, start, end, 0), (size_t) 0, "Differences, with the time steps past the end flagged");
+	std::remove(filename());
+}
+
+inline void RSPReaderTest::TestStatistics::operator()()
+{
+	writeFile();
+	RSPReader reader(filename());
+	// The statistics are only reported through the logger
+	std::stringstream output;
+	std::streambuf *coutBuffer = std::cout.rdbuf(output.rdbuf());
+	try {
+		reader.ReadForStatistics(beamletCount());
+	} catch(...)
+	{
+		std::cout.rdbuf(coutBuffer);
+		throw;
+	}
+	std::cout.rdbuf(coutBuffer);
+	std::remove(filename());
+	for(unsigned b=0;b!=beamletCount();++b)
+	{
+		std::ostringstream statFilename;
+		statFilename << "rsp-statistics" << b << ".txt";
+		std::remove(statFilename.str().c_str());
+	}
+
+	// The last report of each beamlet has the counts of the whole file
+	std::vector<std::vector<unsigned long> > reported(beamletCount(), std::vector<unsigned long>(16));
+	std::string line;
+	unsigned beamlet = 0;
+	while(std::getline(output, line))
+	{
+		unsigned index, bit;
+		unsigned long count;
+		if(sscanf(line.c_str(), "Beamlet index %u:", &index) == 1)
+			beamlet = index;
+		else if(sscanf(line.c_str(), "Bit %u times required: %lu", &bit, &count) == 2 && beamlet < beamletCount() && bit < 16)
+			reported[beamlet][bit] = count;
+	}
+
+	for(unsigned b=0;b!=beamletCount();++b)
+	{
+		std::vector<unsigned long> expected(16, 0);
+		for(unsigned long t=0;t!=timestepCount();++t)
+		{
+			for(unsigned component=0;component!=4;++component)
+				countBits(sampleValue(t, b, component), expected);
+		}
+		for(unsigned bit=0;bit!=16;++bit)
+		{
+			std::ostringstream s;
+			s << "Use count of bit " << bit << " of beamlet " << b;
+			AssertEquals(reported[b][bit], expected[bit], s.str());
+		}
+	}
+}
+
+#endif
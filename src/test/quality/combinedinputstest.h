@@ -0,0 +1,118 @@
+#ifndef AOFLAGGER_COMBINEDINPUTSTEST_H
+#define AOFLAGGER_COMBINEDINPUTSTEST_H
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../quality/combinedinputs.h"
+
+#include <casacore/tables/Tables/Table.h>
+#include <casacore/tables/Tables/SetupNewTab.h>
+#include <casacore/tables/Tables/ScaColDesc.h>
+
+class CombinedInputsTest : public UnitTest {
+	public:
+		CombinedInputsTest() : UnitTest("Combined inputs")
+		{
+			createTable("CombinedInputsTarget.MS");
+			createTable("CombinedInputsA.MS");
+			createTable("CombinedInputsB.MS");
+			AddTest(TestCanonicalNames(), "Canonical names");
+			AddTest(TestTargetWithoutList(), "Target without list");
+			AddTest(TestIncrementalSelection(), "Selecting sets to add incrementally");
+		}
+		virtual ~CombinedInputsTest()
+		{
+			casacore::Table::deleteTable("CombinedInputsTarget.MS");
+			casacore::Table::deleteTable("CombinedInputsA.MS");
+			casacore::Table::deleteTable("CombinedInputsB.MS");
+		}
+	private:
+		static void createTable(const std::string &name)
+		{
+			casacore::TableDesc tableDesc("MAIN_TABLE", "1.0", casacore::TableDesc::Scratch);
+			tableDesc.addColumn(casacore::ScalarColumnDesc<int>("TEST"));
+			casacore::SetupNewTable mainTableSetup(name, tableDesc, casacore::Table::New);
+			casacore::Table mainOutputTable(mainTableSetup);
+		}
+		struct TestCanonicalNames : public Asserter
+		{
+			void operator()();
+		};
+		struct TestTargetWithoutList : public Asserter
+		{
+			void operator()();
+		};
+		struct TestIncrementalSelection : public Asserter
+		{
+			void operator()();
+		};
+};
+
+void CombinedInputsTest::TestCanonicalNames::operator()()
+{
+	const std::string name = CombinedInputs::CanonicalName("CombinedInputsA.MS");
+	AssertEquals(name[0], '/', "Canonical name is absolute");
+	AssertEquals(CombinedInputs::CanonicalName("./CombinedInputsA.MS"), name, "Leading ./");
+	AssertEquals(CombinedInputs::CanonicalName("CombinedInputsA.MS/"), name, "Trailing slash");
+	AssertEquals(CombinedInputs::CanonicalName("CombinedInputsA.MS/../CombinedInputsA.MS"), name, "Parent directory");
+	AssertEquals(CombinedInputs::CanonicalName("CombinedInputsMissing.MS"), std::string("CombinedInputsMissing.MS"), "Name of a set that does not exist");
+}
+
+void CombinedInputsTest::TestTargetWithoutList::operator()()
+{
+	// A target that was not written by 'combine' should not be added to, because it is
+	// unknown which sets its statistics contain
+	AssertFalse(CombinedInputs::IsStoredIn("CombinedInputsTarget.MS"), "Plain set has no list");
+	CombinedInputs inputs;
+	bool hasThrown = false;
+	try {
+		inputs.Read("CombinedInputsTarget.MS");
+	} catch(std::runtime_error &) {
+		hasThrown = true;
+	}
+	AssertTrue(hasThrown, "Reading a missing list throws");
+}
+
+void CombinedInputsTest::TestIncrementalSelection::operator()()
+{
+	// First combine: the same set given twice is only combined once
+	CombinedInputs written;
+	std::vector<std::string> names;
+	names.push_back("CombinedInputsA.MS");
+	names.push_back("./CombinedInputsA.MS");
+	std::vector<std::string> newNames = written.SelectNew(names);
+	AssertEquals(newNames.size(), (size_t) 1, "Duplicate input is selected once");
+	AssertEquals(newNames[0], std::string("CombinedInputsA.MS"), "Selected name");
+	written.Add(newNames[0]);
+	written.Write("CombinedInputsTarget.MS");
+	AssertTrue(CombinedInputs::IsStoredIn("CombinedInputsTarget.MS"), "List is stored");
+	
+	// Incremental combine: A is already in the target, in whatever way it is written
+	CombinedInputs read;
+	read.Read("CombinedInputsTarget.MS");
+	AssertEquals(read.Size(), (size_t) 1, "Size of the list that was read");
+	AssertTrue(read.Contains("CombinedInputsA.MS/"), "Contains A with trailing slash");
+	AssertFalse(read.Contains("CombinedInputsB.MS"), "Does not contain B");
+	names.clear();
+	names.push_back("./CombinedInputsA.MS");
+	names.push_back("CombinedInputsB.MS/");
+	names.push_back("CombinedInputsA.MS/");
+	names.push_back("CombinedInputsB.MS");
+	newNames = read.SelectNew(names);
+	AssertEquals(newNames.size(), (size_t) 1, "Only B is new");
+	AssertEquals(newNames[0], std::string("CombinedInputsB.MS/"), "Name of B as given first");
+	read.Add(newNames[0]);
+	read.Write("CombinedInputsTarget.MS");
+	
+	CombinedInputs readAgain;
+	readAgain.Read("CombinedInputsTarget.MS");
+	AssertEquals(readAgain.Size(), (size_t) 2, "Size after adding B");
+	AssertTrue(readAgain.SelectNew(names).empty(), "Nothing is new after adding B");
+}
+
+#endif
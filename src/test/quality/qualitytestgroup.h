@@ -3,6 +3,7 @@
 
 #include "../testingtools/testgroup.h"
 
+#include "combinedinputstest.h"
 #include "qualitytablesformattertest.h"
 #include "statisticscollectiontest.h"
 #include "statisticsderivatortest.h"
@@ -13,6 +14,7 @@ class QualityTestGroup : public TestGroup {
 		
 		virtual void Initialize()
 		{
+			Add(new CombinedInputsTest());
 			Add(new QualityTablesFormatterTest());
 			Add(new StatisticsCollectionTest());
 			Add(new StatisticsDerivatorTest());
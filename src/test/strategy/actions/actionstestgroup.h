@@ -0,0 +1,22 @@
+#ifndef AOFLAGGER_ACTIONSTESTGROUP_H
+#define AOFLAGGER_ACTIONSTESTGROUP_H
+
+#include "../../testingtools/testgroup.h"
+
+#include "changeresolutionactiontest.h"
+#include "coarsescreeningactiontest.h"
+#include "strategytest.h"
+
+class ActionsTestGroup : public TestGroup {
+	public:
+		ActionsTestGroup() : TestGroup("Actions") { }
+		
+		virtual void Initialize()
+		{
+			Add(new ChangeResolutionActionTest());
+			Add(new CoarseScreeningActionTest());
+			Add(new StrategyTest());
+		}
+};
+
+#endif
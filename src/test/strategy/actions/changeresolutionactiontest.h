@@ -0,0 +1,431 @@
+#ifndef AOFLAGGER_CHANGERESOLUTIONACTIONTEST_H
+#define AOFLAGGER_CHANGERESOLUTIONACTIONTEST_H
+
+#include <sstream>
+#include <string>
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/image2d.h"
+#include "../../../structures/mask2d.h"
+#include "../../../structures/timefrequencydata.h"
+
+#include "../../../strategy/actions/changeresolutionaction.h"
+
+#include "../../../strategy/algorithms/thresholdtools.h"
+
+#include "../../../strategy/control/artifactset.h"
+
+#include "../../../util/progresslistener.h"
+
+#include "../../../util/rng.h"
+
+class ChangeResolutionActionTest : public UnitTest {
+	public:
+		ChangeResolutionActionTest() : UnitTest("Change resolution action")
+		{
+			AddTest(TestWideStride(), "Decreasing frequency of images with a wide stride");
+			AddTest(TestImageResampling(), "Resampling images against direct loops");
+			AddTest(TestMaskResampling(), "Resampling masks against direct loops");
+			AddTest(TestMaskedAveraging(), "Averaging unflagged samples per row");
+			AddTest(TestDecreaseTimeWithMask(), "Decreasing time with the mask");
+			AddTest(TestSharedImages(), "Changing resolution of shared images");
+		}
+
+	private:
+		struct TestWideStride : public Asserter
+		{
+			void operator()();
+		};
+		struct TestImageResampling : public Asserter
+		{
+			void operator()();
+		};
+		struct TestMaskResampling : public Asserter
+		{
+			void operator()();
+		};
+		struct TestMaskedAveraging : public Asserter
+		{
+			void operator()();
+		};
+		struct TestDecreaseTimeWithMask : public Asserter
+		{
+			void operator()();
+		};
+		struct TestSharedImages : public Asserter
+		{
+			void operator()();
+		};
+
+		static Image2DPtr createImage(size_t width, size_t height, size_t widthCapacity);
+		static Mask2DPtr createMask(size_t width, size_t height);
+		static Image2DPtr referenceShrinkHorizontally(const Image2D &image, size_t factor);
+		static Image2DPtr referenceShrinkVertically(const Image2D &image, size_t factor);
+		static Image2DPtr referenceEnlargeHorizontally(const Image2D &image, size_t factor, size_t newWidth);
+		static Image2DPtr referenceEnlargeVertically(const Image2D &image, size_t factor, size_t newHeight);
+		static Image2DPtr referenceMaskedShrinkHorizontally(const Image2D &image, const Mask2D &mask, size_t factor);
+		static Mask2DPtr referenceShrinkMaskHorizontally(const Mask2D &mask, size_t factor, bool all);
+		static Mask2DPtr referenceShrinkMaskVertically(const Mask2D &mask, size_t factor);
+		static size_t countDifferences(const Image2D &a, const Image2D &b);
+		static size_t countDifferences(const Mask2D &a, const Mask2D &b);
+};
+
+inline Image2DPtr ChangeResolutionActionTest::createImage(size_t width, size_t height, size_t widthCapacity)
+{
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height, widthCapacity);
+	for(size_t y=0;y!=height;++y)
+	{
+		for(size_t x=0;x!=width;++x)
+			image->SetValue(x, y, RNG::Gaussian());
+	}
+	return image;
+}
+
+/**
+ * Flags about a third of the samples.
+ */
+inline Mask2DPtr ChangeResolutionActionTest::createMask(size_t width, size_t height)
+{
+	Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(width, height);
+	for(size_t y=0;y!=height;++y)
+	{
+		for(size_t x=0;x!=width;++x)
+			mask->SetValue(x, y, RNG::Uniform() < 0.33);
+	}
+	return mask;
+}
+
+/*
+ * The reference functions below resample one sample at a time, as was done before the
+ * resampling was vectorised. The sums are made in the same order, so the results should
+ * be identical.
+ */
+
+inline Image2DPtr ChangeResolutionActionTest::referenceShrinkHorizontally(const Image2D &image, size_t factor)
+{
+	const size_t newWidth = (image.Width() + factor - 1) / factor;
+	Image2DPtr newImage = Image2D::CreateUnsetImagePtr(newWidth, image.Height());
+	for(size_t x=0;x<newWidth;++x)
+	{
+		size_t binSize = factor;
+		if(binSize + x*factor > image.Width())
+			binSize = image.Width() - x*factor;
+		for(size_t y=0;y<image.Height();++y)
+		{
+			num_t sum = 0.0;
+			for(size_t binX=0;binX<binSize;++binX)
+				sum += image.Value(x*factor + binX, y);
+			newImage->SetValue(x, y, sum / (num_t) binSize);
+		}
+	}
+	return newImage;
+}
+
+inline Image2DPtr ChangeResolutionActionTest::referenceShrinkVertically(const Image2D &image, size_t factor)
+{
+	const size_t newHeight = (image.Height() + factor - 1) / factor;
+	Image2DPtr newImage = Image2D::CreateUnsetImagePtr(image.Width(), newHeight);
+	for(size_t y=0;y<newHeight;++y)
+	{
+		size_t binSize = factor;
+		if(binSize + y*factor > image.Height())
+			binSize = image.Height() - y*factor;
+		for(size_t x=0;x<image.Width();++x)
+		{
+			num_t sum = 0.0;
+			for(size_t binY=0;binY<binSize;++binY)
+				sum += image.Value(x, y*factor + binY);
+			newImage->SetValue(x, y, sum / (num_t) binSize);
+		}
+	}
+	return newImage;
+}
+
+inline Image2DPtr ChangeResolutionActionTest::referenceEnlargeHorizontally(const Image2D &image, size_t factor, size_t newWidth)
+{
+	Image2DPtr newImage = Image2D::CreateUnsetImagePtr(newWidth, image.Height());
+	for(size_t x=0;x<newWidth;++x)
+	{
+		for(size_t y=0;y<image.Height();++y)
+			newImage->SetValue(x, y, image.Value(x / factor, y));
+	}
+	return newImage;
+}
+
+inline Image2DPtr ChangeResolutionActionTest::referenceEnlargeVertically(const Image2D &image, size_t factor, size_t newHeight)
+{
+	Image2DPtr newImage = Image2D::CreateUnsetImagePtr(image.Width(), newHeight);
+	for(size_t x=0;x<image.Width();++x)
+	{
+		for(size_t y=0;y<newHeight;++y)
+			newImage->SetValue(x, y, image.Value(x, y / factor));
+	}
+	return newImage;
+}
+
+/**
+ * Averages the unflagged samples of each bin, or all samples when the bin is fully flagged.
+ */
+inline Image2DPtr ChangeResolutionActionTest::referenceMaskedShrinkHorizontally(const Image2D &image, const Mask2D &mask, size_t factor)
+{
+	const size_t newWidth = (image.Width() + factor - 1) / factor;
+	Image2DPtr newImage = Image2D::CreateUnsetImagePtr(newWidth, image.Height());
+	for(size_t x=0;x<newWidth;++x)
+	{
+		size_t binSize = factor;
+		if(binSize + x*factor > image.Width())
+			binSize = image.Width() - x*factor;
+		for(size_t y=0;y<image.Height();++y)
+		{
+			num_t sum = 0.0, unflaggedSum = 0.0;
+			size_t count = 0;
+			for(size_t binX=0;binX<binSize;++binX)
+			{
+				sum += image.Value(x*factor + binX, y);
+				if(!mask.Value(x*factor + binX, y))
+				{
+					unflaggedSum += image.Value(x*factor + binX, y);
+					++count;
+				}
+			}
+			newImage->SetValue(x, y, count == 0 ? sum / (num_t) binSize : unflaggedSum / (num_t) count);
+		}
+	}
+	return newImage;
+}
+
+/**
+ * A bin is flagged when any of its samples is, or when @p all is set, when all of them are.
+ */
+inline Mask2DPtr ChangeResolutionActionTest::referenceShrinkMaskHorizontally(const Mask2D &mask, size_t factor, bool all)
+{
+	const size_t newWidth = (mask.Width() + factor - 1) / factor;
+	Mask2DPtr newMask = Mask2D::CreateUnsetMaskPtr(newWidth, mask.Height());
+	for(size_t x=0;x<newWidth;++x)
+	{
+		size_t binSize = factor;
+		if(binSize + x*factor > mask.Width())
+			binSize = mask.Width() - x*factor;
+		for(size_t y=0;y<mask.Height();++y)
+		{
+			bool value = all;
+			for(size_t binX=0;binX<binSize;++binX)
+			{
+				if(all)
+					value = value && mask.Value(x*factor + binX, y);
+				else
+					value = value || mask.Value(x*factor + binX, y);
+			}
+			newMask->SetValue(x, y, value);
+		}
+	}
+	return newMask;
+}
+
+inline Mask2DPtr ChangeResolutionActionTest::referenceShrinkMaskVertically(const Mask2D &mask, size_t factor)
+{
+	const size_t newHeight = (mask.Height() + factor - 1) / factor;
+	Mask2DPtr newMask = Mask2D::CreateUnsetMaskPtr(mask.Width(), newHeight);
+	for(size_t y=0;y<newHeight;++y)
+	{
+		size_t binSize = factor;
+		if(binSize + y*factor > mask.Height())
+			binSize = mask.Height() - y*factor;
+		for(size_t x=0;x<mask.Width();++x)
+		{
+			bool value = false;
+			for(size_t binY=0;binY<binSize;++binY)
+				value = value || mask.Value(x, y*factor + binY);
+			newMask->SetValue(x, y, value);
+		}
+	}
+	return newMask;
+}
+
+inline size_t ChangeResolutionActionTest::countDifferences(const Mask2D &a, const Mask2D &b)
+{
+	if(a.Width() != b.Width() || a.Height() != b.Height())
+		return a.Width() * a.Height();
+	size_t count = 0;
+	for(size_t y=0;y!=a.Height();++y)
+	{
+		for(size_t x=0;x!=a.Width();++x)
+		{
+			if(a.Value(x, y) != b.Value(x, y))
+				++count;
+		}
+	}
+	return count;
+}
+
+inline size_t ChangeResolutionActionTest::countDifferences(const Image2D &a, const Image2D &b)
+{
+	if(a.Width() != b.Width() || a.Height() != b.Height())
+		return a.Width() * a.Height();
+	size_t count = 0;
+	for(size_t y=0;y!=a.Height();++y)
+	{
+		for(size_t x=0;x!=a.Width();++x)
+		{
+			if(a.Value(x, y) != b.Value(x, y))
+				++count;
+		}
+	}
+	return count;
+}
+
+inline void ChangeResolutionActionTest::TestWideStride::operator()()
+{
+	// The rows of the source are much wider than the rows of the shrunk image
+	const Image2DPtr image = createImage(10, 13, 64);
+	AssertTrue(image->Stride() > 12, "Source has a wide stride");
+	const Image2DPtr shrunk = image->ShrinkVertically(4);
+	AssertEquals(shrunk->Width(), (size_t) 10, "Width of shrunk image");
+	AssertEquals(shrunk->Height(), (size_t) 4, "Height of shrunk image");
+	AssertEquals(countDifferences(*shrunk, *referenceShrinkVertically(*image, 4)), (size_t) 0, "Values of shrunk image");
+
+	rfiStrategy::ChangeResolutionAction action;
+	action.SetFrequencyDecreaseFactor(3);
+	TimeFrequencyData data(TimeFrequencyData::AmplitudePart, SinglePolarisation, image);
+	data.SetGlobalMask(Mask2D::CreateSetMaskPtr<false>(10, 13));
+	action.DecreaseFrequency(data);
+	AssertEquals(data.ImageHeight(), (size_t) 5, "Height after decreasing frequency");
+	AssertEquals(countDifferences(*data.GetImage(0), *referenceShrinkVertically(*image, 3)), (size_t) 0, "Values after decreasing frequency");
+}
+
+inline void ChangeResolutionActionTest::TestImageResampling::operator()()
+{
+	// Sizes that are not multiples of the factors, so that the last bins are partial
+	const size_t factors[3] = { 1, 4, 7 };
+	const Image2DPtr image = createImage(45, 30, 45);
+	for(size_t i=0;i!=3;++i)
+	{
+		const size_t factor = factors[i];
+		std::stringstream s;
+		s << " with factor " << factor;
+		const Image2DPtr
+			horizontal = image->ShrinkHorizontally(factor),
+			vertical = image->ShrinkVertically(factor);
+		AssertEquals(countDifferences(*horizontal, *referenceShrinkHorizontally(*image, factor)), (size_t) 0, "Shrinking horizontally" + s.str());
+		AssertEquals(countDifferences(*vertical, *referenceShrinkVertically(*image, factor)), (size_t) 0, "Shrinking vertically" + s.str());
+		AssertEquals(countDifferences(*horizontal->EnlargeHorizontally(factor, 45), *referenceEnlargeHorizontally(*horizontal, factor, 45)), (size_t) 0, "Enlarging horizontally" + s.str());
+		AssertEquals(countDifferences(*vertical->EnlargeVertically(factor, 30), *referenceEnlargeVertically(*vertical, factor, 30)), (size_t) 0, "Enlarging vertically" + s.str());
+	}
+}
+
+inline void ChangeResolutionActionTest::TestMaskResampling::operator()()
+{
+	const size_t factors[3] = { 1, 4, 7 };
+	const Mask2DPtr mask = createMask(45, 30);
+	for(size_t i=0;i!=3;++i)
+	{
+		const size_t factor = factors[i];
+		std::stringstream s;
+		s << " with factor " << factor;
+		const Mask2DPtr
+			horizontal = mask->ShrinkHorizontally(factor),
+			vertical = mask->ShrinkVertically(factor);
+		AssertEquals(countDifferences(*horizontal, *referenceShrinkMaskHorizontally(*mask, factor, false)), (size_t) 0, "Shrinking horizontally" + s.str());
+		AssertEquals(countDifferences(*mask->ShrinkHorizontallyForAveraging(factor), *referenceShrinkMaskHorizontally(*mask, factor, true)), (size_t) 0, "Shrinking horizontally for averaging" + s.str());
+		AssertEquals(countDifferences(*vertical, *referenceShrinkMaskVertically(*mask, factor)), (size_t) 0, "Shrinking vertically" + s.str());
+
+		// Enlarging again should give the flags of the bins
+		Mask2DPtr enlarged = Mask2D::CreateUnsetMaskPtr(45, 30);
+		enlarged->EnlargeHorizontallyAndSet(horizontal, factor);
+		size_t errors = 0;
+		for(size_t y=0;y!=30;++y)
+		{
+			for(size_t x=0;x!=45;++x)
+				if(enlarged->Value(x, y) != horizontal->Value(x / factor, y)) ++errors;
+		}
+		AssertEquals(errors, (size_t) 0, "Enlarging horizontally" + s.str());
+		enlarged->EnlargeVerticallyAndSet(vertical, factor);
+		errors = 0;
+		for(size_t y=0;y!=30;++y)
+		{
+			for(size_t x=0;x!=45;++x)
+				if(enlarged->Value(x, y) != vertical->Value(x, y / factor)) ++errors;
+		}
+		AssertEquals(errors, (size_t) 0, "Enlarging vertically" + s.str());
+	}
+}
+
+inline void ChangeResolutionActionTest::TestMaskedAveraging::operator()()
+{
+	// The number of unflagged samples used to be summed over the rows of a bin, which
+	// changed the averages of all rows but the first
+	const Image2DPtr image = createImage(45, 30, 45);
+	const Mask2DPtr mask = createMask(45, 30);
+	const Image2DPtr shrunk = ThresholdTools::ShrinkHorizontally(4, image, mask);
+	AssertEquals(countDifferences(*shrunk, *referenceMaskedShrinkHorizontally(*image, *mask, 4)), (size_t) 0, "Averages of unflagged samples");
+
+	// Two rows of which only the second has flags
+	Image2DPtr twoRows = Image2D::CreateUnsetImagePtr(4, 2);
+	Mask2DPtr twoRowsMask = Mask2D::CreateSetMaskPtr<false>(4, 2);
+	for(size_t x=0;x!=4;++x)
+	{
+		twoRows->SetValue(x, 0, (num_t) x);
+		twoRows->SetValue(x, 1, (num_t) (x + 10));
+	}
+	twoRowsMask->SetValue(3, 1, true);
+	const Image2DPtr twoRowsShrunk = ThresholdTools::ShrinkHorizontally(4, twoRows, twoRowsMask);
+	AssertEquals(twoRowsShrunk->Value(0, 0), (num_t) 1.5, "First row");
+	AssertEquals(twoRowsShrunk->Value(0, 1), (num_t) 11.0, "Second row");
+}
+
+inline void ChangeResolutionActionTest::TestDecreaseTimeWithMask::operator()()
+{
+	// Used to leave the full-width images next to shrunk masks
+	const Image2DPtr
+		xx = createImage(45, 30, 45),
+		yy = createImage(45, 30, 45);
+	const Mask2DPtr
+		xxMask = createMask(45, 30),
+		yyMask = createMask(45, 30);
+	TimeFrequencyData data(TimeFrequencyData::AmplitudePart, AutoDipolePolarisation, xx, yy);
+	data.SetIndividualPolarisationMasks(xxMask, yyMask);
+
+	rfiStrategy::ChangeResolutionAction action;
+	action.SetTimeDecreaseFactor(4);
+	action.SetUseMaskInAveraging(true);
+	action.DecreaseTime(data);
+	AssertEquals(data.ImageWidth(), (size_t) 12, "Width of images");
+	AssertEquals(data.GetImage(1)->Width(), (size_t) 12, "Width of second image");
+	AssertEquals(data.GetMask(0)->Width(), (size_t) 12, "Width of masks");
+	AssertEquals(countDifferences(*data.GetImage(0), *referenceMaskedShrinkHorizontally(*xx, *xxMask, 4)), (size_t) 0, "First image");
+	AssertEquals(countDifferences(*data.GetImage(1), *referenceMaskedShrinkHorizontally(*yy, *yyMask, 4)), (size_t) 0, "Second image");
+	AssertEquals(countDifferences(*data.GetMask(1), *referenceShrinkMaskHorizontally(*yyMask, 4, true)), (size_t) 0, "Second mask");
+}
+
+inline void ChangeResolutionActionTest::TestSharedImages::operator()()
+{
+	// The original, contaminated and revised data share their image, which is then only
+	// resampled once. The revised data are restored to the enlarged averages, which are
+	// subtracted from the contaminated data.
+	const Image2DPtr image = createImage(45, 30, 45);
+	TimeFrequencyData data(TimeFrequencyData::AmplitudePart, SinglePolarisation, image);
+	data.SetGlobalMask(Mask2D::CreateSetMaskPtr<false>(45, 30));
+	rfiStrategy::ArtifactSet artifacts(0);
+	artifacts.SetOriginalData(data);
+	artifacts.SetContaminatedData(data);
+	artifacts.SetRevisedData(data);
+
+	rfiStrategy::ChangeResolutionAction action;
+	action.SetTimeDecreaseFactor(4);
+	action.SetFrequencyDecreaseFactor(7);
+	DummyProgressListener listener;
+	action.Perform(artifacts, listener);
+
+	const Image2DPtr
+		timeShrunk = referenceShrinkHorizontally(*image, 4),
+		bothShrunk = referenceShrinkVertically(*timeShrunk, 7),
+		revised = referenceEnlargeHorizontally(*referenceEnlargeVertically(*bothShrunk, 7, 30), 4, 45),
+		contaminated = Image2D::CreateFromDiff(image, revised);
+	AssertEquals(countDifferences(*artifacts.RevisedData().GetImage(0), *revised), (size_t) 0, "Revised data");
+	AssertEquals(countDifferences(*artifacts.ContaminatedData().GetImage(0), *contaminated), (size_t) 0, "Contaminated data");
+	AssertEquals(countDifferences(*artifacts.OriginalData().GetImage(0), *image), (size_t) 0, "Original data");
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef AOFLAGGER_COARSESCREENINGACTIONTEST_H
+#define AOFLAGGER_COARSESCREENINGACTIONTEST_H
+
+#include <string>
+#include <vector>
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/image2d.h"
+#include "../../../structures/mask2d.h"
+#include "../../../structures/timefrequencydata.h"
+
+#include "../../../strategy/actions/action.h"
+#include "../../../strategy/actions/coarsescreeningaction.h"
+
+#include "../../../strategy/control/artifactset.h"
+
+#include "../../../util/progresslistener.h"
+#include "../../../util/rng.h"
+
+class CoarseScreeningActionTest : public UnitTest {
+	public:
+		CoarseScreeningActionTest() : UnitTest("Coarse screening action")
+		{
+			AddTest(TestCleanTiles(), "Skipping clean tiles with a bandpass");
+			AddTest(TestSpikeTile(), "Flagging a tile with a spike");
+		}
+
+	private:
+		struct TestCleanTiles : public Asserter
+		{
+			void operator()();
+		};
+		struct TestSpikeTile : public Asserter
+		{
+			void operator()();
+		};
+
+		/**
+		 * Child that flags nothing, but remembers the size of the data of each call.
+		 */
+		class SizeRecorder : public rfiStrategy::Action
+		{
+			public:
+				SizeRecorder(std::vector<size_t> &widths, std::vector<size_t> &heights) : _widths(widths), _heights(heights) { }
+				virtual std::string Description() { return "Size recorder"; }
+				virtual void Perform(rfiStrategy::ArtifactSet &artifacts, ProgressListener &)
+				{
+					_widths.push_back(artifacts.ContaminatedData().ImageWidth());
+					_heights.push_back(artifacts.ContaminatedData().ImageHeight());
+				}
+				virtual rfiStrategy::ActionType Type() const { return rfiStrategy::ActionBlockType; }
+			private:
+				std::vector<size_t> &_widths, &_heights;
+		};
+
+		static TimeFrequencyData createData(size_t width, size_t height);
+		static void screen(const TimeFrequencyData &data, std::vector<size_t> &widths, std::vector<size_t> &heights);
+};
+
+/**
+ * Noise with a strong bandpass: the noise in the highest channel is a hundred times the
+ * noise in the lowest channel.
+ */
+inline TimeFrequencyData CoarseScreeningActionTest::createData(size_t width, size_t height)
+{
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	for(size_t y=0;y!=height;++y)
+	{
+		const double gain = 1.0 + 99.0 * (double) (y * y) / (double) (height * height);
+		for(size_t x=0;x!=width;++x)
+			image->SetValue(x, y, gain * (10.0 + RNG::Gaussian()));
+	}
+	TimeFrequencyData data(TimeFrequencyData::AmplitudePart, SinglePolarisation, image);
+	data.SetGlobalMask(Mask2D::CreateSetMaskPtr<false>(width, height));
+	return data;
+}
+
+inline void CoarseScreeningActionTest::screen(const TimeFrequencyData &data, std::vector<size_t> &widths, std::vector<size_t> &heights)
+{
+	rfiStrategy::CoarseScreeningAction action;
+	action.Add(new SizeRecorder(widths, heights));
+	rfiStrategy::ArtifactSet artifacts(0);
+	artifacts.SetOriginalData(data);
+	artifacts.SetContaminatedData(data);
+	artifacts.SetRevisedData(data);
+	DummyProgressListener listener;
+	action.Perform(artifacts, listener);
+}
+
+inline void CoarseScreeningActionTest::TestCleanTiles::operator()()
+{
+	// Four tiles of 256 x 64
+	std::vector<size_t> widths, heights;
+	screen(createData(512, 128), widths, heights);
+	AssertEquals(widths.size(), (size_t) 1, "Only the low-resolution data are flagged");
+	AssertEquals(widths[0], (size_t) 52, "Width of low-resolution data");
+	AssertEquals(heights[0], (size_t) 32, "Height of low-resolution data");
+}
+
+inline void CoarseScreeningActionTest::TestSpikeTile::operator()()
+{
+	TimeFrequencyData data = createData(512, 128);
+	// A spike in a low channel, in the second tile in time. It is well above the noise of
+	// its channel, but below the noise of the high channels.
+	Image2DPtr image = Image2D::CreateCopy(data.GetImage(0));
+	image->SetValue(300, 20, image->Value(300, 20) + 50.0);
+	data.SetImage(0, image);
+
+	std::vector<size_t> widths, heights;
+	screen(data, widths, heights);
+	AssertEquals(widths.size(), (size_t) 2, "The tile with the spike is flagged at full resolution");
+	// The tile from time step 256 to 512 and channel 0 to 64, plus a margin of half a tile
+	AssertEquals(widths[1], (size_t) 384, "Width of full-resolution region");
+	AssertEquals(heights[1], (size_t) 96, "Height of full-resolution region");
+}
+
+#endif
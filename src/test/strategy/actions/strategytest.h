@@ -0,0 +1,210 @@
+#ifndef AOFLAGGER_STRATEGYTEST_H
+#define AOFLAGGER_STRATEGYTEST_H
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/image2d.h"
+#include "../../../structures/mask2d.h"
+#include "../../../structures/timefrequencydata.h"
+
+#include "../../../strategy/actions/strategy.h"
+
+#include "../../../strategy/algorithms/baselineselector.h"
+#include "../../../strategy/algorithms/mitigationtester.h"
+#include "../../../strategy/algorithms/polarizationstatistics.h"
+
+#include "../../../strategy/control/artifactset.h"
+#include "../../../strategy/control/defaultstrategy.h"
+
+#include "../../../util/progresslistener.h"
+
+class StrategyTest : public UnitTest {
+	public:
+		StrategyTest() : UnitTest("Strategy")
+		{
+			AddTest(TestRepeatedPerform(), "Performing a strategy repeatedly");
+			AddTest(TestConcurrentPerform(), "Performing one strategy from several threads");
+		}
+		
+	private:
+		struct TestRepeatedPerform : public Asserter
+		{
+			void operator()();
+		};
+		struct TestConcurrentPerform : public Asserter
+		{
+			void operator()();
+		};
+		
+		/**
+		 * Remembers the first exception, because the strategy reports exceptions
+		 * to its listener instead of throwing them.
+		 */
+		class ExceptionListener : public DummyProgressListener
+		{
+			public:
+				virtual void OnException(const rfiStrategy::Action &, std::exception &thrownException)
+				{
+					if(message.empty())
+						message = thrownException.what();
+				}
+				std::string message;
+		};
+		
+		/**
+		 * The flags that each thread found that are different from the flags of
+		 * a single-threaded run.
+		 */
+		struct ConcurrentRuns
+		{
+			rfiStrategy::Strategy *strategy;
+			std::vector<TimeFrequencyData> inputs;
+			std::vector<Mask2DCPtr> expected;
+			size_t repeatCount;
+			boost::mutex mutex;
+			size_t differences;
+			std::string errorMessage;
+		};
+		
+		static std::vector<TimeFrequencyData> makeInputs();
+		static Mask2DCPtr flag(rfiStrategy::Strategy &strategy, const TimeFrequencyData &input, std::string &errorMessage);
+		static size_t countDifferences(const Mask2DCPtr &a, const Mask2DCPtr &b);
+		static void flagConcurrently(ConcurrentRuns *runs, size_t threadIndex);
+};
+
+inline std::vector<TimeFrequencyData> StrategyTest::makeInputs()
+{
+	// Data sets of different sizes, such that the threads work on different shapes at the same time
+	const int testSets[] = { 3, 5, 7, 26 };
+	const unsigned widths[] = { 200, 333, 256, 150 }, heights[] = { 64, 48, 100, 32 };
+	std::vector<TimeFrequencyData> inputs;
+	for(size_t i=0;i!=4;++i)
+	{
+		const unsigned width = widths[i], height = heights[i];
+		Mask2DPtr rfi = Mask2D::CreateUnsetMaskPtr(width, height);
+		Image2DPtr
+			xxReal = MitigationTester::CreateTestSet(testSets[i], rfi, width, height),
+			xxImag = MitigationTester::CreateTestSet(testSets[i], rfi, width, height),
+			yyReal = MitigationTester::CreateTestSet(testSets[i], rfi, width, height),
+			yyImag = MitigationTester::CreateTestSet(testSets[i], rfi, width, height);
+		inputs.push_back(TimeFrequencyData(AutoDipolePolarisation, xxReal, xxImag, yyReal, yyImag));
+	}
+	return inputs;
+}
+
+inline Mask2DCPtr StrategyTest::flag(rfiStrategy::Strategy &strategy, const TimeFrequencyData &input, std::string &errorMessage)
+{
+	rfiStrategy::ArtifactSet artifacts(0);
+	Mask2DCPtr mask = Mask2D::CreateSetMaskPtr<false>(input.ImageWidth(), input.ImageHeight());
+	Image2DCPtr zero = Image2D::CreateZeroImagePtr(input.ImageWidth(), input.ImageHeight());
+	TimeFrequencyData inputData(input), revisedData(AutoDipolePolarisation, zero, zero, zero, zero);
+	inputData.SetIndividualPolarisationMasks(mask, mask);
+	revisedData.SetIndividualPolarisationMasks(mask, mask);
+	artifacts.SetOriginalData(inputData);
+	artifacts.SetContaminatedData(inputData);
+	artifacts.SetRevisedData(revisedData);
+	PolarizationStatistics polarizationStatistics;
+	rfiStrategy::BaselineSelector baselineSelector;
+	artifacts.SetPolarizationStatistics(&polarizationStatistics);
+	artifacts.SetBaselineSelectionInfo(&baselineSelector);
+	
+	ExceptionListener listener;
+	strategy.Perform(artifacts, listener);
+	errorMessage = listener.message;
+	return artifacts.ContaminatedData().GetSingleMask();
+}
+
+inline size_t StrategyTest::countDifferences(const Mask2DCPtr &a, const Mask2DCPtr &b)
+{
+	if(a->Width() != b->Width() || a->Height() != b->Height())
+		return a->Width() * a->Height();
+	size_t count = 0;
+	for(size_t y=0;y!=a->Height();++y)
+	{
+		for(size_t x=0;x!=a->Width();++x)
+		{
+			if(a->Value(x, y) != b->Value(x, y))
+				++count;
+		}
+	}
+	return count;
+}
+
+inline void StrategyTest::TestRepeatedPerform::operator()()
+{
+	// A strategy should not keep anything of one run that changes the next
+	rfiStrategy::Strategy *strategy = rfiStrategy::DefaultStrategy::CreateStrategy(
+		rfiStrategy::DefaultStrategy::GENERIC_TELESCOPE, rfiStrategy::DefaultStrategy::FLAG_NONE);
+	std::vector<TimeFrequencyData> inputs = makeInputs();
+	std::vector<Mask2DCPtr> firstFlags;
+	std::string errorMessage;
+	for(size_t i=0;i!=inputs.size();++i)
+	{
+		firstFlags.push_back(flag(*strategy, inputs[i], errorMessage));
+		AssertEquals(errorMessage, std::string(), "No exception in first run");
+	}
+	for(size_t i=inputs.size();i!=0;--i)
+	{
+		Mask2DCPtr flags = flag(*strategy, inputs[i-1], errorMessage);
+		AssertEquals(errorMessage, std::string(), "No exception in second run");
+		AssertEquals(countDifferences(flags, firstFlags[i-1]), (size_t) 0, "Second run gives same flags");
+	}
+	delete strategy;
+}
+
+inline void StrategyTest::flagConcurrently(ConcurrentRuns *runs, size_t threadIndex)
+{
+	size_t differences = 0;
+	std::string errorMessage;
+	for(size_t repeat=0;repeat!=runs->repeatCount && errorMessage.empty();++repeat)
+	{
+		// Every thread goes through the inputs in a different order
+		for(size_t i=0;i!=runs->inputs.size() && errorMessage.empty();++i)
+		{
+			const size_t index = (i + threadIndex + repeat) % runs->inputs.size();
+			Mask2DCPtr flags = flag(*runs->strategy, runs->inputs[index], errorMessage);
+			differences += countDifferences(flags, runs->expected[index]);
+		}
+	}
+	boost::mutex::scoped_lock lock(runs->mutex);
+	runs->differences += differences;
+	if(runs->errorMessage.empty())
+		runs->errorMessage = errorMessage;
+}
+
+inline void StrategyTest::TestConcurrentPerform::operator()()
+{
+	ConcurrentRuns runs;
+	runs.strategy = rfiStrategy::DefaultStrategy::CreateStrategy(
+		rfiStrategy::DefaultStrategy::GENERIC_TELESCOPE, rfiStrategy::DefaultStrategy::FLAG_NONE);
+	runs.inputs = makeInputs();
+	runs.repeatCount = 3;
+	runs.differences = 0;
+	for(size_t i=0;i!=runs.inputs.size();++i)
+	{
+		runs.expected.push_back(flag(*runs.strategy, runs.inputs[i], runs.errorMessage));
+		AssertEquals(runs.errorMessage, std::string(), "No exception in single-threaded run");
+	}
+	
+	// More threads than processors, so that the runs are interleaved
+	const size_t threadCount = 8;
+	boost::thread_group threads;
+	for(size_t i=0;i!=threadCount;++i)
+		threads.create_thread(boost::bind(&StrategyTest::flagConcurrently, &runs, i));
+	threads.join_all();
+	
+	AssertEquals(runs.errorMessage, std::string(), "No exception in concurrent runs");
+	AssertEquals(runs.differences, (size_t) 0, "Concurrent runs give same flags as single-threaded runs");
+	delete runs.strategy;
+}
+
+#endif
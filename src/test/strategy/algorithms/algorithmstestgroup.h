@@ -11,6 +11,7 @@
 #include "siroperatortest.h"
 #include "statisticalflaggertest.h"
 #include "sumthresholdtest.h"
+#include "svdmitigatertest.h"
 #include "thresholdtoolstest.h"
 
 class AlgorithmsTestGroup : public TestGroup {
@@ -27,6 +28,7 @@ class AlgorithmsTestGroup : public TestGroup {
 			Add(new SIROperatorTest());
 			Add(new StatisticalFlaggerTest());
 			Add(new SumThresholdTest());
+			Add(new SVDMitigaterTest());
 			Add(new ThresholdToolsTest());
 		}
 };
@@ -1,6 +1,8 @@
 #ifndef AOFLAGGER_HIGHPASSFILTERTEST_H
 #define AOFLAGGER_HIGHPASSFILTERTEST_H
 
+#include <sstream>
+
 #include "../../testingtools/asserter.h"
 #include "../../testingtools/unittest.h"
 #include "../../testingtools/imageasserter.h"
@@ -11,6 +13,8 @@
 #include "../../../strategy/algorithms/localfitmethod.h"
 #include "../../../strategy/algorithms/highpassfilter.h"
 
+#include "../../../util/rng.h"
+
 class HighPassFilterTest : public UnitTest {
 	public:
 		HighPassFilterTest() : UnitTest("High-pass filter algorithm")
@@ -20,6 +24,7 @@ class HighPassFilterTest : public UnitTest {
 			AddTest(TestFilterWithMask(), "Low-pass filter algorithm with mask");
 			AddTest(TestCompletelyMaskedImage(), "Low-pass filter algorithm with completely set mask");
 			AddTest(TestNaNImage(), "Low-pass filter algorithm with NaNs");
+			AddTest(TestIncrementalFilter(), "Incremental low-pass filter");
 		}
 		
 	private:
@@ -43,6 +48,10 @@ class HighPassFilterTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TestIncrementalFilter : public Asserter
+		{
+			void operator()();
+		};
 		
 };
 
@@ -161,4 +170,54 @@ inline void HighPassFilterTest::TestNaNImage::operator()()
 	ImageAsserter::AssertFinite(image, "Low-pass convolution with NaNs");
 }
 
+inline void HighPassFilterTest::TestIncrementalFilter::operator()()
+{
+	const size_t width = 103, height = 77;
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+			image->SetValue(x, y, RNG::Gaussian());
+	}
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(width, height);
+	image->SetValue(60, 60, 0.0);
+	mask->SetValue(60, 60, true);
+	
+	HighPassFilter filter;
+	filter.SetHWindowSize(21);
+	filter.SetVWindowSize(31);
+	filter.SetHKernelSigmaSq(2.5);
+	filter.SetVKernelSigmaSq(5.0);
+	HighPassFilter::State state;
+	
+	for(size_t iteration=0;iteration<4;++iteration)
+	{
+		// Flag a channel, a time step and a single sample
+		mask->SetValue(iteration*20 + 3, iteration*10 + 5, true);
+		for(size_t x=0;x<width;++x)
+			mask->SetValue(x, iteration*17 + 1, true);
+		for(size_t y=0;y<height;++y)
+			mask->SetValue(iteration*25 + 2, y, true);
+		// An unflagged zero has the same value as a flagged sample, but not the same weight
+		if(iteration == 1)
+			mask->SetValue(60, 60, false);
+		
+		Image2DPtr
+			incremental = filter.ApplyLowPass(image, mask, state),
+			full = filter.ApplyLowPass(image, mask);
+		size_t differences = 0;
+		for(size_t y=0;y<height;++y)
+		{
+			for(size_t x=0;x<width;++x)
+			{
+				if(incremental->Value(x, y) != full->Value(x, y))
+					++differences;
+			}
+		}
+		std::stringstream s;
+		s << "Incremental result equals full result in iteration " << iteration;
+		AssertEquals(differences, (size_t) 0, s.str());
+	}
+}
+
 #endif
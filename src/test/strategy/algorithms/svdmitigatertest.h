@@ -0,0 +1,125 @@
+#ifndef AOFLAGGER_SVDMITIGATERTEST_H
+#define AOFLAGGER_SVDMITIGATERTEST_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/image2d.h"
+#include "../../../structures/timefrequencydata.h"
+
+#include "../../../strategy/algorithms/svdmitigater.h"
+
+#include "../../../util/rng.h"
+
+class SVDMitigaterTest : public UnitTest {
+	public:
+		SVDMitigaterTest() : UnitTest("SVD mitigater")
+		{
+			AddTest(TestRangeFinder(), "Range finder against full decomposition");
+			AddTest(TestRepeatability(), "Repeatability of the range finder");
+		}
+		
+	private:
+		struct TestRangeFinder : public Asserter
+		{
+			void operator()();
+		};
+		struct TestRepeatability : public Asserter
+		{
+			void operator()();
+		};
+		
+		static TimeFrequencyData createData(size_t width, size_t height);
+		static TimeFrequencyData removeComponents(const TimeFrequencyData &data, unsigned count, bool useRangeFinder);
+		static num_t maxDifference(const TimeFrequencyData &a, const TimeFrequencyData &b);
+};
+
+/**
+ * Three strong components, which are products of phase gradients along time and
+ * frequency, plus Gaussian noise.
+ */
+inline TimeFrequencyData SVDMitigaterTest::createData(size_t width, size_t height)
+{
+	Image2DPtr
+		real = Image2D::CreateUnsetImagePtr(width, height),
+		imaginary = Image2D::CreateUnsetImagePtr(width, height);
+	const double amplitudes[3] = { 20.0, 10.0, 5.0 };
+	const double timeRates[3] = { 0.013, 0.071, 0.029 }, frequencyRates[3] = { 0.037, 0.011, 0.083 };
+	for(size_t f=0;f!=height;++f)
+	{
+		for(size_t t=0;t!=width;++t)
+		{
+			double r = RNG::Gaussian(), i = RNG::Gaussian();
+			for(size_t c=0;c!=3;++c)
+			{
+				const double
+					timeAmplitude = 1.0 + 0.5 * cos(timeRates[c] * 3.0 * t),
+					phase = 2.0 * M_PI * (timeRates[c] * t + frequencyRates[c] * f);
+				r += amplitudes[c] * timeAmplitude * cos(phase);
+				i += amplitudes[c] * timeAmplitude * sin(phase);
+			}
+			real->SetValue(t, f, r);
+			imaginary->SetValue(t, f, i);
+		}
+	}
+	return TimeFrequencyData(SinglePolarisation, real, imaginary);
+}
+
+inline TimeFrequencyData SVDMitigaterTest::removeComponents(const TimeFrequencyData &data, unsigned count, bool useRangeFinder)
+{
+	SVDMitigater mitigater;
+	mitigater.SetUseRangeFinder(useRangeFinder);
+	mitigater.Initialize(data);
+	mitigater.RemoveSingularValues(count);
+	return mitigater.Background();
+}
+
+inline num_t SVDMitigaterTest::maxDifference(const TimeFrequencyData &a, const TimeFrequencyData &b)
+{
+	Image2DCPtr
+		aReal = a.GetRealPart(), aImaginary = a.GetImaginaryPart(),
+		bReal = b.GetRealPart(), bImaginary = b.GetImaginaryPart();
+	num_t difference = 0.0;
+	for(size_t y=0;y!=aReal->Height();++y)
+	{
+		for(size_t x=0;x!=aReal->Width();++x)
+		{
+			difference = std::max(difference, std::fabs(aReal->Value(x, y) - bReal->Value(x, y)));
+			difference = std::max(difference, std::fabs(aImaginary->Value(x, y) - bImaginary->Value(x, y)));
+		}
+	}
+	return difference;
+}
+
+inline void SVDMitigaterTest::TestRangeFinder::operator()()
+{
+	const TimeFrequencyData data = createData(300, 120);
+	const unsigned counts[2] = { 1, 3 };
+	for(size_t i=0;i!=2;++i)
+	{
+		const TimeFrequencyData
+			truncated = removeComponents(data, counts[i], true),
+			full = removeComponents(data, counts[i], false);
+		std::stringstream s;
+		s << "Background after removing " << counts[i] << " components";
+		AssertLessThan(maxDifference(truncated, full), 1e-3, s.str());
+	}
+}
+
+inline void SVDMitigaterTest::TestRepeatability::operator()()
+{
+	// The random range should not depend on the process-wide generator
+	const TimeFrequencyData data = createData(300, 120);
+	const TimeFrequencyData first = removeComponents(data, 3, true);
+	std::rand();
+	RNG::Gaussian();
+	const TimeFrequencyData second = removeComponents(data, 3, true);
+	AssertEquals(maxDifference(first, second), (num_t) 0.0, "Same background twice");
+}
+
+#endif
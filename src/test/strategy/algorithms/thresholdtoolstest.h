@@ -1,8 +1,15 @@
 #ifndef AOFLAGGER_THRESHOLDTOOLSTEST_H
 #define AOFLAGGER_THRESHOLDTOOLSTEST_H
 
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
 #include "../../../structures/mask2d.h"
 
+#include "../../../util/rng.h"
+
+#include "../../../strategy/algorithms/histogramselector.h"
 #include "../../../strategy/algorithms/thresholdtools.h"
 
 #include "../../testingtools/asserter.h"
@@ -14,6 +21,9 @@ class ThresholdToolsTest : public UnitTest {
 		{
 			AddTest(WinsorizedMaskedMeanVar(), "Winsorized, masked mean and variance");
 			AddTest(WinsorizedMaskedMode(), "Winsorized, masked mode");
+			AddTest(HistogramSelection(), "Histogram selection");
+			AddTest(FilterConnectedSamples(), "Filter connected samples");
+			AddTest(FrequencyRectangularConvolution(), "Frequency rectangular convolution");
 		}
 		
 	private:
@@ -25,6 +35,18 @@ class ThresholdToolsTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct HistogramSelection : public Asserter
+		{
+			void operator()();
+		};
+		struct FilterConnectedSamples : public Asserter
+		{
+			void operator()();
+		};
+		struct FrequencyRectangularConvolution : public Asserter
+		{
+			void operator()();
+		};
 };
 
 void ThresholdToolsTest::WinsorizedMaskedMeanVar::operator()()
@@ -117,4 +139,109 @@ void ThresholdToolsTest::WinsorizedMaskedMode::operator()()
 	// the Winsorized variance. Therefore, don't test it here. TODO
 }
 
+void ThresholdToolsTest::HistogramSelection::operator()()
+{
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(200, 50);
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(200, 50);
+	std::vector<num_t> unflagged;
+	for(size_t y=0;y<image->Height();++y)
+	{
+		for(size_t x=0;x<image->Width();++x)
+		{
+			image->SetValue(x, y, RNG::Gaussian());
+			if((x+y)%7 == 0)
+				mask->SetValue(x, y, true);
+			else if(x == 3 && y == 0)
+				image->SetValue(x, y, std::numeric_limits<num_t>::quiet_NaN());
+			else
+				unflagged.push_back(image->Value(x, y));
+		}
+	}
+	
+	HistogramSelector selector(image, mask);
+	AssertEquals(selector.Count(), unflagged.size(), "Count of unflagged finite samples");
+	const size_t ranks[] = { 0, 100, unflagged.size()/2, unflagged.size()-1 };
+	for(size_t i=0;i!=4;++i)
+	{
+		std::nth_element(unflagged.begin(), unflagged.begin() + ranks[i], unflagged.end());
+		const num_t expected = unflagged[ranks[i]];
+		AssertEquals(selector.Select(ranks[i], true), expected, "Exact selection");
+		AssertLessThan(fabs(selector.Select(ranks[i], false) - expected), (num_t) (fabs(expected) / 64.0 + 1e-6), "Approximate selection");
+	}
+	
+	num_t exactMean, exactStddev, mean, stddev;
+	ThresholdTools::WinsorizedMeanAndStdDev(image, mask, exactMean, exactStddev, true);
+	ThresholdTools::WinsorizedMeanAndStdDev(image, mask, mean, stddev, false);
+	AssertLessThan(fabs(mean - exactMean), (num_t) 0.01, "Approximate winsorized mean");
+	AssertLessThan(fabs(stddev - exactStddev), (num_t) 0.01, "Approximate winsorized stddev");
+	
+	AssertEquals(HistogramSelector::FromKey(HistogramSelector::ToKey(-2.5)), -2.5f, "Key conversion of negative value");
+	AssertLessThan(HistogramSelector::ToKey(-1.0), HistogramSelector::ToKey(0.5), "Key order");
+}
+
+void ThresholdToolsTest::FilterConnectedSamples::operator()()
+{
+	// A diagonal line of three samples, a horizontal line of three samples and
+	// a 'U' shape of seven samples
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(10, 10);
+	for(size_t i=0;i!=3;++i)
+	{
+		mask->SetValue(i, i, true);
+		mask->SetValue(5+i, 0, true);
+	}
+	for(size_t y=5;y!=8;++y)
+	{
+		mask->SetValue(2, y, true);
+		mask->SetValue(4, y, true);
+	}
+	mask->SetValue(3, 7, true);
+	
+	Mask2DPtr eight = Mask2D::CreateCopy(mask);
+	ThresholdTools::FilterConnectedSamples(eight, 3, true);
+	AssertEquals(eight->GetCount<true>(), (size_t) 13, "Eight-connected, no segments removed");
+	
+	Mask2DPtr four = Mask2D::CreateCopy(mask);
+	ThresholdTools::FilterConnectedSamples(four, 3, false);
+	AssertEquals(four->GetCount<true>(), (size_t) 10, "Four-connected, diagonal line removed");
+	AssertFalse(four->Value(1, 1), "Diagonal sample removed");
+	AssertTrue(four->Value(3, 7), "Sample of the U shape kept");
+	
+	ThresholdTools::FilterConnectedSamples(four, 4, false);
+	AssertEquals(four->GetCount<true>(), (size_t) 7, "Only U shape left");
+}
+
+void ThresholdToolsTest::FrequencyRectangularConvolution::operator()()
+{
+	const size_t width = 3, height = 10;
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+			image->SetValue(x, y, RNG::Uniform());
+	}
+	
+	const size_t sizes[4] = { 1, 4, 5, 15 };
+	for(size_t i=0;i!=4;++i)
+	{
+		const size_t size = sizes[i], upperHalf = (size+1) / 2;
+		Image2DPtr result = ThresholdTools::FrequencyRectangularConvolution(image, size);
+		for(size_t y=0;y<height;++y)
+		{
+			// The window is truncated at the borders
+			const size_t
+				start = (y + upperHalf > size) ? (y + upperHalf - size) : 0,
+				end = std::min(y + upperHalf, height);
+			for(size_t x=0;x<width;++x)
+			{
+				num_t sum = 0.0;
+				for(size_t j=start;j<end;++j)
+					sum += image->Value(x, j);
+				std::stringstream s;
+				s << "Window of " << size << " samples at (" << x << ',' << y << ')';
+				AssertAlmostEqual(result->Value(x, y), sum / (num_t) (end - start), s.str());
+			}
+		}
+	}
+}
+
 #endif
@@ -0,0 +1,87 @@
+#ifndef AOFLAGGER_FFTTOOLSTEST_H
+#define AOFLAGGER_FFTTOOLSTEST_H
+
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../structures/image2d.h"
+
+#include "../../strategy/algorithms/convolutions.h"
+
+#include "../../util/ffttools.h"
+#include "../../util/rng.h"
+
+class FFTToolsTest : public UnitTest {
+	public:
+		FFTToolsTest() : UnitTest("FFT tools")
+		{
+			AddTest(TestConvolveVertically(), "Vertical FFT convolution");
+		}
+
+	private:
+		struct TestConvolveVertically : public Asserter
+		{
+			void operator()();
+		};
+
+		static num_t convolutionDifference(size_t width, size_t height, size_t kernelSize);
+};
+
+/**
+ * Largest difference between FFTConvolveVertically() and a direct convolution of
+ * each column, on a random image with a random kernel.
+ */
+inline num_t FFTToolsTest::convolutionDifference(size_t width, size_t height, size_t kernelSize)
+{
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	for(size_t y=0;y!=height;++y)
+	{
+		for(size_t x=0;x!=width;++x)
+			image->SetValue(x, y, RNG::Gaussian());
+	}
+	std::vector<num_t> kernel(kernelSize);
+	for(size_t k=0;k!=kernelSize;++k)
+		kernel[k] = RNG::Gaussian() / (num_t) kernelSize;
+
+	Image2DPtr convolved = Image2D::CreateCopy(image);
+	FFTTools::FFTConvolveVertically(*convolved, &kernel[0], kernelSize);
+
+	num_t maxDifference = 0.0;
+	std::vector<num_t> column(height);
+	for(size_t x=0;x!=width;++x)
+	{
+		for(size_t y=0;y!=height;++y)
+			column[y] = image->Value(x, y);
+		Convolutions::OneDimensionalConvolutionBorderZero(&column[0], height, &kernel[0], kernelSize);
+		for(size_t y=0;y!=height;++y)
+		{
+			const num_t difference = std::fabs(convolved->Value(x, y) - column[y]);
+			if(!(difference <= maxDifference))
+				maxDifference = difference;
+		}
+	}
+	return maxDifference;
+}
+
+inline void FFTToolsTest::TestConvolveVertically::operator()()
+{
+	// Odd and even widths, because the columns are transformed in pairs, and odd and even
+	// kernels, because the kernel is centred on element kernelSize/2. The last kernel is
+	// longer than the columns.
+	const size_t
+		widths[4] = { 7, 8, 8, 7 },
+		heights[4] = { 50, 64, 37, 30 },
+		kernelSizes[4] = { 5, 8, 16, 41 };
+	for(size_t i=0;i!=4;++i)
+	{
+		std::stringstream s;
+		s << "Difference for a " << widths[i] << " x " << heights[i] << " image and kernel size " << kernelSizes[i];
+		AssertLessThan(convolutionDifference(widths[i], heights[i], kernelSizes[i]), 1e-5, s.str());
+	}
+}
+
+#endif
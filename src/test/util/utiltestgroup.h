@@ -3,6 +3,7 @@
 
 #include "../testingtools/testgroup.h"
 
+#include "ffttoolstest.h"
 #include "numberparsertest.h"
 
 class UtilTestGroup : public TestGroup {
@@ -11,6 +12,7 @@ class UtilTestGroup : public TestGroup {
 		
 		virtual void Initialize()
 		{
+			Add(new FFTToolsTest());
 			Add(new NumberParserTest());
 		}
 };
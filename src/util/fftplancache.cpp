@@ -0,0 +1,316 @@
+#include "fftplancache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+FFTPlanCache &FFTPlanCache::Instance()
+{
+	// Function-local statics are initialized thread safely in C++11, and
+	// are destructed on exit, at which point the wisdom is saved when enabled.
+	static FFTPlanCache instance;
+	return instance;
+}
+
+FFTPlanCache::FFTPlanCache() : _hasNewWisdom(false)
+{
+	const char *wisdomDir = getenv("AOFLAGGER_FFTW_WISDOM_DIR");
+	if(wisdomDir != 0)
+		SetWisdomDirectory(wisdomDir);
+}
+
+FFTPlanCache::~FFTPlanCache()
+{
+	SaveWisdom();
+	for(std::map<PlanKey, fftwf_plan>::iterator i=_singlePlans.begin();i!=_singlePlans.end();++i)
+		fftwf_destroy_plan(i->second);
+	for(std::map<PlanKey, fftw_plan>::iterator i=_doublePlans.begin();i!=_doublePlans.end();++i)
+		fftw_destroy_plan(i->second);
+}
+
+void FFTPlanCache::SetWisdomDirectory(const std::string &directory)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	if(directory.empty())
+	{
+		_singleWisdomFilename.clear();
+		_doubleWisdomFilename.clear();
+	} else {
+		_singleWisdomFilename = directory + "/aoflagger-fftwf-wisdom";
+		_doubleWisdomFilename = directory + "/aoflagger-fftw-wisdom";
+		// Failing to import is not an error: the file might not exist yet
+		fftwf_import_wisdom_from_filename(_singleWisdomFilename.c_str());
+		fftw_import_wisdom_from_filename(_doubleWisdomFilename.c_str());
+	}
+}
+
+void FFTPlanCache::SaveWisdom()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	if(_hasNewWisdom && !_singleWisdomFilename.empty())
+	{
+		// Another process might have saved wisdom since it was loaded
+		fftwf_import_wisdom_from_filename(_singleWisdomFilename.c_str());
+		fftw_import_wisdom_from_filename(_doubleWisdomFilename.c_str());
+		
+		// Saving is best effort: a failure only means that later processes measure again
+		const std::string
+			singleTemporary = temporaryFilename(_singleWisdomFilename),
+			doubleTemporary = temporaryFilename(_doubleWisdomFilename);
+		if(fftwf_export_wisdom_to_filename(singleTemporary.c_str()))
+			std::rename(singleTemporary.c_str(), _singleWisdomFilename.c_str());
+		else
+			std::remove(singleTemporary.c_str());
+		if(fftw_export_wisdom_to_filename(doubleTemporary.c_str()))
+			std::rename(doubleTemporary.c_str(), _doubleWisdomFilename.c_str());
+		else
+			std::remove(doubleTemporary.c_str());
+		_hasNewWisdom = false;
+	}
+}
+
+/**
+ * Name of a file next to @p filename that no other process writes to. Renaming it to
+ * @p filename replaces the file in one step.
+ */
+std::string FFTPlanCache::temporaryFilename(const std::string &filename)
+{
+	std::ostringstream s;
+	s << filename << ".tmp" << getpid();
+	return s.str();
+}
+
+bool FFTPlanCache::PlanKey::operator<(const PlanKey &rhs) const
+{
+	if(kind != rhs.kind) return kind < rhs.kind;
+	if(sign != rhs.sign) return sign < rhs.sign;
+	if(inPlace != rhs.inPlace) return inPlace < rhs.inPlace;
+	if(unaligned != rhs.unaligned) return unaligned < rhs.unaligned;
+	if(rigor != rhs.rigor) return rigor < rhs.rigor;
+	if(transform != rhs.transform) return transform < rhs.transform;
+	return batch < rhs.batch;
+}
+
+FFTPlanCache::PlanKey FFTPlanCache::makeKey(enum PlanKind kind, const Dimensions &transform, const Dimensions &batch, int sign, bool inPlace, bool unaligned, enum PlanRigor rigor)
+{
+	PlanKey key;
+	key.kind = kind;
+	key.sign = sign;
+	key.inPlace = inPlace;
+	key.unaligned = unaligned;
+	key.rigor = rigor;
+	for(Dimensions::const_iterator i=transform.begin();i!=transform.end();++i)
+	{
+		key.transform.push_back(i->n);
+		key.transform.push_back(i->stride);
+	}
+	for(Dimensions::const_iterator i=batch.begin();i!=batch.end();++i)
+	{
+		key.batch.push_back(i->n);
+		key.batch.push_back(i->stride);
+	}
+	return key;
+}
+
+void FFTPlanCache::toIODims(const Dimensions &dimensions, std::vector<fftwf_iodim> &dims)
+{
+	dims.resize(dimensions.size());
+	for(size_t i=0;i!=dimensions.size();++i)
+	{
+		dims[i].n = dimensions[i].n;
+		dims[i].is = dimensions[i].stride;
+		dims[i].os = dimensions[i].stride;
+	}
+}
+
+void FFTPlanCache::toIODims(const Dimensions &dimensions, std::vector<fftw_iodim> &dims)
+{
+	dims.resize(dimensions.size());
+	for(size_t i=0;i!=dimensions.size();++i)
+	{
+		dims[i].n = dimensions[i].n;
+		dims[i].is = dimensions[i].stride;
+		dims[i].os = dimensions[i].stride;
+	}
+}
+
+/**
+ * Number of elements spanned by the given layout, i.e., the size of the
+ * scratch arrays that are used for planning.
+ */
+size_t FFTPlanCache::arraySize(const Dimensions &transform, const Dimensions &batch)
+{
+	size_t lastIndex = 0;
+	for(Dimensions::const_iterator i=transform.begin();i!=transform.end();++i)
+		lastIndex += (i->n - 1) * i->stride;
+	for(Dimensions::const_iterator i=batch.begin();i!=batch.end();++i)
+		lastIndex += (i->n - 1) * i->stride;
+	return lastIndex + 1;
+}
+
+FFTPlanCache::ThreadPlans &FFTPlanCache::threadPlans()
+{
+	ThreadPlans *plans = _threadPlans.get();
+	if(plans == 0)
+	{
+		plans = new ThreadPlans();
+		_threadPlans.reset(plans);
+	}
+	return *plans;
+}
+
+unsigned FFTPlanCache::flags(bool unaligned, enum PlanRigor rigor)
+{
+	unsigned flags = (rigor == MeasurePlan) ? FFTW_MEASURE : FFTW_ESTIMATE;
+	if(unaligned)
+		flags |= FFTW_UNALIGNED;
+	return flags;
+}
+
+fftwf_plan FFTPlanCache::ComplexPlan(const Dimensions &transform, const Dimensions &batch, int sign, bool inPlace, bool unaligned, enum PlanRigor rigor)
+{
+	const PlanKey key = makeKey(ComplexKind, transform, batch, sign, inPlace, unaligned, rigor);
+	std::map<PlanKey, fftwf_plan> &localPlans = threadPlans().singlePlans;
+	std::map<PlanKey, fftwf_plan>::const_iterator i = localPlans.find(key);
+	if(i != localPlans.end())
+		return i->second;
+	
+	boost::mutex::scoped_lock lock(_mutex);
+	i = _singlePlans.find(key);
+	if(i != _singlePlans.end())
+	{
+		localPlans.insert(*i);
+		return i->second;
+	}
+	
+	std::vector<fftwf_iodim> transformDims, batchDims;
+	toIODims(transform, transformDims);
+	toIODims(batch, batchDims);
+	// Measuring overwrites the arrays, so plan on scratch arrays
+	const size_t size = arraySize(transform, batch);
+	fftwf_complex
+		*in = fftwf_alloc_complex(size),
+		*out = inPlace ? in : fftwf_alloc_complex(size);
+	fftwf_plan plan = fftwf_plan_guru_dft(transformDims.size(), &transformDims[0], batchDims.size(), batchDims.empty() ? 0 : &batchDims[0], in, out, sign, flags(unaligned, rigor));
+	if(!inPlace)
+		fftwf_free(out);
+	fftwf_free(in);
+	if(plan == 0)
+		throw std::runtime_error("fftw could not make a plan for the requested single precision transform");
+	_singlePlans.insert(std::make_pair(key, plan));
+	localPlans.insert(std::make_pair(key, plan));
+	_hasNewWisdom = true;
+	return plan;
+}
+
+fftwf_plan FFTPlanCache::SplitComplexPlan(const Dimensions &transform, const Dimensions &batch, bool inPlace, bool unaligned, enum PlanRigor rigor)
+{
+	const PlanKey key = makeKey(SplitComplexKind, transform, batch, FFTW_FORWARD, inPlace, unaligned, rigor);
+	std::map<PlanKey, fftwf_plan> &localPlans = threadPlans().singlePlans;
+	std::map<PlanKey, fftwf_plan>::const_iterator i = localPlans.find(key);
+	if(i != localPlans.end())
+		return i->second;
+	
+	boost::mutex::scoped_lock lock(_mutex);
+	i = _singlePlans.find(key);
+	if(i != _singlePlans.end())
+	{
+		localPlans.insert(*i);
+		return i->second;
+	}
+	
+	std::vector<fftwf_iodim> transformDims, batchDims;
+	toIODims(transform, transformDims);
+	toIODims(batch, batchDims);
+	const size_t size = arraySize(transform, batch);
+	float
+		*in = fftwf_alloc_real(size * 2),
+		*out = inPlace ? in : fftwf_alloc_real(size * 2);
+	fftwf_plan plan = fftwf_plan_guru_split_dft(transformDims.size(), &transformDims[0], batchDims.size(), batchDims.empty() ? 0 : &batchDims[0], in, in + size, out, out + size, flags(unaligned, rigor));
+	if(!inPlace)
+		fftwf_free(out);
+	fftwf_free(in);
+	if(plan == 0)
+		throw std::runtime_error("fftw could not make a plan for the requested split transform");
+	_singlePlans.insert(std::make_pair(key, plan));
+	localPlans.insert(std::make_pair(key, plan));
+	_hasNewWisdom = true;
+	return plan;
+}
+
+fftw_plan FFTPlanCache::DoubleComplexPlan(const Dimensions &transform, const Dimensions &batch, int sign, bool inPlace, bool unaligned, enum PlanRigor rigor)
+{
+	const PlanKey key = makeKey(DoubleComplexKind, transform, batch, sign, inPlace, unaligned, rigor);
+	std::map<PlanKey, fftw_plan> &localPlans = threadPlans().doublePlans;
+	std::map<PlanKey, fftw_plan>::const_iterator i = localPlans.find(key);
+	if(i != localPlans.end())
+		return i->second;
+	
+	boost::mutex::scoped_lock lock(_mutex);
+	i = _doublePlans.find(key);
+	if(i != _doublePlans.end())
+	{
+		localPlans.insert(*i);
+		return i->second;
+	}
+	
+	std::vector<fftw_iodim> transformDims, batchDims;
+	toIODims(transform, transformDims);
+	toIODims(batch, batchDims);
+	const size_t size = arraySize(transform, batch);
+	fftw_complex
+		*in = fftw_alloc_complex(size),
+		*out = inPlace ? in : fftw_alloc_complex(size);
+	fftw_plan plan = fftw_plan_guru_dft(transformDims.size(), &transformDims[0], batchDims.size(), batchDims.empty() ? 0 : &batchDims[0], in, out, sign, flags(unaligned, rigor));
+	if(!inPlace)
+		fftw_free(out);
+	fftw_free(in);
+	if(plan == 0)
+		throw std::runtime_error("fftw could not make a plan for the requested double precision transform");
+	_doublePlans.insert(std::make_pair(key, plan));
+	localPlans.insert(std::make_pair(key, plan));
+	_hasNewWisdom = true;
+	return plan;
+}
+
+fftw_plan FFTPlanCache::DoubleRealToComplexPlan(const std::vector<size_t> &sizes, enum PlanRigor rigor)
+{
+	Dimensions transform;
+	for(std::vector<size_t>::const_iterator i=sizes.begin();i!=sizes.end();++i)
+		transform.push_back(Dimension(*i, 1));
+	const PlanKey key = makeKey(DoubleRealToComplexKind, transform, Dimensions(), FFTW_FORWARD, false, false, rigor);
+	std::map<PlanKey, fftw_plan> &localPlans = threadPlans().doublePlans;
+	std::map<PlanKey, fftw_plan>::const_iterator i = localPlans.find(key);
+	if(i != localPlans.end())
+		return i->second;
+	
+	boost::mutex::scoped_lock lock(_mutex);
+	i = _doublePlans.find(key);
+	if(i != _doublePlans.end())
+	{
+		localPlans.insert(*i);
+		return i->second;
+	}
+	
+	std::vector<int> n(sizes.begin(), sizes.end());
+	size_t inSize = 1, outSize = 1;
+	for(size_t d=0;d!=sizes.size();++d)
+	{
+		inSize *= sizes[d];
+		outSize *= (d+1 == sizes.size()) ? (sizes[d]/2+1) : sizes[d];
+	}
+	double *in = fftw_alloc_real(inSize);
+	fftw_complex *out = fftw_alloc_complex(outSize);
+	fftw_plan plan = fftw_plan_dft_r2c(n.size(), &n[0], in, out, flags(false, rigor));
+	fftw_free(out);
+	fftw_free(in);
+	if(plan == 0)
+		throw std::runtime_error("fftw could not make a plan for the requested real-to-complex transform");
+	_doublePlans.insert(std::make_pair(key, plan));
+	localPlans.insert(std::make_pair(key, plan));
+	_hasNewWisdom = true;
+	return plan;
+}
@@ -0,0 +1,154 @@
+#ifndef FFT_PLAN_CACHE_H
+#define FFT_PLAN_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <fftw3.h>
+
+/**
+ * Process-wide cache of fftw plans. Making a plan, in particular with FFTW_MEASURE,
+ * is expensive and the fftw planner is not thread safe, whereas executing a plan is.
+ * Therefore, each plan is made only once per process while holding the planner lock,
+ * and the same plan is handed out to all threads. Threads should execute the plans
+ * on their own arrays with the new-array execute functions, e.g. fftwf_execute_dft().
+ * Every thread also remembers the plans it has been handed, so that only the first
+ * request of a plan in a thread takes the lock.
+ * The cache owns the plans; they should not be destroyed by the caller.
+ *
+ * Plans are described as in fftw's guru interface: the dimensions of the transform
+ * and the dimensions over which transforms are batched, each with the stride
+ * between consecutive elements. Strides are in units of the complex type for
+ * interleaved plans and in units of the real type for split plans.
+ *
+ * The single-precision plans match num_t. The wisdom that is gathered while
+ * planning can be kept on disk, so that measuring is not repeated by later
+ * processes either. This is off by default; it is turned on with
+ * SetWisdomDirectory() or by setting the environment variable
+ * AOFLAGGER_FFTW_WISDOM_DIR to a directory. The wisdom is then stored in
+ * aoflagger-fftwf-wisdom and aoflagger-fftw-wisdom inside that directory, and is
+ * saved on exit.
+ */
+class FFTPlanCache
+{
+	public:
+		struct Dimension
+		{
+			Dimension(size_t _n, size_t _stride) : n(_n), stride(_stride) { }
+			size_t n, stride;
+		};
+		typedef std::vector<Dimension> Dimensions;
+		
+		enum PlanRigor { EstimatePlan, MeasurePlan };
+		
+		static FFTPlanCache &Instance();
+		
+		/**
+		 * A single dimension of @p n contiguous elements.
+		 */
+		static Dimensions Contiguous(size_t n)
+		{
+			return Dimensions(1, Dimension(n, 1));
+		}
+		
+		/**
+		 * A batch of @p count transforms that lie @p distance elements apart.
+		 */
+		static Dimensions Batch(size_t count, size_t distance)
+		{
+			return Dimensions(1, Dimension(count, distance));
+		}
+		
+		/**
+		 * Single precision plan on interleaved complex data.
+		 * @param sign FFTW_FORWARD or FFTW_BACKWARD.
+		 * @param inPlace Whether the plan will be executed with the same input and output array.
+		 * @param unaligned Should be set when the plan is executed on memory that was
+		 * not allocated by fftw, e.g. the rows of an Image2D.
+		 */
+		fftwf_plan ComplexPlan(const Dimensions &transform, const Dimensions &batch, int sign, bool inPlace, bool unaligned, enum PlanRigor rigor = MeasurePlan);
+		
+		/**
+		 * Single precision forward plan on split real and imaginary arrays, executed
+		 * with fftwf_execute_split_dft(). A backward transform is performed by
+		 * executing the same plan with the real and imaginary arrays swapped.
+		 */
+		fftwf_plan SplitComplexPlan(const Dimensions &transform, const Dimensions &batch, bool inPlace, bool unaligned, enum PlanRigor rigor = MeasurePlan);
+		
+		/**
+		 * Double precision plan on interleaved complex data.
+		 */
+		fftw_plan DoubleComplexPlan(const Dimensions &transform, const Dimensions &batch, int sign, bool inPlace, bool unaligned, enum PlanRigor rigor = MeasurePlan);
+		
+		/**
+		 * Double precision out-of-place real-to-complex plan on contiguous fftw_malloc'ed arrays,
+		 * executed with fftw_execute_dft_r2c().
+		 * @param sizes The sizes of the dimensions, slowest changing first.
+		 */
+		fftw_plan DoubleRealToComplexPlan(const std::vector<size_t> &sizes, enum PlanRigor rigor = MeasurePlan);
+		
+		/**
+		 * Lock that should be held by code that makes or destroys fftw plans
+		 * itself, because the fftw planner is shared with this cache.
+		 */
+		boost::mutex &PlannerMutex() { return _mutex; }
+		
+		/**
+		 * Loads the wisdom from @p directory, and saves it there on exit and in
+		 * SaveWisdom(). An empty directory turns persisting off.
+		 */
+		void SetWisdomDirectory(const std::string &directory);
+		
+		/**
+		 * Saves the new wisdom if a wisdom directory is set. The wisdom on disk is
+		 * merged in first, and the files are replaced by renaming a temporary file, so
+		 * that processes saving at the same time do not corrupt or lose each other's wisdom.
+		 */
+		void SaveWisdom();
+	private:
+		enum PlanKind { ComplexKind, SplitComplexKind, DoubleComplexKind, DoubleRealToComplexKind };
+		
+		struct PlanKey
+		{
+			enum PlanKind kind;
+			int sign;
+			bool inPlace, unaligned;
+			enum PlanRigor rigor;
+			std::vector<size_t> transform, batch;
+			
+			bool operator<(const PlanKey &rhs) const;
+		};
+		
+		/** The plans that a thread has been handed before. */
+		struct ThreadPlans
+		{
+			std::map<PlanKey, fftwf_plan> singlePlans;
+			std::map<PlanKey, fftw_plan> doublePlans;
+		};
+		
+		FFTPlanCache();
+		~FFTPlanCache();
+		FFTPlanCache(const FFTPlanCache &) { } // don't allow copies
+		void operator=(const FFTPlanCache &) { } // don't allow assignment
+		
+		static PlanKey makeKey(enum PlanKind kind, const Dimensions &transform, const Dimensions &batch, int sign, bool inPlace, bool unaligned, enum PlanRigor rigor);
+		static void toIODims(const Dimensions &dimensions, std::vector<fftwf_iodim> &dims);
+		static void toIODims(const Dimensions &dimensions, std::vector<fftw_iodim> &dims);
+		static size_t arraySize(const Dimensions &transform, const Dimensions &batch);
+		static unsigned flags(bool unaligned, enum PlanRigor rigor);
+		static std::string temporaryFilename(const std::string &filename);
+		ThreadPlans &threadPlans();
+		
+		boost::mutex _mutex;
+		std::map<PlanKey, fftwf_plan> _singlePlans;
+		std::map<PlanKey, fftw_plan> _doublePlans;
+		std::string _singleWisdomFilename, _doubleWisdomFilename;
+		bool _hasNewWisdom;
+		boost::thread_specific_ptr<ThreadPlans> _threadPlans;
+};
+
+#endif
@@ -1,7 +1,13 @@
 #include "ffttools.h"
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include <fftw3.h>
 
+#include "fftplancache.h"
+
 #include "../strategy/algorithms/sinusfitter.h"
 
 Image2D *FFTTools::CreateFFTImage(const Image2D &original, FFTOutputMethod method)
@@ -27,10 +33,12 @@ Image2D *FFTTools::CreateFFTImage(const Image2D &original, FFTOutputMethod metho
 		}
 	}
 	
-	fftw_plan plan = fftw_plan_dft_r2c_2d(original.Width(), original.Height(),
-		in, out, FFTW_ESTIMATE);
+	std::vector<size_t> sizes(2);
+	sizes[0] = original.Width();
+	sizes[1] = original.Height();
+	fftw_plan plan = FFTPlanCache::Instance().DoubleRealToComplexPlan(sizes, FFTPlanCache::EstimatePlan);
 	
-	fftw_execute(plan);
+	fftw_execute_dft_r2c(plan, in, out);
 	
 	// Copy data to new image
 	if(method != Both) {
@@ -65,7 +73,6 @@ Image2D *FFTTools::CreateFFTImage(const Image2D &original, FFTOutputMethod metho
 		}
 	}
 	
-	fftw_destroy_plan(plan);
 	fftw_free(in);
 	fftw_free(out);
 	
@@ -103,9 +110,11 @@ void FFTTools::CreateFFTImage(const Image2D &real, const Image2D &imaginary, Ima
 	int sign = 1;
 	if(negate)
 		sign = -1;
-	fftw_plan plan = fftw_plan_dft_2d(real.Width(), real.Height(),
-		in, out, sign, FFTW_ESTIMATE);
-	fftw_execute(plan);
+	FFTPlanCache::Dimensions dims;
+	dims.push_back(FFTPlanCache::Dimension(real.Width(), real.Height()));
+	dims.push_back(FFTPlanCache::Dimension(real.Height(), 1));
+	fftw_plan plan = FFTPlanCache::Instance().DoubleComplexPlan(dims, FFTPlanCache::Dimensions(), sign, false, false, FFTPlanCache::EstimatePlan);
+	fftw_execute_dft(plan, in, out);
 	
 	ptr = 0;
 	const num_t normFactor = 1.0/sqrtn((num_t) real.Width() * real.Height());
@@ -116,7 +125,6 @@ void FFTTools::CreateFFTImage(const Image2D &real, const Image2D &imaginary, Ima
 			ptr++;
 		}
 	}
-	fftw_destroy_plan(plan);
 	fftw_free(in);
 	fftw_free(out);
 	if(centerAfter) {
@@ -226,6 +234,121 @@ void FFTTools::FFTConvolveFFTKernel(const Image2D &realIn, const Image2D &imagin
 	delete realFFTIn;
 }
 
+/**
+ * Smallest size of at least n that has no prime factors larger than 7, for which fftw is fast.
+ */
+static size_t fastFFTSize(size_t n)
+{
+	const size_t factors[4] = { 2, 3, 5, 7 };
+	for(;;++n)
+	{
+		size_t remainder = n;
+		for(size_t i=0;i!=4;++i)
+		{
+			while(remainder % factors[i] == 0)
+				remainder /= factors[i];
+		}
+		if(remainder == 1)
+			return n;
+	}
+}
+
+void FFTTools::FFTConvolveVertically(Image2D &image, const num_t *kernel, size_t kernelSize)
+{
+	const size_t width = image.Width(), height = image.Height();
+	if(width == 0 || height == 0 || kernelSize == 0) return;
+	const size_t
+		paddedHeight = fastFFTSize(height + kernelSize - 1),
+		pairCount = (width + 1) / 2,
+		centre = kernelSize / 2;
+	FFTPlanCache &planCache = FFTPlanCache::Instance();
+	
+	// out[y] = sum_k in[y + k - centre] * kernel[k] is the convolution of the input with
+	// h[centre - k] = kernel[k]. With enough padding, the cyclic convolution equals it.
+	// The spectrum is divided by the size, to normalize the backward transform.
+	float
+		*kernelReal = fftwf_alloc_real(paddedHeight),
+		*kernelImag = fftwf_alloc_real(paddedHeight);
+	std::fill(kernelReal, kernelReal + paddedHeight, 0.0);
+	std::fill(kernelImag, kernelImag + paddedHeight, 0.0);
+	for(size_t k=0;k!=kernelSize;++k)
+		kernelReal[(centre + paddedHeight - k) % paddedHeight] = kernel[k] / (num_t) paddedHeight;
+	fftwf_plan kernelPlan = planCache.SplitComplexPlan(FFTPlanCache::Contiguous(paddedHeight), FFTPlanCache::Dimensions(), true, false);
+	fftwf_execute_split_dft(kernelPlan, kernelReal, kernelImag, kernelReal, kernelImag);
+	
+	// Because the kernel is real, the even and odd columns can be convolved as the real
+	// and imaginary parts of one complex signal. Each row of the arrays holds one row of
+	// the image, such that all columns are transformed with one batched plan, and the
+	// multiplication with the spectrum runs along the rows.
+	float
+		*real = fftwf_alloc_real(paddedHeight * pairCount),
+		*imaginary = fftwf_alloc_real(paddedHeight * pairCount);
+	for(size_t y=0;y<height;++y)
+	{
+		const num_t *row = image.ValuePtr(0, y);
+		float
+			*realRow = &real[y * pairCount],
+			*imaginaryRow = &imaginary[y * pairCount];
+		for(size_t i=0;i!=width/2;++i)
+		{
+			realRow[i] = row[i*2];
+			imaginaryRow[i] = row[i*2 + 1];
+		}
+		if(width % 2 != 0)
+		{
+			realRow[pairCount-1] = row[width-1];
+			imaginaryRow[pairCount-1] = 0.0;
+		}
+	}
+	std::fill(&real[height * pairCount], &real[paddedHeight * pairCount], 0.0);
+	std::fill(&imaginary[height * pairCount], &imaginary[paddedHeight * pairCount], 0.0);
+	
+	const FFTPlanCache::Dimensions columnTransform(1, FFTPlanCache::Dimension(paddedHeight, pairCount));
+	fftwf_plan plan = planCache.SplitComplexPlan(columnTransform, FFTPlanCache::Batch(pairCount, 1), true, false);
+	fftwf_execute_split_dft(plan, real, imaginary, real, imaginary);
+	
+	for(size_t f=0;f<paddedHeight;++f)
+	{
+		const float
+			kReal = kernelReal[f],
+			kImag = kernelImag[f];
+		float
+			*realRow = &real[f * pairCount],
+			*imaginaryRow = &imaginary[f * pairCount];
+		for(size_t i=0;i<pairCount;++i)
+		{
+			const float
+				r = realRow[i],
+				im = imaginaryRow[i];
+			realRow[i] = r * kReal - im * kImag;
+			imaginaryRow[i] = r * kImag + im * kReal;
+		}
+	}
+	
+	// The backward transform is the forward plan with the real and imaginary parts swapped
+	fftwf_execute_split_dft(plan, imaginary, real, imaginary, real);
+	
+	for(size_t y=0;y<height;++y)
+	{
+		num_t *row = image.ValuePtr(0, y);
+		const float
+			*realRow = &real[y * pairCount],
+			*imaginaryRow = &imaginary[y * pairCount];
+		for(size_t i=0;i!=width/2;++i)
+		{
+			row[i*2] = realRow[i];
+			row[i*2 + 1] = imaginaryRow[i];
+		}
+		if(width % 2 != 0)
+			row[width-1] = realRow[pairCount-1];
+	}
+	
+	fftwf_free(imaginary);
+	fftwf_free(real);
+	fftwf_free(kernelImag);
+	fftwf_free(kernelReal);
+}
+
 void FFTTools::Multiply(Image2D &left, const Image2D &right)
 {
 	for(unsigned y=0;y<left.Height();++y)
@@ -297,15 +420,14 @@ void FFTTools::CreateHorizontalFFTImage(Image2D &real, Image2D &imaginary, bool
 	int sign = -1;
 	if(inverse)
 		sign = 1;
+	fftw_plan plan = FFTPlanCache::Instance().DoubleComplexPlan(FFTPlanCache::Contiguous(real.Width()), FFTPlanCache::Dimensions(), sign, false, false, FFTPlanCache::EstimatePlan);
 
 	for(unsigned long y=0;y<real.Height();++y) {
 		for(unsigned long x=0;x<real.Width();++x) {
 			in[x][0] = real.Value(x, y);
 			in[x][1] = imaginary.Value(x, y);
 		}
-		fftw_plan plan = fftw_plan_dft_1d(real.Width(), in, out, sign, FFTW_ESTIMATE);
-		fftw_execute(plan);
-		fftw_destroy_plan(plan);
+		fftw_execute_dft(plan, in, out);
 		for(unsigned long x=0;x<real.Width();++x) {
 			real.SetValue(x, y, out[x][0]);
 			imaginary.SetValue(x, y, out[x][1]);
@@ -318,7 +440,7 @@ void FFTTools::CreateHorizontalFFTImage(Image2D &real, Image2D &imaginary, bool
 void FFTTools::CreateDynamicHorizontalFFTImage(Image2DPtr real, Image2DPtr imaginary, unsigned sections, bool inverse)
 {
 	const size_t width = real->Width();
-	if(real->Height() == 0 || width == 0) return;
+	if(real->Height() == 0 || width == 0 || sections == 0) return;
 	SampleRowPtr
 		realRow = SampleRow::CreateFromRowSum(real, 0, real->Height()),
 		imaginaryRow = SampleRow::CreateFromRowSum(imaginary, 0, imaginary->Height());
@@ -327,46 +449,67 @@ void FFTTools::CreateDynamicHorizontalFFTImage(Image2DPtr real, Image2DPtr imagi
 		destReal = Image2D::CreateUnsetImagePtr(real->Width(), real->Height()),
 		destImag = Image2D::CreateUnsetImagePtr(real->Width(), real->Height());
 	
-	unsigned long n_in = width;
-	fftw_complex *in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * n_in);
-	fftw_complex *out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * n_in);
-
 	int sign = -1;
 	if(inverse)
 		sign = 1;
 
+	// Because of rounding, the sections have at most two different sizes. The
+	// sections of the same size are stored consecutively and transformed
+	// together with one batched plan. The transform is done in double precision, as
+	// the rows are sums over all channels.
+	std::map<size_t, std::vector<unsigned> > sectionsBySize;
 	for(unsigned sec=0;sec<sections;++sec)
 	{
 		const unsigned
 			secStart = width * sec / (sections + 1),
 			secEnd = width * (sec + 2) / (sections + 1);
-
-		for(unsigned x=secStart;x<secEnd;++x) {
-			in[x-secStart][0] = realRow->Value(x);
-			in[x-secStart][1] = imaginaryRow->Value(x);
+		sectionsBySize[secEnd - secStart].push_back(sec);
+	}
+	
+	for(std::map<size_t, std::vector<unsigned> >::const_iterator group=sectionsBySize.begin();group!=sectionsBySize.end();++group)
+	{
+		const size_t sectionSize = group->first;
+		const std::vector<unsigned> &groupSections = group->second;
+		const size_t batchSize = groupSections.size();
+		fftw_complex
+			*in = fftw_alloc_complex(sectionSize * batchSize),
+			*out = fftw_alloc_complex(sectionSize * batchSize);
+		
+		for(size_t i=0;i!=batchSize;++i)
+		{
+			const unsigned secStart = width * groupSections[i] / (sections + 1);
+			fftw_complex *sectionIn = &in[i * sectionSize];
+			for(size_t x=0;x<sectionSize;++x) {
+				sectionIn[x][0] = realRow->Value(x + secStart);
+				sectionIn[x][1] = imaginaryRow->Value(x + secStart);
+			}
 		}
-
-		fftw_plan plan = fftw_plan_dft_1d(secEnd - secStart, in, out, sign, FFTW_ESTIMATE);
-		fftw_execute(plan);
-		fftw_destroy_plan(plan);
-
-		size_t maxF = secEnd - secStart;
+		
+		fftw_plan plan = FFTPlanCache::Instance().DoubleComplexPlan(FFTPlanCache::Contiguous(sectionSize), FFTPlanCache::Batch(batchSize, sectionSize), sign, false, false, FFTPlanCache::EstimatePlan);
+		fftw_execute_dft(plan, in, out);
+		
+		size_t maxF = sectionSize;
 		if(maxF > destReal->Height()) maxF = destReal->Height();
-		unsigned xEnd = width*(sec+1)/sections;
-		for(unsigned long x=width*sec/sections;x<xEnd;++x) {
-			for(unsigned long y=0;y<maxF;++y) {
-					destReal->SetValue(x, y, out[y][0]);
-					destImag->SetValue(x, y, out[y][1]);
+		for(size_t i=0;i!=batchSize;++i)
+		{
+			const unsigned sec = groupSections[i];
+			const fftw_complex *sectionOut = &out[i * sectionSize];
+			unsigned xEnd = width*(sec+1)/sections;
+			for(unsigned long x=width*sec/sections;x<xEnd;++x) {
+				for(unsigned long y=0;y<maxF;++y) {
+					destReal->SetValue(x, y, sectionOut[y][0]);
+					destImag->SetValue(x, y, sectionOut[y][1]);
+				}
+				for(unsigned long y=maxF;y<destReal->Height();++y)
+				{
+					destReal->SetValue(x, y, 0.0);
+					destImag->SetValue(x, y, 0.0);
 				}
-			for(unsigned long y=maxF;y<destReal->Height();++y)
-			{
-				destReal->SetValue(x, y, 0.0);
-				destImag->SetValue(x, y, 0.0);
 			}
 		}
+		fftw_free(out);
+		fftw_free(in);
 	}
-	fftw_free(out);
-	fftw_free(in);
 	real->SetValues(destReal);
 	imaginary->SetValues(destImag);
 }
@@ -408,9 +551,8 @@ void FFTTools::FFT(SampleRowPtr realRow, SampleRowPtr imaginaryRow)
 		in[i][0] = realRow->Value(i);
 		in[i][1] = imaginaryRow->Value(i);
 	}
-	fftw_plan p = fftw_plan_dft_1d(n, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
-	fftw_execute(p);
-	fftw_destroy_plan(p);
+	fftw_plan p = FFTPlanCache::Instance().DoubleComplexPlan(FFTPlanCache::Contiguous(n), FFTPlanCache::Dimensions(), FFTW_FORWARD, false, false, FFTPlanCache::EstimatePlan);
+	fftw_execute_dft(p, in, out);
 	for(unsigned i=0;i<n;++i)
 	{
 		realRow->SetValue(i, out[i][0]);
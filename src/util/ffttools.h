@@ -57,6 +57,14 @@ class FFTTools{
 		static Image2DPtr CreatePhaseImage(Image2DCPtr real, Image2DCPtr imaginary);
 		static void FFTConvolve(const Image2D &realIn, const Image2D &imaginaryIn, const Image2D &realKernel, const Image2D &imaginaryKernel, Image2D &outReal, Image2D &outImaginary);
 		static void FFTConvolveFFTKernel(const Image2D &realIn, const Image2D &imaginaryIn, const Image2D &realFFTKernel, const Image2D &imaginaryFFTKernel, Image2D &outReal, Image2D &outImaginary);
+		/**
+		 * Convolves each column of the image with a real kernel, with the same result as
+		 * Convolutions::OneDimensionalConvolutionBorderZero() on each column. The columns are
+		 * zero padded and transformed together, two columns per complex transform, so that the
+		 * time is O(width x height x log(height + kernelSize)), independent of the kernel.
+		 * @param kernel Kernel of which the element at (kernelSize/2) is placed on the sample.
+		 */
+		static void FFTConvolveVertically(Image2D &image, const num_t *kernel, size_t kernelSize);
 		static void Multiply(Image2D &left, const Image2D &right); 
 		static void Divide(Image2D &left, const Image2D &right); 
 		static void Multiply(Image2D &leftReal, Image2D &leftImaginary, const Image2D &rightReal, const Image2D &rightImaginary);